@@ -0,0 +1,298 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <exception>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <set>
+
+#include <unistd.h>
+
+#include "loguru.hpp"
+#include "httplib.h"
+
+#include "../code/placement.hpp"
+#include "../code/admission.hpp"
+#include "../code/userdata.hpp"
+#include "../code/process.hpp"
+#include "../code/agents.hpp"
+#include "../code/cgroup.hpp"
+#include "../code/image.hpp"
+#include "../code/ports.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "agent.hpp"
+
+namespace instruct {
+
+namespace {
+    struct Spawned {
+        pid_t pid;
+        int port;
+    };
+    
+    agent::Options options {};
+    std::unique_ptr<code::PortAllocator> ports {};
+    
+    // Keyed by label.
+    std::mutex spawnedMutex {};
+    std::unordered_map<std::string, Spawned> spawned {};
+    // Labels being spawned outside the lock. Requests for them wait on the signal.
+    std::unordered_set<std::string> starting {};
+    std::condition_variable startedSignal {};
+}
+
+std::optional<agent::Options> agent::parseOptions(int argc, char **argv) {
+    Options parsed {
+        "0.0.0.0", constants::AGENT_DEFAULT_PORT, "", "0.0.0.0", 
+        constants::AGENT_DEFAULT_PORT_RANGE
+    };
+    if (const char *token {std::getenv(constants::AGENT_TOKEN_ENV.c_str())}; token != nullptr) {
+        parsed.token = token;
+    }
+    for (int idx {1}; idx < argc; ++idx) {
+        std::string option {argv[idx]};
+        if (option == "-v") {
+            continue;
+        }
+        if (idx + 1 == argc) {
+            LOG_F(ERROR, "Missing a value for %s.", option.c_str());
+            return std::nullopt;
+        }
+        std::string value {argv[++idx]};
+        try {
+            if (option == "--host") {
+                parsed.host = value;
+            } else if (option == "--port") {
+                parsed.port = std::stoi(value);
+            } else if (option == "--token") {
+                parsed.token = value;
+            } else if (option == "--instance-host") {
+                parsed.instanceHost = value;
+            } else if (option == "--ports") {
+                std::size_t dash {value.find('-')};
+                parsed.portRange = {
+                    std::stoi(value.substr(0, dash)), 
+                    std::stoi(dash == std::string::npos ? value : value.substr(dash + 1))
+                };
+            } else {
+                LOG_F(ERROR, "Unknown option %s.", option.c_str());
+                return std::nullopt;
+            }
+        } catch (const std::exception &e) {
+            LOG_F(ERROR, "Invalid value for %s: %s", option.c_str(), value.c_str());
+            log::logExceptionWarning(e);
+            return std::nullopt;
+        }
+    }
+    if (parsed.token.empty()) {
+        LOG_F(
+            ERROR, "No token given. Pass --token or set %s.", 
+            constants::AGENT_TOKEN_ENV.c_str()
+        );
+        return std::nullopt;
+    }
+    return parsed;
+}
+
+static bool authorized(const httplib::Request &req) {
+    std::string expected {code::agentAuthorization(options.token)};
+    std::string given {req.get_header_value("Authorization")};
+    // Every byte is compared so the time taken doesn't give the token away.
+    unsigned char diff {given.size() != expected.size()};
+    for (std::size_t idx {}; idx < std::min(given.size(), expected.size()); ++idx) {
+        diff |= given.at(idx) ^ expected.at(idx);
+    }
+    return diff == 0;
+}
+
+// Hands back everything the instance held. Its cgroup is only known while it runs.
+static void releaseSpawned(
+    const std::string &label, 
+    const Spawned &instance, 
+    const std::optional<std::filesystem::path> &cgroup
+) {
+    if (cgroup) {
+        code::removeInstanceCgroup(*cgroup);
+    }
+    code::releaseUserData(label);
+    code::releasePlacement(label);
+    code::releaseServerView(constants::INSTANCES_DIR / label);
+    ports->release(instance.port);
+}
+
+// Expects `spawnedMutex` to be held.
+static void reapSpawned() {
+    for (auto it {spawned.begin()}; it != spawned.end();) {
+        if (!code::processExited(it->second.pid)) {
+            ++it;
+            continue;
+        }
+        LOG_F(WARNING, "Instance %s exited unexpectedly.", it->first.c_str());
+        releaseSpawned(it->first, it->second, std::nullopt);
+        it = spawned.erase(it);
+    }
+}
+
+static void handleStats(const httplib::Request &, httplib::Response &res) {
+    code::AgentStatus status {options.host, options.port, true, 0, 0, 0, 0.0, {}};
+    if (std::optional<code::MemoryPressure> pressure {code::readMemoryPressure()}; pressure) {
+        status.memTotal = pressure->totalBytes;
+        status.memAvailable = pressure->availableBytes;
+    }
+    status.cpus = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    double load[1] {};
+    if (getloadavg(load, 1) == 1) {
+        status.load = load[0];
+    }
+    {
+        std::lock_guard<std::mutex> lock {spawnedMutex};
+        reapSpawned();
+        for (const auto &[label, instance] : spawned) {
+            status.instances.push_back(label);
+        }
+    }
+    res.set_content(code::encodeAgentStatus(status), "application/yaml");
+}
+
+static void handleSpawn(const httplib::Request &req, httplib::Response &res) {
+    std::string label {req.get_param_value("label")};
+    // Labels name directories under the shared instruct directory.
+    if (label.empty() || label.find('/') != std::string::npos || label.front() == '.') {
+        res.status = httplib::StatusCode::BadRequest_400;
+        res.set_content("Invalid label.", "text/plain");
+        return;
+    }
+    // Written to a file under the label's directory, so it's kept to hex digits.
+    std::string token {req.get_param_value("token")};
+    if (token.empty() || token.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        res.status = httplib::StatusCode::BadRequest_400;
+        res.set_content("Invalid token.", "text/plain");
+        return;
+    }
+    std::optional<std::filesystem::path> serverRoot {code::locateServerRoot()};
+    if (!serverRoot) {
+        res.status = httplib::StatusCode::ServiceUnavailable_503;
+        res.set_content("OpenVsCode Server is not installed.", "text/plain");
+        return;
+    }
+    
+    std::unique_lock<std::mutex> lock {spawnedMutex};
+    // A retried request gets the instance the first one started, once it has.
+    startedSignal.wait(lock, [&label] {
+        return starting.count(label) == 0;
+    });
+    reapSpawned();
+    if (auto it {spawned.find(label)}; it != spawned.end()) {
+        res.set_content(
+            code::encodeSpawnResult(it->second.port, it->second.pid), "application/yaml"
+        );
+        return;
+    }
+    int port {ports->allocate()};
+    if (port == -1) {
+        res.status = httplib::StatusCode::ServiceUnavailable_503;
+        res.set_content("No ports left.", "text/plain");
+        return;
+    }
+    starting.insert(label);
+    lock.unlock();
+    
+    // Provisioning the server's view is slow, so it doesn't hold up other labels.
+    // The same relative paths as on instruct's host, which expects shared storage.
+    code::SpawnSpec spec {code::makeServerSpec(
+        *serverRoot, 
+        options.instanceHost, 
+        port, 
+        constants::WORKSPACES_DIR / label, 
+        constants::INSTANCES_DIR / label, 
+        label, 
+        token
+    )};
+    spec.budget = code::decodeBudget(req);
+    spec.placement = code::placeInstance(label, false);
+    pid_t pid {code::spawnProcess(spec)};
+    
+    lock.lock();
+    starting.erase(label);
+    if (pid != -1) {
+        spawned.emplace(label, Spawned {pid, port});
+    }
+    lock.unlock();
+    startedSignal.notify_all();
+    if (pid == -1) {
+        releaseSpawned(label, {pid, port}, std::nullopt);
+        res.status = httplib::StatusCode::InternalServerError_500;
+        res.set_content("Failed to spawn.", "text/plain");
+        return;
+    }
+    LOG_F(INFO, "Spawned %s on port %d.", label.c_str(), port);
+    res.set_content(code::encodeSpawnResult(port, pid), "application/yaml");
+}
+
+static void stopSpawned(const std::string &label, const Spawned &instance) {
+    std::optional<std::filesystem::path> cgroup {code::getInstanceCgroup(instance.pid)};
+    code::stopProcess(instance.pid);
+    releaseSpawned(label, instance, cgroup);
+    LOG_F(INFO, "Stopped %s.", label.c_str());
+}
+
+static void handleStop(const httplib::Request &req, httplib::Response &res) {
+    std::string label {req.get_param_value("label")};
+    Spawned instance {};
+    {
+        std::unique_lock<std::mutex> lock {spawnedMutex};
+        startedSignal.wait(lock, [&label] {
+            return starting.count(label) == 0;
+        });
+        auto it {spawned.find(label)};
+        if (it == spawned.end()) {
+            res.status = httplib::StatusCode::NotFound_404;
+            res.set_content("No such instance.", "text/plain");
+            return;
+        }
+        instance = it->second;
+        spawned.erase(it);
+    }
+    // Outside of the lock since it may wait out the grace period.
+    stopSpawned(label, instance);
+    res.set_content("Stopped.", "text/plain");
+}
+
+sec::ThreadedServer agent::createAgentServer(const Options &opts) {
+    options = opts;
+    ports = std::make_unique<code::PortAllocator>(std::set<int> {}, opts.portRange, false);
+    // Leaves out ports taken by anything else on the host, i.e. another agent.
+    ports->probe(opts.instanceHost, ports->available());
+    return {opts.host, opts.port, [] (httplib::Server &server) {
+        server.set_pre_routing_handler([] (const httplib::Request &req, httplib::Response &res) {
+            if (authorized(req)) {
+                return httplib::Server::HandlerResponse::Unhandled;
+            }
+            LOG_F(WARNING, "Rejected a request from %s.", req.remote_addr.c_str());
+            res.status = httplib::StatusCode::Unauthorized_401;
+            return httplib::Server::HandlerResponse::Handled;
+        });
+        server.Get("/stats", handleStats);
+        server.Post("/spawn", handleSpawn);
+        server.Post("/stop", handleStop);
+    }};
+}
+
+void agent::stopAgentInstances() {
+    std::unordered_map<std::string, Spawned> stopping {};
+    {
+        std::unique_lock<std::mutex> lock {spawnedMutex};
+        startedSignal.wait(lock, [] {
+            return starting.empty();
+        });
+        stopping.swap(spawned);
+    }
+    for (const auto &[label, instance] : stopping) {
+        stopSpawned(label, instance);
+    }
+}
+
+}
@@ -0,0 +1,32 @@
+#ifndef INSTRUCT_AGENT_HPP
+#define INSTRUCT_AGENT_HPP
+
+#include <optional>
+#include <utility>
+#include <string>
+
+#include "../security.hpp"
+
+namespace instruct::agent {
+    struct Options {
+        // Where the agent itself listens for instruct.
+        std::string host;
+        int port;
+        std::string token;
+        // Where spawned editors listen, which instruct and, without its proxy, 
+        // students must be able to reach.
+        std::string instanceHost;
+        std::pair<int, int> portRange;
+    };
+    
+    // Reads `--host`, `--port`, `--token`, `--instance-host` and `--ports <first>-<last>`. 
+    // The token may come from `INSTRUCT_AGENT_TOKEN` instead, keeping it out of `ps`.
+    std::optional<Options> parseOptions(int, char **);
+    
+    // Serves `/stats`, `/spawn` and `/stop` to whoever presents the token.
+    sec::ThreadedServer createAgentServer(const Options &);
+    // Stops every instance the agent spawned.
+    void stopAgentInstances();
+}
+
+#endif
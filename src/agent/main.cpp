@@ -0,0 +1,77 @@
+#include <exception>
+#include <optional>
+#include <cstring>
+#include <csignal>
+#include <string>
+
+#include "loguru.hpp"
+
+#include "../code/placement.hpp"
+#include "../code/userdata.hpp"
+#include "../code/cgroup.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "../data.hpp"
+#include "agent.hpp"
+
+int main(int argc, char **argv) {
+
+    loguru::g_preamble_uptime = false;
+    
+    std::optional<instruct::agent::Options> options {instruct::agent::parseOptions(argc, argv)};
+    if (!options) {
+        return EXIT_FAILURE;
+    }
+    // Named after the port so that several agents can share a directory.
+    std::string logPath {
+        instruct::constants::LOG_DIR / ("agent-" + std::to_string(options->port) + ".log")
+    };
+    loguru::add_file(logPath.c_str(), loguru::Append, loguru::Verbosity_INFO);
+    
+    LOG_F(INFO, "Instruct agent launched. Timestamps are recorded in local time.");
+    
+    instruct::log::logVersion();
+    
+    // Settings and the OpenVsCode Server come from the instruct directory it runs in, 
+    // which must be the one instruct uses, i.e. on shared storage. They're only read.
+    try {
+        instruct::Data::initAll();
+    } catch (const std::exception &e) {
+        instruct::log::logExceptionWarning(e);
+        LOG_F(ERROR, "Run the agent from a directory instruct was set up in.");
+        return EXIT_FAILURE;
+    }
+    
+    instruct::code::initCgroupDelegation();
+    instruct::code::initPlacement();
+    
+    // Every thread started from here on leaves these to `sigwait`.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    instruct::sec::ThreadedServer server {};
+    if (!(server = instruct::agent::createAgentServer(*options)).initialized) {
+        LOG_F(INFO, "Exiting.");
+        return EXIT_FAILURE;
+    }
+    instruct::code::startUserDataSync();
+    LOG_F(
+        INFO, "Serving on %s:%d with editors on ports %d-%d.", 
+        options->host.c_str(), options->port, 
+        options->portRange.first, options->portRange.second
+    );
+    
+    int received {};
+    sigwait(&signals, &received);
+    LOG_F(INFO, "Received %s. Stopping instances.", strsignal(received));
+    
+    instruct::agent::stopAgentInstances();
+    instruct::code::stopUserDataSync();
+    
+    LOG_F(INFO, "Exiting instruct agent.");
+    
+    return EXIT_SUCCESS;
+}
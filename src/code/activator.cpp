@@ -0,0 +1,379 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <cstring>
+#include <csignal>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "loguru.hpp"
+#include "uuid.h"
+
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "activator.hpp"
+#include "admission.hpp"
+#include "../data.hpp"
+#include "agents.hpp"
+#include "relay.hpp"
+#include "ports.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    struct Listener {
+        int fd;
+        uuids::uuid uuid;
+        code::Endpoint endpoint {code::EndpointKind::Listener, this};
+    };
+    
+    // A tunnel waiting on its student's instance to accept connections.
+    struct ActivatedTunnel {
+        code::Tunnel tunnel;
+        uuids::uuid uuid;
+        Clock::time_point deadline;
+        std::uint64_t reportedBytes {};
+    };
+    
+    std::thread activatorThread {};
+    std::atomic_bool activating {false};
+    int epollFd {-1};
+    int wakeFd {-1};
+    code::Endpoint wakeEndpoint {code::EndpointKind::Wake, nullptr};
+    
+    std::vector<std::unique_ptr<Listener>> listeners {};
+    std::unordered_map<code::Tunnel *, std::unique_ptr<ActivatedTunnel>> tunnels {};
+    
+    std::mutex statsMutex {};
+    code::ActivationStats stats {};
+    
+    // Spawning blocks, so launches run on a thread of their own rather than 
+    // stalling every tunnel on the event loop.
+    std::thread launcherThread {};
+    std::mutex launchMutex {};
+    std::condition_variable launchSignal {};
+    std::deque<uuids::uuid> launchQueue {};
+    // Queued or being started. Their tunnels wait rather than expire.
+    std::unordered_set<uuids::uuid> launching {};
+    // Launches that failed since the event loop last dropped their tunnels.
+    std::unordered_set<uuids::uuid> launchesFailed {};
+}
+
+// Starts the student's instance if needed. Returns false if it couldn't be.
+static bool ensureBackend(const uuids::uuid &uuid) {
+    // Also covers instances reattached after instruct restarted.
+    if (code::instanceActive(uuid)) {
+        return true;
+    }
+    if (code::admitLaunch(uuid).verdict != code::AdmissionVerdict::Admit) {
+        return false;
+    }
+    int port {-1};
+    if (code::agentsConfigured()) {
+        // Agents pick the ports of the students placed on them.
+        std::optional<code::Instance> instance {};
+        if (!code::startInstance(uuid) || !(instance = code::getInstance(uuid))) {
+            return false;
+        }
+        port = instance->port;
+    } else if ((port = code::getInternalPort()) == -1 
+        || !code::startInstance(uuid, "127.0.0.1", port)) {
+        return false;
+    }
+    LOG_F(INFO, "Activated %s on port %d.", uuids::to_string(uuid).c_str(), port);
+    std::lock_guard<std::mutex> lock {statsMutex};
+    ++stats.activated;
+    return true;
+}
+
+static void wakeActivator() {
+    std::uint64_t one {1};
+    if (write(wakeFd, &one, sizeof(one)) == -1) {
+        LOG_F(WARNING, "Failed to wake the activation loop.");
+    }
+}
+
+static void requestLaunch(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {launchMutex};
+    launchesFailed.erase(uuid);
+    if (launching.insert(uuid).second) {
+        launchQueue.push_back(uuid);
+        launchSignal.notify_one();
+    }
+}
+
+static void runLauncher() {
+    std::unique_lock<std::mutex> lock {launchMutex};
+    while (true) {
+        launchSignal.wait(lock, [] {return !activating || !launchQueue.empty();});
+        if (!activating) {
+            return;
+        }
+        uuids::uuid uuid {launchQueue.front()};
+        launchQueue.pop_front();
+        lock.unlock();
+        bool started {ensureBackend(uuid)};
+        lock.lock();
+        launching.erase(uuid);
+        if (!started) {
+            launchesFailed.insert(uuid);
+        }
+        // Lets the event loop connect or drop the tunnels waiting on it.
+        wakeActivator();
+    }
+}
+
+static void dropTunnel(code::Tunnel *tunnel) {
+    code::closeTunnel(*tunnel);
+    code::recordActivity(tunnels.at(tunnel)->uuid, -1, 0);
+    tunnels.erase(tunnel);
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.tunnels = static_cast<int>(tunnels.size());
+}
+
+static void acceptClients(Listener &listener) {
+    while (true) {
+        int clientFd {accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+        if (clientFd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_F(WARNING, "accept4() failed: %s", std::strerror(errno));
+            }
+            return;
+        }
+        // A hibernating instance wakes on its next connection.
+        code::thawInstance(listener.uuid);
+        if (!code::instanceActive(listener.uuid)) {
+            requestLaunch(listener.uuid);
+        }
+        code::recordActivity(listener.uuid, 1, 0);
+        auto activated {std::make_unique<ActivatedTunnel>()};
+        activated->uuid = listener.uuid;
+        activated->deadline = Clock::now() + constants::LAUNCH_READY_TIMEOUT;
+        activated->tunnel.clientFd = clientFd;
+        code::Tunnel *tunnel {&activated->tunnel};
+        tunnels.emplace(tunnel, std::move(activated));
+        code::watchTunnel(epollFd, *tunnel, true);
+        
+        std::lock_guard<std::mutex> lock {statsMutex};
+        stats.tunnels = static_cast<int>(tunnels.size());
+    }
+}
+
+// Connects waiting tunnels once their instance is up, retrying until the deadline.
+static void connectPending() {
+    std::unordered_set<uuids::uuid> starting {};
+    std::unordered_set<uuids::uuid> failed {};
+    {
+        std::lock_guard<std::mutex> lock {launchMutex};
+        starting = launching;
+        failed.swap(launchesFailed);
+    }
+    std::vector<code::Tunnel *> expired {};
+    for (auto &[tunnel, activated] : tunnels) {
+        if (tunnel->backendConnected || tunnel->backendFd != -1) {
+            continue;
+        }
+        bool queued {starting.count(activated->uuid) > 0};
+        if (Clock::now() > activated->deadline || failed.count(activated->uuid) > 0 
+            || (!queued && !code::instanceActive(activated->uuid))) {
+            expired.push_back(tunnel);
+            continue;
+        }
+        if (queued) {
+            continue;
+        }
+        std::optional<code::Instance> instance {code::getInstance(activated->uuid)};
+        if (!instance) {
+            continue;
+        }
+        tunnel->backendFd = code::connectTCP(instance->host, instance->port);
+        if (tunnel->backendFd != -1) {
+            code::watchTunnel(epollFd, *tunnel, false);
+        }
+    }
+    for (code::Tunnel *tunnel : expired) {
+        LOG_F(WARNING, "Gave up forwarding a connection to a starting instance.");
+        dropTunnel(tunnel);
+    }
+}
+
+static void handleTunnelEvent(code::Tunnel *tunnel, code::EndpointKind kind) {
+    ActivatedTunnel &activated {*tunnels.at(tunnel)};
+    if (kind == code::EndpointKind::Client) {
+        code::thawInstance(activated.uuid);
+    }
+    if (kind == code::EndpointKind::Backend && !tunnel->backendConnected) {
+        if (!code::connectSucceeded(tunnel->backendFd)) {
+            // Not listening yet. Retry on the next tick.
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, tunnel->backendFd, nullptr);
+            close(tunnel->backendFd);
+            tunnel->backendFd = -1;
+            return;
+        }
+        tunnel->backendConnected = true;
+    }
+    bool alive {code::pumpTunnel(*tunnel)};
+    if (tunnel->bytesRelayed != activated.reportedBytes) {
+        code::recordActivity(activated.uuid, 0, tunnel->bytesRelayed - activated.reportedBytes);
+        activated.reportedBytes = tunnel->bytesRelayed;
+    }
+    if (!alive) {
+        dropTunnel(tunnel);
+        return;
+    }
+    code::watchTunnel(epollFd, *tunnel, false);
+}
+
+static void runActivator() {
+    std::vector<epoll_event> events(constants::RELAY_MAX_EVENTS);
+    int timeoutMs {static_cast<int>(constants::LAUNCH_POLL_INTERVAL.count())};
+    Clock::time_point nextReap {Clock::now()};
+    while (activating) {
+        int count {epoll_wait(epollFd, events.data(), events.size(), timeoutMs)};
+        if (count == -1 && errno != EINTR) {
+            LOG_F(ERROR, "epoll_wait() failed: %s", std::strerror(errno));
+            break;
+        }
+        for (int idx {}; idx < count; ++idx) {
+            code::Endpoint *endpoint {static_cast<code::Endpoint *>(events.at(idx).data.ptr)};
+            switch (endpoint->kind) {
+                case code::EndpointKind::Listener:
+                    acceptClients(*static_cast<Listener *>(endpoint->owner));
+                    break;
+                case code::EndpointKind::Client:
+                case code::EndpointKind::Backend: {
+                    code::Tunnel *tunnel {static_cast<code::Tunnel *>(endpoint->owner)};
+                    // An earlier event in this batch may have dropped it.
+                    if (tunnels.count(tunnel) > 0) {
+                        handleTunnelEvent(tunnel, endpoint->kind);
+                    }
+                    break;
+                }
+                case code::EndpointKind::Wake: {
+                    std::uint64_t wakes {};
+                    if (read(wakeFd, &wakes, sizeof(wakes)) == -1 && errno != EAGAIN) {
+                        LOG_F(WARNING, "Failed to drain the activation wake-up.");
+                    }
+                    break;
+                }
+                case code::EndpointKind::Request:
+                    break;
+            }
+        }
+        // Exits are noticed on a timer, not on every burst of traffic.
+        if (Clock::now() >= nextReap) {
+            code::reapInstances();
+            nextReap = Clock::now() + constants::ACTIVATION_REAP_INTERVAL;
+        }
+        connectPending();
+    }
+}
+
+bool code::startLazyActivation() {
+    if (activating) {
+        return true;
+    }
+    // Splicing into a socket the peer already closed raises `SIGPIPE` instead of failing.
+    std::signal(SIGPIPE, SIG_IGN);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeFd == -1) {
+        LOG_F(ERROR, "Failed to create the activation event loop: %s", std::strerror(errno));
+        return false;
+    }
+    epoll_event wakeEvent {};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.ptr = &wakeEndpoint;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent);
+    
+    const std::string &host {SData::studentsData->get_authHost()};
+    for (const auto &[uuid, port] : SData::studentsData->get_assignedPorts()) {
+        int fd {code::listenTCP(host, port)};
+        if (fd == -1) {
+            continue;
+        }
+        auto listener {std::make_unique<Listener>()};
+        listener->fd = fd;
+        listener->uuid = uuid;
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.ptr = &listener->endpoint;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        listeners.push_back(std::move(listener));
+    }
+    {
+        std::lock_guard<std::mutex> lock {statsMutex};
+        stats = {};
+        stats.listening = static_cast<int>(listeners.size());
+    }
+    
+    activating = true;
+    activatorThread = std::thread {runActivator};
+    launcherThread = std::thread {runLauncher};
+    LOG_F(INFO, "Lazy activation listening on %zu port(s).", listeners.size());
+    return true;
+}
+
+void code::stopLazyActivation() {
+    if (!activating) {
+        return;
+    }
+    {
+        // Under the lock so that the launcher can't miss it between checks.
+        std::lock_guard<std::mutex> lock {launchMutex};
+        activating = false;
+    }
+    launchSignal.notify_one();
+    wakeActivator();
+    activatorThread.join();
+    // Waits out a launch in progress, which may still write to `wakeFd`.
+    launcherThread.join();
+    {
+        std::lock_guard<std::mutex> lock {launchMutex};
+        launchQueue.clear();
+        launching.clear();
+        launchesFailed.clear();
+    }
+    
+    for (auto &[tunnel, activated] : tunnels) {
+        code::recordActivity(activated->uuid, -1, 0);
+        closeTunnel(*tunnel);
+    }
+    tunnels.clear();
+    for (std::unique_ptr<Listener> &listener : listeners) {
+        close(listener->fd);
+    }
+    listeners.clear();
+    close(wakeFd);
+    close(epollFd);
+    wakeFd = epollFd = -1;
+    
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.listening = stats.tunnels = 0;
+    DLOG_F(INFO, "Lazy activation stopped.");
+}
+
+bool code::lazyActivationRunning() {
+    return activating;
+}
+
+code::ActivationStats code::getActivationStats() {
+    std::lock_guard<std::mutex> lock {statsMutex};
+    return stats;
+}
+
+}
@@ -0,0 +1,22 @@
+#ifndef INSTRUCT_ACTIVATOR_HPP
+#define INSTRUCT_ACTIVATOR_HPP
+
+namespace instruct::code {
+    struct ActivationStats {
+        int listening;
+        int activated;
+        int tunnels;
+    };
+    
+    // Binds every student's assigned port and starts the student's instance 
+    // on an internal port when the first connection arrives, forwarding 
+    // connections to it from a single epoll thread.
+    bool startLazyActivation();
+    // Closes the listeners and forwarded connections. Instances keep running.
+    void stopLazyActivation();
+    bool lazyActivationRunning();
+    
+    ActivationStats getActivationStats();
+}
+
+#endif
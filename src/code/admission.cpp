@@ -0,0 +1,216 @@
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "hibernation.hpp"
+#include "supervisor.hpp"
+#include "admission.hpp"
+#include "agents.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    struct Verdict {
+        code::AdmissionDecision decision;
+        Clock::time_point decided;
+    };
+    
+    std::mutex verdictMutex {};
+    // The latest verdict per UUID so that retried launches only log changes.
+    std::unordered_map<uuids::uuid, Verdict> verdicts {};
+}
+
+std::optional<code::MemoryPressure> code::readMemoryPressure() {
+    MemoryPressure pressure {};
+    std::ifstream meminfo {"/proc/meminfo"};
+    std::string key {};
+    std::uint64_t kibibytes {};
+    while (meminfo >> key >> kibibytes) {
+        if (key == "MemTotal:") {
+            pressure.totalBytes = kibibytes << 10;
+        } else if (key == "MemAvailable:") {
+            pressure.availableBytes = kibibytes << 10;
+        }
+        meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    if (pressure.totalBytes == 0) {
+        return std::nullopt;
+    }
+    
+    // Lines look like "full avg10=0.00 avg60=0.00 avg300=0.00 total=0". 
+    // Kernels without PSI simply leave the stall at zero.
+    std::ifstream psi {"/proc/pressure/memory"};
+    std::string line {};
+    while (std::getline(psi, line)) {
+        std::size_t avgPos {line.find("avg10=")};
+        if (line.rfind("full ", 0) == 0 && avgPos != std::string::npos) {
+            pressure.fullAvg10 = std::strtod(line.c_str() + avgPos + 6, nullptr);
+        }
+    }
+    return pressure;
+}
+
+std::uint64_t code::estimateInstanceCost(InstanceUsage &usage) {
+    std::uint64_t total {};
+    std::uint64_t samples {};
+    for (const Instance &instance : getInstances()) {
+        // Instances on agents don't use this host's memory.
+        if (instance.state != InstanceState::Running || instance.pid == -1 
+            || instance.agent != -1) {
+            continue;
+        }
+        if (std::uint64_t bytes {usage.of(instance.pid).memoryBytes}; bytes > 0) {
+            total += bytes;
+            ++samples;
+        }
+    }
+    return samples == 0 ? constants::ADMISSION_DEFAULT_INSTANCE_COST : total / samples;
+}
+
+// Projects the headroom left after one more instance and, if it's too small, 
+// estimates when enough memory should come back.
+static code::AdmissionDecision assess(std::string &detail) {
+    std::optional<code::MemoryPressure> pressure {code::readMemoryPressure()};
+    if (!pressure) {
+        detail = "memory usage unavailable";
+        return {code::AdmissionVerdict::Admit, {}};
+    }
+    std::vector<code::Instance> instances {code::getInstances()};
+    std::vector<pid_t> leaders {};
+    for (const code::Instance &instance : instances) {
+        if (instance.pid != -1 && instance.agent == -1) {
+            leaders.push_back(instance.pid);
+        }
+    }
+    code::InstanceUsage usage {std::move(leaders), false};
+    std::uint64_t cost {code::estimateInstanceCost(usage)};
+    
+    // Booting instances haven't grown to their full size yet, so hold back the rest.
+    std::uint64_t reserved {};
+    std::optional<Clock::time_point> settled {};
+    std::optional<Clock::time_point> freed {};
+    for (const code::Instance &instance : instances) {
+        if (instance.pid == -1 || instance.agent != -1) {
+            continue;
+        }
+        if (instance.state == code::InstanceState::Starting) {
+            reserved += cost - std::min(cost, usage.of(instance.pid).memoryBytes);
+            Clock::time_point ready {instance.startTime + constants::LAUNCH_READY_TIMEOUT};
+            settled = settled ? std::min(*settled, ready) : ready;
+        } else if (instance.state == code::InstanceState::Running && instance.connections == 0) {
+            if (auto deadline {code::idleStopDeadline(instance)}; deadline) {
+                freed = freed ? std::min(*freed, *deadline) : *deadline;
+            }
+        }
+    }
+    
+    std::uint64_t floor {static_cast<std::uint64_t>(
+        pressure->totalBytes * constants::ADMISSION_HEADROOM_FRACTION
+    )};
+    bool fits {pressure->availableBytes >= reserved + cost + floor};
+    detail = std::to_string(pressure->availableBytes >> 20) + " MB available, " 
+        + std::to_string((reserved + cost + floor) >> 20) + " MB needed, " 
+        + std::to_string(static_cast<int>(pressure->fullAvg10)) + "% stalled";
+    if (fits && pressure->fullAvg10 < constants::ADMISSION_PSI_FULL_LIMIT) {
+        return {code::AdmissionVerdict::Admit, {}};
+    }
+    if (fits) {
+        // A stall without a shortfall is usually a burst that the next window won't see.
+        return {code::AdmissionVerdict::Defer, constants::ADMISSION_PSI_WINDOW};
+    }
+    
+    std::optional<Clock::time_point> next {freed};
+    if (reserved > 0 && pressure->availableBytes >= cost + floor) {
+        next = next ? std::min(*next, *settled) : *settled;
+    }
+    if (!next) {
+        // Nothing is booting or due to be stopped, so waiting won't help.
+        return {code::AdmissionVerdict::Refuse, {}};
+    }
+    return {
+        code::AdmissionVerdict::Defer, 
+        std::max(
+            std::chrono::seconds {1}, 
+            std::chrono::duration_cast<std::chrono::seconds>(*next - Clock::now())
+        )
+    };
+}
+
+code::AdmissionDecision code::admitLaunch(const uuids::uuid &uuid) {
+    // Whatever else happens, the instructor must be able to teach.
+    if (uuid == INSTRUCTOR_UUID) {
+        return {AdmissionVerdict::Admit, {}};
+    }
+    // Students go to whichever agent has room, which placement decides.
+    if (agentsConfigured()) {
+        return {AdmissionVerdict::Admit, {}};
+    }
+    std::string detail {};
+    AdmissionDecision decision {assess(detail)};
+    std::string uuidStr {uuids::to_string(uuid)};
+    
+    std::lock_guard<std::mutex> lock {verdictMutex};
+    auto it {verdicts.find(uuid)};
+    bool changed {it == verdicts.end() || it->second.decision.verdict != decision.verdict};
+    switch (decision.verdict) {
+        case AdmissionVerdict::Admit:
+            if (it != verdicts.end()) {
+                LOG_F(INFO, "Admitted launch of %s (%s).", uuidStr.c_str(), detail.c_str());
+                verdicts.erase(it);
+            }
+            return decision;
+        case AdmissionVerdict::Defer:
+            if (changed) {
+                LOG_F(
+                    WARNING, "Deferred launch of %s for about %llds (%s).", 
+                    uuidStr.c_str(), static_cast<long long>(decision.eta.count()), detail.c_str()
+                );
+            }
+            break;
+        case AdmissionVerdict::Refuse:
+            if (changed) {
+                LOG_F(WARNING, "Refused launch of %s (%s).", uuidStr.c_str(), detail.c_str());
+            }
+            break;
+    }
+    verdicts[uuid] = {decision, Clock::now()};
+    return decision;
+}
+
+bool code::spareHeadroom() {
+    std::string detail {};
+    return assess(detail).verdict == AdmissionVerdict::Admit;
+}
+
+code::AdmissionStats code::getAdmissionStats() {
+    AdmissionStats stats {};
+    Clock::time_point now {Clock::now()};
+    std::lock_guard<std::mutex> lock {verdictMutex};
+    for (auto it {verdicts.begin()}; it != verdicts.end();) {
+        // Launches that stopped retrying, e.g. cancelled ones, age out.
+        if (now - it->second.decided > constants::ADMISSION_VERDICT_TTL) {
+            it = verdicts.erase(it);
+            continue;
+        }
+        if (it->second.decision.verdict == AdmissionVerdict::Defer) {
+            ++stats.deferred;
+            stats.eta = std::max(stats.eta, it->second.decision.eta);
+        } else {
+            ++stats.refused;
+        }
+        ++it;
+    }
+    return stats;
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef INSTRUCT_ADMISSION_HPP
+#define INSTRUCT_ADMISSION_HPP
+
+#include <optional>
+#include <cstdint>
+#include <chrono>
+
+#include "uuid.h"
+
+#include "procstat.hpp"
+
+namespace instruct::code {
+    struct MemoryPressure {
+        // Percentage of the last 10 seconds in which all tasks stalled on memory.
+        double fullAvg10;
+        std::uint64_t totalBytes;
+        std::uint64_t availableBytes;
+    };
+    
+    enum class AdmissionVerdict {
+        Admit, Defer, Refuse
+    };
+    
+    struct AdmissionDecision {
+        AdmissionVerdict verdict;
+        // Rough wait until a deferred launch is expected to fit.
+        std::chrono::seconds eta;
+    };
+    
+    struct AdmissionStats {
+        // Launches currently waiting for memory, and ones turned away.
+        int deferred;
+        int refused;
+        std::chrono::seconds eta;
+    };
+    
+    // Reads /proc/meminfo and, where the kernel supports it, /proc/pressure/memory.
+    std::optional<MemoryPressure> readMemoryPressure();
+    // The mean memory of the running instances, children included, 
+    // or a conservative default before any have been observed.
+    std::uint64_t estimateInstanceCost(InstanceUsage &);
+    
+    // Decides whether an instance may start now. The instructor is always admitted.
+    AdmissionDecision admitLaunch(const uuids::uuid &);
+    // Whether an instance not tied to anyone, i.e. a pooled one, would fit right now.
+    bool spareHeadroom();
+    
+    AdmissionStats getAdmissionStats();
+}
+
+#endif
@@ -0,0 +1,398 @@
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "yaml-cpp/yaml.h"
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "agents.hpp"
+
+namespace instruct {
+
+namespace {
+    namespace keys {
+        static const std::string MEM_TOTAL {"mem_total"};
+        static const std::string MEM_AVAILABLE {"mem_available"};
+        static const std::string CPUS {"cpus"};
+        static const std::string LOAD {"load"};
+        static const std::string INSTANCES {"instances"};
+        static const std::string LABEL {"label"};
+        static const std::string TOKEN {"token"};
+        static const std::string PORT {"port"};
+        static const std::string PID {"pid"};
+    }
+    
+    // Request parameter of each budget field.
+    const std::pair<const char *, int SData::Budget::*> BUDGET_PARAMS [] {
+        {"address_space_mb", &SData::Budget::addressSpaceMB}, 
+        {"cpu_seconds", &SData::Budget::cpuSeconds}, 
+        {"open_files", &SData::Budget::openFiles}, 
+        {"processes", &SData::Budget::processes}, 
+        {"niceness", &SData::Budget::niceness}, 
+        {"io_class", &SData::Budget::ioClass}, 
+        {"io_level", &SData::Budget::ioLevel}, 
+        {"cpu_weight", &SData::Budget::cpuWeight}, 
+        {"memory_max_mb", &SData::Budget::memoryMaxMB}
+    };
+    
+    struct AgentState {
+        code::AgentStatus status {};
+        // Since the first poll until the agent answers one.
+        std::chrono::steady_clock::time_point lastSeen {std::chrono::steady_clock::now()};
+        bool seen {false};
+        bool reported {false};
+        // Spawned since the last poll began, which may have been too early to list 
+        // them or count their memory, with when each was spawned.
+        std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> spawned {};
+    };
+    
+    std::thread pollThread {};
+    std::atomic_bool polling {false};
+    std::mutex pollMutex {};
+    std::condition_variable pollSignal {};
+    
+    // Indexed like `agents`.
+    std::mutex agentsMutex {};
+    std::vector<AgentState> agentStates {};
+}
+
+httplib::Params code::encodeBudget(const SData::Budget &budget) {
+    httplib::Params params {};
+    for (const auto &[name, field] : BUDGET_PARAMS) {
+        params.emplace(name, std::to_string(budget.*field));
+    }
+    return params;
+}
+
+SData::Budget code::decodeBudget(const httplib::Request &req) {
+    SData::Budget budget {};
+    for (const auto &[name, field] : BUDGET_PARAMS) {
+        budget.*field = std::atoi(req.get_param_value(name).c_str());
+    }
+    return budget;
+}
+
+std::string code::agentAuthorization(const std::string &token) {
+    return "Bearer " + token;
+}
+
+std::string code::encodeAgentStatus(const AgentStatus &status) {
+    YAML::Node root {};
+    root[keys::MEM_TOTAL] = status.memTotal;
+    root[keys::MEM_AVAILABLE] = status.memAvailable;
+    root[keys::CPUS] = status.cpus;
+    root[keys::LOAD] = status.load;
+    root[keys::INSTANCES] = YAML::Node {YAML::NodeType::Sequence};
+    for (const std::string &label : status.instances) {
+        root[keys::INSTANCES].push_back(label);
+    }
+    return YAML::Dump(root);
+}
+
+std::string code::encodeSpawnResult(int port, pid_t pid) {
+    YAML::Node root {};
+    root[keys::PORT] = port;
+    root[keys::PID] = pid;
+    return YAML::Dump(root);
+}
+
+bool code::agentsConfigured() {
+    return !SData::studentsData->get_agents().empty();
+}
+
+int code::findAgent(const std::string &host, int port) {
+    const std::vector<SData::Agent> &agents {SData::studentsData->get_agents()};
+    for (std::size_t idx {}; idx < agents.size(); ++idx) {
+        if (agents.at(idx).host == host && agents.at(idx).port == port) {
+            return static_cast<int>(idx);
+        }
+    }
+    return -1;
+}
+
+static httplib::Client makeClient(const SData::Agent &agent) {
+    httplib::Client client {agent.host, agent.port};
+    client.set_connection_timeout(constants::AGENT_REQUEST_TIMEOUT);
+    client.set_read_timeout(constants::AGENT_REQUEST_TIMEOUT);
+    client.set_default_headers({{"Authorization", code::agentAuthorization(agent.token)}});
+    return client;
+}
+
+// The relays connect by address, so host names are looked up once per spawn.
+static std::string resolveHost(const std::string &host) {
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result {};
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || result == nullptr) {
+        return host;
+    }
+    char address[INET_ADDRSTRLEN] {};
+    inet_ntop(
+        AF_INET, &reinterpret_cast<sockaddr_in *>(result->ai_addr)->sin_addr, 
+        address, sizeof(address)
+    );
+    freeaddrinfo(result);
+    return address;
+}
+
+static std::optional<code::AgentStatus> fetchStatus(const SData::Agent &agent) {
+    try {
+        httplib::Client client {makeClient(agent)};
+        httplib::Result res {client.Get("/stats")};
+        if (!res || res->status != httplib::StatusCode::OK_200) {
+            return std::nullopt;
+        }
+        YAML::Node root {YAML::Load(res->body)};
+        code::AgentStatus status {agent.host, agent.port, true, 0, 0, 0, 0.0, {}};
+        status.memTotal = root[keys::MEM_TOTAL].as<std::uint64_t>(0);
+        status.memAvailable = root[keys::MEM_AVAILABLE].as<std::uint64_t>(0);
+        status.cpus = root[keys::CPUS].as<int>(1);
+        status.load = root[keys::LOAD].as<double>(0.0);
+        status.instances = root[keys::INSTANCES].as<std::vector<std::string>>(
+            std::vector<std::string> {}
+        );
+        return status;
+    } catch (const std::exception &e) {
+        log::logExceptionWarning(e);
+        return std::nullopt;
+    }
+}
+
+void code::refreshAgents() {
+    const std::vector<SData::Agent> &agents {SData::studentsData->get_agents()};
+    std::chrono::steady_clock::time_point polledAt {std::chrono::steady_clock::now()};
+    // Polled side by side so one agent that's down doesn't hold up the rest.
+    std::vector<std::optional<AgentStatus>> polled(agents.size());
+    std::vector<std::thread> pollers {};
+    for (std::size_t idx {}; idx < agents.size(); ++idx) {
+        pollers.emplace_back([&agents, &polled, idx] {
+            polled.at(idx) = fetchStatus(agents.at(idx));
+        });
+    }
+    for (std::thread &poller : pollers) {
+        poller.join();
+    }
+    
+    std::lock_guard<std::mutex> lock {agentsMutex};
+    agentStates.resize(agents.size());
+    for (std::size_t idx {}; idx < agents.size(); ++idx) {
+        AgentState &state {agentStates.at(idx)};
+        bool wasReachable {state.status.reachable};
+        if (polled.at(idx)) {
+            state.status = *polled.at(idx);
+            state.lastSeen = std::chrono::steady_clock::now();
+            state.seen = true;
+            // Those spawned before the poll began are in its list if they're still running.
+            auto &spawned {state.spawned};
+            spawned.erase(std::remove_if(spawned.begin(), spawned.end(), [&] (const auto &entry) {
+                return entry.second < polledAt;
+            }), spawned.end());
+            std::vector<std::string> &instances {state.status.instances};
+            for (const auto &[label, spawnedAt] : spawned) {
+                if (std::find(instances.begin(), instances.end(), label) == instances.end()) {
+                    instances.push_back(label);
+                }
+            }
+        } else {
+            // The last known instances stay until the agent is given up on.
+            state.status.host = agents.at(idx).host;
+            state.status.port = agents.at(idx).port;
+            state.status.reachable = false;
+        }
+        if (wasReachable == state.status.reachable && state.reported) {
+            continue;
+        }
+        state.reported = true;
+        const SData::Agent &agent {agents.at(idx)};
+        if (state.status.reachable) {
+            LOG_F(INFO, "Agent %s:%d is reachable.", agent.host.c_str(), agent.port);
+        } else {
+            LOG_F(WARNING, "Agent %s:%d is unreachable.", agent.host.c_str(), agent.port);
+        }
+    }
+}
+
+static void runPolling() {
+    while (polling) {
+        code::refreshAgents();
+        std::unique_lock<std::mutex> lock {pollMutex};
+        pollSignal.wait_for(lock, constants::AGENT_POLL_INTERVAL, [] {
+            return !polling;
+        });
+    }
+}
+
+void code::startAgentPolling() {
+    if (polling || !agentsConfigured()) {
+        return;
+    }
+    polling = true;
+    pollThread = std::thread {runPolling};
+    DLOG_F(INFO, "Agent polling thread started.");
+}
+
+void code::stopAgentPolling() {
+    {
+        std::lock_guard<std::mutex> lock {pollMutex};
+        polling = false;
+    }
+    pollSignal.notify_all();
+    if (pollThread.joinable()) {
+        pollThread.join();
+        DLOG_F(INFO, "Agent polling thread joined.");
+    }
+}
+
+// Free memory weighed by idle CPU. Expects `agentsMutex` to be held.
+static double headroom(const AgentState &state) {
+    const code::AgentStatus &status {state.status};
+    std::uint64_t pendingBytes {
+        state.spawned.size() * constants::ADMISSION_DEFAULT_INSTANCE_COST
+    };
+    std::uint64_t available {status.memAvailable - std::min(status.memAvailable, pendingBytes)};
+    std::uint64_t floor {static_cast<std::uint64_t>(
+        status.memTotal * constants::ADMISSION_HEADROOM_FRACTION
+    )};
+    if (available < floor + constants::ADMISSION_DEFAULT_INSTANCE_COST) {
+        return 0.0;
+    }
+    // A saturated host still ranks by memory, just behind every idle one.
+    double idle {std::max(0.1, 1.0 - status.load / std::max(1, status.cpus))};
+    return static_cast<double>(available - floor) * idle;
+}
+
+std::optional<code::RemoteInstance> code::spawnOnAgent(
+    const std::string &label, const SData::Budget &budget, const std::string &token
+) {
+    const std::vector<SData::Agent> &agents {SData::studentsData->get_agents()};
+    std::vector<std::pair<double, int>> candidates {};
+    {
+        std::lock_guard<std::mutex> lock {agentsMutex};
+        for (std::size_t idx {}; idx < agentStates.size(); ++idx) {
+            double score {headroom(agentStates.at(idx))};
+            if (agentStates.at(idx).status.reachable && score > 0.0) {
+                candidates.emplace_back(score, static_cast<int>(idx));
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<> {});
+    
+    for (const auto &[score, idx] : candidates) {
+        const SData::Agent &agent {agents.at(idx)};
+        httplib::Params params {encodeBudget(budget)};
+        params.emplace(keys::LABEL, label);
+        params.emplace(keys::TOKEN, token);
+        try {
+            httplib::Client client {makeClient(agent)};
+            httplib::Result res {client.Post("/spawn", params)};
+            if (!res || res->status != httplib::StatusCode::OK_200) {
+                LOG_F(
+                    WARNING, "Agent %s:%d failed to spawn %s.", 
+                    agent.host.c_str(), agent.port, label.c_str()
+                );
+                continue;
+            }
+            YAML::Node root {YAML::Load(res->body)};
+            RemoteInstance remote {
+                idx, 
+                resolveHost(agent.host), 
+                root[keys::PORT].as<int>(), 
+                root[keys::PID].as<pid_t>()
+            };
+            std::lock_guard<std::mutex> lock {agentsMutex};
+            AgentState &state {agentStates.at(idx)};
+            state.spawned.emplace_back(label, std::chrono::steady_clock::now());
+            // Until the next poll lists it, so it isn't taken for dead.
+            state.status.instances.push_back(label);
+            LOG_F(
+                INFO, "Placed %s on agent %s:%d.", 
+                label.c_str(), agent.host.c_str(), agent.port
+            );
+            return remote;
+        } catch (const std::exception &e) {
+            log::logExceptionWarning(e);
+        }
+    }
+    LOG_F(WARNING, "No agent has room for %s.", label.c_str());
+    return std::nullopt;
+}
+
+bool code::stopOnAgent(int idx, const std::string &label) {
+    const std::vector<SData::Agent> &agents {SData::studentsData->get_agents()};
+    if (idx < 0 || static_cast<std::size_t>(idx) >= agents.size()) {
+        return false;
+    }
+    const SData::Agent &agent {agents.at(idx)};
+    bool stopped {false};
+    try {
+        httplib::Client client {makeClient(agent)};
+        httplib::Result res {client.Post("/stop", httplib::Params {{keys::LABEL, label}})};
+        // Not found means it's already gone.
+        stopped = res && (res->status == httplib::StatusCode::OK_200 
+            || res->status == httplib::StatusCode::NotFound_404);
+    } catch (const std::exception &e) {
+        log::logExceptionWarning(e);
+    }
+    if (!stopped) {
+        LOG_F(
+            WARNING, "Agent %s:%d failed to stop %s.", 
+            agent.host.c_str(), agent.port, label.c_str()
+        );
+    }
+    std::lock_guard<std::mutex> lock {agentsMutex};
+    if (static_cast<std::size_t>(idx) < agentStates.size()) {
+        AgentState &state {agentStates.at(idx)};
+        std::vector<std::string> &instances {state.status.instances};
+        instances.erase(std::remove(instances.begin(), instances.end(), label), instances.end());
+        state.spawned.erase(std::remove_if(
+            state.spawned.begin(), state.spawned.end(), [&] (const auto &entry) {
+                return entry.first == label;
+            }
+        ), state.spawned.end());
+    }
+    return stopped;
+}
+
+bool code::agentRunsInstance(int idx, const std::string &label) {
+    std::lock_guard<std::mutex> lock {agentsMutex};
+    if (idx < 0 || static_cast<std::size_t>(idx) >= agentStates.size()) {
+        // Not polled yet.
+        return true;
+    }
+    const AgentState &state {agentStates.at(idx)};
+    // Students on an agent that's gone for good are started again elsewhere.
+    if (std::chrono::steady_clock::now() - state.lastSeen > constants::AGENT_STALE_AFTER) {
+        return false;
+    }
+    if (!state.seen) {
+        return true;
+    }
+    const std::vector<std::string> &instances {state.status.instances};
+    return std::find(instances.begin(), instances.end(), label) != instances.end();
+}
+
+std::vector<code::AgentStatus> code::getAgentStatuses() {
+    std::lock_guard<std::mutex> lock {agentsMutex};
+    std::vector<AgentStatus> statuses {};
+    statuses.reserve(agentStates.size());
+    for (const AgentState &state : agentStates) {
+        statuses.push_back(state.status);
+    }
+    return statuses;
+}
+
+}
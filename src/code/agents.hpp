@@ -0,0 +1,70 @@
+#ifndef INSTRUCT_AGENTS_HPP
+#define INSTRUCT_AGENTS_HPP
+
+#include <optional>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "httplib.h"
+
+#include "../data.hpp"
+
+namespace instruct::code {
+    // What an agent reports about its host.
+    struct AgentStatus {
+        std::string host;
+        int port;
+        bool reachable;
+        std::uint64_t memTotal;
+        std::uint64_t memAvailable;
+        int cpus;
+        // One minute load average.
+        double load;
+        // Labels of the instances it runs.
+        std::vector<std::string> instances;
+    };
+    
+    struct RemoteInstance {
+        // Index into `agents`.
+        int agent;
+        std::string host;
+        int port;
+        pid_t pid;
+    };
+    
+    // Budgets travel as request parameters, shared with `instruct-agent`.
+    httplib::Params encodeBudget(const SData::Budget &);
+    SData::Budget decodeBudget(const httplib::Request &);
+    // The bearer token the agent expects.
+    std::string agentAuthorization(const std::string &);
+    // Bodies of the agent's `/stats` and `/spawn` responses.
+    std::string encodeAgentStatus(const AgentStatus &);
+    std::string encodeSpawnResult(int, pid_t);
+    
+    bool agentsConfigured();
+    // Returns the agent at the given address, or -1.
+    int findAgent(const std::string &, int);
+    
+    // Polls every agent once, i.e. before reattaching instances.
+    void refreshAgents();
+    // Keeps the capacity of every agent current in the background.
+    void startAgentPolling();
+    void stopAgentPolling();
+    
+    // Spawns on the reachable agent with the most free memory and idle CPU.
+    // The token is the one the instance's editor is to require.
+    std::optional<RemoteInstance> spawnOnAgent(
+        const std::string &, const SData::Budget &, const std::string &
+    );
+    bool stopOnAgent(int, const std::string &);
+    // Whether the agent last reported the instance as running. Those on an agent 
+    // that hasn't answered for `AGENT_STALE_AFTER` are given up on.
+    bool agentRunsInstance(int, const std::string &);
+    
+    std::vector<AgentStatus> getAgentStatuses();
+}
+
+#endif
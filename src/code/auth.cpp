@@ -0,0 +1,234 @@
+#include <unordered_map>
+#include <exception>
+#include <optional>
+#include <chrono>
+#include <mutex>
+
+#include "loguru.hpp"
+#include "httplib.h"
+
+#include "../constants.hpp"
+#include "../security.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "activator.hpp"
+#include "admission.hpp"
+#include "process.hpp"
+#include "../data.hpp"
+#include "ports.hpp"
+#include "proxy.hpp"
+#include "auth.hpp"
+#include "pool.hpp"
+
+namespace instruct {
+
+static const std::string LOGIN_PAGE {R"(<!DOCTYPE html>
+<html><head><title>instruct</title></head><body>
+<form method="post" action="/login">
+<label>Name <input name="name" autofocus></label>
+<label>Password <input name="password" type="password"></label>
+<button type="submit">Open Editor</button>
+</form>
+</body></html>)"};
+
+namespace {
+    // A login whose editor was still starting, checked on by the page it was sent.
+    struct PendingLogin {
+        uuids::uuid uuid;
+        int port;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    std::mutex pendingMutex {};
+    // By a random ticket, so only the browser that logged in can follow it.
+    std::unordered_map<std::string, PendingLogin> pendingLogins {};
+}
+
+// Reloads itself from the readiness check until the editor answers.
+static std::string startingPage(const std::string &ticket) {
+    return R"(<!DOCTYPE html>
+<html><head><title>instruct</title>
+<meta http-equiv="refresh" content=")" 
+        + std::to_string(constants::LOGIN_REFRESH_INTERVAL.count()) 
+        + ";url=/ready?ticket=" + ticket + R"(">
+</head><body>
+<p>Your editor is starting. This page opens it once it's ready.</p>
+</body></html>)";
+}
+
+static std::optional<SData::Student> findStudent(const std::string &name) {
+    std::optional<SData::Student> found {};
+    for (const auto &[uuid, student] : SData::studentsData->get_students()) {
+        if (student.displayName == name) {
+            if (found) {
+                // Ambiguous display names can't be used to log in.
+                return std::nullopt;
+            }
+            found = student;
+        }
+    }
+    return found;
+}
+
+static std::string editorURL(const httplib::Request &req, int port, const uuids::uuid &uuid) {
+    // Redirect to the same host name the student used to reach us.
+    std::string host {req.get_header_value("Host")};
+    host = host.substr(0, host.rfind(':'));
+    std::string workspace {std::filesystem::absolute(code::getWorkspacePath(uuid))};
+    std::optional<code::Instance> instance {code::getInstance(uuid)};
+    bool live {instance && (instance->state == code::InstanceState::Starting 
+        || instance->state == code::InstanceState::Running)};
+    // The editor trades the token for a cookie of its own. Lazy activation starts 
+    // the instance later, from the data directory the token is kept in.
+    std::string query {
+        "/?folder=" + workspace + "&tkn=" 
+            + (live ? instance->token : code::loadConnectionToken(code::getInstanceDataPath(uuid)))
+    };
+    if (code::proxyRunning()) {
+        // The proxy swaps the session in the path for a cookie it routes on.
+        return "http://" + host + ":" + std::to_string(SData::studentsData->get_proxyPort()) 
+            + constants::PROXY_SESSION_PATH + code::issueSession(uuid) + query;
+    }
+    // Students placed on an agent reach its host directly, unless lazy activation relays them.
+    if (live && instance->agent != -1 && !code::lazyActivationRunning()) {
+        host = instance->host;
+    }
+    return "http://" + host + ":" + std::to_string(port) + query;
+}
+
+static void handleLogin(const httplib::Request &req, httplib::Response &res) {
+    std::optional<SData::Student> student {findStudent(req.get_param_value("name"))};
+    if (!student || !sec::verifyStudentPswd(*student, req.get_param_value("password"))) {
+        LOG_F(INFO, "Rejected student login.");
+        res.status = httplib::StatusCode::Unauthorized_401;
+        res.set_content("Invalid name or password.", "text/plain");
+        return;
+    }
+    const uuids::uuid &uuid {student->uuid};
+    std::error_code err;
+    std::filesystem::create_directories(code::getWorkspacePath(uuid), err);
+    log::logErrorCodeWarning(err);
+    
+    // The student's own port starts the instance on the first connection.
+    if (code::lazyActivationRunning()) {
+        res.set_redirect(editorURL(req, code::getStudentPort(uuid), uuid));
+        return;
+    }
+    
+    // Reuse a running instance, then try the pool, then start cold.
+    std::optional<code::Instance> instance {code::getInstance(uuid)};
+    int port {-1};
+    if (instance && (instance->state == code::InstanceState::Starting 
+        || instance->state == code::InstanceState::Running)) {
+        port = instance->port;
+    } else if ((port = code::claimPooledInstance(uuid)) == -1) {
+        code::AdmissionDecision admission {code::admitLaunch(uuid)};
+        if (admission.verdict != code::AdmissionVerdict::Admit) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            if (admission.verdict == code::AdmissionVerdict::Defer) {
+                std::string eta {std::to_string(admission.eta.count())};
+                res.set_header("Retry-After", eta);
+                res.set_content(
+                    "The server is busy. Try again in about " + eta + " seconds.", "text/plain"
+                );
+            } else {
+                res.set_content(
+                    "The server is out of memory. Ask your instructor for help.", "text/plain"
+                );
+            }
+            return;
+        }
+        if (!code::startInstance(uuid) || !(instance = code::getInstance(uuid))) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            res.set_content("Your editor could not be started.", "text/plain");
+            return;
+        }
+        port = instance->port;
+    }
+    
+    if (code::pollInstanceReady(uuid)) {
+        LOG_F(INFO, "Student %s logged in.", uuids::to_string(uuid).c_str());
+        res.set_redirect(editorURL(req, port, uuid));
+        return;
+    }
+    // Rather than hold a worker until the editor answers, hand the browser a page 
+    // that checks back so the redirect still lands on a live page.
+    std::string ticket {code::makeToken()};
+    {
+        auto now {std::chrono::steady_clock::now()};
+        std::lock_guard<std::mutex> lock {pendingMutex};
+        for (auto it {pendingLogins.begin()}; it != pendingLogins.end();) {
+            it = it->second.deadline < now ? pendingLogins.erase(it) : std::next(it);
+        }
+        pendingLogins[ticket] = {uuid, port, now + constants::LAUNCH_READY_TIMEOUT};
+    }
+    res.set_content(startingPage(ticket), "text/html");
+}
+
+static void handleReady(const httplib::Request &req, httplib::Response &res) {
+    std::string ticket {req.get_param_value("ticket")};
+    std::optional<PendingLogin> pending {};
+    {
+        std::lock_guard<std::mutex> lock {pendingMutex};
+        auto it {pendingLogins.find(ticket)};
+        if (it != pendingLogins.end()) {
+            pending = it->second;
+        }
+    }
+    if (!pending) {
+        res.status = httplib::StatusCode::NotFound_404;
+        res.set_content("This login has expired. Log in again.", "text/plain");
+        return;
+    }
+    
+    bool ready {code::pollInstanceReady(pending->uuid)};
+    if (!ready) {
+        if (!code::instanceActive(pending->uuid)) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            res.set_content("Your editor exited while starting.", "text/plain");
+        } else if (std::chrono::steady_clock::now() >= pending->deadline) {
+            res.status = httplib::StatusCode::ServiceUnavailable_503;
+            res.set_content("Your editor took too long to start.", "text/plain");
+        } else {
+            res.set_content(startingPage(ticket), "text/html");
+            return;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock {pendingMutex};
+        pendingLogins.erase(ticket);
+    }
+    if (ready) {
+        LOG_F(INFO, "Student %s logged in.", uuids::to_string(pending->uuid).c_str());
+        res.set_redirect(editorURL(req, pending->port, pending->uuid));
+    }
+}
+
+sec::ThreadedServer code::createStudentAuthServer() {
+    return {
+        SData::studentsData->get_authHost(), 
+        SData::studentsData->get_authPort(), 
+        [] (httplib::Server &server) {
+            server.Get("/", [] (const httplib::Request &, httplib::Response &res) {
+                res.set_content(LOGIN_PAGE, "text/html");
+            });
+            server.Post("/login", [] (const httplib::Request &req, httplib::Response &res) {
+                try {
+                    handleLogin(req, res);
+                } catch (const std::exception &e) {
+                    log::logExceptionWarning(e);
+                    res.status = httplib::StatusCode::InternalServerError_500;
+                }
+            });
+            server.Get("/ready", [] (const httplib::Request &req, httplib::Response &res) {
+                try {
+                    handleReady(req, res);
+                } catch (const std::exception &e) {
+                    log::logExceptionWarning(e);
+                    res.status = httplib::StatusCode::InternalServerError_500;
+                }
+            });
+        }
+    };
+}
+
+}
@@ -0,0 +1,13 @@
+#ifndef INSTRUCT_AUTH_HPP
+#define INSTRUCT_AUTH_HPP
+
+#include "../security.hpp"
+
+namespace instruct::code {
+    // Serves the student login page on the students' auth host and port. 
+    // A successful login hands the student an instance, from the warm pool 
+    // when one is ready, and redirects them to it.
+    sec::ThreadedServer createStudentAuthServer();
+}
+
+#endif
@@ -0,0 +1,230 @@
+#include <system_error>
+#include <fstream>
+#include <string>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "cgroup.hpp"
+
+namespace instruct {
+
+namespace {
+    // The delegated cgroup instance cgroups are created in, if any.
+    std::optional<std::filesystem::path> delegatedRoot {};
+}
+
+// Writes a single value to a cgroup interface file.
+static bool writeCgroupFile(const std::filesystem::path &file, const std::string &value) {
+    std::ofstream fout {file};
+    if (!fout) {
+        return false;
+    }
+    fout << value;
+    fout.close();
+    return static_cast<bool>(fout);
+}
+
+static std::optional<std::filesystem::path> ownCgroup() {
+    std::ifstream fin {"/proc/self/cgroup"};
+    std::string line {};
+    while (std::getline(fin, line)) {
+        if (line.rfind("0::", 0) == 0) {
+            return constants::CGROUP_ROOT / std::filesystem::path {line.substr(3)}.relative_path();
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::filesystem::path> code::getInstanceCgroup(pid_t pid) {
+    // The unified hierarchy is listed as `0::/path`.
+    std::ifstream fin {"/proc/" + std::to_string(pid) + "/cgroup"};
+    std::string line {};
+    while (std::getline(fin, line)) {
+        if (line.rfind("0::", 0) != 0) {
+            continue;
+        }
+        std::filesystem::path relPath {line.substr(3)};
+        if (std::string {relPath.filename()}.rfind(CGROUP_PREFIX, 0) != 0) {
+            return std::nullopt;
+        }
+        return constants::CGROUP_ROOT / relPath.relative_path();
+    }
+    return std::nullopt;
+}
+
+bool code::setCgroupFrozen(const std::filesystem::path &cgroup, bool frozen) {
+    std::ofstream fout {cgroup / "cgroup.freeze"};
+    if (!fout) {
+        return false;
+    }
+    fout << (frozen ? "1" : "0");
+    fout.close();
+    if (!fout) {
+        LOG_F(WARNING, "Failed to write %s/cgroup.freeze.", cgroup.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool code::waitCgroupFrozen(
+    const std::filesystem::path &cgroup, std::chrono::steady_clock::time_point deadline
+) {
+    int fd {open((cgroup / "cgroup.events").c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd == -1) {
+        return false;
+    }
+    bool frozen {false};
+    while (true) {
+        char buffer[256];
+        ssize_t length {pread(fd, buffer, sizeof buffer - 1, 0)};
+        if (length <= 0) {
+            break;
+        }
+        buffer[length] = '\0';
+        if (std::string {buffer}.find("frozen 1") != std::string::npos) {
+            frozen = true;
+            break;
+        }
+        auto remaining {std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()
+        )};
+        if (remaining.count() <= 0) {
+            break;
+        }
+        // The kernel signals changes to the file as priority events.
+        pollfd event {fd, POLLPRI, 0};
+        if (poll(&event, 1, static_cast<int>(remaining.count())) == -1 && errno != EINTR) {
+            break;
+        }
+    }
+    close(fd);
+    return frozen;
+}
+
+std::uint64_t code::readCgroupWriteOps(const std::filesystem::path &cgroup) {
+    // Each line is `<major>:<minor> rbytes=.. wbytes=.. rios=.. wios=.. ...`.
+    std::ifstream fin {cgroup / "io.stat"};
+    std::string field {};
+    std::uint64_t writeOps {};
+    while (fin >> field) {
+        if (field.rfind("wios=", 0) == 0) {
+            writeOps += std::stoull(field.substr(5));
+        }
+    }
+    return writeOps;
+}
+
+std::uint64_t code::readCgroupCpuMicros(const std::filesystem::path &cgroup) {
+    // Pairs of `<key> <value>`, starting with `usage_usec`.
+    std::ifstream fin {cgroup / "cpu.stat"};
+    std::string key {};
+    std::uint64_t value {};
+    while (fin >> key >> value) {
+        if (key == "usage_usec") {
+            return value;
+        }
+    }
+    return 0;
+}
+
+std::uint64_t code::readCgroupMemoryBytes(const std::filesystem::path &cgroup) {
+    std::ifstream fin {cgroup / "memory.current"};
+    std::uint64_t bytes {};
+    fin >> bytes;
+    return bytes;
+}
+
+void code::readCgroupIoBytes(
+    const std::filesystem::path &cgroup, std::uint64_t &readBytes, std::uint64_t &writeBytes
+) {
+    std::ifstream fin {cgroup / "io.stat"};
+    std::string field {};
+    while (fin >> field) {
+        if (field.rfind("rbytes=", 0) == 0) {
+            readBytes += std::stoull(field.substr(7));
+        } else if (field.rfind("wbytes=", 0) == 0) {
+            writeBytes += std::stoull(field.substr(7));
+        }
+    }
+}
+
+bool code::initCgroupDelegation() {
+    if (delegatedRoot) {
+        return true;
+    }
+    std::optional<std::filesystem::path> self {ownCgroup()};
+    if (!self) {
+        DLOG_F(INFO, "No cgroup v2 hierarchy. Instances won't get cgroups.");
+        return false;
+    }
+    // A restarted instruct may already sit in its leaf.
+    std::filesystem::path root {
+        self->filename() == CGROUP_PREFIX + "supervisor" ? self->parent_path() : *self
+    };
+    if (access(root.c_str(), W_OK) != 0 
+        || access((root / "cgroup.subtree_control").c_str(), W_OK) != 0) {
+        DLOG_F(INFO, "Cgroup %s isn't delegated. Instances won't get cgroups.", root.c_str());
+        return false;
+    }
+    
+    // Controllers can only be enabled for children of a cgroup without processes.
+    std::filesystem::path leaf {root / (CGROUP_PREFIX + "supervisor")};
+    std::error_code err;
+    std::filesystem::create_directory(leaf, err);
+    if (err || !writeCgroupFile(leaf / "cgroup.procs", std::to_string(getpid()))) {
+        LOG_F(WARNING, "Failed to move instruct into %s.", leaf.c_str());
+        return false;
+    }
+    for (const char *controller : {"+cpu", "+memory", "+pids", "+io"}) {
+        if (!writeCgroupFile(root / "cgroup.subtree_control", controller)) {
+            LOG_F(INFO, "The %s cgroup controller is unavailable.", controller + 1);
+        }
+    }
+    delegatedRoot = root;
+    LOG_F(INFO, "Instances will be placed in cgroups under %s.", root.c_str());
+    return true;
+}
+
+std::optional<std::filesystem::path> code::createInstanceCgroup(
+    const std::string &label, const SData::Budget &budget
+) {
+    if (!delegatedRoot) {
+        return std::nullopt;
+    }
+    std::filesystem::path cgroup {*delegatedRoot / (CGROUP_PREFIX + label)};
+    std::error_code err;
+    std::filesystem::create_directory(cgroup, err);
+    if (err) {
+        LOG_F(WARNING, "Failed to create cgroup %s: %s", cgroup.c_str(), err.message().c_str());
+        return std::nullopt;
+    }
+    // Reused cgroups must drop limits that were since unset.
+    bool applied {
+        writeCgroupFile(
+            cgroup / "cpu.weight", std::to_string(budget.cpuWeight > 0 ? budget.cpuWeight : 100)
+        ) 
+        && writeCgroupFile(
+            cgroup / "memory.max", 
+            budget.memoryMaxMB > 0 ? std::to_string(budget.memoryMaxMB) + "M" : "max"
+        )
+    };
+    if (!applied) {
+        LOG_F(WARNING, "Some limits of cgroup %s could not be applied.", cgroup.c_str());
+    }
+    return cgroup;
+}
+
+void code::removeInstanceCgroup(const std::filesystem::path &cgroup) {
+    // Fails harmlessly while stragglers remain; the directory is reused next time.
+    if (rmdir(cgroup.c_str()) == -1) {
+        DLOG_F(INFO, "Kept cgroup %s.", cgroup.c_str());
+    }
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef INSTRUCT_CGROUP_HPP
+#define INSTRUCT_CGROUP_HPP
+
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+#include <sys/types.h>
+
+#include "../data.hpp"
+
+namespace instruct::code {
+    // Prefix of the cgroup v2 directories instruct creates for instances.
+    inline const std::string CGROUP_PREFIX {"instruct-"};
+    
+    // The process's cgroup v2 directory, if it's one dedicated to an instance.
+    std::optional<std::filesystem::path> getInstanceCgroup(pid_t);
+    // Uses the cgroup v2 freezer. Returns false if it's unavailable.
+    bool setCgroupFrozen(const std::filesystem::path &, bool);
+    // Freezing completes asynchronously. Waits until every process in the cgroup 
+    // is frozen, or the deadline passes.
+    bool waitCgroupFrozen(
+        const std::filesystem::path &, std::chrono::steady_clock::time_point
+    );
+    // Block device writes the cgroup has issued so far, summed over devices.
+    std::uint64_t readCgroupWriteOps(const std::filesystem::path &);
+    // CPU time used by every process the cgroup ever held, in microseconds.
+    std::uint64_t readCgroupCpuMicros(const std::filesystem::path &);
+    // Memory charged to the cgroup, including its page cache.
+    std::uint64_t readCgroupMemoryBytes(const std::filesystem::path &);
+    // Bytes read from and written to block devices so far, summed over devices.
+    void readCgroupIoBytes(const std::filesystem::path &, std::uint64_t &, std::uint64_t &);
+    
+    // If instruct's own cgroup is writable, i.e. it was delegated, moves instruct 
+    // into a leaf below it so that instances can get sibling cgroups with controllers.
+    bool initCgroupDelegation();
+    // Creates `instruct-<label>` with the budget's cgroup limits applied. 
+    // Returns nothing without delegation.
+    std::optional<std::filesystem::path> createInstanceCgroup(
+        const std::string &, const SData::Budget &
+    );
+    // Removes an instance's cgroup once its processes are gone.
+    void removeInstanceCgroup(const std::filesystem::path &);
+}
+
+#endif
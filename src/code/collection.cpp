@@ -0,0 +1,755 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <ctime>
+#include <map>
+
+#include <sys/stat.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+
+#include "archive_entry.h"
+#include "yaml-cpp/yaml.h"
+#include "picosha2.h"
+#include "loguru.hpp"
+#include "archive.h"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "collection.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "../data.hpp"
+
+namespace instruct {
+
+namespace {
+    // A student as resolved when collection starts, so workers never read the config.
+    struct Submission {
+        uuids::uuid uuid;
+        std::string name;
+        std::filesystem::path workspace;
+        SData::CollectionFilter filter;
+    };
+    
+    // A file read ahead of the archive, or only looked at if it's too large to hold.
+    struct Entry {
+        // The top directory in the archive.
+        std::string label;
+        std::filesystem::path path;
+        std::string relative;
+        mode_t mode;
+        time_t mtime;
+        // As of reading, and what was reserved of the read-ahead.
+        std::uint64_t size;
+        // Only for symbolic links.
+        std::string symlink;
+        bool buffered;
+        std::vector<char> data;
+        std::string hash;
+    };
+    
+    struct Block {
+        std::size_t sequence;
+        std::vector<unsigned char> data;
+    };
+    
+    // Readers feed entries to the archive, whose output is cut into blocks for 
+    // the compressors, whose output the writer puts back in order.
+    struct Pipeline {
+        std::mutex entryMutex {};
+        std::condition_variable entryReady {};
+        std::condition_variable entrySpace {};
+        std::deque<Entry> entries {};
+        std::uint64_t bytesAhead {};
+        std::size_t readersLeft {};
+        
+        std::mutex blockMutex {};
+        std::condition_variable compressReady {};
+        std::condition_variable writeReady {};
+        std::condition_variable blockSpace {};
+        std::deque<Block> uncompressed {};
+        std::map<std::size_t, std::vector<unsigned char>> compressed {};
+        std::size_t submitted {};
+        std::size_t written {};
+        std::size_t maxInFlight {};
+        bool sealed {false};
+        
+        // Only touched by the archive.
+        std::vector<unsigned char> current {};
+        int fd {-1};
+        std::atomic_bool failed {false};
+    };
+    
+    // Hashes of the files collected from each student, by label.
+    struct Manifest {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> files;
+    };
+    
+    std::thread collectionThread {};
+    std::atomic_bool collecting {false};
+    std::atomic_bool cancelled {false};
+    
+    std::mutex progressMutex {};
+    code::CollectionProgress progress {};
+    std::vector<code::CollectionResult> results {};
+}
+
+// `*` also matches slashes, so `src/*.py` matches at any depth under `src`.
+static bool globMatches(
+    const std::vector<std::string> &globs, const std::filesystem::path &relative
+) {
+    for (const std::string &glob : globs) {
+        std::string subject {
+            glob.find('/') == std::string::npos ? relative.filename().string() : relative.string()
+        };
+        if (fnmatch(glob.c_str(), subject.c_str(), 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stops the archive and every thread feeding or fed by it.
+static void abandonPipeline(Pipeline &pipeline) {
+    {
+        std::lock_guard<std::mutex> lock {pipeline.entryMutex};
+        pipeline.failed = true;
+    }
+    pipeline.entrySpace.notify_all();
+    {
+        std::lock_guard<std::mutex> lock {pipeline.blockMutex};
+    }
+    pipeline.blockSpace.notify_all();
+    pipeline.writeReady.notify_all();
+}
+
+// Waits until the read-ahead has room for the file. Returns false once collection stops.
+static bool reserveAhead(Pipeline &pipeline, std::uint64_t bytes) {
+    std::unique_lock<std::mutex> lock {pipeline.entryMutex};
+    pipeline.entrySpace.wait(lock, [&] {
+        return cancelled || pipeline.failed 
+            || pipeline.bytesAhead + bytes <= constants::COLLECTION_READ_AHEAD_BYTES;
+    });
+    if (cancelled || pipeline.failed) {
+        return false;
+    }
+    pipeline.bytesAhead += bytes;
+    return true;
+}
+
+static void releaseAhead(Pipeline &pipeline, std::uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock {pipeline.entryMutex};
+        pipeline.bytesAhead -= bytes;
+    }
+    pipeline.entrySpace.notify_all();
+}
+
+static void pushEntry(Pipeline &pipeline, Entry entry) {
+    {
+        std::lock_guard<std::mutex> lock {pipeline.entryMutex};
+        pipeline.entries.push_back(std::move(entry));
+    }
+    pipeline.entryReady.notify_one();
+}
+
+// Reads as much of the file as there was when it was looked at.
+static bool readUpTo(int fd, std::vector<char> &data, std::uint64_t size) {
+    data.resize(size);
+    std::uint64_t filled {};
+    while (filled < size) {
+        ssize_t length {read(fd, data.data() + filled, size - filled)};
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            return false;
+        }
+        if (length == 0) {
+            break;
+        }
+        filled += length;
+    }
+    data.resize(filled);
+    return true;
+}
+
+static code::CollectionResult collectFrom(Pipeline &pipeline, const Submission &submission) {
+    code::CollectionResult result {submission.uuid, true, "", 0};
+    auto fail {[&](const std::string &error) {
+        if (result.succeeded) {
+            result.succeeded = false;
+            result.error = error;
+        }
+    }};
+    const SData::CollectionFilter &filter {submission.filter};
+    std::string label {submission.workspace.filename().string()};
+    
+    std::error_code err;
+    if (!std::filesystem::is_directory(submission.workspace, err)) {
+        fail("No workspace.");
+        return result;
+    }
+    std::filesystem::recursive_directory_iterator it {
+        submission.workspace, std::filesystem::directory_options::skip_permission_denied, err
+    };
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        if (cancelled || pipeline.failed) {
+            break;
+        }
+        const std::filesystem::path &path {it->path()};
+        std::filesystem::path relative {path.lexically_relative(submission.workspace)};
+        struct stat info {};
+        if (lstat(path.c_str(), &info) != 0) {
+            fail(relative.string() + ": " + std::strerror(errno));
+            continue;
+        }
+        bool excluded {globMatches(filter.exclude, relative)};
+        if (S_ISDIR(info.st_mode)) {
+            // Include globs only ever apply to files.
+            if (excluded) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (excluded || (!filter.include.empty() && !globMatches(filter.include, relative))) {
+            continue;
+        }
+        Entry entry {
+            label, path, relative.string(), info.st_mode & 07777, info.st_mtim.tv_sec, 
+            static_cast<std::uint64_t>(info.st_size), "", true, {}, ""
+        };
+        if (S_ISLNK(info.st_mode)) {
+            std::error_code linkErr;
+            entry.symlink = std::filesystem::read_symlink(path, linkErr).string();
+            entry.size = 0;
+            if (linkErr) {
+                fail(relative.string() + ": " + linkErr.message());
+                continue;
+            }
+        } else if (!S_ISREG(info.st_mode)) {
+            continue;
+        } else if (entry.size > constants::COLLECTION_MAX_BUFFERED_FILE) {
+            entry.buffered = false;
+        } else {
+            if (!reserveAhead(pipeline, entry.size)) {
+                break;
+            }
+            int fd {open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)};
+            if (fd == -1 || !readUpTo(fd, entry.data, entry.size)) {
+                fail(relative.string() + ": " + std::strerror(errno));
+                releaseAhead(pipeline, entry.size);
+                if (fd != -1) {
+                    close(fd);
+                }
+                continue;
+            }
+            close(fd);
+            entry.hash = picosha2::hash256_hex_string(entry.data.begin(), entry.data.end());
+            std::lock_guard<std::mutex> lock {progressMutex};
+            progress.bytesRead += entry.data.size();
+        }
+        ++result.files;
+        {
+            std::lock_guard<std::mutex> lock {progressMutex};
+            ++progress.files;
+        }
+        pushEntry(pipeline, std::move(entry));
+    }
+    if (err) {
+        fail(err.message());
+    }
+    return result;
+}
+
+// Each block is a complete gzip member, and members concatenated are read as one stream. 
+// Returns an empty block on failure.
+static std::vector<unsigned char> gzipBlock(std::vector<unsigned char> &data) {
+    z_stream stream {};
+    // Adding 16 to the window bits asks for a gzip header and trailer.
+    if (deflateInit2(
+        &stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY
+    ) != Z_OK) {
+        return {};
+    }
+    std::vector<unsigned char> out(deflateBound(&stream, data.size()));
+    stream.next_in = data.data();
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    int status {deflate(&stream, Z_FINISH)};
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        return {};
+    }
+    return out;
+}
+
+static void compressBlocks(Pipeline &pipeline) {
+    for (;;) {
+        Block block {};
+        {
+            std::unique_lock<std::mutex> lock {pipeline.blockMutex};
+            pipeline.compressReady.wait(lock, [&] {
+                return !pipeline.uncompressed.empty() || pipeline.sealed;
+            });
+            if (pipeline.uncompressed.empty()) {
+                return;
+            }
+            block = std::move(pipeline.uncompressed.front());
+            pipeline.uncompressed.pop_front();
+        }
+        std::vector<unsigned char> data {};
+        if (!pipeline.failed) {
+            data = gzipBlock(block.data);
+        }
+        {
+            std::lock_guard<std::mutex> lock {pipeline.blockMutex};
+            pipeline.compressed.emplace(block.sequence, std::move(data));
+        }
+        pipeline.writeReady.notify_all();
+    }
+}
+
+static bool writeAll(int fd, const std::vector<unsigned char> &data) {
+    for (std::size_t written {}; written < data.size();) {
+        ssize_t length {write(fd, data.data() + written, data.size() - written)};
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            return false;
+        }
+        written += length;
+    }
+    return true;
+}
+
+// Writes blocks in the order they were cut, however they finish compressing.
+static void writeBlocks(Pipeline &pipeline) {
+    for (;;) {
+        std::vector<unsigned char> data {};
+        {
+            std::unique_lock<std::mutex> lock {pipeline.blockMutex};
+            pipeline.writeReady.wait(lock, [&] {
+                return pipeline.failed || pipeline.compressed.count(pipeline.written) > 0 
+                    || (pipeline.sealed && pipeline.written == pipeline.submitted);
+            });
+            auto it {pipeline.compressed.find(pipeline.written)};
+            if (pipeline.failed || it == pipeline.compressed.end()) {
+                return;
+            }
+            data = std::move(it->second);
+            pipeline.compressed.erase(it);
+        }
+        if (data.empty()) {
+            LOG_F(ERROR, "Failed to compress a block of the archive.");
+            abandonPipeline(pipeline);
+            return;
+        }
+        if (!writeAll(pipeline.fd, data)) {
+            LOG_F(ERROR, "Failed to write the archive: %s", std::strerror(errno));
+            abandonPipeline(pipeline);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock {pipeline.blockMutex};
+            ++pipeline.written;
+        }
+        pipeline.blockSpace.notify_all();
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress.bytesWritten += data.size();
+    }
+}
+
+// Hands the block being filled to the compressors, waiting while too many are unwritten.
+static void submitBlock(Pipeline &pipeline) {
+    {
+        std::unique_lock<std::mutex> lock {pipeline.blockMutex};
+        pipeline.blockSpace.wait(lock, [&] {
+            return pipeline.failed 
+                || pipeline.submitted - pipeline.written < pipeline.maxInFlight;
+        });
+        pipeline.uncompressed.push_back({pipeline.submitted++, std::move(pipeline.current)});
+    }
+    pipeline.compressReady.notify_one();
+    pipeline.current = {};
+    pipeline.current.reserve(constants::COLLECTION_BLOCK_SIZE);
+}
+
+static la_ssize_t appendOutput(archive *, void *client, const void *buffer, size_t length) {
+    Pipeline &pipeline {*static_cast<Pipeline *>(client)};
+    if (pipeline.failed) {
+        return -1;
+    }
+    const unsigned char *data {static_cast<const unsigned char *>(buffer)};
+    for (std::size_t offset {}; offset < length;) {
+        std::size_t chunk {std::min(
+            length - offset, constants::COLLECTION_BLOCK_SIZE - pipeline.current.size()
+        )};
+        pipeline.current.insert(pipeline.current.end(), data + offset, data + offset + chunk);
+        offset += chunk;
+        if (pipeline.current.size() == constants::COLLECTION_BLOCK_SIZE) {
+            submitBlock(pipeline);
+        }
+    }
+    return static_cast<la_ssize_t>(length);
+}
+
+static int flushOutput(archive *, void *client) {
+    Pipeline &pipeline {*static_cast<Pipeline *>(client)};
+    if (!pipeline.current.empty()) {
+        submitBlock(pipeline);
+    }
+    return pipeline.failed ? ARCHIVE_FATAL : ARCHIVE_OK;
+}
+
+static bool writeData(archive *out, const char *data, std::size_t length) {
+    while (length > 0) {
+        la_ssize_t written {archive_write_data(out, data, length)};
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Reads a file too large to have been read ahead while writing it. It's cut off 
+// or padded with zeros if it changed size since its header was decided.
+static bool streamFile(archive *out, Entry &entry, int fd) {
+    std::vector<char> buffer(constants::COLLECTION_BLOCK_SIZE);
+    picosha2::hash256_one_by_one hasher {};
+    hasher.init();
+    std::uint64_t remaining {entry.size};
+    while (remaining > 0) {
+        ssize_t length {read(fd, buffer.data(), std::min<std::uint64_t>(buffer.size(), remaining))};
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            LOG_F(WARNING, "%s changed while it was collected.", entry.path.c_str());
+            std::fill(buffer.begin(), buffer.end(), '\0');
+            length = static_cast<ssize_t>(std::min<std::uint64_t>(buffer.size(), remaining));
+        }
+        hasher.process(buffer.begin(), buffer.begin() + length);
+        if (!writeData(out, buffer.data(), length)) {
+            return false;
+        }
+        remaining -= length;
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress.bytesRead += length;
+    }
+    hasher.finish();
+    entry.hash = picosha2::get_hash_hex_string(hasher);
+    return true;
+}
+
+static bool archiveEntry(
+    archive *out, Entry &entry, std::unordered_map<std::string, Manifest> &manifests
+) {
+    int fd {-1};
+    if (!entry.buffered) {
+        fd = open(entry.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd == -1) {
+            LOG_F(
+                WARNING, "Failed to collect %s: %s", 
+                entry.path.c_str(), std::strerror(errno)
+            );
+            return true;
+        }
+    }
+    archive_entry *header {archive_entry_new()};
+    archive_entry_set_pathname(header, (entry.label + "/" + entry.relative).c_str());
+    archive_entry_set_mtime(header, entry.mtime, 0);
+    if (!entry.symlink.empty()) {
+        archive_entry_set_filetype(header, AE_IFLNK);
+        archive_entry_set_perm(header, 0777);
+        archive_entry_set_symlink(header, entry.symlink.c_str());
+    } else {
+        archive_entry_set_filetype(header, AE_IFREG);
+        archive_entry_set_perm(header, entry.mode);
+        archive_entry_set_size(header, entry.buffered ? entry.data.size() : entry.size);
+    }
+    bool written {archive_write_header(out, header) == ARCHIVE_OK};
+    archive_entry_free(header);
+    if (written && entry.buffered) {
+        written = writeData(out, entry.data.data(), entry.data.size());
+    } else if (written) {
+        written = streamFile(out, entry, fd);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    if (written && entry.symlink.empty()) {
+        manifests[entry.label].files.emplace_back(entry.relative, entry.hash);
+    }
+    return written;
+}
+
+static bool archiveManifest(
+    archive *out, std::unordered_map<std::string, Manifest> &manifests
+) {
+    std::vector<std::string> labels {};
+    for (auto &[label, manifest] : manifests) {
+        labels.push_back(label);
+        std::sort(manifest.files.begin(), manifest.files.end());
+    }
+    std::sort(labels.begin(), labels.end());
+    YAML::Emitter emitter {};
+    emitter << YAML::BeginMap;
+    for (const std::string &label : labels) {
+        const Manifest &manifest {manifests.at(label)};
+        emitter << YAML::Key << label << YAML::Value << YAML::BeginMap;
+        emitter << YAML::Key << "name" << YAML::Value << manifest.name;
+        emitter << YAML::Key << "sha256" << YAML::Value << YAML::BeginMap;
+        for (const auto &[relative, hash] : manifest.files) {
+            emitter << YAML::Key << relative << YAML::Value << hash;
+        }
+        emitter << YAML::EndMap << YAML::EndMap;
+    }
+    emitter << YAML::EndMap;
+    
+    archive_entry *header {archive_entry_new()};
+    archive_entry_set_pathname(header, constants::COLLECTION_MANIFEST.c_str());
+    archive_entry_set_mtime(header, std::time(nullptr), 0);
+    archive_entry_set_filetype(header, AE_IFREG);
+    archive_entry_set_perm(header, 0644);
+    archive_entry_set_size(header, emitter.size());
+    bool written {archive_write_header(out, header) == ARCHIVE_OK};
+    archive_entry_free(header);
+    return written && writeData(out, emitter.c_str(), emitter.size());
+}
+
+static void runCollection(
+    std::filesystem::path output, 
+    int fd, 
+    std::vector<Submission> submissions, 
+    std::function<void()> onProgress
+) {
+    code::unpinThread();
+    Pipeline pipeline {};
+    pipeline.fd = fd;
+    pipeline.current.reserve(constants::COLLECTION_BLOCK_SIZE);
+    std::size_t compressorCount {std::max(1u, std::thread::hardware_concurrency())};
+    pipeline.maxInFlight = compressorCount * constants::COLLECTION_BLOCKS_PER_COMPRESSOR;
+    // Workspaces share a disk, so more readers than this only queue up on it.
+    std::size_t readerCount {std::min(constants::COLLECTION_MAX_READERS, submissions.size())};
+    pipeline.readersLeft = readerCount;
+    
+    std::unordered_map<std::string, Manifest> manifests {};
+    for (const Submission &submission : submissions) {
+        manifests[submission.workspace.filename().string()].name = submission.name;
+    }
+    
+    std::vector<std::thread> blockThreads {};
+    blockThreads.emplace_back(writeBlocks, std::ref(pipeline));
+    for (std::size_t idx {}; idx < compressorCount; ++idx) {
+        blockThreads.emplace_back(compressBlocks, std::ref(pipeline));
+    }
+    std::atomic_size_t next {0};
+    auto read {[&] {
+        for (std::size_t idx {next++}; idx < submissions.size() && !cancelled 
+            && !pipeline.failed; idx = next++) {
+            code::CollectionResult result {collectFrom(pipeline, submissions.at(idx))};
+            if (!result.succeeded) {
+                LOG_F(
+                    WARNING, "Failed to collect the workspace of %s: %s", 
+                    uuids::to_string(result.uuid).c_str(), result.error.c_str()
+                );
+            }
+            {
+                std::lock_guard<std::mutex> lock {progressMutex};
+                ++progress.done;
+                progress.failed += !result.succeeded;
+                results.push_back(std::move(result));
+            }
+            if (onProgress) {
+                onProgress();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock {pipeline.entryMutex};
+            --pipeline.readersLeft;
+        }
+        pipeline.entryReady.notify_all();
+    }};
+    std::vector<std::thread> readers {};
+    for (std::size_t idx {}; idx < readerCount; ++idx) {
+        readers.emplace_back(read);
+    }
+    
+    // Entries are archived in the order they were read, which interleaves students 
+    // but keeps every reader busy.
+    archive *out {archive_write_new()};
+    archive_write_set_format_pax_restricted(out);
+    bool archived {
+        archive_write_open(out, &pipeline, nullptr, appendOutput, flushOutput) == ARCHIVE_OK
+    };
+    while (archived) {
+        Entry entry {};
+        {
+            std::unique_lock<std::mutex> lock {pipeline.entryMutex};
+            pipeline.entryReady.wait(lock, [&] {
+                return !pipeline.entries.empty() || pipeline.readersLeft == 0;
+            });
+            if (pipeline.entries.empty()) {
+                break;
+            }
+            entry = std::move(pipeline.entries.front());
+            pipeline.entries.pop_front();
+        }
+        archived = archiveEntry(out, entry, manifests) && !cancelled;
+        if (entry.buffered) {
+            releaseAhead(pipeline, entry.size);
+        }
+    }
+    archived = archived && archiveManifest(out, manifests);
+    archived = archive_write_close(out) == ARCHIVE_OK && archived;
+    if (!archived && !cancelled && !pipeline.failed) {
+        LOG_F(ERROR, "Failed to archive submissions: %s", archive_error_string(out));
+    }
+    archive_write_free(out);
+    if (!archived) {
+        abandonPipeline(pipeline);
+    }
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock {pipeline.blockMutex};
+        pipeline.sealed = true;
+    }
+    pipeline.compressReady.notify_all();
+    pipeline.writeReady.notify_all();
+    for (std::thread &thread : blockThreads) {
+        thread.join();
+    }
+    
+    std::filesystem::path partial {output.string() + ".part"};
+    archived = close(fd) == 0 && archived && !pipeline.failed;
+    std::error_code err;
+    if (archived) {
+        std::filesystem::rename(partial, output, err);
+        archived = !err;
+    }
+    if (!archived) {
+        std::filesystem::remove(partial, err);
+    }
+    
+    code::CollectionProgress finalProgress {};
+    {
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress.active = false;
+        finalProgress = progress;
+    }
+    if (archived) {
+        LOG_F(
+            INFO, 
+            "Collected %d/%d workspace(s), %d file(s) and %llu MB, into %s (%llu MB).", 
+            finalProgress.done - finalProgress.failed, finalProgress.total, 
+            finalProgress.files, 
+            static_cast<unsigned long long>(finalProgress.bytesRead >> 20), 
+            output.c_str(), 
+            static_cast<unsigned long long>(finalProgress.bytesWritten >> 20)
+        );
+    }
+    if (!archived && !cancelled) {
+        notif::notify(
+            "Failed to write `" + output.string() + "`. See the log file for more details."
+        );
+    } else if (finalProgress.failed > 0) {
+        notif::notify(
+            std::to_string(finalProgress.failed) + " workspace(s) were not fully collected. "
+            "See the log file for more details."
+        );
+    }
+    collecting = false;
+    if (onProgress) {
+        onProgress();
+    }
+}
+
+bool code::collectSubmissions(
+    const std::filesystem::path &output, 
+    std::vector<uuids::uuid> students, 
+    std::function<void()> onProgress, 
+    const std::filesystem::path &root
+) {
+    if (collecting) {
+        notif::notify("Submissions are already being collected.");
+        return false;
+    }
+    code::cancelCollection();
+    
+    const auto &studentMap {SData::studentsData->get_students()};
+    const auto &overrides {SData::studentsData->get_collectionOverrides()};
+    std::vector<Submission> submissions {};
+    submissions.reserve(students.size());
+    for (const uuids::uuid &uuid : students) {
+        auto student {studentMap.find(uuid)};
+        auto filter {overrides.find(uuid)};
+        std::filesystem::path workspace {code::getWorkspacePath(uuid)};
+        submissions.push_back({
+            uuid, 
+            student != studentMap.end() ? student->second.displayName : "", 
+            root.empty() ? workspace : root / workspace.filename(), 
+            filter != overrides.end() 
+                ? filter->second 
+                : SData::studentsData->get_collectionFilter()
+        });
+    }
+    // Written beside the output and renamed over it once complete.
+    int fd {open(
+        (output.string() + ".part").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644
+    )};
+    if (fd == -1) {
+        notif::notify("Failed to create `" + output.string() + "`.");
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress = {};
+        progress.total = static_cast<int>(submissions.size());
+        progress.active = true;
+        results.clear();
+    }
+    cancelled = false;
+    collecting = true;
+    collectionThread = std::thread {
+        runCollection, output, fd, std::move(submissions), std::move(onProgress)
+    };
+    DLOG_F(INFO, "Collection thread started.");
+    return true;
+}
+
+void code::cancelCollection() {
+    cancelled = true;
+    if (collectionThread.joinable()) {
+        collectionThread.join();
+        DLOG_F(INFO, "Collection thread joined.");
+    }
+}
+
+code::CollectionProgress code::getCollectionProgress() {
+    std::lock_guard<std::mutex> lock {progressMutex};
+    return progress;
+}
+
+std::vector<code::CollectionResult> code::getCollectionResults() {
+    std::lock_guard<std::mutex> lock {progressMutex};
+    return results;
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef INSTRUCT_COLLECTION_HPP
+#define INSTRUCT_COLLECTION_HPP
+
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct CollectionProgress {
+        int total;
+        int done;
+        int failed;
+        int files;
+        std::uint64_t bytesRead;
+        // Compressed, i.e. the size of the archive so far.
+        std::uint64_t bytesWritten;
+        bool active;
+    };
+    
+    struct CollectionResult {
+        uuids::uuid uuid;
+        bool succeeded;
+        // The first error for the student, if any.
+        std::string error;
+        int files;
+    };
+    
+    // Collects each student's workspace into a gzipped tar at the given path on 
+    // background threads. Workspaces are walked and read on a bounded pool, 
+    // the archive is compressed in blocks across every core and written in order 
+    // as it's produced. Files are filtered by the student's collection filter, 
+    // and a manifest of every file's hash is added last. The callback is invoked 
+    // as students finish and once the archive is complete. Workspaces are read 
+    // from the directory named after each one under the given root instead, if any.
+    bool collectSubmissions(
+        const std::filesystem::path &, 
+        std::vector<uuids::uuid>, 
+        std::function<void()>, 
+        const std::filesystem::path &
+    );
+    // Abandons the archive and joins the threads.
+    void cancelCollection();
+    
+    CollectionProgress getCollectionProgress();
+    // One per student finished so far, in the order they finished.
+    std::vector<CollectionResult> getCollectionResults();
+}
+
+#endif
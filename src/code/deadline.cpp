@@ -0,0 +1,288 @@
+#include <unordered_set>
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <mutex>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "collection.hpp"
+#include "deadline.hpp"
+#include "fileops.hpp"
+#include "cgroup.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    struct FrozenInstance {
+        uuids::uuid uuid;
+        pid_t pid;
+        std::optional<std::filesystem::path> cgroup;
+        // Instances that were already hibernating are left frozen.
+        bool thaw;
+    };
+    
+    code::ReflinkProbe reflinks {
+        "The filesystem doesn't support reflinks, deadline captures will copy."
+    };
+    std::atomic_bool capturing {false};
+    
+    std::mutex reportMutex {};
+    std::optional<code::DeadlineReport> report {};
+    std::vector<code::DeadlineCapture> captures {};
+}
+
+static std::chrono::milliseconds elapsed(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from);
+}
+
+// Only the leader is checked, since the whole group was sent the same signal.
+static bool waitStopped(pid_t pid, Clock::time_point deadline) {
+    std::string statPath {"/proc/" + std::to_string(pid) + "/stat"};
+    while (true) {
+        std::ifstream fin {statPath};
+        std::string stat {};
+        std::getline(fin, stat);
+        // The state follows the command name, which may itself contain spaces.
+        std::size_t nameEnd {stat.rfind(')')};
+        if (nameEnd == std::string::npos || nameEnd + 2 >= stat.size()) {
+            return false;
+        }
+        if (stat.at(nameEnd + 2) == 'T') {
+            return true;
+        }
+        if (Clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds {1});
+    }
+}
+
+// Every freeze is requested before any is waited on, so the instances 
+// freeze together and the wait is that of the slowest one.
+static std::vector<FrozenInstance> freezeInstances(const std::vector<uuids::uuid> &students) {
+    std::unordered_set<uuids::uuid> targets {students.begin(), students.end()};
+    std::vector<FrozenInstance> frozen {};
+    for (const code::Instance &instance : code::getInstances()) {
+        if (targets.count(instance.uuid) == 0 || instance.pid == -1 || instance.agent != -1) {
+            continue;
+        }
+        bool froze {!instance.frozen && code::freezeInstance(instance.uuid)};
+        if (!froze) {
+            // It may have been hibernated since it was listed.
+            std::optional<code::Instance> current {code::getInstance(instance.uuid)};
+            if (!current || !current->frozen) {
+                LOG_F(
+                    WARNING, "Failed to freeze instance %s for the deadline.", 
+                    code::workspaceLabel(instance.uuid).c_str()
+                );
+                continue;
+            }
+        }
+        frozen.push_back({
+            instance.uuid, instance.pid, code::getInstanceCgroup(instance.pid), froze
+        });
+    }
+    Clock::time_point deadline {Clock::now() + constants::DEADLINE_FREEZE_TIMEOUT};
+    for (const FrozenInstance &instance : frozen) {
+        bool settled {
+            instance.cgroup 
+                ? code::waitCgroupFrozen(*instance.cgroup, deadline) 
+                : waitStopped(instance.pid, deadline)
+        };
+        if (!settled) {
+            LOG_F(
+                WARNING, "Instance %s was still freezing when its workspace was captured.", 
+                code::workspaceLabel(instance.uuid).c_str()
+            );
+        }
+    }
+    return frozen;
+}
+
+// A reflink is nearly as quick as a hard link but unaffected by later writes, 
+// which editors usually make in place. Without reflinks, files are copied, which 
+// lengthens the freeze accordingly. Hard links would share the live file with a 
+// student who may write to it again before the archive is done. Captured files 
+// are made read-only, so the capture can't be changed afterwards by mistake.
+static bool captureFile(
+    const std::filesystem::path &src, 
+    const std::filesystem::path &dst, 
+    code::DeadlineCapture &capture
+) {
+    struct stat info {};
+    code::CopyResult result {reflinks.cloneFile(src, dst, &info)};
+    capture.cloned += result == code::CopyResult::Cloned;
+    capture.copied += result == code::CopyResult::Copied;
+    if (result == code::CopyResult::Failed) {
+        return false;
+    }
+    // The archive records modification times, which should be the student's.
+    timespec times[2] {info.st_atim, info.st_mtim};
+    utimensat(AT_FDCWD, dst.c_str(), times, 0);
+    chmod(dst.c_str(), info.st_mode & 07555);
+    return true;
+}
+
+static code::DeadlineCapture captureWorkspace(
+    const uuids::uuid &uuid, const std::filesystem::path &captureDir, bool frozen
+) {
+    code::DeadlineCapture capture {uuid, false, "", frozen, 0, 0, 0};
+    std::filesystem::path workspace {code::getWorkspacePath(uuid)};
+    std::filesystem::path target {captureDir / workspace.filename()};
+    std::error_code err;
+    if (!std::filesystem::is_directory(workspace, err)) {
+        capture.error = "No workspace";
+        return capture;
+    }
+    std::filesystem::create_directory(target, workspace, err);
+    if (err) {
+        capture.error = err.message();
+        return capture;
+    }
+    std::filesystem::recursive_directory_iterator it {workspace, err};
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        const std::filesystem::path &src {it->path()};
+        std::filesystem::path dst {target / src.lexically_relative(workspace)};
+        std::error_code entryErr;
+        if (it->is_symlink(entryErr)) {
+            std::filesystem::copy_symlink(src, dst, entryErr);
+        } else if (it->is_directory(entryErr)) {
+            std::filesystem::create_directory(dst, src, entryErr);
+        } else if (it->is_regular_file(entryErr)) {
+            if (captureFile(src, dst, capture)) {
+                ++capture.files;
+            } else {
+                entryErr = {errno, std::generic_category()};
+            }
+        }
+        if (entryErr && capture.error.empty()) {
+            capture.error = src.lexically_relative(workspace).string() + ": " + entryErr.message();
+        }
+    }
+    if (err && capture.error.empty()) {
+        capture.error = err.message();
+    }
+    capture.succeeded = capture.error.empty();
+    return capture;
+}
+
+bool code::captureDeadline(
+    std::vector<uuids::uuid> students, bool stop, std::function<void()> onProgress
+) {
+    if (capturing.exchange(true)) {
+        notif::notify("A deadline is already being captured.");
+        return false;
+    }
+    std::string id {makeTimestampId()};
+    std::filesystem::path captureDir {constants::DEADLINES_DIR / id};
+    std::error_code err;
+    std::filesystem::create_directories(constants::DEADLINES_DIR, err);
+    if (err || !std::filesystem::create_directory(captureDir, err)) {
+        if (err) {
+            log::logErrorCodeWarning(err);
+        }
+        notif::notify(
+            "Failed to create `" + captureDir.string() + "`. See the log file for more details."
+        );
+        capturing = false;
+        return false;
+    }
+    
+    Clock::time_point started {Clock::now()};
+    // Held first, so that no connection can wake an instance once it's frozen, 
+    // or start one for a student who had none running.
+    code::holdThaws(true);
+    code::holdStarts(students);
+    std::vector<FrozenInstance> frozen {freezeInstances(students)};
+    Clock::time_point frozenAt {Clock::now()};
+    
+    std::unordered_set<uuids::uuid> frozenUUIDs {};
+    for (const FrozenInstance &instance : frozen) {
+        frozenUUIDs.insert(instance.uuid);
+    }
+    std::vector<DeadlineCapture> results(students.size());
+    forEachParallel(students.size(), constants::DEADLINE_MAX_WORKERS, [&] (std::size_t idx) {
+        const uuids::uuid &uuid {students.at(idx)};
+        results.at(idx) = captureWorkspace(uuid, captureDir, frozenUUIDs.count(uuid) > 0);
+    });
+    Clock::time_point capturedAt {Clock::now()};
+    
+    code::holdStarts({});
+    code::holdThaws(false);
+    if (!stop) {
+        for (const FrozenInstance &instance : frozen) {
+            if (instance.thaw) {
+                code::thawInstance(instance.uuid);
+            }
+        }
+    }
+    Clock::time_point releasedAt {Clock::now()};
+    if (stop) {
+        // Stopping continues the instances first, so they're released as it starts.
+        forEachParallel(students.size(), constants::DEADLINE_MAX_STOPPERS, [&] (std::size_t idx) {
+            if (code::instanceActive(students.at(idx))) {
+                code::stopInstance(students.at(idx));
+            }
+        });
+    }
+    
+    DeadlineReport deadlineReport {
+        id, 
+        static_cast<int>(students.size()), 
+        static_cast<int>(frozen.size()), 
+        static_cast<int>(std::count_if(results.begin(), results.end(), [] (const auto &result) {
+            return !result.succeeded;
+        })), 
+        stop, 
+        elapsed(started, frozenAt), 
+        elapsed(frozenAt, capturedAt), 
+        elapsed(started, releasedAt), 
+        false
+    };
+    LOG_F(
+        INFO, 
+        "Deadline %s: froze %d instance(s) in %lld ms and captured %d workspace(s) "
+        "in %lld ms (%d failed). Instances were frozen for %lld ms.", 
+        id.c_str(), deadlineReport.frozen, 
+        static_cast<long long>(deadlineReport.freezeTime.count()), 
+        deadlineReport.students, static_cast<long long>(deadlineReport.captureTime.count()), 
+        deadlineReport.failed, static_cast<long long>(deadlineReport.freezeWindow.count())
+    );
+    // The capture doesn't change anymore, so it's archived at leisure.
+    deadlineReport.archiving = code::collectSubmissions(
+        constants::DEADLINES_DIR / (id + ".tar.gz"), students, std::move(onProgress), captureDir
+    );
+    {
+        std::lock_guard<std::mutex> lock {reportMutex};
+        report = deadlineReport;
+        captures = std::move(results);
+    }
+    capturing = false;
+    return true;
+}
+
+std::optional<code::DeadlineReport> code::getDeadlineReport() {
+    std::lock_guard<std::mutex> lock {reportMutex};
+    return report;
+}
+
+std::vector<code::DeadlineCapture> code::getDeadlineCaptures() {
+    std::lock_guard<std::mutex> lock {reportMutex};
+    return captures;
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef INSTRUCT_DEADLINE_HPP
+#define INSTRUCT_DEADLINE_HPP
+
+#include <functional>
+#include <optional>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct DeadlineCapture {
+        uuids::uuid uuid;
+        bool succeeded;
+        // The first error for the student, if any.
+        std::string error;
+        // Instances not running had nothing to freeze, and those on an agent 
+        // can't be frozen from here.
+        bool frozen;
+        int files;
+        // Files sharing the workspace's extents, and copied.
+        int cloned;
+        int copied;
+    };
+    
+    struct DeadlineReport {
+        // Names the capture's directory and its archive.
+        std::string id;
+        int students;
+        int frozen;
+        int failed;
+        bool stopped;
+        // Until every instance was frozen, then until every workspace was captured. 
+        // The window runs from the first freeze until the instances were released.
+        std::chrono::milliseconds freezeTime;
+        std::chrono::milliseconds captureTime;
+        std::chrono::milliseconds freezeWindow;
+        bool archiving;
+    };
+    
+    // Freezes the given students' instances all at once, captures their workspaces 
+    // under `DEADLINES_DIR/<id>` in parallel, then thaws the instances, or stops 
+    // them if asked to, and archives the capture in the background. Returns once 
+    // the instances are released. The callback is passed on to the collection.
+    bool captureDeadline(std::vector<uuids::uuid>, bool, std::function<void()>);
+    
+    std::optional<DeadlineReport> getDeadlineReport();
+    // One per student of the last capture.
+    std::vector<DeadlineCapture> getDeadlineCaptures();
+}
+
+#endif
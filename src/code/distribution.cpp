@@ -0,0 +1,556 @@
+#include <unordered_map>
+#include <algorithm>
+#include <exception>
+#include <optional>
+#include <fstream>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <mutex>
+
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "yaml-cpp/yaml.h"
+#include "picosha2.h"
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "distribution.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "fileops.hpp"
+
+namespace instruct {
+
+namespace {
+    // Kept with the instance's data rather than in the workspace, out of the student's way.
+    const std::filesystem::path RECORD_FILE {"distributed.yaml"};
+    
+    struct BlockSignature {
+        std::uint32_t weak;
+        std::uint32_t length;
+        // Only filled in where the weak checksum leaves a match possible.
+        std::array<unsigned char, 32> strong;
+        
+        bool operator==(const BlockSignature &rhs) const {
+            return weak == rhs.weak && length == rhs.length && strong == rhs.strong;
+        }
+    };
+    
+    struct SourceFile {
+        std::filesystem::path path;
+        // Where it goes under the destination.
+        std::filesystem::path relative;
+        std::uint64_t size;
+        mode_t mode;
+        std::string hash;
+        // Only for updates.
+        std::vector<BlockSignature> blocks;
+    };
+    
+    // What every student gets, scanned and hashed once up front.
+    struct Manifest {
+        std::filesystem::path destination;
+        std::vector<std::filesystem::path> dirs;
+        std::vector<SourceFile> files;
+        bool removing;
+        bool update;
+    };
+    
+    // What was last distributed to a student, by path relative to the workspace, 
+    // which tells files the student changed apart from those not yet updated.
+    using Record = std::unordered_map<std::string, std::string>;
+    
+    code::ReflinkProbe reflinks {
+        "The filesystem doesn't support reflinks, distributed files will be copied."
+    };
+    
+    std::thread distributionThread {};
+    std::atomic_bool distributing {false};
+    std::atomic_bool cancelled {false};
+    
+    std::mutex progressMutex {};
+    code::DistributionProgress progress {};
+    std::vector<code::DistributionResult> results {};
+}
+
+// rsync's weak checksum, which rules out most changed blocks before they're hashed.
+static std::uint32_t weakChecksum(const unsigned char *data, std::size_t length) {
+    std::uint32_t a {}, b {};
+    for (std::size_t idx {}; idx < length; ++idx) {
+        a += data[idx];
+        b += static_cast<std::uint32_t>(length - idx) * data[idx];
+    }
+    return (a & 0xffff) | (b << 16);
+}
+
+// Hashes the whole file and, if asked to, each of its blocks in the same pass. 
+// Blocks that differ from the reference's in weak checksum or length aren't hashed 
+// any further. Returns an empty string if the file can't be read.
+static std::string hashFile(
+    const std::filesystem::path &path, 
+    std::vector<BlockSignature> *blocks = nullptr, 
+    const std::vector<BlockSignature> *reference = nullptr
+) {
+    static_assert(constants::DISTRIBUTION_BUFFER_SIZE % constants::DISTRIBUTION_BLOCK_SIZE == 0);
+    int fd {open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd == -1) {
+        return "";
+    }
+    std::vector<unsigned char> buffer(constants::DISTRIBUTION_BUFFER_SIZE);
+    picosha2::hash256_one_by_one hasher {};
+    hasher.init();
+    ssize_t length {};
+    while ((length = code::readFull(fd, buffer.data(), buffer.size())) > 0) {
+        hasher.process(buffer.begin(), buffer.begin() + length);
+        for (ssize_t offset {}; blocks != nullptr && offset < length; 
+            offset += constants::DISTRIBUTION_BLOCK_SIZE) {
+            const unsigned char *data {buffer.data() + offset};
+            std::uint32_t blockLength {static_cast<std::uint32_t>(std::min<std::size_t>(
+                constants::DISTRIBUTION_BLOCK_SIZE, length - offset
+            ))};
+            BlockSignature block {weakChecksum(data, blockLength), blockLength, {}};
+            std::size_t idx {blocks->size()};
+            if (reference == nullptr || (idx < reference->size() 
+                && reference->at(idx).weak == block.weak 
+                && reference->at(idx).length == block.length)) {
+                picosha2::hash256(
+                    data, data + blockLength, block.strong.begin(), block.strong.end()
+                );
+            }
+            blocks->push_back(block);
+        }
+    }
+    close(fd);
+    if (length == -1) {
+        return "";
+    }
+    hasher.finish();
+    return picosha2::get_hash_hex_string(hasher);
+}
+
+static bool targetMatches(const SourceFile &file, const std::filesystem::path &target) {
+    struct stat info {};
+    if (stat(target.c_str(), &info) != 0 || !S_ISREG(info.st_mode) 
+        || static_cast<std::uint64_t>(info.st_size) != file.size) {
+        return false;
+    }
+    return hashFile(target) == file.hash;
+}
+
+// Writes next to the target and renames it into place, so an editor never 
+// sees half a file. Sets `error` on failure.
+static bool writeFile(
+    const SourceFile &file, const std::filesystem::path &target, std::string &error
+) {
+    std::filesystem::path temp {
+        target.parent_path() / ("." + target.filename().string() + ".instruct-tmp")
+    };
+    int in {open(file.path.c_str(), O_RDONLY | O_CLOEXEC)};
+    int out {open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, file.mode)};
+    bool written {
+        in != -1 && out != -1 
+            && reflinks.cloneContents(in, out, file.size) != code::CopyResult::Failed
+    };
+    error = written ? "" : std::strerror(errno);
+    if (in != -1) {
+        close(in);
+    }
+    if (out != -1 && close(out) != 0 && written) {
+        written = false;
+        error = std::strerror(errno);
+    }
+    if (written && rename(temp.c_str(), target.c_str()) != 0) {
+        written = false;
+        error = std::strerror(errno);
+    }
+    if (!written) {
+        unlink(temp.c_str());
+    }
+    return written;
+}
+
+// Rewrites only the blocks that differ from the source, in a reflink clone of the 
+// target renamed into place like any other write. Without reflinks the clone would be 
+// a full copy, and patching in place would let an editor see a mix of both versions, 
+// so the whole file is written instead and `whole` is set. Blocks are only compared 
+// at the same offset rather than searched for. Moved data could be shared from the 
+// clone with `FICLONERANGE`, but only if it moved by a multiple of the filesystem's 
+// block size, which edits to code rarely do, and copying it from the target instead 
+// writes as much as writing it from the source.
+static bool patchFile(
+    const SourceFile &file, 
+    const std::filesystem::path &target, 
+    const std::vector<BlockSignature> &targetBlocks, 
+    std::uint64_t &bytes, 
+    bool &whole, 
+    std::string &error
+) {
+    std::filesystem::path temp {
+        target.parent_path() / ("." + target.filename().string() + ".instruct-tmp")
+    };
+    int in {open(file.path.c_str(), O_RDONLY | O_CLOEXEC)};
+    int old {open(target.c_str(), O_RDONLY | O_CLOEXEC)};
+    int out {open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, file.mode)};
+    bool cloned {old != -1 && out != -1 && ioctl(out, FICLONE, old) == 0};
+    if (old != -1) {
+        close(old);
+    }
+    whole = !cloned;
+    if (!cloned) {
+        if (in != -1) {
+            close(in);
+        }
+        if (out != -1) {
+            close(out);
+            unlink(temp.c_str());
+        }
+        bytes += file.size;
+        return writeFile(file, target, error);
+    }
+    
+    bool patched {in != -1 && out != -1};
+    std::vector<unsigned char> buffer(constants::DISTRIBUTION_BLOCK_SIZE);
+    for (std::size_t idx {}; patched && idx < file.blocks.size(); ++idx) {
+        if (idx < targetBlocks.size() && targetBlocks.at(idx) == file.blocks.at(idx)) {
+            continue;
+        }
+        ssize_t length {file.blocks.at(idx).length};
+        off_t offset {static_cast<off_t>(idx * constants::DISTRIBUTION_BLOCK_SIZE)};
+        patched = pread(in, buffer.data(), length, offset) == length 
+            && pwrite(out, buffer.data(), length, offset) == length;
+        bytes += length;
+    }
+    patched = patched && ftruncate(out, static_cast<off_t>(file.size)) == 0;
+    error = patched ? "" : std::strerror(errno);
+    if (in != -1) {
+        close(in);
+    }
+    if (out != -1 && close(out) != 0 && patched) {
+        patched = false;
+        error = std::strerror(errno);
+    }
+    if (patched && rename(temp.c_str(), target.c_str()) != 0) {
+        patched = false;
+        error = std::strerror(errno);
+    }
+    if (!patched) {
+        unlink(temp.c_str());
+    }
+    return patched;
+}
+
+static Record loadRecord(const uuids::uuid &uuid) {
+    Record record {};
+    std::filesystem::path path {code::getInstanceDataPath(uuid) / RECORD_FILE};
+    std::error_code err;
+    if (!std::filesystem::exists(path, err)) {
+        return record;
+    }
+    try {
+        for (const auto &entry : YAML::LoadFile(path)) {
+            record.emplace(entry.first.as<std::string>(), entry.second.as<std::string>());
+        }
+    } catch (const std::exception &e) {
+        log::logExceptionWarning(e);
+    }
+    return record;
+}
+
+static void saveRecord(const uuids::uuid &uuid, const Record &record) {
+    YAML::Node root {YAML::NodeType::Map};
+    for (const auto &[path, hash] : record) {
+        root[path] = hash;
+    }
+    std::filesystem::path path {code::getInstanceDataPath(uuid) / RECORD_FILE};
+    std::filesystem::path tmpPath {path};
+    tmpPath += ".tmp";
+    std::error_code err;
+    std::filesystem::create_directories(path.parent_path(), err);
+    {
+        std::ofstream fout {tmpPath};
+        if (!fout) {
+            LOG_F(WARNING, "Failed to write %s.", tmpPath.c_str());
+            return;
+        }
+        fout << root;
+    }
+    std::filesystem::rename(tmpPath, path, err);
+    if (err) {
+        log::logErrorCodeWarning(err);
+    }
+}
+
+static code::DistributionResult distributeTo(const Manifest &manifest, const uuids::uuid &uuid) {
+    code::DistributionResult result {uuid, true, "", {}};
+    std::filesystem::path root {code::getWorkspacePath(uuid) / manifest.destination};
+    Record record {loadRecord(uuid)};
+    std::error_code err;
+    if (manifest.removing) {
+        std::filesystem::remove_all(root, err);
+        std::string removed {manifest.destination.lexically_normal().generic_string()};
+        for (auto it {record.begin()}; it != record.end();) {
+            bool within {it->first.rfind(removed, 0) == 0 
+                && (it->first.size() == removed.size() || it->first.at(removed.size()) == '/')};
+            it = within ? record.erase(it) : std::next(it);
+        }
+    } else {
+        std::filesystem::create_directories(root, err);
+        for (const std::filesystem::path &dir : manifest.dirs) {
+            std::filesystem::create_directories(root / dir, err);
+        }
+    }
+    if (err) {
+        return {uuid, false, err.message(), {}};
+    }
+    
+    int copied {}, patched {}, skipped {};
+    std::uint64_t bytes {};
+    for (const SourceFile &file : manifest.files) {
+        std::filesystem::path target {root / file.relative};
+        std::string key {
+            (manifest.destination / file.relative).lexically_normal().generic_string()
+        };
+        auto recorded {record.find(key)};
+        struct stat info {};
+        bool exists {stat(target.c_str(), &info) == 0};
+        std::vector<BlockSignature> targetBlocks {};
+        std::string targetHash {};
+        bool whole {false};
+        if (exists && manifest.update) {
+            targetHash = hashFile(target, &targetBlocks, &file.blocks);
+        }
+        
+        if (!manifest.update ? targetMatches(file, target) : targetHash == file.hash) {
+            ++skipped;
+        } else if (manifest.update && (exists || recorded != record.end()) 
+            && (recorded == record.end() || recorded->second != targetHash)) {
+            // Changed or deleted since it was distributed, or never distributed at all.
+            result.modified.push_back(manifest.destination / file.relative);
+            continue;
+        } else if (!(manifest.update && exists 
+            ? patchFile(file, target, targetBlocks, bytes, whole, result.error) 
+            : writeFile(file, target, result.error))) {
+            result.error = file.relative.string() + ": " + result.error;
+            result.succeeded = false;
+            break;
+        } else if (manifest.update && exists) {
+            ++(whole ? copied : patched);
+        } else {
+            ++copied;
+            bytes += file.size;
+        }
+        record[key] = file.hash;
+    }
+    saveRecord(uuid, record);
+    std::lock_guard<std::mutex> lock {progressMutex};
+    progress.filesCopied += copied;
+    progress.filesPatched += patched;
+    progress.filesSkipped += skipped;
+    progress.filesModified += static_cast<int>(result.modified.size());
+    progress.bytesCopied += bytes;
+    return result;
+}
+
+// Paths given by the instructor must stay inside the workspace.
+static bool withinWorkspace(const std::filesystem::path &path) {
+    return !path.is_absolute() && std::none_of(
+        path.begin(), path.end(), [] (const std::filesystem::path &part) {
+            return part == "..";
+        }
+    );
+}
+
+static std::optional<Manifest> scanSource(
+    const std::filesystem::path &source, const std::filesystem::path &destination, bool update
+) {
+    Manifest manifest {destination, {}, {}, false, update};
+    std::filesystem::path base {std::filesystem::absolute(source).lexically_normal()};
+    if (!base.has_filename()) {
+        base = base.parent_path();
+    }
+    auto addFile {[&] (const std::filesystem::path &path, const std::filesystem::path &rel) {
+        struct stat info {};
+        std::vector<BlockSignature> blocks {};
+        // Signed once here and compared against every student's copy.
+        std::string hash {hashFile(path, update ? &blocks : nullptr)};
+        if (stat(path.c_str(), &info) != 0 || hash.empty()) {
+            LOG_F(WARNING, "Failed to read %s.", path.c_str());
+            return false;
+        }
+        manifest.files.push_back({
+            path, 
+            rel, 
+            static_cast<std::uint64_t>(info.st_size), 
+            info.st_mode & 07777, 
+            hash, 
+            std::move(blocks)
+        });
+        return true;
+    }};
+    
+    std::error_code err;
+    if (std::filesystem::is_regular_file(base, err)) {
+        return addFile(base, base.filename()) ? std::optional {manifest} : std::nullopt;
+    }
+    if (!std::filesystem::is_directory(base, err)) {
+        return std::nullopt;
+    }
+    // The directory itself is copied into the destination, not just its contents.
+    manifest.dirs.push_back(base.filename());
+    std::filesystem::recursive_directory_iterator it {base, err};
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        std::filesystem::path rel {base.filename() / it->path().lexically_relative(base)};
+        if (it->is_symlink(err)) {
+            LOG_F(INFO, "Skipping symbolic link %s.", it->path().c_str());
+        } else if (it->is_directory(err)) {
+            manifest.dirs.push_back(rel);
+        } else if (it->is_regular_file(err) && !addFile(it->path(), rel)) {
+            return std::nullopt;
+        }
+    }
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return std::nullopt;
+    }
+    return manifest;
+}
+
+static void runDistribution(
+    Manifest manifest, std::vector<uuids::uuid> students, std::function<void()> onProgress
+) {
+    code::unpinThread();
+    auto distribute {[&] (std::size_t idx) {
+        if (cancelled) {
+            return;
+        }
+        code::DistributionResult result {distributeTo(manifest, students.at(idx))};
+        if (!result.succeeded) {
+            LOG_F(
+                WARNING, "Failed to update the workspace of %s: %s", 
+                uuids::to_string(result.uuid).c_str(), result.error.c_str()
+            );
+        }
+        {
+            std::lock_guard<std::mutex> lock {progressMutex};
+            ++progress.done;
+            progress.failed += !result.succeeded;
+            results.push_back(std::move(result));
+        }
+        if (onProgress) {
+            onProgress();
+        }
+    }};
+    code::forEachParallel(students.size(), constants::DISTRIBUTION_MAX_WORKERS, distribute);
+    
+    code::DistributionProgress finalProgress {};
+    {
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress.active = false;
+        finalProgress = progress;
+    }
+    LOG_F(
+        INFO, 
+        "Distribution finished: %d/%d workspace(s), %d file(s) copied, %d patched, " 
+        "%d skipped, %d modified by students.", 
+        finalProgress.done - finalProgress.failed, finalProgress.total, 
+        finalProgress.filesCopied, finalProgress.filesPatched, 
+        finalProgress.filesSkipped, finalProgress.filesModified
+    );
+    if (finalProgress.failed > 0) {
+        notif::notify(
+            std::to_string(finalProgress.failed) + " workspace(s) could not be updated. "
+            "See the log file for more details."
+        );
+    }
+    distributing = false;
+    if (onProgress) {
+        onProgress();
+    }
+}
+
+static bool startDistribution(
+    Manifest manifest, std::vector<uuids::uuid> students, std::function<void()> onProgress
+) {
+    if (distributing) {
+        notif::notify("Workspaces are already being updated.");
+        return false;
+    }
+    code::cancelDistribution();
+    {
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress = {};
+        progress.total = static_cast<int>(students.size());
+        progress.active = true;
+        results.clear();
+    }
+    cancelled = false;
+    distributing = true;
+    distributionThread = std::thread {
+        runDistribution, std::move(manifest), std::move(students), std::move(onProgress)
+    };
+    DLOG_F(INFO, "Distribution thread started.");
+    return true;
+}
+
+bool code::distributeFiles(
+    const std::filesystem::path &source, 
+    const std::filesystem::path &destination, 
+    std::vector<uuids::uuid> students, 
+    std::function<void()> onProgress, 
+    bool update
+) {
+    if (!withinWorkspace(destination)) {
+        notif::notify("The destination must be a relative path inside the workspace.");
+        return false;
+    }
+    std::optional<Manifest> manifest {scanSource(source, destination, update)};
+    if (!manifest) {
+        notif::notify("Failed to read `" + source.string() + "`.");
+        return false;
+    }
+    return startDistribution(std::move(*manifest), std::move(students), std::move(onProgress));
+}
+
+bool code::removeDistributedFiles(
+    const std::filesystem::path &path, 
+    std::vector<uuids::uuid> students, 
+    std::function<void()> onProgress
+) {
+    // An empty path would remove the whole workspace.
+    if (!withinWorkspace(path) || path.lexically_normal().relative_path().empty() 
+        || path.lexically_normal() == ".") {
+        notif::notify("The path must name a file or directory inside the workspace.");
+        return false;
+    }
+    return startDistribution(
+        {path, {}, {}, true, false}, std::move(students), std::move(onProgress)
+    );
+}
+
+void code::cancelDistribution() {
+    cancelled = true;
+    if (distributionThread.joinable()) {
+        distributionThread.join();
+        DLOG_F(INFO, "Distribution thread joined.");
+    }
+}
+
+code::DistributionProgress code::getDistributionProgress() {
+    std::lock_guard<std::mutex> lock {progressMutex};
+    return progress;
+}
+
+std::vector<code::DistributionResult> code::getDistributionResults() {
+    std::lock_guard<std::mutex> lock {progressMutex};
+    return results;
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef INSTRUCT_DISTRIBUTION_HPP
+#define INSTRUCT_DISTRIBUTION_HPP
+
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct DistributionProgress {
+        int total;
+        int done;
+        int failed;
+        // Files written whole, those patched in a clone of the previous version 
+        // and those left alone because their content already matched.
+        int filesCopied;
+        int filesPatched;
+        int filesSkipped;
+        // Files a student changed since they were distributed, which an update keeps.
+        int filesModified;
+        std::uint64_t bytesCopied;
+        bool active;
+    };
+    
+    struct DistributionResult {
+        uuids::uuid uuid;
+        bool succeeded;
+        // The first error for the student, if any.
+        std::string error;
+        // Relative to the workspace.
+        std::vector<std::filesystem::path> modified;
+    };
+    
+    // Copies a file or directory into the given directory relative to each student's 
+    // workspace on a bounded pool of background threads. Every file is written 
+    // to a temporary name and renamed into place, and files whose content already 
+    // matches are skipped. The callback is invoked from the pool as students finish. 
+    // As an update, files still as they were last distributed only have their changed 
+    // blocks rewritten, and files the student changed or deleted are left alone.
+    bool distributeFiles(
+        const std::filesystem::path &, 
+        const std::filesystem::path &, 
+        std::vector<uuids::uuid>, 
+        std::function<void()>, 
+        bool
+    );
+    // Removes the given path relative to each student's workspace in the same way.
+    bool removeDistributedFiles(
+        const std::filesystem::path &, std::vector<uuids::uuid>, std::function<void()>
+    );
+    // Lets the students already underway finish and joins the pool.
+    void cancelDistribution();
+    
+    DistributionProgress getDistributionProgress();
+    // One per student finished so far, in the order they finished.
+    std::vector<DistributionResult> getDistributionResults();
+}
+
+#endif
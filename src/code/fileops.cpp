@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+#include <vector>
+#include <ctime>
+
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "fileops.hpp"
+
+namespace instruct {
+
+code::ReflinkProbe::ReflinkProbe(std::string warning) : warning {std::move(warning)} {
+}
+
+code::CopyResult code::ReflinkProbe::cloneContents(int in, int out, std::uint64_t size) {
+    if (!unsupported && ioctl(out, FICLONE, in) == 0) {
+        return CopyResult::Cloned;
+    }
+    if (!unsupported && (errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV 
+        || errno == EINVAL) && !unsupported.exchange(true)) {
+        LOG_F(WARNING, "%s", warning.c_str());
+    }
+    return copyContents(in, out, size) ? CopyResult::Copied : CopyResult::Failed;
+}
+
+code::CopyResult code::ReflinkProbe::cloneFile(
+    const std::filesystem::path &src, const std::filesystem::path &dst, struct stat *info
+) {
+    int in {open(src.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)};
+    if (in == -1) {
+        return CopyResult::Failed;
+    }
+    struct stat status {};
+    int out {
+        fstat(in, &status) == 0 
+            ? open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, status.st_mode & 07777) 
+            : -1
+    };
+    if (out == -1) {
+        int openErr {errno};
+        close(in);
+        errno = openErr;
+        return CopyResult::Failed;
+    }
+    CopyResult result {cloneContents(in, out, status.st_size)};
+    int copyErr {errno};
+    close(out);
+    close(in);
+    if (result == CopyResult::Failed) {
+        unlink(dst.c_str());
+    }
+    if (info != nullptr) {
+        *info = status;
+    }
+    errno = copyErr;
+    return result;
+}
+
+bool code::copyContents(int in, int out, std::uint64_t size) {
+    std::uint64_t copied {};
+    while (copied < size) {
+        ssize_t length {copy_file_range(in, nullptr, out, nullptr, size - copied, 0)};
+        if (length <= 0) {
+            break;
+        }
+        copied += length;
+    }
+    if (copied == size) {
+        return true;
+    }
+    // Both offsets were advanced past what was copied.
+    std::vector<char> buffer(constants::COPY_BUFFER_SIZE);
+    ssize_t length {};
+    while ((length = read(in, buffer.data(), buffer.size())) > 0) {
+        for (ssize_t written {}; written < length;) {
+            ssize_t chunk {write(out, buffer.data() + written, length - written)};
+            if (chunk == -1) {
+                return false;
+            }
+            written += chunk;
+        }
+    }
+    return length == 0;
+}
+
+ssize_t code::readFull(int fd, unsigned char *buffer, std::size_t size) {
+    std::size_t filled {};
+    while (filled < size) {
+        ssize_t length {read(fd, buffer + filled, size - filled)};
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            return -1;
+        }
+        if (length == 0) {
+            break;
+        }
+        filled += length;
+    }
+    return static_cast<ssize_t>(filled);
+}
+
+void code::forEachParallel(
+    std::size_t count, std::size_t maxThreads, const std::function<void(std::size_t)> &fn
+) {
+    std::atomic_size_t next {0};
+    std::size_t threadCount {std::min(maxThreads, count)};
+    std::vector<std::thread> workers {};
+    for (std::size_t idx {}; idx < threadCount; ++idx) {
+        workers.emplace_back([&] {
+            unpinThread();
+            for (std::size_t job {next++}; job < count; job = next++) {
+                fn(job);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+std::string code::workspaceLabel(const uuids::uuid &uuid) {
+    return getWorkspacePath(uuid).filename().string();
+}
+
+std::string code::makeTimestampId() {
+    std::time_t now {std::time(nullptr)};
+    std::tm local {};
+    localtime_r(&now, &local);
+    char buffer[32];
+    std::strftime(buffer, sizeof buffer, "%Y%m%d-%H%M%S", &local);
+    return buffer;
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef INSTRUCT_FILEOPS_HPP
+#define INSTRUCT_FILEOPS_HPP
+
+#include <filesystem>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <atomic>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    enum class CopyResult {
+        Cloned, Copied, Failed
+    };
+    
+    // Clones the files of one kind of job with reflinks, which share extents until 
+    // either side is written. Once the filesystem refuses one, the job's remaining 
+    // files are copied without trying.
+    class ReflinkProbe {
+        std::atomic_bool unsupported {false};
+        // Logged once, when the first reflink is refused.
+        std::string warning;
+        
+        public:
+        
+        explicit ReflinkProbe(std::string);
+        
+        CopyResult cloneContents(int in, int out, std::uint64_t size);
+        // Creates the destination, which mustn't exist yet, with the source's permissions 
+        // and fills `info` with the source's status if given. Nothing is left behind 
+        // on failure, and `errno` says why.
+        CopyResult cloneFile(
+            const std::filesystem::path &src, 
+            const std::filesystem::path &dst, 
+            struct stat *info = nullptr
+        );
+    };
+    
+    // Lets the kernel copy without a round trip through user space, and only 
+    // then reads and writes, i.e. across filesystems on older kernels.
+    bool copyContents(int in, int out, std::uint64_t size);
+    // Reads until the buffer is full or the file ends. Returns -1 on error.
+    ssize_t readFull(int fd, unsigned char *buffer, std::size_t size);
+    
+    // Runs the function for every index on up to the given number of threads, each 
+    // unpinned first. The caller only waits, since it may be pinned to the reserved core. 
+    // Jobs over workspaces keep to a few threads, since the workspaces share a disk.
+    void forEachParallel(
+        std::size_t count, std::size_t maxThreads, const std::function<void(std::size_t)> &
+    );
+    
+    // The name of the workspace's directory, which labels it in logs and on disk.
+    std::string workspaceLabel(const uuids::uuid &);
+    // The local time, sortable and readable, i.e. `20250102-150405`.
+    std::string makeTimestampId();
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <csignal>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <cmath>
+#include <mutex>
+
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "harness.hpp"
+#include "process.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    // A running command as the loop sees it. Its group is only signalled while 
+    // it's registered, and the leader is only reaped once it isn't, so the 
+    // group can't have been reused by the time it's killed.
+    struct Watched {
+        pid_t group;
+        int pidfd;
+        int timerFd;
+        bool timedOut;
+    };
+    
+    std::thread harnessThread {};
+    std::atomic_bool harnessRunning {false};
+    int epollFd {-1};
+    int wakeFd {-1};
+    
+    std::mutex watchedMutex {};
+    // By id, which is never reused, so events for commands gone since are dropped.
+    std::unordered_map<std::uint64_t, Watched> watched {};
+    std::uint64_t nextId {1};
+    bool cancelled {false};
+}
+
+// The low bit of an event's data tells the timer from the pidfd.
+static std::uint64_t makeToken(std::uint64_t id, bool timer) {
+    return id << 1 | (timer ? 1 : 0);
+}
+
+static std::chrono::microseconds toMicroseconds(const timeval &time) {
+    return std::chrono::seconds {time.tv_sec} + std::chrono::microseconds {time.tv_usec};
+}
+
+static void handleEvent(std::uint64_t token) {
+    std::lock_guard<std::mutex> lock {watchedMutex};
+    auto it {watched.find(token >> 1)};
+    if (it == watched.end()) {
+        return;
+    }
+    Watched &command {it->second};
+    if (token & 1) {
+        command.timedOut = true;
+        kill(-command.group, SIGKILL);
+        return;
+    }
+    // The leader exited, but what it forked may still hold the pipes open.
+    kill(-command.group, SIGKILL);
+    // A pidfd stays readable, so it's dropped to not wake the loop again.
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, command.pidfd, nullptr);
+}
+
+static void runHarness() {
+    std::vector<epoll_event> events(constants::TEST_MAX_EVENTS);
+    while (harnessRunning) {
+        int count {epoll_wait(epollFd, events.data(), events.size(), -1)};
+        if (count == -1 && errno != EINTR) {
+            LOG_F(ERROR, "epoll_wait() failed: %s", std::strerror(errno));
+            break;
+        }
+        for (int idx {}; idx < count; ++idx) {
+            // The wake eventfd has a token of 0, which no command has.
+            if (events.at(idx).data.u64 != 0) {
+                handleEvent(events.at(idx).data.u64);
+            }
+        }
+    }
+}
+
+static std::uint64_t watchCommand(pid_t group, double seconds) {
+    std::lock_guard<std::mutex> lock {watchedMutex};
+    std::uint64_t id {nextId++};
+    Watched command {group, -1, -1, false};
+    // Cancelling may have gone through the commands just before this one joined.
+    if (cancelled) {
+        kill(-group, SIGKILL);
+    }
+    if (epollFd != -1) {
+        command.pidfd = code::openPidfd(group);
+        if (command.pidfd != -1) {
+            epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.u64 = makeToken(id, false);
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, command.pidfd, &event);
+        }
+        if (seconds > 0) {
+            command.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        }
+        if (command.timerFd != -1) {
+            itimerspec spec {};
+            spec.it_value.tv_sec = static_cast<time_t>(seconds);
+            spec.it_value.tv_nsec = static_cast<long>((seconds - spec.it_value.tv_sec) * 1e9);
+            // A zero value would disarm it instead.
+            spec.it_value.tv_nsec = std::max(1L, spec.it_value.tv_nsec);
+            timerfd_settime(command.timerFd, 0, &spec, nullptr);
+            epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.u64 = makeToken(id, true);
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, command.timerFd, &event);
+        }
+    }
+    watched.emplace(id, command);
+    return id;
+}
+
+// Returns whether the command was killed for running out of time.
+static bool unwatchCommand(std::uint64_t id) {
+    std::lock_guard<std::mutex> lock {watchedMutex};
+    Watched command {watched.at(id)};
+    watched.erase(id);
+    for (int fd : {command.pidfd, command.timerFd}) {
+        if (fd != -1) {
+            if (epollFd != -1) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            close(fd);
+        }
+    }
+    return command.timedOut;
+}
+
+// Returns false once the pipe is closed or broken.
+static bool readInto(int fd, std::vector<char> &buffer, std::size_t &length) {
+    ssize_t count {read(fd, buffer.data(), buffer.size())};
+    length = count > 0 ? static_cast<std::size_t>(count) : 0;
+    return count > 0 || (count == -1 && errno == EINTR);
+}
+
+bool code::startHarness() {
+    if (harnessRunning) {
+        return true;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || wakeFd == -1) {
+        LOG_F(ERROR, "Failed to create the test harness' event loop: %s", std::strerror(errno));
+        for (int *fd : {&epollFd, &wakeFd}) {
+            if (*fd != -1) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        return false;
+    }
+    epoll_event wakeEvent {};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.u64 = 0;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent);
+    {
+        std::lock_guard<std::mutex> lock {watchedMutex};
+        cancelled = false;
+    }
+    harnessRunning = true;
+    harnessThread = std::thread {runHarness};
+    DLOG_F(INFO, "Test harness started.");
+    return true;
+}
+
+void code::stopHarness() {
+    if (!harnessRunning) {
+        return;
+    }
+    harnessRunning = false;
+    std::uint64_t one {1};
+    if (write(wakeFd, &one, sizeof(one)) == -1) {
+        LOG_F(WARNING, "Failed to wake the test harness.");
+    }
+    harnessThread.join();
+    std::lock_guard<std::mutex> lock {watchedMutex};
+    close(wakeFd);
+    close(epollFd);
+    wakeFd = epollFd = -1;
+    DLOG_F(INFO, "Test harness stopped.");
+}
+
+code::CommandOutput code::runCommand(
+    const CommandSpec &spec, const OutputSink &onOut, const OutputSink &onErr
+) {
+    CommandOutput output {false, {{}, {}, {}, 0, -1, 0, false, false}, false};
+    // Everything the child touches is prepared before forking, since only 
+    // async-signal-safe calls are allowed between `fork` and `exec`.
+    std::vector<std::string> argStrs {"sh", "-c", spec.command};
+    std::vector<char *> argv {};
+    for (std::string &arg : argStrs) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    std::vector<std::string> envStrs {spec.env};
+    std::vector<char *> envp {};
+    for (std::string &var : envStrs) {
+        envp.push_back(var.data());
+    }
+    envp.push_back(nullptr);
+    double seconds {spec.timeLimit.count()};
+    // Past the soft limit the kernel sends `SIGXCPU`, and past the hard one `SIGKILL` 
+    // for commands that ignore it.
+    rlimit cpuLimit {RLIM_INFINITY, RLIM_INFINITY};
+    if (seconds > 0) {
+        cpuLimit.rlim_cur = static_cast<rlim_t>(std::ceil(seconds));
+        cpuLimit.rlim_max = cpuLimit.rlim_cur + 1;
+    }
+    
+    int outPipe[2] {-1, -1};
+    int errPipe[2] {-1, -1};
+    if (pipe2(outPipe, O_CLOEXEC) == -1 || pipe2(errPipe, O_CLOEXEC) == -1) {
+        for (int fd : {outPipe[0], outPipe[1], errPipe[0], errPipe[1]}) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        return output;
+    }
+    int devNull {open("/dev/null", O_RDONLY | O_CLOEXEC)};
+    
+    Clock::time_point started {Clock::now()};
+    pid_t pid {fork()};
+    if (pid == 0) {
+        // Child.
+        setpgid(0, 0);
+        signal(SIGPIPE, SIG_DFL);
+        sigset_t unblocked;
+        sigemptyset(&unblocked);
+        sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+        if (seconds > 0) {
+            setrlimit(RLIMIT_CPU, &cpuLimit);
+        }
+        // Students' code shouldn't compete with the UI on instruct's core.
+        code::unpinThread();
+        if (devNull != -1) {
+            dup2(devNull, STDIN_FILENO);
+        }
+        dup2(outPipe[1], STDOUT_FILENO);
+        dup2(errPipe[1], STDERR_FILENO);
+        if (chdir(spec.dir.c_str()) == -1) {
+            _exit(127);
+        }
+        execve("/bin/sh", argv.data(), envp.data());
+        _exit(127);
+    }
+    
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (devNull != -1) {
+        close(devNull);
+    }
+    if (pid == -1) {
+        LOG_F(ERROR, "fork() failed: %s", std::strerror(errno));
+        close(outPipe[0]);
+        close(errPipe[0]);
+        return output;
+    }
+    // Also set it from the parent to avoid racing the child.
+    setpgid(pid, pid);
+    output.started = true;
+    std::uint64_t id {watchCommand(pid, seconds)};
+    
+    // The only buffer, so a command's output takes the same memory however much it writes.
+    std::vector<char> buffer(constants::TEST_READ_BUFFER_SIZE);
+    const OutputSink *sinks[2] {&onOut, &onErr};
+    pollfd fds[2] {{outPipe[0], POLLIN, 0}, {errPipe[0], POLLIN, 0}};
+    while (fds[0].fd != -1 || fds[1].fd != -1) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int idx {}; idx < 2; ++idx) {
+            if (fds[idx].fd == -1 || fds[idx].revents == 0) {
+                continue;
+            }
+            std::size_t length {};
+            if (!readInto(fds[idx].fd, buffer, length)) {
+                close(fds[idx].fd);
+                fds[idx].fd = -1;
+                continue;
+            }
+            // The rest is drained without being looked at, so the group isn't left 
+            // blocked on a full pipe in the time it takes to die.
+            if (length > 0 && !output.stopped && !(*sinks[idx])(buffer.data(), length)) {
+                output.stopped = true;
+                kill(-pid, SIGKILL);
+            }
+        }
+    }
+    for (const pollfd &fd : fds) {
+        if (fd.fd != -1) {
+            close(fd.fd);
+        }
+    }
+    
+    int status {};
+    rusage usage {};
+    // Waited on without reaping first, so the group is still ours to kill. This 
+    // covers kernels without pidfds, as long as nothing left holds the pipes.
+    siginfo_t info {};
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == -1 && errno == EINTR) {}
+    kill(-pid, SIGKILL);
+    output.usage.timedOut = unwatchCommand(id);
+    while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR) {}
+    
+    CommandUsage &result {output.usage};
+    result.wallTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - started
+    );
+    result.userTime = toMicroseconds(usage.ru_utime);
+    result.systemTime = toMicroseconds(usage.ru_stime);
+    // In kilobytes on Linux.
+    result.peakRssBytes = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+    if (WIFEXITED(status)) {
+        result.exitCode = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        result.signal = WTERMSIG(status);
+    }
+    result.cpuExceeded = !result.timedOut && seconds > 0 && (result.signal == SIGXCPU 
+        || (result.signal == SIGKILL && result.userTime + result.systemTime
+            >= std::chrono::duration<double>(std::ceil(seconds))));
+    return output;
+}
+
+void code::cancelCommands() {
+    std::lock_guard<std::mutex> lock {watchedMutex};
+    cancelled = true;
+    for (const auto &[id, command] : watched) {
+        kill(-command.group, SIGKILL);
+    }
+}
+
+std::string code::describeExit(const CommandUsage &usage, const CommandSpec &spec) {
+    std::ostringstream description {};
+    if (usage.timedOut) {
+        description << "Timed out after " << spec.timeLimit.count() << " s";
+    } else if (usage.cpuExceeded) {
+        description << "Used more than " << std::ceil(spec.timeLimit.count())
+            << " s of CPU time";
+    } else if (usage.signal != 0) {
+        description << strsignal(usage.signal) << " (signal " << usage.signal << ")";
+    } else {
+        description << "Exited with status " << usage.exitCode;
+    }
+    return description.str();
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef INSTRUCT_HARNESS_HPP
+#define INSTRUCT_HARNESS_HPP
+
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace instruct::code {
+    struct CommandSpec {
+        std::string command;
+        std::filesystem::path dir;
+        // The whole environment, as `NAME=value`.
+        std::vector<std::string> env;
+        // Zero for no limit. Wall time is also what CPU time is limited to.
+        std::chrono::duration<double> timeLimit;
+    };
+    
+    // As reported by `wait4`, i.e. covering the command's waited-for descendants.
+    struct CommandUsage {
+        std::chrono::microseconds wallTime;
+        std::chrono::microseconds userTime;
+        std::chrono::microseconds systemTime;
+        std::uint64_t peakRssBytes;
+        // -1 if the command didn't exit normally.
+        int exitCode;
+        // 0 unless the command was killed by a signal.
+        int signal;
+        bool timedOut;
+        bool cpuExceeded;
+    };
+    
+    struct CommandOutput {
+        bool started;
+        CommandUsage usage;
+        // Whether a sink had it killed.
+        bool stopped;
+    };
+    
+    // Given each chunk of a stream as it's read. Returning false kills the command, 
+    // after which the rest of its output is discarded.
+    using OutputSink = std::function<bool(const char *, std::size_t)>;
+    
+    // Starts the loop that kills commands over their time limit. Until it's 
+    // started, commands run without one.
+    bool startHarness();
+    void stopHarness();
+    
+    // Runs the command under `sh -c` in a process group of its own, with nothing 
+    // on stdin, passing what it writes to stdout and stderr to the sinks until the 
+    // group is gone. The group is killed once the command exits, so nothing it 
+    // forked outlives it.
+    CommandOutput runCommand(const CommandSpec &, const OutputSink &, const OutputSink &);
+    // Kills every command running, and those started until the harness restarts.
+    void cancelCommands();
+    
+    // How the command ended, e.g. `Timed out after 2.5 s`.
+    std::string describeExit(const CommandUsage &, const CommandSpec &);
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include <unistd.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "hibernation.hpp"
+#include "supervisor.hpp"
+#include "procstat.hpp"
+#include "../data.hpp"
+
+namespace instruct {
+
+namespace {
+    std::thread monitorThread {};
+    std::atomic_bool monitoring {false};
+    std::mutex monitorMutex {};
+    std::condition_variable monitorSignal {};
+    
+    std::mutex statsMutex {};
+    code::HibernationStats stats {};
+}
+
+// Minutes until freezing and stopping, where zero disables the step.
+static std::pair<int, int> idlePolicy(const uuids::uuid &uuid) {
+    const auto &overrides {SData::studentsData->get_idleOverrides()};
+    auto it {overrides.find(uuid)};
+    if (it != overrides.end()) {
+        return it->second;
+    }
+    return {
+        SData::studentsData->get_idleFreezeMinutes(), 
+        SData::studentsData->get_idleStopMinutes()
+    };
+}
+
+static void monitorInstances() {
+    using Clock = std::chrono::steady_clock;
+    std::unordered_map<pid_t, std::uint64_t> lastTicks {};
+    std::unordered_map<uuids::uuid, std::uint64_t> frozenBytes {};
+    // Anything above this share of one core over an interval counts as activity.
+    const std::uint64_t busyTicks {static_cast<std::uint64_t>(
+        sysconf(_SC_CLK_TCK) * constants::HIBERNATION_INTERVAL.count() 
+        * constants::HIBERNATION_BUSY_CPU_FRACTION
+    )};
+    
+    while (monitoring) {
+        Clock::time_point now {Clock::now()};
+        // Editors reached directly would never be thawed, so they're only stopped.
+        bool behindInstruct {code::studentsBehindInstruct()};
+        std::vector<code::Instance> instances {code::getInstances()};
+        std::vector<pid_t> leaders {};
+        for (const code::Instance &instance : instances) {
+            if (instance.pid != -1 && instance.agent == -1) {
+                leaders.push_back(instance.pid);
+            }
+        }
+        // The server does its work in children, so count all of an instance's processes.
+        code::InstanceUsage usage {std::move(leaders), false};
+        std::unordered_map<pid_t, std::uint64_t> ticks {};
+        for (const code::Instance &instance : instances) {
+            if (instance.uuid == code::INSTRUCTOR_UUID || instance.pid == -1 
+                || instance.state != code::InstanceState::Running) {
+                continue;
+            }
+            // The pid of an instance on an agent isn't one of this host's.
+            bool local {instance.agent == -1};
+            if (!instance.frozen && local) {
+                std::uint64_t cpuTicks {usage.of(instance.pid).cpuTicks};
+                ticks.emplace(instance.pid, cpuTicks);
+                auto last {lastTicks.find(instance.pid)};
+                if (last != lastTicks.end() && cpuTicks - last->second > busyTicks) {
+                    code::touchInstance(instance.uuid);
+                    continue;
+                }
+            }
+            
+            auto [freezeMinutes, stopMinutes] {idlePolicy(instance.uuid)};
+            Clock::duration idle {now - instance.lastActive};
+            if (stopMinutes > 0 && idle > std::chrono::minutes {stopMinutes}) {
+                std::uint64_t bytes {local ? usage.of(instance.pid).memoryBytes : 0};
+                LOG_F(INFO, "Stopping instance idle for %d minute(s).", stopMinutes);
+                code::stopInstance(instance.uuid);
+                frozenBytes.erase(instance.uuid);
+                std::lock_guard<std::mutex> lock {statsMutex};
+                stats.freedBytes += bytes;
+                ++stats.stopped;
+            } else if (local && !instance.frozen && freezeMinutes > 0 && behindInstruct 
+                && idle > std::chrono::minutes {freezeMinutes}) {
+                std::uint64_t bytes {usage.of(instance.pid).memoryBytes};
+                if (code::freezeInstance(instance.uuid)) {
+                    frozenBytes[instance.uuid] = bytes;
+                }
+            }
+        }
+        lastTicks.swap(ticks);
+        
+        // Forget instances that were thawed or stopped elsewhere.
+        for (auto it {frozenBytes.begin()}; it != frozenBytes.end();) {
+            std::optional<code::Instance> instance {code::getInstance(it->first)};
+            it = instance && instance->frozen ? std::next(it) : frozenBytes.erase(it);
+        }
+        {
+            std::lock_guard<std::mutex> lock {statsMutex};
+            stats.frozen = static_cast<int>(frozenBytes.size());
+            stats.frozenBytes = 0;
+            for (auto &[uuid, bytes] : frozenBytes) {
+                stats.frozenBytes += bytes;
+            }
+        }
+        
+        std::unique_lock<std::mutex> lock {monitorMutex};
+        monitorSignal.wait_for(lock, constants::HIBERNATION_INTERVAL, [] {
+            return !monitoring;
+        });
+    }
+}
+
+void code::startHibernation() {
+    if (monitoring) {
+        return;
+    }
+    monitoring = true;
+    monitorThread = std::thread {monitorInstances};
+    DLOG_F(INFO, "Hibernation thread started.");
+}
+
+void code::stopHibernation() {
+    {
+        std::lock_guard<std::mutex> lock {monitorMutex};
+        monitoring = false;
+    }
+    monitorSignal.notify_all();
+    if (monitorThread.joinable()) {
+        monitorThread.join();
+        DLOG_F(INFO, "Hibernation thread joined.");
+    }
+}
+
+code::HibernationStats code::getHibernationStats() {
+    std::lock_guard<std::mutex> lock {statsMutex};
+    return stats;
+}
+
+std::optional<std::chrono::steady_clock::time_point> code::idleStopDeadline(
+    const Instance &instance
+) {
+    int stopMinutes {idlePolicy(instance.uuid).second};
+    if (!monitoring || instance.uuid == INSTRUCTOR_UUID || stopMinutes <= 0) {
+        return std::nullopt;
+    }
+    // The monitor only notices once per interval.
+    return instance.lastActive + std::chrono::minutes {stopMinutes} 
+        + constants::HIBERNATION_INTERVAL;
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef INSTRUCT_HIBERNATION_HPP
+#define INSTRUCT_HIBERNATION_HPP
+
+#include <optional>
+#include <cstdint>
+#include <chrono>
+
+#include "supervisor.hpp"
+
+namespace instruct::code {
+    struct HibernationStats {
+        int frozen;
+        // Memory of the instances currently frozen, children included.
+        std::uint64_t frozenBytes;
+        // Memory released by stopping idle instances this session.
+        std::uint64_t freedBytes;
+        int stopped;
+    };
+    
+    // Periodically freezes student instances idle past `idle_freeze_minutes` 
+    // and stops them past `idle_stop_minutes`. The instructor is never touched. 
+    // Freezing needs the proxy or lazy activation to thaw instances on connect.
+    void startHibernation();
+    void stopHibernation();
+    
+    HibernationStats getHibernationStats();
+    
+    // When the monitor will stop the instance if it stays idle, 
+    // or nothing if its idle policy never stops it.
+    std::optional<std::chrono::steady_clock::time_point> idleStopDeadline(const Instance &);
+}
+
+#endif
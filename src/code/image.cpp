@@ -0,0 +1,202 @@
+#include <system_error>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cerrno>
+#include <cstdio>
+#include <mutex>
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "loguru.hpp"
+
+#include "../logging.hpp"
+#include "image.hpp"
+
+namespace instruct {
+
+namespace {
+    const std::filesystem::path VIEW_DIR {"server"};
+    const std::filesystem::path STAGING_DIR {"server.new"};
+    // The view a rebuild replaced, until its instance is gone.
+    const std::filesystem::path RETIRED_DIR {"server.old"};
+    // Kept inside the view so that it's replaced along with it.
+    const std::filesystem::path STAMP_FILE {".instruct-image"};
+    
+    // Set once neither hard links nor reflinks work, since every view would fail alike.
+    std::atomic_bool viewsUnsupported {false};
+    // Orders swapping views in against removing retired ones.
+    std::mutex viewsMutex {};
+    
+    struct MirrorStats {
+        int linked;
+        int cloned;
+        int copied;
+    };
+}
+
+// Identifies the extraction rather than the version, since a download of 
+// the same version replaces every file.
+static std::string imageStamp(const std::filesystem::path &serverRoot) {
+    struct stat info {};
+    if (stat((serverRoot / "package.json").c_str(), &info) != 0) {
+        return "";
+    }
+    return serverRoot.filename().string() + " " + std::to_string(info.st_ino) 
+        + " " + std::to_string(info.st_mtim.tv_sec);
+}
+
+static bool cloneFile(const std::filesystem::path &src, const std::filesystem::path &dst) {
+    int in {open(src.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (in == -1) {
+        return false;
+    }
+    struct stat info {};
+    fstat(in, &info);
+    int out {open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, info.st_mode & 07777)};
+    bool cloned {out != -1 && ioctl(out, FICLONE, in) == 0};
+    int cloneErr {errno};
+    if (out != -1) {
+        close(out);
+        if (!cloned) {
+            unlink(dst.c_str());
+        }
+    }
+    close(in);
+    errno = cloneErr;
+    return cloned;
+}
+
+// Recreates the directories of the image and links its files into them. Single files 
+// the kernel refuses to link, i.e. at the link limit, are copied, but the whole tree isn't.
+static bool mirrorTree(
+    const std::filesystem::path &image, const std::filesystem::path &view, MirrorStats &stats
+) {
+    bool hardLinks {true}, reflinks {true};
+    std::error_code err;
+    std::filesystem::recursive_directory_iterator it {image, err};
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        const std::filesystem::path &src {it->path()};
+        std::filesystem::path dst {view / src.lexically_relative(image)};
+        if (it->is_symlink(err)) {
+            std::filesystem::copy_symlink(src, dst, err);
+            continue;
+        }
+        if (it->is_directory(err)) {
+            std::filesystem::create_directory(dst, src, err);
+            continue;
+        }
+        if (hardLinks) {
+            if (link(src.c_str(), dst.c_str()) == 0) {
+                ++stats.linked;
+                continue;
+            }
+            // Only a different filesystem rules out linking the rest.
+            hardLinks = errno != EXDEV;
+        }
+        if (!hardLinks && reflinks) {
+            if (cloneFile(src, dst)) {
+                ++stats.cloned;
+                continue;
+            }
+            reflinks = errno != EOPNOTSUPP && errno != ENOTTY && errno != EXDEV 
+                && errno != EINVAL;
+        }
+        if (!hardLinks && !reflinks) {
+            // Copying every file into every view is what this is meant to avoid.
+            viewsUnsupported = true;
+            return false;
+        }
+        std::filesystem::copy_file(src, dst, err);
+        ++stats.copied;
+    }
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return false;
+    }
+    return true;
+}
+
+std::filesystem::path code::provisionServerView(
+    const std::filesystem::path &serverRoot, const std::filesystem::path &dataDir
+) {
+    std::string stamp {imageStamp(serverRoot)};
+    if (viewsUnsupported || stamp.empty()) {
+        return serverRoot;
+    }
+    std::filesystem::path view {dataDir / VIEW_DIR};
+    {
+        std::ifstream fin {view / STAMP_FILE};
+        std::string current {};
+        if (std::getline(fin, current) && current == stamp) {
+            return view;
+        }
+    }
+    
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point started {Clock::now()};
+    std::filesystem::path staging {dataDir / STAGING_DIR};
+    std::error_code err;
+    std::filesystem::remove_all(staging, err);
+    std::filesystem::create_directories(staging, err);
+    MirrorStats stats {};
+    if (err || !mirrorTree(serverRoot, staging, stats)) {
+        std::filesystem::remove_all(staging, err);
+        if (viewsUnsupported) {
+            LOG_F(
+                WARNING, "Can't link %s into %s. Instances share the server directly.", 
+                serverRoot.c_str(), dataDir.parent_path().c_str()
+            );
+        } else {
+            LOG_F(WARNING, "Failed to provision %s.", view.c_str());
+        }
+        return serverRoot;
+    }
+    {
+        std::ofstream fout {staging / STAMP_FILE};
+        fout << stamp << '\n';
+    }
+    // An instance that hasn't exited yet may still run from the old view, so it's 
+    // swapped out whole and only removed by `releaseServerView`.
+    {
+        std::lock_guard<std::mutex> lock {viewsMutex};
+        std::filesystem::path retired {dataDir / RETIRED_DIR};
+        std::filesystem::remove_all(retired, err);
+        if (renameat2(AT_FDCWD, staging.c_str(), AT_FDCWD, view.c_str(), RENAME_EXCHANGE) == 0) {
+            std::filesystem::rename(staging, retired, err);
+        } else {
+            // No old view to exchange with, or a filesystem that can't exchange.
+            if (errno != ENOENT) {
+                std::filesystem::rename(view, retired, err);
+            }
+            std::filesystem::rename(staging, view, err);
+        }
+    }
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return serverRoot;
+    }
+    LOG_F(
+        1, "Provisioned %s in %lld ms: %d linked, %d cloned, %d copied.", 
+        view.c_str(), 
+        static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            Clock::now() - started
+        ).count()), 
+        stats.linked, stats.cloned, stats.copied
+    );
+    return view;
+}
+
+void code::releaseServerView(const std::filesystem::path &dataDir) {
+    std::lock_guard<std::mutex> lock {viewsMutex};
+    std::error_code err;
+    std::filesystem::remove_all(dataDir / RETIRED_DIR, err);
+    log::logErrorCodeWarning(err);
+}
+
+}
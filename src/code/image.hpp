@@ -0,0 +1,20 @@
+#ifndef INSTRUCT_IMAGE_HPP
+#define INSTRUCT_IMAGE_HPP
+
+#include <filesystem>
+
+namespace instruct::code {
+    // Returns the instance's own view of the extracted server, kept under its data 
+    // directory and rebuilt once the server is replaced. Files are hard links into 
+    // the shared tree, or reflinks across filesystems, so a view costs little more 
+    // than its directories, and replacing the server never pulls files out from 
+    // under a running instance. Returns the shared tree itself if neither works.
+    std::filesystem::path provisionServerView(
+        const std::filesystem::path &, const std::filesystem::path &
+    );
+    // Removes the view a rebuild swapped out of the data directory. Call once the 
+    // instance that may still run from it has exited.
+    void releaseServerView(const std::filesystem::path &);
+}
+
+#endif
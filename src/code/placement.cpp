@@ -0,0 +1,309 @@
+#include <unordered_map>
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <cctype>
+#include <mutex>
+
+#include <sched.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "placement.hpp"
+#include "../data.hpp"
+
+namespace instruct {
+
+namespace {
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+    
+    std::mutex placementMutex {};
+    bool discovered {false};
+    std::vector<Node> nodes {};
+    std::vector<int> supervisorCpus {};
+    std::vector<int> instructorCpus {};
+    // Set once before other threads start and only read afterwards, so that 
+    // `unpinThread` needs no lock.
+    bool pinned {false};
+    cpu_set_t unpinnedMask {};
+    // Instances placed on each CPU.
+    std::unordered_map<int, int> cpuLoad {};
+    std::unordered_map<std::string, code::CpuPlacement> placements {};
+}
+
+// Parses the kernel's CPU list format, i.e. `0-3,8-11`.
+static std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus {};
+    std::istringstream ranges {list};
+    std::string range {};
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        std::size_t dash {range.find('-')};
+        try {
+            int first {std::stoi(range.substr(0, dash))};
+            int last {dash == std::string::npos ? first : std::stoi(range.substr(dash + 1))};
+            for (int cpu {first}; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::exception &) {
+            continue;
+        }
+    }
+    return cpus;
+}
+
+std::string code::formatCpuList(const std::vector<int> &cpus) {
+    std::vector<int> sorted {cpus};
+    std::sort(sorted.begin(), sorted.end());
+    std::string list {};
+    for (std::size_t idx {}; idx < sorted.size();) {
+        std::size_t end {idx};
+        while (end + 1 < sorted.size() && sorted.at(end + 1) == sorted.at(end) + 1) {
+            ++end;
+        }
+        list += (list.empty() ? "" : ",") + std::to_string(sorted.at(idx));
+        if (end > idx) {
+            list += "-" + std::to_string(sorted.at(end));
+        }
+        idx = end + 1;
+    }
+    return list;
+}
+
+static std::vector<int> allowedCpus(pid_t pid) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    std::vector<int> cpus {};
+    if (sched_getaffinity(pid, sizeof(mask), &mask) == -1) {
+        return cpus;
+    }
+    for (int cpu {}; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &mask)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// Expects `placementMutex` to be held.
+static void discoverTopology() {
+    std::vector<int> allowed {allowedCpus(0)};
+    std::error_code err;
+    for (const std::filesystem::directory_entry &dirEntry 
+        : std::filesystem::directory_iterator {constants::NUMA_NODES_DIR, err}) {
+        std::string name {dirEntry.path().filename()};
+        if (name.rfind("node", 0) != 0 
+            || !std::all_of(name.begin() + 4, name.end(), ::isdigit) || name.size() == 4) {
+            continue;
+        }
+        std::ifstream fin {dirEntry.path() / "cpulist"};
+        std::string list {};
+        std::getline(fin, list);
+        Node node {std::stoi(name.substr(4)), {}};
+        for (int cpu : parseCpuList(list)) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                node.cpus.push_back(cpu);
+            }
+        }
+        // Memory-only nodes and nodes outside instruct's own affinity are skipped.
+        if (!node.cpus.empty()) {
+            nodes.push_back(node);
+        }
+    }
+    std::sort(nodes.begin(), nodes.end(), [] (const Node &lhs, const Node &rhs) {
+        return lhs.id < rhs.id;
+    });
+    // Without NUMA information everything is one node, which gets no memory policy.
+    if (nodes.empty()) {
+        nodes.push_back({-1, allowed});
+    }
+    
+    // Cores are only set aside when there are enough left for students.
+    std::vector<int> &firstCpus {nodes.front().cpus};
+    std::size_t reserved {1 + constants::PLACEMENT_INSTRUCTOR_CPUS};
+    if (allowed.size() >= constants::PLACEMENT_MIN_CPUS_TO_RESERVE 
+        && firstCpus.size() > reserved) {
+        supervisorCpus.assign(firstCpus.begin(), firstCpus.begin() + 1);
+        instructorCpus.assign(firstCpus.begin() + 1, firstCpus.begin() + reserved);
+        firstCpus.erase(firstCpus.begin(), firstCpus.begin() + reserved);
+    }
+    if (instructorCpus.empty()) {
+        instructorCpus = allowed;
+    }
+    discovered = true;
+    LOG_F(
+        INFO, "Found %zu NUMA node(s) and %zu usable CPU(s).", 
+        nodes.front().id == -1 ? 0 : nodes.size(), allowed.size()
+    );
+}
+
+void code::initPlacement() {
+    if (!SData::studentsData->get_cpuPlacement()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock {placementMutex};
+    if (!discovered) {
+        discoverTopology();
+    }
+    if (supervisorCpus.empty()) {
+        DLOG_F(INFO, "Too few CPUs to reserve any for instruct.");
+        return;
+    }
+    // Threads started afterwards, i.e. the UI and student logins, inherit this.
+    if (sched_getaffinity(0, sizeof(unpinnedMask), &unpinnedMask) == -1) {
+        LOG_F(WARNING, "Failed to read instruct's CPU affinity.");
+        return;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : supervisorCpus) {
+        CPU_SET(cpu, &mask);
+    }
+    if (sched_setaffinity(0, sizeof(mask), &mask) == -1) {
+        LOG_F(
+            WARNING, "Failed to pin instruct to CPU(s) %s.", 
+            formatCpuList(supervisorCpus).c_str()
+        );
+        return;
+    }
+    pinned = true;
+    LOG_F(INFO, "Pinned instruct to CPU(s) %s.", formatCpuList(supervisorCpus).c_str());
+}
+
+void code::unpinThread() {
+    if (pinned) {
+        sched_setaffinity(0, sizeof(unpinnedMask), &unpinnedMask);
+    }
+}
+
+// The node a CPU belongs to, or -1 without NUMA information.
+static int nodeOf(int cpu) {
+    for (const Node &node : nodes) {
+        if (std::find(node.cpus.begin(), node.cpus.end(), cpu) != node.cpus.end()) {
+            return node.id;
+        }
+    }
+    return nodes.empty() ? -1 : nodes.front().id;
+}
+
+code::CpuPlacement code::placeInstance(const std::string &label, bool isInstructor) {
+    if (!SData::studentsData->get_cpuPlacement()) {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock {placementMutex};
+    if (!discovered) {
+        discoverTopology();
+    }
+    auto previous {placements.find(label)};
+    if (previous != placements.end()) {
+        for (int cpu : previous->second.cpus) {
+            --cpuLoad[cpu];
+        }
+        placements.erase(previous);
+    }
+    
+    CpuPlacement placement {};
+    if (isInstructor) {
+        placement.cpus = instructorCpus;
+        placement.node = nodes.size() > 1 ? nodeOf(instructorCpus.front()) : -1;
+    } else {
+        // The node with the fewest instances per CPU, then its least loaded CPUs.
+        const Node *target {};
+        double targetLoad {std::numeric_limits<double>::max()};
+        for (const Node &node : nodes) {
+            int load {};
+            for (int cpu : node.cpus) {
+                load += cpuLoad[cpu];
+            }
+            double perCpu {static_cast<double>(load) / node.cpus.size()};
+            if (!node.cpus.empty() && perCpu < targetLoad) {
+                target = &node;
+                targetLoad = perCpu;
+            }
+        }
+        if (target == nullptr) {
+            return {};
+        }
+        std::vector<int> cpus {target->cpus};
+        std::stable_sort(cpus.begin(), cpus.end(), [] (int lhs, int rhs) {
+            return cpuLoad[lhs] < cpuLoad[rhs];
+        });
+        cpus.resize(std::min(cpus.size(), constants::PLACEMENT_CPUS_PER_INSTANCE));
+        placement.cpus = cpus;
+        placement.node = nodes.size() > 1 ? target->id : -1;
+    }
+    for (int cpu : placement.cpus) {
+        ++cpuLoad[cpu];
+    }
+    placements[label] = placement;
+    return placement;
+}
+
+void code::recordPlacement(const std::string &label, pid_t pid) {
+    if (!SData::studentsData->get_cpuPlacement()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock {placementMutex};
+    if (!discovered) {
+        discoverTopology();
+    }
+    CpuPlacement placement {allowedCpus(pid), -1};
+    // An unpinned instance doesn't weigh on any CPU in particular.
+    bool pinned {
+        placement.cpus.size() <= constants::PLACEMENT_CPUS_PER_INSTANCE 
+            || placement.cpus == instructorCpus
+    };
+    if (placement.cpus.empty() || !pinned) {
+        return;
+    }
+    placement.node = nodes.size() > 1 ? nodeOf(placement.cpus.front()) : -1;
+    for (int cpu : placement.cpus) {
+        ++cpuLoad[cpu];
+    }
+    placements[label] = placement;
+}
+
+void code::releasePlacement(const std::string &label) {
+    std::lock_guard<std::mutex> lock {placementMutex};
+    auto it {placements.find(label)};
+    if (it == placements.end()) {
+        return;
+    }
+    for (int cpu : it->second.cpus) {
+        --cpuLoad[cpu];
+    }
+    placements.erase(it);
+}
+
+code::PlacementReport code::getPlacementReport() {
+    std::lock_guard<std::mutex> lock {placementMutex};
+    PlacementReport report {};
+    report.enabled = SData::studentsData->get_cpuPlacement() && discovered;
+    report.supervisorCpus = supervisorCpus;
+    report.instructorCpus = instructorCpus;
+    for (const Node &node : nodes) {
+        int instances {};
+        for (const auto &[label, placement] : placements) {
+            if (placement.node == node.id || nodes.size() == 1) {
+                ++instances;
+            }
+        }
+        report.nodes.push_back({node.id, node.cpus, instances});
+    }
+    report.instances.assign(placements.begin(), placements.end());
+    std::sort(report.instances.begin(), report.instances.end(), [] (auto &lhs, auto &rhs) {
+        return lhs.first < rhs.first;
+    });
+    return report;
+}
+
+}
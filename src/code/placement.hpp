@@ -0,0 +1,54 @@
+#ifndef INSTRUCT_PLACEMENT_HPP
+#define INSTRUCT_PLACEMENT_HPP
+
+#include <utility>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace instruct::code {
+    struct CpuPlacement {
+        std::vector<int> cpus;
+        // NUMA node memory is preferably allocated from, or -1 to leave it to the kernel.
+        int node {-1};
+    };
+    
+    struct NodeLoad {
+        int node;
+        // CPUs of the node that students are placed on.
+        std::vector<int> cpus;
+        int instances;
+    };
+    
+    struct PlacementReport {
+        bool enabled;
+        std::vector<int> supervisorCpus;
+        std::vector<int> instructorCpus;
+        std::vector<NodeLoad> nodes;
+        // Where each instance was put, by label.
+        std::vector<std::pair<std::string, CpuPlacement>> instances;
+    };
+    
+    // Discovers the CPUs and NUMA nodes instruct may use and, with `cpu_placement` 
+    // enabled, pins instruct's own threads to their reserved core. Call before 
+    // any other thread is started so that they all inherit it.
+    void initPlacement();
+    // Gives the calling thread back every CPU instruct was allowed before pinning. 
+    // Threads doing bulk work call it first, so the threads and children they start 
+    // stay off the reserved core. Async-signal-safe, so it may run between fork and exec.
+    void unpinThread();
+    
+    // Picks CPUs for a new instance, spreading students over the least loaded 
+    // node and cores. The instructor gets its reserved cores. Empty when disabled.
+    CpuPlacement placeInstance(const std::string &, bool);
+    // Records where an instance that outlived the previous run already runs.
+    void recordPlacement(const std::string &, pid_t);
+    void releasePlacement(const std::string &);
+    
+    PlacementReport getPlacementReport();
+    // Formats CPUs as ranges, i.e. `0-3,8`.
+    std::string formatCpuList(const std::vector<int> &);
+}
+
+#endif
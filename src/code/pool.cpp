@@ -0,0 +1,240 @@
+#include <condition_variable>
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "scheduler.hpp"
+#include "admission.hpp"
+#include "placement.hpp"
+#include "userdata.hpp"
+#include "../data.hpp"
+#include "process.hpp"
+#include "cgroup.hpp"
+#include "agents.hpp"
+#include "image.hpp"
+#include "ports.hpp"
+#include "pool.hpp"
+
+namespace instruct {
+
+namespace {
+    struct PooledInstance {
+        pid_t pid;
+        int port;
+        std::string token;
+        bool ready;
+    };
+    
+    std::thread refillThread {};
+    std::atomic_bool refilling {false};
+    std::condition_variable refillSignal {};
+    
+    std::mutex poolMutex {};
+    std::vector<PooledInstance> pool {};
+    int poolTarget {};
+    int hits {};
+    int misses {};
+}
+
+static std::string pooledLabel(int port) {
+    return "pool-" + std::to_string(port);
+}
+
+static bool spawnPooledInstance(const std::filesystem::path &serverRoot) {
+    int port {code::getPortAllocator().allocate()};
+    if (port == -1) {
+        LOG_F(WARNING, "No spare ports left for the warm pool.");
+        return false;
+    }
+    // Pooled instances open an empty placeholder folder until they're claimed.
+    std::string label {pooledLabel(port)};
+    std::string token {code::loadConnectionToken(constants::INSTANCES_DIR / label)};
+    if (token.empty()) {
+        code::getPortAllocator().release(port);
+        return false;
+    }
+    code::SpawnSpec spec {code::makeServerSpec(
+        serverRoot, 
+        code::studentInstanceHost(), 
+        port, 
+        constants::INSTANCES_DIR / label / "workspace", 
+        constants::INSTANCES_DIR / label, 
+        label, 
+        token
+    )};
+    // Pooled instances are handed to students, so they run under the student budget.
+    spec.budget = SData::studentsData->get_studentBudget();
+    spec.placement = code::placeInstance(label, false);
+    pid_t pid {code::spawnProcess(spec)};
+    if (pid == -1) {
+        code::releasePlacement(label);
+        code::getPortAllocator().release(port);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock {poolMutex};
+    pool.push_back({pid, port, token, false});
+    return true;
+}
+
+static void refillPool() {
+    std::optional<std::filesystem::path> serverRoot {code::locateServerRoot()};
+    if (!serverRoot) {
+        LOG_F(WARNING, "Warm pool disabled since OpenVsCode Server is not installed.");
+        return;
+    }
+    while (refilling) {
+        // Promote booted instances and drop dead ones.
+        std::vector<PooledInstance> booting {};
+        {
+            std::lock_guard<std::mutex> lock {poolMutex};
+            for (const PooledInstance &pooled : pool) {
+                if (!pooled.ready) {
+                    booting.push_back(pooled);
+                }
+            }
+        }
+        for (PooledInstance &pooled : booting) {
+            if (code::processExited(pooled.pid)) {
+                LOG_F(WARNING, "Pooled instance on port %d exited.", pooled.port);
+                pooled.pid = -1;
+            } else {
+                pooled.ready = code::serverReady(
+                    code::studentInstanceHost(), pooled.port
+                );
+            }
+        }
+        int deficit {};
+        {
+            std::lock_guard<std::mutex> lock {poolMutex};
+            for (const PooledInstance &polled : booting) {
+                auto it {std::find_if(pool.begin(), pool.end(), [&] (const PooledInstance &p) {
+                    return p.port == polled.port;
+                })};
+                if (it == pool.end()) {
+                    continue;
+                }
+                if (polled.pid == -1) {
+                    code::releaseUserData(pooledLabel(it->port));
+                    code::releasePlacement(pooledLabel(it->port));
+                    code::releaseServerView(constants::INSTANCES_DIR / pooledLabel(it->port));
+                    code::getPortAllocator().release(it->port);
+                    pool.erase(it);
+                } else {
+                    it->ready = polled.ready;
+                }
+            }
+            deficit = poolTarget - static_cast<int>(pool.size());
+        }
+        
+        // Refill one at a time so the pool never competes with a class-wide launch 
+        // or takes memory that a student's own launch would need.
+        if (deficit > 0 && !code::getLaunchProgress().active && code::spareHeadroom()) {
+            spawnPooledInstance(*serverRoot);
+        }
+        
+        std::unique_lock<std::mutex> lock {poolMutex};
+        refillSignal.wait_for(lock, constants::LAUNCH_POLL_INTERVAL, [] {
+            return !refilling;
+        });
+    }
+}
+
+void code::startWarmPool() {
+    // Students are placed on agents, which a pool on this host would undercut.
+    int target {agentsConfigured() ? 0 : SData::studentsData->get_warmPoolSize()};
+    {
+        std::lock_guard<std::mutex> lock {poolMutex};
+        poolTarget = target;
+    }
+    if (target <= 0 || refilling) {
+        return;
+    }
+    refilling = true;
+    refillThread = std::thread {refillPool};
+    DLOG_F(INFO, "Warm pool thread started. Target size: %d.", target);
+}
+
+static void stopPooledInstance(const PooledInstance &pooled) {
+    std::optional<std::filesystem::path> cgroup {code::getInstanceCgroup(pooled.pid)};
+    code::stopProcess(pooled.pid);
+    if (cgroup) {
+        code::removeInstanceCgroup(*cgroup);
+    }
+    code::releaseUserData(pooledLabel(pooled.port));
+    code::releasePlacement(pooledLabel(pooled.port));
+    code::releaseServerView(constants::INSTANCES_DIR / pooledLabel(pooled.port));
+    code::getPortAllocator().release(pooled.port);
+}
+
+void code::stopWarmPool() {
+    refilling = false;
+    refillSignal.notify_all();
+    if (refillThread.joinable()) {
+        refillThread.join();
+        DLOG_F(INFO, "Warm pool thread joined.");
+    }
+    std::vector<PooledInstance> remaining {};
+    {
+        std::lock_guard<std::mutex> lock {poolMutex};
+        remaining.swap(pool);
+    }
+    for (const PooledInstance &pooled : remaining) {
+        stopPooledInstance(pooled);
+    }
+}
+
+int code::claimPooledInstance(const uuids::uuid &uuid) {
+    std::optional<PooledInstance> claimed {};
+    {
+        std::lock_guard<std::mutex> lock {poolMutex};
+        auto it {std::find_if(pool.begin(), pool.end(), [] (const PooledInstance &pooled) {
+            return pooled.ready;
+        })};
+        if (it == pool.end()) {
+            ++misses;
+            return -1;
+        }
+        ++hits;
+        claimed = *it;
+        pool.erase(it);
+    }
+    if (!adoptInstance(
+        uuid, claimed->pid, claimed->port, pooledLabel(claimed->port), claimed->token
+    )) {
+        // Still booted and unclaimed, so it goes back for the next login, unless 
+        // the pool was stopped meanwhile and won't stop it anymore.
+        {
+            std::lock_guard<std::mutex> lock {poolMutex};
+            --hits;
+            if (refilling) {
+                pool.push_back(*claimed);
+                return -1;
+            }
+        }
+        stopPooledInstance(*claimed);
+        return -1;
+    }
+    refillSignal.notify_all();
+    return claimed->port;
+}
+
+code::PoolStats code::getPoolStats() {
+    std::lock_guard<std::mutex> lock {poolMutex};
+    PoolStats stats {};
+    for (const PooledInstance &pooled : pool) {
+        ++(pooled.ready ? stats.ready : stats.booting);
+    }
+    stats.target = poolTarget;
+    stats.hits = hits;
+    stats.misses = misses;
+    return stats;
+}
+
+}
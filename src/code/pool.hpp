@@ -0,0 +1,28 @@
+#ifndef INSTRUCT_POOL_HPP
+#define INSTRUCT_POOL_HPP
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct PoolStats {
+        int ready;
+        int booting;
+        int target;
+        int hits;
+        int misses;
+    };
+    
+    // Keeps `warm_pool_size` generic instances booted on spare ports, 
+    // refilling on a background thread. Does nothing if the size is zero.
+    void startWarmPool();
+    // Stops the refill thread and every instance still in the pool.
+    void stopWarmPool();
+    
+    // Hands a booted instance over to the student. Returns its port, or -1 on a miss 
+    // or if the student can't take one, i.e. already has an instance.
+    int claimPooledInstance(const uuids::uuid &);
+    
+    PoolStats getPoolStats();
+}
+
+#endif
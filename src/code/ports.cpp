@@ -0,0 +1,450 @@
+#include <unordered_map>
+#include <algorithm>
+#include <exception>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "../data.hpp"
+#include "ports.hpp"
+
+namespace instruct {
+
+code::PortAllocator::PortAllocator() : rng {std::random_device {}()} {
+}
+
+code::PortAllocator::PortAllocator(
+    const std::set<int> &ports, 
+    std::pair<int, int> portRange, 
+    bool randomize
+) : randomize {randomize}, rng {std::random_device {}()} {
+    auto addPort {[this] (int port) {
+        if (port <= 0 || port >= PORT_COUNT) {
+            return;
+        }
+        poolBits[port / WORD_BITS] |= std::uint64_t {1} << (port % WORD_BITS);
+        markFree(port);
+    }};
+    for (int port : ports) {
+        addPort(port);
+    }
+    for (int port {portRange.first}; port <= portRange.second; ++port) {
+        addPort(port);
+    }
+}
+
+void code::PortAllocator::markFree(int port) {
+    std::uint64_t &word {freeBits[port / WORD_BITS]};
+    std::uint64_t bit {std::uint64_t {1} << (port % WORD_BITS)};
+    if (word & bit) {
+        return;
+    }
+    word |= bit;
+    int wordIdx {port / WORD_BITS};
+    summaryBits[wordIdx / WORD_BITS] |= std::uint64_t {1} << (wordIdx % WORD_BITS);
+    ++freeCount;
+}
+
+void code::PortAllocator::markUsed(int port) {
+    std::uint64_t &word {freeBits[port / WORD_BITS]};
+    std::uint64_t bit {std::uint64_t {1} << (port % WORD_BITS)};
+    if (!(word & bit)) {
+        return;
+    }
+    word &= ~bit;
+    if (word == 0) {
+        int wordIdx {port / WORD_BITS};
+        summaryBits[wordIdx / WORD_BITS] &= ~(std::uint64_t {1} << (wordIdx % WORD_BITS));
+    }
+    --freeCount;
+}
+
+// Finds the first free port at or after `start`, wrapping around once.
+int code::PortAllocator::findFrom(int start) const {
+    if (freeCount == 0) {
+        return -1;
+    }
+    
+    // Check the remainder of the starting word first.
+    int wordIdx {start / WORD_BITS};
+    std::uint64_t word {freeBits[wordIdx] & (~std::uint64_t {0} << (start % WORD_BITS))};
+    if (word != 0) {
+        return wordIdx * WORD_BITS + __builtin_ctzll(word);
+    }
+    
+    // Then use the summary to jump straight to the next non-empty word.
+    int nextWordIdx {wordIdx + 1};
+    for (int pass {}; pass < 2; ++pass) {
+        for (
+            int summaryIdx {nextWordIdx / WORD_BITS}; 
+            summaryIdx < SUMMARY_COUNT; 
+            ++summaryIdx
+        ) {
+            std::uint64_t summary {summaryBits[summaryIdx]};
+            if (summaryIdx == nextWordIdx / WORD_BITS) {
+                summary &= ~std::uint64_t {0} << (nextWordIdx % WORD_BITS);
+            }
+            if (summary != 0) {
+                int foundWordIdx {summaryIdx * WORD_BITS + __builtin_ctzll(summary)};
+                return foundWordIdx * WORD_BITS + __builtin_ctzll(freeBits[foundWordIdx]);
+            }
+        }
+        nextWordIdx = 0;
+    }
+    return -1;
+}
+
+// Finds the free port with `idx` free ports below it, skipping whole words by 
+// their population count.
+int code::PortAllocator::findNth(std::size_t idx) const {
+    if (idx >= freeCount) {
+        return -1;
+    }
+    for (int summaryIdx {}; summaryIdx < SUMMARY_COUNT; ++summaryIdx) {
+        std::uint64_t summary {summaryBits[summaryIdx]};
+        while (summary != 0) {
+            int wordIdx {summaryIdx * WORD_BITS + __builtin_ctzll(summary)};
+            summary &= summary - 1;
+            std::uint64_t word {freeBits[wordIdx]};
+            std::size_t count {static_cast<std::size_t>(__builtin_popcountll(word))};
+            if (idx >= count) {
+                idx -= count;
+                continue;
+            }
+            for (; idx > 0; --idx) {
+                word &= word - 1;
+            }
+            return wordIdx * WORD_BITS + __builtin_ctzll(word);
+        }
+    }
+    return -1;
+}
+
+int code::PortAllocator::pick() {
+    if (freeCount == 0) {
+        return -1;
+    }
+    if (!randomize) {
+        return findFrom(0);
+    }
+    return findNth(std::uniform_int_distribution<std::size_t> {0, freeCount - 1}(rng));
+}
+
+int code::PortAllocator::allocate() {
+    std::lock_guard<std::mutex> lock {mutex};
+    while (!vetted.empty()) {
+        int port {vetted.front()};
+        vetted.pop_front();
+        // It may have been reserved since.
+        if (freeBits[port / WORD_BITS] & (std::uint64_t {1} << (port % WORD_BITS))) {
+            markUsed(port);
+            return port;
+        }
+    }
+    int port {pick()};
+    if (port != -1) {
+        markUsed(port);
+    }
+    return port;
+}
+
+bool code::PortAllocator::reserve(int port) {
+    std::lock_guard<std::mutex> lock {mutex};
+    if (port <= 0 || port >= PORT_COUNT) {
+        return false;
+    }
+    if (!(freeBits[port / WORD_BITS] & (std::uint64_t {1} << (port % WORD_BITS)))) {
+        return false;
+    }
+    markUsed(port);
+    return true;
+}
+
+void code::PortAllocator::release(int port) {
+    std::lock_guard<std::mutex> lock {mutex};
+    if (port <= 0 || port >= PORT_COUNT) {
+        return;
+    }
+    if (poolBits[port / WORD_BITS] & (std::uint64_t {1} << (port % WORD_BITS))) {
+        markFree(port);
+    }
+}
+
+bool code::PortAllocator::inPool(int port) const {
+    std::lock_guard<std::mutex> lock {mutex};
+    return port > 0 && port < PORT_COUNT 
+        && (poolBits[port / WORD_BITS] & (std::uint64_t {1} << (port % WORD_BITS)));
+}
+
+bool code::PortAllocator::isFree(int port) const {
+    std::lock_guard<std::mutex> lock {mutex};
+    return port > 0 && port < PORT_COUNT 
+        && (freeBits[port / WORD_BITS] & (std::uint64_t {1} << (port % WORD_BITS)));
+}
+
+std::size_t code::PortAllocator::available() const {
+    std::lock_guard<std::mutex> lock {mutex};
+    return freeCount;
+}
+
+int code::PortAllocator::probe(const std::string &host, std::size_t count) {
+    // In the order they're drawn, which is the order they'll be allocated in.
+    std::vector<int> candidates {};
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        vetted.clear();
+        // Each is taken while drawing so it isn't drawn twice, then given back.
+        while (candidates.size() < count) {
+            int port {pick()};
+            if (port == -1) {
+                break;
+            }
+            candidates.push_back(port);
+            markUsed(port);
+        }
+        for (int port : candidates) {
+            markFree(port);
+        }
+    }
+    
+    // Probe without holding the lock since it waits on the network.
+    std::set<int> busy {probePorts(host, {candidates.begin(), candidates.end()})};
+    
+    std::lock_guard<std::mutex> lock {mutex};
+    for (int port : candidates) {
+        if (busy.count(port) > 0) {
+            LOG_F(INFO, "Port %d is already in use. Withdrawing it.", port);
+            markUsed(port);
+        } else {
+            vetted.push_back(port);
+        }
+    }
+    return static_cast<int>(busy.size());
+}
+
+static sockaddr_in makeAddress(const std::string &host, int port) {
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    return addr;
+}
+
+static void probeBatch(
+    const std::string &host, 
+    const std::vector<int> &batch, 
+    std::set<int> &busy
+) {
+    // Bind phase: fails immediately if something holds the port on our address.
+    std::vector<int> bindable {};
+    bindable.reserve(batch.size());
+    for (int port : batch) {
+        int fd {socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+        if (fd == -1) {
+            LOG_F(WARNING, "Port probe socket() failed: %s", std::strerror(errno));
+            continue;
+        }
+        // Ignore `TIME_WAIT` leftovers since the server will also reuse the address.
+        int enable {1};
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in addr {makeAddress(host, port)};
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1) {
+            if (errno == EADDRINUSE || errno == EACCES) {
+                busy.insert(port);
+            }
+        } else {
+            bindable.push_back(port);
+        }
+        close(fd);
+    }
+    
+    // Connect phase: catches listeners bound to a more specific address.
+    std::vector<pollfd> pollFds {};
+    std::vector<int> pollPorts {};
+    pollFds.reserve(bindable.size());
+    pollPorts.reserve(bindable.size());
+    for (int port : bindable) {
+        int fd {socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+        if (fd == -1) {
+            continue;
+        }
+        sockaddr_in addr {makeAddress("127.0.0.1", port)};
+        int res {connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))};
+        if (res == 0) {
+            busy.insert(port);
+            close(fd);
+        } else if (errno == EINPROGRESS) {
+            pollFds.push_back({fd, POLLOUT, 0});
+            pollPorts.push_back(port);
+        } else {
+            close(fd);
+        }
+    }
+    
+    int timeoutMs {static_cast<int>(constants::PORT_PROBE_TIMEOUT.count())};
+    std::size_t pending {pollFds.size()};
+    while (pending > 0 && poll(pollFds.data(), pollFds.size(), timeoutMs) > 0) {
+        for (std::size_t idx {}; idx < pollFds.size(); ++idx) {
+            pollfd &pfd {pollFds.at(idx)};
+            if (pfd.fd < 0 || pfd.revents == 0) {
+                continue;
+            }
+            int err {};
+            socklen_t errLen {sizeof(err)};
+            getsockopt(pfd.fd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+            if (err == 0) {
+                busy.insert(pollPorts.at(idx));
+            }
+            close(pfd.fd);
+            // Negative descriptors are ignored by `poll`.
+            pfd.fd = -1;
+            --pending;
+        }
+    }
+    for (pollfd &pfd : pollFds) {
+        if (pfd.fd >= 0) {
+            close(pfd.fd);
+        }
+    }
+}
+
+std::set<int> code::probePorts(const std::string &host, const std::set<int> &ports) {
+    std::set<int> busy {};
+    std::vector<int> batch {};
+    batch.reserve(constants::PORT_PROBE_BATCH_SIZE);
+    for (int port : ports) {
+        batch.push_back(port);
+        if (batch.size() == constants::PORT_PROBE_BATCH_SIZE) {
+            probeBatch(host, batch, busy);
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) {
+        probeBatch(host, batch, busy);
+    }
+    DLOG_F(INFO, "Probed %zu port(s). %zu in use.", ports.size(), busy.size());
+    return busy;
+}
+
+namespace {
+    std::unique_ptr<code::PortAllocator> portAllocator {
+        std::make_unique<code::PortAllocator>()
+    };
+}
+
+code::PortAllocator &code::getPortAllocator() {
+    return *portAllocator;
+}
+
+void code::initPorts() {
+    SData &sData {*SData::studentsData};
+    portAllocator = std::make_unique<PortAllocator>(
+        sData.get_codePorts(), sData.get_codePortRange(), sData.get_useRandomPorts()
+    );
+    
+    // Never hand out ports instruct itself listens on.
+    portAllocator->reserve(IData::instructorData->get_codePort());
+    portAllocator->reserve(IData::instructorData->get_authPort());
+    portAllocator->reserve(sData.get_authPort());
+    portAllocator->reserve(sData.get_proxyPort());
+    
+    // Keep existing assignments so students keep stable URLs.
+    std::unordered_map<uuids::uuid, int> assignedPorts {sData.get_assignedPorts()};
+    bool changed {false};
+    for (auto it {assignedPorts.begin()}; it != assignedPorts.end();) {
+        if (sData.get_students().count(it->first) == 0 || !portAllocator->reserve(it->second)) {
+            LOG_F(INFO, "Dropping port assignment %d.", it->second);
+            it = assignedPorts.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    if (changed) {
+        try {
+            sData.set_assignedPorts(assignedPorts);
+        } catch (const std::exception &e) {
+            log::logExceptionWarning(e);
+        }
+    }
+    DLOG_F(INFO, "Port allocator ready. %zu port(s) free.", portAllocator->available());
+}
+
+bool code::assignStudentPorts() {
+    SData &sData {*SData::studentsData};
+    std::unordered_map<uuids::uuid, int> assignedPorts {sData.get_assignedPorts()};
+    
+    std::vector<uuids::uuid> unassigned {};
+    for (const auto &[uuid, student] : sData.get_students()) {
+        if (assignedPorts.count(uuid) == 0) {
+            unassigned.push_back(uuid);
+        }
+    }
+    if (unassigned.empty()) {
+        return true;
+    }
+    
+    // Probe more candidates than needed so withdrawn ports don't force another round.
+    portAllocator->probe(sData.get_authHost(), unassigned.size() * 2);
+    
+    bool exhausted {false};
+    for (const uuids::uuid &uuid : unassigned) {
+        int port {portAllocator->allocate()};
+        if (port == -1) {
+            exhausted = true;
+            break;
+        }
+        assignedPorts.emplace(uuid, port);
+    }
+    
+    try {
+        sData.set_assignedPorts(assignedPorts);
+    } catch (const std::exception &e) {
+        notif::notify("Failed to save port assignments. Student ports may change.");
+        log::logExceptionWarning(e);
+    }
+    
+    if (exhausted) {
+        notif::notify("Ran out of code ports. Add more ports or widen the port range.");
+        return false;
+    }
+    return true;
+}
+
+int code::getInternalPort() {
+    int fd {socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (fd == -1) {
+        return -1;
+    }
+    sockaddr_in addr {makeAddress("127.0.0.1", 0)};
+    socklen_t addrLen {sizeof(addr)};
+    int port {-1};
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 
+        && getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addrLen) == 0) {
+        port = ntohs(addr.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+int code::getStudentPort(const uuids::uuid &uuid) {
+    const auto &assignedPorts {SData::studentsData->get_assignedPorts()};
+    auto it {assignedPorts.find(uuid)};
+    return it == assignedPorts.end() ? -1 : it->second;
+}
+
+}
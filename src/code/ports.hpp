@@ -0,0 +1,83 @@
+#ifndef INSTRUCT_PORTS_HPP
+#define INSTRUCT_PORTS_HPP
+
+#include <cstdint>
+#include <utility>
+#include <string>
+#include <random>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <set>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    // Two-level bitmap over the whole port space. A set bit in `freeBits` 
+    // marks an allocatable port and a set bit in `summaryBits` marks a word 
+    // of `freeBits` with at least one free port, so allocation and release 
+    // are a bounded number of word operations regardless of range size.
+    class PortAllocator {
+        static constexpr int PORT_COUNT {65536};
+        static constexpr int WORD_BITS {64};
+        static constexpr int WORD_COUNT {PORT_COUNT / WORD_BITS};
+        static constexpr int SUMMARY_COUNT {WORD_COUNT / WORD_BITS};
+        
+        std::array<std::uint64_t, WORD_COUNT> freeBits {};
+        std::array<std::uint64_t, SUMMARY_COUNT> summaryBits {};
+        std::array<std::uint64_t, WORD_COUNT> poolBits {};
+        std::size_t freeCount {};
+        bool randomize {};
+        std::mt19937 rng;
+        // Ports that passed the last probe, handed out before any others.
+        std::deque<int> vetted {};
+        mutable std::mutex mutex;
+        
+        void markFree(int);
+        void markUsed(int);
+        int findFrom(int) const;
+        int findNth(std::size_t) const;
+        // The next port to hand out: a uniformly random free one if randomizing, 
+        // the lowest otherwise.
+        int pick();
+
+        public:
+        
+        PortAllocator();
+        PortAllocator(const std::set<int> &, std::pair<int, int>, bool);
+        
+        // Returns -1 when no port is left.
+        int allocate();
+        // Claims a specific port. Returns false if it is not in the pool or taken.
+        bool reserve(int);
+        void release(int);
+        
+        bool inPool(int) const;
+        bool isFree(int) const;
+        std::size_t available() const;
+        
+        // Checks up to the given number of free ports, picked as `allocate` would, 
+        // concurrently and withdraws any that are already bound by another process. 
+        // Those left are the next to be allocated. Returns the number of ports withdrawn.
+        int probe(const std::string &, std::size_t);
+    };
+    
+    // Checks ports concurrently with non-blocking sockets. 
+    // Returns the subset of ports that are already in use.
+    std::set<int> probePorts(const std::string &, const std::set<int> &);
+    
+    PortAllocator &getPortAllocator();
+    
+    // Rebuilds the allocator from the students config, keeping persisted 
+    // assignments that are still within the configured ports.
+    void initPorts();
+    // Ensures every student has a port, persisting new assignments.
+    bool assignStudentPorts();
+    // Returns -1 if the student has no port.
+    int getStudentPort(const uuids::uuid &);
+    
+    // Asks the kernel for an unused loopback port for servers hidden behind instruct.
+    int getInternalPort();
+}
+
+#endif
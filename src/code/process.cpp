@@ -0,0 +1,401 @@
+#include <exception>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <cstring>
+#include <csignal>
+#include <thread>
+#include <random>
+#include <cerrno>
+#include <mutex>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <poll.h>
+
+#include "loguru.hpp"
+#include "httplib.h"
+
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "userdata.hpp"
+#include "../data.hpp"
+#include "process.hpp"
+#include "cgroup.hpp"
+#include "image.hpp"
+
+namespace instruct {
+
+// From `linux/ioprio.h`, which glibc doesn't wrap and older kernel headers lack.
+static constexpr int IOPRIO_CLASS_SHIFT {13};
+static constexpr int IOPRIO_WHO_PROCESS {1};
+// From `linux/mempolicy.h`, since `numaif.h` belongs to libnuma.
+static constexpr int MPOL_PREFERRED_MODE {1};
+
+// Serializes creating tokens, so two callers can't each write a different one.
+static std::mutex tokensMutex {};
+
+std::optional<std::filesystem::path> code::locateServerRoot() {
+    // The archive unpacks into a versioned directory, i.e. 
+    // `openvscode-server-v1.79.2-linux-x64`.
+    std::string prefix {
+        "openvscode-server-" + IData::instructorData->get_ovscsVersion() + "-linux-"
+    };
+    std::filesystem::path searchDirs [] {
+        constants::OPENVSCODE_SERVER_DIR, 
+        std::filesystem::current_path()
+    };
+    for (std::filesystem::path &searchDir : searchDirs) {
+        std::error_code err;
+        std::filesystem::directory_iterator dirIter {searchDir, err};
+        if (err) {
+            log::logErrorCodeWarning(err);
+            continue;
+        }
+        for (const std::filesystem::directory_entry &dirEntry : dirIter) {
+            std::string name {dirEntry.path().filename()};
+            if (dirEntry.is_directory() && name.rfind(prefix, 0) == 0) {
+                return dirEntry.path();
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::string code::makeToken() {
+    static const char HEX_DIGITS[] {"0123456789abcdef"};
+    std::random_device entropy {};
+    std::string token {};
+    for (int word {}; word < 8; ++word) {
+        std::uint32_t bits {entropy()};
+        for (int digit {}; digit < 8; ++digit, bits >>= 4) {
+            token.push_back(HEX_DIGITS[bits & 0xF]);
+        }
+    }
+    return token;
+}
+
+// Created with owner-only permissions from the start and renamed into place, 
+// so the token is never readable by anyone else, even partially written.
+static bool writeToken(const std::filesystem::path &target, const std::string &token) {
+    std::error_code err;
+    std::filesystem::create_directories(target.parent_path(), err);
+    std::filesystem::path staging {target.string() + ".tmp"};
+    std::filesystem::remove(staging, err);
+    int fd {open(
+        staging.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600
+    )};
+    if (fd == -1) {
+        LOG_F(ERROR, "Failed to create %s: %s", staging.c_str(), std::strerror(errno));
+        return false;
+    }
+    bool written {write(fd, token.data(), token.size()) == static_cast<ssize_t>(token.size())};
+    written = fsync(fd) == 0 && written;
+    close(fd);
+    if (!written || rename(staging.c_str(), target.c_str()) == -1) {
+        LOG_F(ERROR, "Failed to write %s: %s", target.c_str(), std::strerror(errno));
+        std::filesystem::remove(staging, err);
+        return false;
+    }
+    return true;
+}
+
+std::string code::loadConnectionToken(const std::filesystem::path &dataDir) {
+    std::filesystem::path target {dataDir / constants::CONNECTION_TOKEN_FILE};
+    std::lock_guard<std::mutex> lock {tokensMutex};
+    std::string token {};
+    std::ifstream fin {target};
+    if (fin >> token && !token.empty()) {
+        return token;
+    }
+    token = makeToken();
+    return writeToken(target, token) ? token : "";
+}
+
+code::SpawnSpec code::makeServerSpec(
+    const std::filesystem::path &serverRoot, 
+    const std::string &host, 
+    int port, 
+    const std::filesystem::path &workspace, 
+    const std::filesystem::path &dataDir, 
+    const std::string &label, 
+    const std::string &token
+) {
+    SpawnSpec spec {};
+    // Agents are handed the token, so it's written wherever the server runs.
+    std::filesystem::path tokenFile {dataDir / constants::CONNECTION_TOKEN_FILE};
+    {
+        std::lock_guard<std::mutex> lock {tokensMutex};
+        std::string current {};
+        std::ifstream fin {tokenFile};
+        if (!(fin >> current) || current != token) {
+            fin.close();
+            writeToken(tokenFile, token);
+        }
+    }
+    std::filesystem::path root {provisionServerView(serverRoot, dataDir)};
+    // Run node directly rather than the launcher script so the 
+    // supervised pid is the server itself.
+    std::filesystem::path node {root / "node"};
+    if (std::filesystem::exists(node)) {
+        spec.executable = node;
+        spec.args.push_back(root / "out" / "server-main.js");
+    } else {
+        spec.executable = root / "bin" / "openvscode-server";
+    }
+    spec.args.insert(spec.args.end(), {
+        "--host", host, 
+        "--port", std::to_string(port), 
+        "--connection-token-file", std::filesystem::absolute(tokenFile), 
+        "--user-data-dir", prepareUserData(label, dataDir / "user-data"), 
+        "--server-data-dir", dataDir / "server-data", 
+        "--extensions-dir", dataDir / "extensions", 
+        "--default-folder", std::filesystem::absolute(workspace)
+    });
+    spec.workingDir = workspace;
+    spec.logPath = constants::INSTANCE_LOG_DIR / (label + ".log");
+    spec.label = label;
+    return spec;
+}
+
+pid_t code::spawnProcess(const SpawnSpec &spec) {
+    std::error_code err;
+    std::filesystem::create_directories(spec.workingDir, err);
+    std::filesystem::create_directories(spec.logPath.parent_path(), err);
+    
+    // Everything the child touches is prepared before forking, since only 
+    // async-signal-safe calls are allowed between `fork` and `exec`.
+    std::vector<std::string> argStrs {spec.executable};
+    argStrs.insert(argStrs.end(), spec.args.begin(), spec.args.end());
+    std::vector<char *> argv {};
+    argv.reserve(argStrs.size() + 1);
+    for (std::string &arg : argStrs) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    
+    int logFd {open(spec.logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+    int devNull {open("/dev/null", O_RDONLY | O_CLOEXEC)};
+    
+    // The child joins its cgroup itself so that nothing it forks is left behind.
+    std::optional<std::filesystem::path> cgroup {createInstanceCgroup(spec.label, spec.budget)};
+    int procsFd {
+        cgroup ? open((*cgroup / "cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC) : -1
+    };
+    const SData::Budget &budget {spec.budget};
+    std::vector<std::pair<int, rlim_t>> limits {};
+    if (budget.addressSpaceMB > 0) {
+        limits.emplace_back(RLIMIT_AS, static_cast<rlim_t>(budget.addressSpaceMB) << 20);
+    }
+    if (budget.cpuSeconds > 0) {
+        limits.emplace_back(RLIMIT_CPU, budget.cpuSeconds);
+    }
+    if (budget.openFiles > 0) {
+        limits.emplace_back(RLIMIT_NOFILE, budget.openFiles);
+    }
+    if (budget.processes > 0) {
+        limits.emplace_back(RLIMIT_NPROC, budget.processes);
+    }
+    int ioPriority {
+        budget.ioClass > 0 
+            ? (budget.ioClass << IOPRIO_CLASS_SHIFT) | std::clamp(budget.ioLevel, 0, 7) 
+            : -1
+    };
+    
+    // Memory policy is set for the whole process rather than per mapping with `mbind`.
+    cpu_set_t cpuMask;
+    CPU_ZERO(&cpuMask);
+    for (int cpu : spec.placement.cpus) {
+        CPU_SET(cpu, &cpuMask);
+    }
+    unsigned long nodeMask {};
+    constexpr unsigned long NODE_MASK_BITS {sizeof(nodeMask) * 8};
+    bool preferNode {
+        spec.placement.node >= 0 
+            && static_cast<unsigned long>(spec.placement.node) < NODE_MASK_BITS
+    };
+    if (preferNode) {
+        nodeMask = 1ul << spec.placement.node;
+    }
+    
+    pid_t pid {fork()};
+    if (pid == 0) {
+        // Child.
+        setpgid(0, 0);
+        // Ignored signals survive `exec`, and instruct ignores `SIGPIPE` for its relays.
+        signal(SIGPIPE, SIG_DFL);
+        // So does the signal mask, and `instruct-agent` blocks `SIGTERM` to wait on it.
+        sigset_t unblocked;
+        sigemptyset(&unblocked);
+        sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+        // Budgets are best effort, e.g. raising priority needs `CAP_SYS_NICE`.
+        if (procsFd != -1 && write(procsFd, "0", 1) == -1) {
+            // Left in instruct's own cgroup, only the cgroup limits are lost.
+        }
+        if (budget.niceness != 0) {
+            setpriority(PRIO_PROCESS, 0, budget.niceness);
+        }
+        if (ioPriority != -1) {
+            syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioPriority);
+        }
+        if (!spec.placement.cpus.empty()) {
+            sched_setaffinity(0, sizeof(cpuMask), &cpuMask);
+        } else {
+            code::unpinThread();
+        }
+        // The kernel expects one more than the number of bits in the mask.
+        if (preferNode) {
+            syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &nodeMask, NODE_MASK_BITS + 1);
+        }
+        for (const auto &[resource, limit] : limits) {
+            rlimit rlim {limit, limit};
+            setrlimit(resource, &rlim);
+        }
+        if (devNull != -1) {
+            dup2(devNull, STDIN_FILENO);
+        }
+        if (logFd != -1) {
+            dup2(logFd, STDOUT_FILENO);
+            dup2(logFd, STDERR_FILENO);
+        }
+        if (chdir(spec.workingDir.c_str()) == -1) {
+            _exit(127);
+        }
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    
+    if (logFd != -1) {
+        close(logFd);
+    }
+    if (devNull != -1) {
+        close(devNull);
+    }
+    if (procsFd != -1) {
+        close(procsFd);
+    }
+    if (pid == -1) {
+        LOG_F(ERROR, "fork() failed: %s", std::strerror(errno));
+        return -1;
+    }
+    // Also set it from the parent to avoid racing the child.
+    setpgid(pid, pid);
+    
+    DLOG_F(INFO, "Spawned %s as pid %d.", spec.executable.c_str(), pid);
+    return pid;
+}
+
+bool code::processExited(pid_t pid, int pidfd) {
+    if (pidfd != -1) {
+        // A pidfd turns readable once the process exits, whoever reaps it.
+        pollfd pfd {pidfd, POLLIN, 0};
+        return poll(&pfd, 1, 0) == 1;
+    }
+    int status {};
+    pid_t res {waitpid(pid, &status, WNOHANG)};
+    // `ECHILD` means it was already reaped or isn't our child.
+    return res == pid || (res == -1 && errno == ECHILD);
+}
+
+// Whether a process that may not be instruct's child, so can't be waited for, 
+// is gone. A pid taken over by another process counts as gone.
+static bool strangerExited(pid_t pid, std::uint64_t startTicks) {
+    if (kill(pid, 0) == -1 && errno == ESRCH) {
+        return true;
+    }
+    return code::readStartTicks(pid) != startTicks;
+}
+
+bool code::stopProcess(pid_t pid, int pidfd) {
+    if (pid <= 0) {
+        return false;
+    }
+    // Don't signal whichever group reused the pid of a process that's long gone.
+    if (pidfd != -1 && processExited(pid, pidfd)) {
+        return true;
+    }
+    // Without a pidfd, `waitpid` only tells about children. Others, i.e. those 
+    // reattached after a restart, are watched by their start time instead.
+    std::uint64_t startTicks {pidfd == -1 ? readStartTicks(pid) : 0};
+    auto exited {[&] {
+        if (pidfd != -1) {
+            return processExited(pid, pidfd);
+        }
+        int status {};
+        pid_t res {waitpid(pid, &status, WNOHANG)};
+        if (res == -1 && errno == ECHILD) {
+            return strangerExited(pid, startTicks);
+        }
+        return res == pid;
+    }};
+    if (kill(-pid, SIGTERM) == -1 && errno == ESRCH) {
+        exited();
+        return true;
+    }
+    auto deadline {std::chrono::steady_clock::now() + constants::PROCESS_STOP_GRACE_PERIOD};
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (exited()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds {20});
+    }
+    LOG_F(WARNING, "Process %d ignored SIGTERM. Killing.", pid);
+    kill(-pid, SIGKILL);
+    // Waits until the port and the rest of what it held are released.
+    deadline = std::chrono::steady_clock::now() + constants::PROCESS_STOP_GRACE_PERIOD;
+    while (!exited() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds {20});
+    }
+    return true;
+}
+
+int code::openPidfd(pid_t pid) {
+    #ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    #else
+    return -1;
+    #endif
+}
+
+std::uint64_t code::readStartTicks(pid_t pid) {
+    std::ifstream fin {"/proc/" + std::to_string(pid) + "/stat"};
+    std::string line {};
+    if (!std::getline(fin, line)) {
+        return 0;
+    }
+    // Skip past the command name, which may contain spaces.
+    std::size_t commEnd {line.rfind(')')};
+    if (commEnd == std::string::npos) {
+        return 0;
+    }
+    std::istringstream fields {line.substr(commEnd + 2)};
+    std::string field {};
+    // `starttime` is the 22nd field, the 20th after the command name.
+    for (int idx {}; idx < 19; ++idx) {
+        fields >> field;
+    }
+    std::uint64_t startTicks {};
+    fields >> startTicks;
+    return startTicks;
+}
+
+bool code::serverReady(const std::string &host, int port) {
+    try {
+        std::string connectHost {host == "0.0.0.0" ? "127.0.0.1" : host};
+        httplib::Client client {connectHost, port};
+        client.set_connection_timeout(0, 200000);
+        client.set_read_timeout(1, 0);
+        httplib::Result res {client.Get("/")};
+        return res.error() == httplib::Error::Success;
+    } catch (const std::exception &e) {
+        log::logExceptionWarning(e);
+        return false;
+    }
+}
+
+}
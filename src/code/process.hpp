@@ -0,0 +1,70 @@
+#ifndef INSTRUCT_PROCESS_HPP
+#define INSTRUCT_PROCESS_HPP
+
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "placement.hpp"
+#include "../data.hpp"
+
+namespace instruct::code {
+    struct SpawnSpec {
+        std::filesystem::path executable;
+        std::vector<std::string> args;
+        std::filesystem::path workingDir;
+        std::filesystem::path logPath;
+        // Names the log file and, with delegation, the instance's cgroup.
+        std::string label;
+        SData::Budget budget {};
+        CpuPlacement placement {};
+    };
+    
+    // Locates the root of the extracted OpenVsCode Server distribution.
+    std::optional<std::filesystem::path> locateServerRoot();
+    
+    // 256 bits straight from the OS entropy source, as hex.
+    std::string makeToken();
+    // Returns the token an instance's editor requires of its clients, creating it 
+    // under the data directory the first time. Returns an empty string on failure.
+    std::string loadConnectionToken(const std::filesystem::path &);
+    
+    // Builds the command line for an OpenVsCode Server listening on `host:port`, 
+    // run from the instance's own view of the server under its data directory. 
+    // The server only lets in clients that present the given token, which must 
+    // not be empty.
+    SpawnSpec makeServerSpec(
+        const std::filesystem::path &, 
+        const std::string &, 
+        int, 
+        const std::filesystem::path &, 
+        const std::filesystem::path &, 
+        const std::string &, 
+        const std::string &
+    );
+    
+    // Starts the process in its own process group under the spec's budget. 
+    // Returns -1 on failure.
+    pid_t spawnProcess(const SpawnSpec &);
+    // Signals the process group, escalating to `SIGKILL` after a grace period. 
+    // Processes that aren't instruct's children are tracked through their pidfd, 
+    // or without one, by their pid and start time.
+    bool stopProcess(pid_t, int = -1);
+    // Returns true and reaps the process if it has exited.
+    bool processExited(pid_t, int = -1);
+    
+    // Returns -1 if the process is gone or the kernel lacks `pidfd_open`.
+    int openPidfd(pid_t);
+    // When the process started in clock ticks since boot, which tells it apart 
+    // from a later process reusing its pid. Returns 0 if it doesn't exist.
+    std::uint64_t readStartTicks(pid_t);
+    
+    // True once the server answers HTTP on `host:port`.
+    bool serverReady(const std::string &, int);
+}
+
+#endif
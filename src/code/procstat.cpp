@@ -0,0 +1,152 @@
+#include <unordered_set>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "../constants.hpp"
+#include "procstat.hpp"
+#include "cgroup.hpp"
+
+namespace instruct {
+
+// Reads the whole file into the buffer as a C string. Returns false if it's unreadable.
+static bool readSmallFile(const std::string &path, char *buffer, std::size_t size) {
+    int fd {open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd == -1) {
+        return false;
+    }
+    ssize_t length {read(fd, buffer, size - 1)};
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    return true;
+}
+
+static std::uint64_t parseField(const char *buffer, const char *name) {
+    const char *field {std::strstr(buffer, name)};
+    return field == nullptr ? 0 : std::strtoull(field + std::strlen(name), nullptr, 10);
+}
+
+static int countOpenFds(pid_t pid) {
+    std::string path {"/proc/" + std::to_string(pid) + "/fd"};
+    // Since Linux 6.2 the size of the directory is the number of open files.
+    struct stat info {};
+    if (stat(path.c_str(), &info) == 0 && info.st_size > 0) {
+        return static_cast<int>(info.st_size);
+    }
+    DIR *fds {opendir(path.c_str())};
+    if (fds == nullptr) {
+        return 0;
+    }
+    int count {};
+    while (const dirent *entry {readdir(fds)}) {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(fds);
+    return count;
+}
+
+// Only readable with ptrace access, so IO may be missing.
+static void addProcessIo(pid_t pid, code::GroupUsage &usage) {
+    char buffer[constants::SAMPLER_READ_BUFFER_SIZE];
+    if (readSmallFile("/proc/" + std::to_string(pid) + "/io", buffer, sizeof buffer)) {
+        usage.readBytes += parseField(buffer, "\nread_bytes: ");
+        usage.writeBytes += parseField(buffer, "\nwrite_bytes: ");
+    }
+}
+
+static std::unordered_map<pid_t, code::GroupUsage> scanProcessGroups(
+    const std::unordered_set<pid_t> &wanted, bool detailed
+) {
+    static const std::uint64_t pageSize {static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE))};
+    std::unordered_map<pid_t, code::GroupUsage> groups {};
+    DIR *proc {opendir("/proc")};
+    if (proc == nullptr) {
+        return groups;
+    }
+    char buffer[constants::SAMPLER_READ_BUFFER_SIZE];
+    while (const dirent *entry {readdir(proc)}) {
+        char *nameEnd {};
+        long pid {std::strtol(entry->d_name, &nameEnd, 10)};
+        if (*nameEnd != '\0' || pid <= 0 
+            || !readSmallFile(
+                std::string {"/proc/"} + entry->d_name + "/stat", buffer, sizeof buffer
+            )) {
+            continue;
+        }
+        // The command name may contain spaces, so start after its closing parenthesis. 
+        // `pgrp` is then the 3rd field, `utime` through `cstime` the 12th to 15th 
+        // and `rss` the 22nd.
+        char *field {std::strrchr(buffer, ')')};
+        if (field == nullptr) {
+            continue;
+        }
+        std::uint64_t values[22] {};
+        for (std::uint64_t &value : values) {
+            while (*field == ' ' || *field == ')') {
+                ++field;
+            }
+            value = std::strtoull(field, &field, 10);
+            while (*field != ' ' && *field != '\0') {
+                ++field;
+            }
+        }
+        pid_t group {static_cast<pid_t>(values[2])};
+        if (wanted.count(group) == 0) {
+            continue;
+        }
+        code::GroupUsage &usage {groups[group]};
+        usage.cpuTicks += values[11] + values[12] + values[13] + values[14];
+        usage.memoryBytes += values[21] * pageSize;
+        if (detailed) {
+            usage.openFds += countOpenFds(static_cast<pid_t>(pid));
+            addProcessIo(static_cast<pid_t>(pid), usage);
+        }
+    }
+    closedir(proc);
+    return groups;
+}
+
+static code::GroupUsage readCgroupUsage(const std::filesystem::path &cgroup, bool detailed) {
+    code::GroupUsage usage {};
+    usage.cpuTicks = code::readCgroupCpuMicros(cgroup) 
+        * static_cast<std::uint64_t>(sysconf(_SC_CLK_TCK)) / 1000000;
+    usage.memoryBytes = code::readCgroupMemoryBytes(cgroup);
+    if (detailed) {
+        code::readCgroupIoBytes(cgroup, usage.readBytes, usage.writeBytes);
+        std::ifstream fin {cgroup / "cgroup.procs"};
+        pid_t pid {};
+        while (fin >> pid) {
+            usage.openFds += countOpenFds(pid);
+        }
+    }
+    return usage;
+}
+
+code::InstanceUsage::InstanceUsage(
+    std::vector<pid_t> leaders, bool detailed
+) : leaders {std::move(leaders)}, detailed {detailed} {
+}
+
+code::GroupUsage code::InstanceUsage::of(pid_t pid) {
+    if (std::optional<std::filesystem::path> cgroup {getInstanceCgroup(pid)}; cgroup) {
+        return readCgroupUsage(*cgroup, detailed);
+    }
+    if (!groups) {
+        groups = scanProcessGroups({leaders.begin(), leaders.end()}, detailed);
+    }
+    auto it {groups->find(pid)};
+    return it == groups->end() ? GroupUsage {} : it->second;
+}
+
+}
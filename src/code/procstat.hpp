@@ -0,0 +1,44 @@
+#ifndef INSTRUCT_PROCSTAT_HPP
+#define INSTRUCT_PROCSTAT_HPP
+
+#include <unordered_map>
+#include <optional>
+#include <cstdint>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace instruct::code {
+    // Totals over every process of an instance, since OpenVsCode Server does most 
+    // of its work in children: the extension host, language servers and terminals.
+    struct GroupUsage {
+        // User and system CPU time in clock ticks, counting reaped children, 
+        // so the total doesn't drop when a worker exits.
+        std::uint64_t cpuTicks;
+        std::uint64_t memoryBytes;
+        int openFds;
+        // Storage reads and writes, not counting the page cache.
+        std::uint64_t readBytes;
+        std::uint64_t writeBytes;
+    };
+    
+    // What instances use, by the pid of their leader. Instances with a cgroup of 
+    // their own are read from it. The rest are summed by process group from one 
+    // pass over `/proc`, taken the first time one of them is asked for.
+    class InstanceUsage {
+        std::vector<pid_t> leaders;
+        bool detailed;
+        std::optional<std::unordered_map<pid_t, GroupUsage>> groups {};
+        
+        public:
+        
+        // Open files and IO take more reads per process, so they're only 
+        // counted when detailed.
+        InstanceUsage(std::vector<pid_t>, bool);
+        
+        // Zero throughout if the instance can't be read.
+        GroupUsage of(pid_t);
+    };
+}
+
+#endif
@@ -0,0 +1,471 @@
+#include <unordered_map>
+#include <algorithm>
+#include <optional>
+#include <cstring>
+#include <csignal>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <mutex>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "process.hpp"
+#include "../data.hpp"
+#include "relay.hpp"
+#include "proxy.hpp"
+#include "state.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    // A client whose request head is still being read.
+    struct PendingRequest {
+        int fd;
+        std::string head;
+        Clock::time_point deadline;
+        code::Endpoint endpoint {code::EndpointKind::Request, this};
+    };
+    
+    struct ProxiedTunnel {
+        code::Tunnel tunnel;
+        uuids::uuid uuid;
+        std::uint64_t reportedBytes {};
+    };
+    
+    struct RequestHead {
+        std::string target;
+        std::string host;
+        std::string session;
+    };
+    
+    std::thread proxyThread {};
+    std::atomic_bool proxying {false};
+    int epollFd {-1};
+    int wakeFd {-1};
+    int listenFd {-1};
+    code::Endpoint listenEndpoint {code::EndpointKind::Listener, nullptr};
+    code::Endpoint wakeEndpoint {code::EndpointKind::Wake, nullptr};
+    
+    std::unordered_map<PendingRequest *, std::unique_ptr<PendingRequest>> requests {};
+    std::unordered_map<code::Tunnel *, std::unique_ptr<ProxiedTunnel>> tunnels {};
+    
+    std::mutex sessionsMutex {};
+    std::unordered_map<std::string, uuids::uuid> sessions {};
+    
+    std::mutex statsMutex {};
+    code::ProxyStats stats {};
+}
+
+std::string code::issueSession(const uuids::uuid &uuid) {
+    std::string token {};
+    {
+        std::lock_guard<std::mutex> lock {sessionsMutex};
+        for (const auto &[issued, owner] : sessions) {
+            if (owner == uuid) {
+                return issued;
+            }
+        }
+        token = makeToken();
+        sessions.emplace(token, uuid);
+        std::lock_guard<std::mutex> statsLock {statsMutex};
+        stats.sessions = static_cast<int>(sessions.size());
+    }
+    saveState();
+    return token;
+}
+
+std::unordered_map<std::string, uuids::uuid> code::getSessions() {
+    std::lock_guard<std::mutex> lock {sessionsMutex};
+    return sessions;
+}
+
+void code::restoreSession(const std::string &token, const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {sessionsMutex};
+    sessions.emplace(token, uuid);
+    std::lock_guard<std::mutex> statsLock {statsMutex};
+    stats.sessions = static_cast<int>(sessions.size());
+}
+
+static std::optional<uuids::uuid> findSession(const std::string &token) {
+    std::lock_guard<std::mutex> lock {sessionsMutex};
+    auto it {sessions.find(token)};
+    if (it == sessions.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+static std::string trim(const std::string &str) {
+    std::size_t first {str.find_first_not_of(" \t")};
+    if (first == std::string::npos) {
+        return "";
+    }
+    return str.substr(first, str.find_last_not_of(" \t") - first + 1);
+}
+
+// Only the request target and the headers needed for routing are extracted. 
+// Everything is forwarded verbatim, so the backend still sees the full request.
+static std::optional<RequestHead> parseHead(const std::string &head) {
+    std::size_t lineEnd {head.find("\r\n")};
+    std::size_t targetStart {head.find(' ')};
+    if (lineEnd == std::string::npos || targetStart == std::string::npos 
+        || targetStart > lineEnd) {
+        return std::nullopt;
+    }
+    std::size_t targetEnd {head.find(' ', targetStart + 1)};
+    if (targetEnd == std::string::npos || targetEnd > lineEnd) {
+        return std::nullopt;
+    }
+    RequestHead request {};
+    request.target = head.substr(targetStart + 1, targetEnd - targetStart - 1);
+    
+    std::size_t headersEnd {head.find("\r\n\r\n")};
+    for (std::size_t pos {lineEnd + 2}; pos < headersEnd;) {
+        std::size_t next {head.find("\r\n", pos)};
+        std::string line {head.substr(pos, next - pos)};
+        pos = next + 2;
+        std::size_t colon {line.find(':')};
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name {line.substr(0, colon)};
+        std::transform(name.begin(), name.end(), name.begin(), [] (unsigned char c) {
+            return std::tolower(c);
+        });
+        std::string value {trim(line.substr(colon + 1))};
+        if (name == "host") {
+            request.host = value;
+        } else if (name == "cookie") {
+            std::size_t cookieStart {};
+            while (cookieStart < value.size()) {
+                std::size_t cookieEnd {std::min(value.find(';', cookieStart), value.size())};
+                std::string cookie {trim(value.substr(cookieStart, cookieEnd - cookieStart))};
+                std::size_t equals {cookie.find('=')};
+                if (equals != std::string::npos 
+                    && cookie.substr(0, equals) == constants::PROXY_SESSION_COOKIE) {
+                    request.session = cookie.substr(equals + 1);
+                }
+                cookieStart = cookieEnd + 1;
+            }
+        }
+    }
+    return request;
+}
+
+// Writes a bodyless response and leaves closing to the caller. 
+// A fresh connection's socket buffer always has room, so one send suffices.
+static void respond(int fd, const std::string &status, const std::string &headers) {
+    std::string response {
+        "HTTP/1.1 " + status + "\r\n" + headers 
+        + "Content-Length: 0\r\nConnection: close\r\n\r\n"
+    };
+    if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) == -1) {
+        DLOG_F(INFO, "Proxy response not delivered: %s", std::strerror(errno));
+    }
+}
+
+static void redirectToLogin(int fd, const RequestHead &request) {
+    std::string host {request.host};
+    // Strip the port, minding bracketed IPv6 literals.
+    std::size_t colon {host.rfind(':')};
+    if (colon != std::string::npos && host.find(']', colon) == std::string::npos) {
+        host = host.substr(0, colon);
+    }
+    respond(fd, "302 Found", 
+        "Location: http://" + host + ":" 
+        + std::to_string(SData::studentsData->get_authPort()) + "/\r\n");
+    std::lock_guard<std::mutex> lock {statsMutex};
+    ++stats.rejected;
+}
+
+static void dropRequest(PendingRequest *request) {
+    close(request->fd);
+    requests.erase(request);
+}
+
+static void dropTunnel(code::Tunnel *tunnel) {
+    code::closeTunnel(*tunnel);
+    code::recordActivity(tunnels.at(tunnel)->uuid, -1, 0);
+    tunnels.erase(tunnel);
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.tunnels = static_cast<int>(tunnels.size());
+}
+
+// Hands the connection to its student's instance, or answers it directly.
+static void routeRequest(PendingRequest *request) {
+    std::optional<RequestHead> head {parseHead(request->head)};
+    if (!head) {
+        respond(request->fd, "400 Bad Request", "");
+        dropRequest(request);
+        return;
+    }
+    
+    // The session in the path is traded for a cookie so that the editor's own 
+    // absolute URLs work unchanged.
+    const std::string &target {head->target};
+    if (target.rfind(constants::PROXY_SESSION_PATH, 0) == 0) {
+        std::size_t tokenStart {constants::PROXY_SESSION_PATH.size()};
+        std::size_t tokenEnd {std::min(target.find_first_of("/?", tokenStart), target.size())};
+        std::string token {target.substr(tokenStart, tokenEnd - tokenStart)};
+        if (!findSession(token)) {
+            redirectToLogin(request->fd, *head);
+        } else {
+            std::string location {target.substr(tokenEnd)};
+            if (location.empty() || location.front() != '/') {
+                location.insert(0, "/");
+            }
+            respond(request->fd, "302 Found", 
+                "Location: " + location + "\r\n"
+                "Set-Cookie: " + constants::PROXY_SESSION_COOKIE + "=" + token 
+                + "; Path=/; HttpOnly; SameSite=Lax\r\n");
+        }
+        dropRequest(request);
+        return;
+    }
+    
+    std::optional<uuids::uuid> uuid {findSession(head->session)};
+    std::optional<code::Instance> instance {uuid ? code::getInstance(*uuid) : std::nullopt};
+    if (!uuid || !instance || !code::instanceActive(*uuid)) {
+        // Logging in again starts the instance.
+        redirectToLogin(request->fd, *head);
+        dropRequest(request);
+        return;
+    }
+    code::thawInstance(*uuid);
+    
+    auto proxied {std::make_unique<ProxiedTunnel>()};
+    proxied->uuid = *uuid;
+    code::Tunnel &tunnel {proxied->tunnel};
+    if (!code::preloadTunnel(tunnel, request->head) 
+        || (tunnel.backendFd = code::connectTCP(instance->host, instance->port)) == -1) {
+        respond(request->fd, "502 Bad Gateway", "");
+        dropRequest(request);
+        return;
+    }
+    // The tunnel takes over the descriptor under a different endpoint.
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, request->fd, nullptr);
+    tunnel.clientFd = request->fd;
+    request->fd = -1;
+    requests.erase(request);
+    
+    code::recordActivity(*uuid, 1, 0);
+    tunnels.emplace(&tunnel, std::move(proxied));
+    code::watchTunnel(epollFd, tunnel, true);
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.tunnels = static_cast<int>(tunnels.size());
+}
+
+static void readRequest(PendingRequest *request) {
+    char chunk[4096];
+    while (true) {
+        ssize_t res {recv(request->fd, chunk, sizeof(chunk), 0)};
+        if (res > 0) {
+            request->head.append(chunk, res);
+            if (request->head.find("\r\n\r\n") != std::string::npos) {
+                routeRequest(request);
+                return;
+            }
+            if (request->head.size() > constants::PROXY_MAX_REQUEST_HEAD) {
+                respond(request->fd, "431 Request Header Fields Too Large", "");
+                dropRequest(request);
+                return;
+            }
+        } else if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        } else {
+            dropRequest(request);
+            return;
+        }
+    }
+}
+
+static void acceptClients() {
+    while (true) {
+        int clientFd {accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+        if (clientFd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_F(WARNING, "accept4() failed: %s", std::strerror(errno));
+            }
+            return;
+        }
+        auto request {std::make_unique<PendingRequest>()};
+        request->fd = clientFd;
+        request->deadline = Clock::now() + constants::PROXY_REQUEST_TIMEOUT;
+        epoll_event event {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = &request->endpoint;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &event);
+        requests.emplace(request.get(), std::move(request));
+    }
+}
+
+static void handleTunnelEvent(code::Tunnel *tunnel, code::EndpointKind kind) {
+    ProxiedTunnel &proxied {*tunnels.at(tunnel)};
+    if (kind == code::EndpointKind::Client) {
+        code::thawInstance(proxied.uuid);
+    }
+    if (kind == code::EndpointKind::Backend && !tunnel->backendConnected) {
+        if (!code::connectSucceeded(tunnel->backendFd)) {
+            LOG_F(WARNING, "Proxy failed to reach %s.", uuids::to_string(proxied.uuid).c_str());
+            dropTunnel(tunnel);
+            return;
+        }
+        tunnel->backendConnected = true;
+    }
+    bool alive {code::pumpTunnel(*tunnel)};
+    if (tunnel->bytesRelayed != proxied.reportedBytes) {
+        std::uint64_t delta {tunnel->bytesRelayed - proxied.reportedBytes};
+        code::recordActivity(proxied.uuid, 0, delta);
+        proxied.reportedBytes = tunnel->bytesRelayed;
+        std::lock_guard<std::mutex> lock {statsMutex};
+        stats.bytesRelayed += delta;
+    }
+    if (!alive) {
+        dropTunnel(tunnel);
+        return;
+    }
+    code::watchTunnel(epollFd, *tunnel, false);
+}
+
+static void runProxy() {
+    std::vector<epoll_event> events(constants::RELAY_MAX_EVENTS);
+    int timeoutMs {static_cast<int>(constants::LAUNCH_POLL_INTERVAL.count())};
+    while (proxying) {
+        int count {epoll_wait(epollFd, events.data(), events.size(), timeoutMs)};
+        if (count == -1 && errno != EINTR) {
+            LOG_F(ERROR, "epoll_wait() failed: %s", std::strerror(errno));
+            break;
+        }
+        for (int idx {}; idx < count; ++idx) {
+            code::Endpoint *endpoint {static_cast<code::Endpoint *>(events.at(idx).data.ptr)};
+            switch (endpoint->kind) {
+                case code::EndpointKind::Listener:
+                    acceptClients();
+                    break;
+                case code::EndpointKind::Request: {
+                    PendingRequest *request {static_cast<PendingRequest *>(endpoint->owner)};
+                    // An earlier event in this batch may have dropped it.
+                    if (requests.count(request) > 0) {
+                        readRequest(request);
+                    }
+                    break;
+                }
+                case code::EndpointKind::Client:
+                case code::EndpointKind::Backend: {
+                    code::Tunnel *tunnel {static_cast<code::Tunnel *>(endpoint->owner)};
+                    if (tunnels.count(tunnel) > 0) {
+                        handleTunnelEvent(tunnel, endpoint->kind);
+                    }
+                    break;
+                }
+                case code::EndpointKind::Wake:
+                    break;
+            }
+        }
+        
+        // Don't let idle connections that never finish a request pile up.
+        Clock::time_point now {Clock::now()};
+        std::vector<PendingRequest *> expired {};
+        for (auto &[request, owned] : requests) {
+            if (now > request->deadline) {
+                expired.push_back(request);
+            }
+        }
+        for (PendingRequest *request : expired) {
+            dropRequest(request);
+        }
+    }
+}
+
+bool code::startProxy() {
+    if (proxying) {
+        return true;
+    }
+    int port {SData::studentsData->get_proxyPort()};
+    if (port <= 0) {
+        return false;
+    }
+    // Splicing into a socket the peer already closed raises `SIGPIPE` instead of failing.
+    std::signal(SIGPIPE, SIG_IGN);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    listenFd = listenTCP(SData::studentsData->get_authHost(), port);
+    if (epollFd == -1 || wakeFd == -1 || listenFd == -1) {
+        LOG_F(ERROR, "Failed to start the student proxy: %s", std::strerror(errno));
+        for (int fd : {epollFd, wakeFd, listenFd}) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        epollFd = wakeFd = listenFd = -1;
+        return false;
+    }
+    epoll_event wakeEvent {};
+    wakeEvent.events = EPOLLIN;
+    wakeEvent.data.ptr = &wakeEndpoint;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent);
+    epoll_event listenEvent {};
+    listenEvent.events = EPOLLIN;
+    listenEvent.data.ptr = &listenEndpoint;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent);
+    
+    proxying = true;
+    proxyThread = std::thread {runProxy};
+    LOG_F(INFO, "Student proxy listening on port %d.", port);
+    return true;
+}
+
+void code::stopProxy() {
+    if (!proxying) {
+        return;
+    }
+    proxying = false;
+    std::uint64_t one {1};
+    if (write(wakeFd, &one, sizeof(one)) == -1) {
+        LOG_F(WARNING, "Failed to wake the proxy loop.");
+    }
+    proxyThread.join();
+    
+    for (auto &[tunnel, proxied] : tunnels) {
+        code::recordActivity(proxied->uuid, -1, 0);
+        closeTunnel(*tunnel);
+    }
+    tunnels.clear();
+    for (auto &[request, owned] : requests) {
+        close(request->fd);
+    }
+    requests.clear();
+    close(listenFd);
+    close(wakeFd);
+    close(epollFd);
+    listenFd = wakeFd = epollFd = -1;
+    
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.tunnels = 0;
+    DLOG_F(INFO, "Student proxy stopped.");
+}
+
+bool code::proxyRunning() {
+    return proxying;
+}
+
+code::ProxyStats code::getProxyStats() {
+    std::lock_guard<std::mutex> lock {statsMutex};
+    return stats;
+}
+
+}
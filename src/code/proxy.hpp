@@ -0,0 +1,36 @@
+#ifndef INSTRUCT_PROXY_HPP
+#define INSTRUCT_PROXY_HPP
+
+#include <unordered_map>
+#include <cstdint>
+#include <string>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct ProxyStats {
+        int sessions;
+        int tunnels;
+        // Requests without a valid session, which were sent back to the login page.
+        int rejected;
+        std::uint64_t bytesRelayed;
+    };
+    
+    // Listens on `proxy_port` and forwards each connection, WebSockets included, 
+    // to the instance of the student its session belongs to.
+    bool startProxy();
+    // Closes the listener and forwarded connections. Sessions and instances remain.
+    void stopProxy();
+    bool proxyRunning();
+    
+    // Returns the student's session token, creating one on the first login. 
+    // A browser presents it once as a path prefix and then as a cookie.
+    std::string issueSession(const uuids::uuid &);
+    // Sessions are persisted so students stay logged in across restarts.
+    std::unordered_map<std::string, uuids::uuid> getSessions();
+    void restoreSession(const std::string &, const uuids::uuid &);
+    
+    ProxyStats getProxyStats();
+}
+
+#endif
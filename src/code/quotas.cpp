@@ -0,0 +1,360 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+#include <sys/stat.h>
+
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "watcher.hpp"
+#include "../data.hpp"
+#include "quotas.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    struct Account {
+        // Bytes allocated to the files directly in each directory, by path relative 
+        // to the workspace, empty for the workspace itself.
+        std::unordered_map<std::string, std::uint64_t> dirs;
+        std::uint64_t bytes;
+        // The watcher's sequence the directories are current as of.
+        std::uint64_t since;
+        bool scanned;
+        Clock::time_point scannedAt;
+        code::QuotaState state;
+        bool paused;
+    };
+    
+    std::thread quotaThread {};
+    std::atomic_bool checking {false};
+    std::mutex quotaMutex {};
+    std::condition_variable quotaSignal {};
+    
+    // Only touched by the quota thread.
+    std::unordered_map<uuids::uuid, Account> accounts {};
+    
+    std::mutex usageMutex {};
+    std::unordered_map<uuids::uuid, code::DiskUsage> usages {};
+}
+
+static std::string parentRelative(const std::string &relative) {
+    std::size_t slash {relative.rfind('/')};
+    return slash == std::string::npos ? "" : relative.substr(0, slash);
+}
+
+static bool isWithin(const std::string &relative, const std::string &dir) {
+    return relative == dir || relative.rfind(dir + "/", 0) == 0;
+}
+
+// Soft and hard MB, where zero leaves either unset.
+static std::pair<int, int> quotaPolicy(const uuids::uuid &uuid) {
+    const auto &overrides {SData::studentsData->get_diskQuotaOverrides()};
+    auto it {overrides.find(uuid)};
+    if (it != overrides.end()) {
+        return it->second;
+    }
+    return SData::studentsData->get_diskQuotaMB();
+}
+
+// What's allocated rather than the apparent size, which is what fills the disk. 
+// Symbolic links are counted as themselves, and hard links once per name.
+static std::uint64_t allocatedBytes(const std::filesystem::path &path) {
+    struct stat info {};
+    if (lstat(path.c_str(), &info) == -1 || S_ISDIR(info.st_mode)) {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(info.st_blocks) * 512;
+}
+
+// Counts the directory and every one below it into the map. 
+// Returns false if the directory couldn't be read.
+static bool scanTree(
+    const std::filesystem::path &root, const std::string &relative, 
+    std::unordered_map<std::string, std::uint64_t> &dirs
+) {
+    std::filesystem::path top {relative.empty() ? root : root / relative};
+    std::error_code err;
+    std::filesystem::recursive_directory_iterator it {
+        top, std::filesystem::directory_options::skip_permission_denied, err
+    };
+    if (err) {
+        return false;
+    }
+    dirs[relative] = 0;
+    for (; it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        if (err) {
+            break;
+        }
+        std::string entryRelative {it->path().lexically_relative(root).string()};
+        if (it->is_directory(err) && !it->is_symlink(err)) {
+            dirs.try_emplace(entryRelative, 0);
+        } else {
+            dirs[parentRelative(entryRelative)] += allocatedBytes(it->path());
+        }
+    }
+    return true;
+}
+
+// Only the files directly in the directory. Returns false if it's gone.
+static bool countDir(
+    const std::filesystem::path &root, const std::string &relative, std::uint64_t &bytes
+) {
+    std::error_code err;
+    std::filesystem::directory_iterator it {relative.empty() ? root : root / relative, err};
+    if (err) {
+        return false;
+    }
+    bytes = 0;
+    for (; it != std::filesystem::directory_iterator {}; it.increment(err)) {
+        if (err) {
+            break;
+        }
+        if (!it->is_directory(err) || it->is_symlink(err)) {
+            bytes += allocatedBytes(it->path());
+        }
+    }
+    return true;
+}
+
+static void dropTree(Account &account, const std::string &relative) {
+    for (auto it {account.dirs.begin()}; it != account.dirs.end();) {
+        it = isWithin(it->first, relative) ? account.dirs.erase(it) : std::next(it);
+    }
+}
+
+static void rescanAccount(const uuids::uuid &uuid, Account &account, std::uint64_t since) {
+    std::unordered_map<std::string, std::uint64_t> dirs {};
+    // Workspaces are created when instances first start.
+    scanTree(code::getWorkspacePath(uuid), "", dirs);
+    account.dirs.swap(dirs);
+    account.since = since;
+    account.scanned = true;
+    account.scannedAt = Clock::now();
+}
+
+// Recounts the directories holding the changed paths, picking up directories 
+// that appeared and dropping those that are gone.
+static void updateAccount(
+    const uuids::uuid &uuid, Account &account, const code::WorkspaceChanges &changes
+) {
+    std::filesystem::path root {code::getWorkspacePath(uuid)};
+    std::unordered_set<std::string> recount {};
+    for (const std::string &relative : changes.paths) {
+        recount.insert(parentRelative(relative));
+        std::error_code err;
+        std::filesystem::file_status status {std::filesystem::symlink_status(root / relative, err)};
+        if (std::filesystem::is_directory(status)) {
+            // Moved in whole, so nothing below it was reported.
+            if (account.dirs.count(relative) == 0) {
+                scanTree(root, relative, account.dirs);
+            }
+            recount.insert(relative);
+        } else if (account.dirs.count(relative) > 0) {
+            dropTree(account, relative);
+        }
+    }
+    for (const std::string &relative : recount) {
+        std::uint64_t bytes {};
+        if (countDir(root, relative, bytes)) {
+            account.dirs[relative] = bytes;
+        } else {
+            dropTree(account, relative);
+        }
+    }
+    account.since = changes.sequence;
+}
+
+// Warns on going over a quota. Coming back under is only logged.
+static void reportTransition(
+    const uuids::uuid &uuid, const Account &account, code::QuotaState previous
+) {
+    const auto &students {SData::studentsData->get_students()};
+    auto student {students.find(uuid)};
+    std::string name {student != students.end() ? student->second.displayName : "A student"};
+    if (account.state < previous) {
+        LOG_F(
+            INFO, "Workspace of %s back under its %s disk quota.", 
+            name.c_str(), previous == code::QuotaState::Hard ? "hard" : "soft"
+        );
+        return;
+    }
+    bool hard {account.state == code::QuotaState::Hard};
+    LOG_F(WARNING, "Workspace of %s over its %s disk quota.", name.c_str(), hard ? "hard" : "soft");
+    notif::notify(
+        name + "'s workspace is over its " + (hard ? "hard" : "soft") + " disk quota at " 
+        + std::to_string(account.bytes >> 20) + " MB" 
+        + (account.paused ? ", so their instance was paused." : ".")
+    );
+}
+
+// Pauses the instance while over the hard quota, re-pausing it after a restart.
+static bool enforceQuota(const uuids::uuid &uuid, const Account &account) {
+    bool over {account.state == code::QuotaState::Hard 
+        && SData::studentsData->get_enforceDiskQuota()};
+    std::optional<code::Instance> instance {code::getInstance(uuid)};
+    if (!over) {
+        if (account.paused) {
+            code::resumeInstance(uuid);
+        }
+        return false;
+    }
+    // Instances on an agent can't be frozen from here.
+    if (instance && instance->pid != -1 && instance->agent == -1 
+        && instance->state == code::InstanceState::Running && !instance->paused) {
+        return code::pauseInstance(uuid);
+    }
+    return instance && instance->paused;
+}
+
+static void checkQuotas() {
+    // The scanners it starts inherit this, so none of them walk trees on the reserved core.
+    code::unpinThread();
+    while (checking) {
+        std::unordered_set<uuids::uuid> students {};
+        std::vector<uuids::uuid> rescans {};
+        std::vector<std::uint64_t> rescanSequences {};
+        Clock::time_point now {Clock::now()};
+        bool watched {code::watcherRunning()};
+        for (const auto &[uuid, student] : SData::studentsData->get_students()) {
+            students.insert(uuid);
+            Account &account {accounts[uuid]};
+            // Read before scanning, so changes made during the scan are seen again.
+            std::uint64_t sequence {code::changeSequence()};
+            if (!account.scanned || (!watched && now - account.scannedAt
+                >= constants::QUOTA_RESCAN_INTERVAL)) {
+                rescans.push_back(uuid);
+                rescanSequences.push_back(sequence);
+                continue;
+            }
+            if (!watched) {
+                continue;
+            }
+            code::WorkspaceChanges changes {code::changesSince(uuid, account.since)};
+            if (changes.sequence == account.since) {
+                continue;
+            }
+            if (changes.everything) {
+                rescans.push_back(uuid);
+                rescanSequences.push_back(changes.sequence);
+            } else {
+                updateAccount(uuid, account, changes);
+            }
+        }
+        for (auto it {accounts.begin()}; it != accounts.end();) {
+            it = students.count(it->first) == 0 ? accounts.erase(it) : std::next(it);
+        }
+        
+        // Made up front, so scanners never insert into the map.
+        std::vector<Account *> rescanAccounts {};
+        for (const uuids::uuid &uuid : rescans) {
+            rescanAccounts.push_back(&accounts.at(uuid));
+        }
+        std::atomic_size_t next {0};
+        auto work {[&] {
+            for (std::size_t idx {next++}; idx < rescans.size() && checking; idx = next++) {
+                rescanAccount(rescans.at(idx), *rescanAccounts.at(idx), rescanSequences.at(idx));
+            }
+        }};
+        std::size_t scannerCount {std::min(constants::QUOTA_MAX_SCANNERS, rescans.size())};
+        std::vector<std::thread> scanners {};
+        for (std::size_t idx {1}; idx < scannerCount; ++idx) {
+            scanners.emplace_back(work);
+        }
+        work();
+        for (std::thread &scanner : scanners) {
+            scanner.join();
+        }
+        if (!checking) {
+            break;
+        }
+        
+        std::unordered_map<uuids::uuid, code::DiskUsage> current {};
+        for (auto &[uuid, account] : accounts) {
+            if (!account.scanned) {
+                continue;
+            }
+            account.bytes = 0;
+            for (const auto &[relative, bytes] : account.dirs) {
+                account.bytes += bytes;
+            }
+            auto [softMB, hardMB] {quotaPolicy(uuid)};
+            std::uint64_t softBytes {static_cast<std::uint64_t>(std::max(softMB, 0)) << 20};
+            std::uint64_t hardBytes {static_cast<std::uint64_t>(std::max(hardMB, 0)) << 20};
+            code::QuotaState state {code::QuotaState::Under};
+            if (hardBytes > 0 && account.bytes > hardBytes) {
+                state = code::QuotaState::Hard;
+            } else if (softBytes > 0 && account.bytes > softBytes) {
+                state = code::QuotaState::Soft;
+            }
+            code::QuotaState previous {account.state};
+            account.state = state;
+            account.paused = enforceQuota(uuid, account);
+            if (state != previous) {
+                reportTransition(uuid, account, previous);
+            }
+            current[uuid] = {account.bytes, softBytes, hardBytes, state, account.paused};
+        }
+        {
+            std::lock_guard<std::mutex> lock {usageMutex};
+            usages.swap(current);
+        }
+        
+        std::unique_lock<std::mutex> lock {quotaMutex};
+        quotaSignal.wait_for(lock, constants::QUOTA_CHECK_INTERVAL, [] {
+            return !checking;
+        });
+    }
+}
+
+void code::startDiskQuotas() {
+    if (checking) {
+        return;
+    }
+    checking = true;
+    quotaThread = std::thread {checkQuotas};
+    DLOG_F(INFO, "Disk quota thread started.");
+}
+
+void code::stopDiskQuotas() {
+    {
+        std::lock_guard<std::mutex> lock {quotaMutex};
+        checking = false;
+    }
+    quotaSignal.notify_all();
+    if (quotaThread.joinable()) {
+        quotaThread.join();
+        DLOG_F(INFO, "Disk quota thread joined.");
+    }
+    // Paused instances would otherwise stay frozen with nothing left to resume them.
+    for (auto &[uuid, account] : accounts) {
+        if (account.paused) {
+            code::resumeInstance(uuid);
+        }
+    }
+    accounts.clear();
+    std::lock_guard<std::mutex> lock {usageMutex};
+    usages.clear();
+}
+
+std::optional<code::DiskUsage> code::getDiskUsage(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {usageMutex};
+    auto it {usages.find(uuid)};
+    if (it == usages.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+}
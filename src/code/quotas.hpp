@@ -0,0 +1,35 @@
+#ifndef INSTRUCT_QUOTAS_HPP
+#define INSTRUCT_QUOTAS_HPP
+
+#include <optional>
+#include <cstdint>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    enum class QuotaState {
+        Under, Soft, Hard
+    };
+    
+    struct DiskUsage {
+        // Allocated on disk, so sparse files only count for what they use.
+        std::uint64_t bytes;
+        // 0 where unset.
+        std::uint64_t softBytes;
+        std::uint64_t hardBytes;
+        QuotaState state;
+        // Whether the instance was paused for being over the hard quota.
+        bool paused;
+    };
+    
+    // Scans every student's workspace once, then keeps its usage current from 
+    // the watcher's changes, warning as it goes over `disk_quota_mb` and pausing 
+    // the instance over the hard quota if `enforce_disk_quota` is set.
+    void startDiskQuotas();
+    void stopDiskQuotas();
+    
+    // Nothing until the student's workspace has been scanned.
+    std::optional<DiskUsage> getDiskUsage(const uuids::uuid &);
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include <cstring>
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "relay.hpp"
+
+namespace instruct {
+
+code::RelayPipe::RelayPipe() {
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        LOG_F(WARNING, "Relay pipe2() failed: %s", std::strerror(errno));
+        return;
+    }
+    readFd = fds[0];
+    writeFd = fds[1];
+    // Larger pipes mean fewer wakeups per megabyte. The kernel may round up or refuse.
+    int size {fcntl(writeFd, F_SETPIPE_SZ, static_cast<int>(constants::RELAY_BUFFER_SIZE))};
+    if (size == -1) {
+        size = fcntl(writeFd, F_GETPIPE_SZ);
+    }
+    capacity = size > 0 ? static_cast<std::size_t>(size) : 0;
+}
+
+code::RelayPipe::~RelayPipe() {
+    if (readFd != -1) {
+        close(readFd);
+    }
+    if (writeFd != -1) {
+        close(writeFd);
+    }
+}
+
+bool code::RelayPipe::valid() const {
+    return readFd != -1 && capacity > 0;
+}
+
+bool code::RelayPipe::empty() const {
+    return pending == 0;
+}
+
+bool code::RelayPipe::full() const {
+    return pending >= capacity;
+}
+
+int code::listenTCP(const std::string &host, int port) {
+    int fd {socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (fd == -1) {
+        return -1;
+    }
+    int enable {1};
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 
+        || listen(fd, SOMAXCONN) == -1) {
+        LOG_F(WARNING, "Failed to listen on port %d: %s", port, std::strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int code::connectTCP(const std::string &host, int port) {
+    int fd {socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (fd == -1) {
+        LOG_F(WARNING, "Relay socket() failed: %s", std::strerror(errno));
+        return -1;
+    }
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    // Servers listening on every interface are reached over loopback.
+    if (host == "0.0.0.0" || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 
+        && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool code::connectSucceeded(int fd) {
+    int err {};
+    socklen_t errLen {sizeof(err)};
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) == 0 && err == 0;
+}
+
+// Splices from the socket into the pipe. Returns false on a hard error.
+static bool fill(int fd, code::RelayPipe &pipe, bool &eof) {
+    while (!eof && !pipe.full()) {
+        ssize_t res {splice(
+            fd, nullptr, pipe.writeFd, nullptr, 
+            pipe.capacity - pipe.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+        )};
+        if (res > 0) {
+            pipe.pending += res;
+        } else if (res == 0) {
+            eof = true;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+    }
+    return true;
+}
+
+// Splices from the pipe into the socket. Returns false on a hard error.
+static bool drain(int fd, code::RelayPipe &pipe, std::uint64_t &bytesRelayed) {
+    while (!pipe.empty()) {
+        ssize_t res {splice(
+            pipe.readFd, nullptr, fd, nullptr, 
+            pipe.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+        )};
+        if (res > 0) {
+            pipe.pending -= res;
+            bytesRelayed += res;
+        } else {
+            return res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        }
+    }
+    return true;
+}
+
+bool code::preloadTunnel(Tunnel &tunnel, const std::string &bytes) {
+    if (bytes.empty()) {
+        return true;
+    }
+    if (bytes.size() > tunnel.toBackend.capacity - tunnel.toBackend.pending) {
+        return false;
+    }
+    // The pipe is empty and large enough, so a single write never blocks or splits.
+    ssize_t res {write(tunnel.toBackend.writeFd, bytes.data(), bytes.size())};
+    if (res != static_cast<ssize_t>(bytes.size())) {
+        return false;
+    }
+    tunnel.toBackend.pending += bytes.size();
+    return true;
+}
+
+bool code::pumpTunnel(Tunnel &tunnel) {
+    if (!tunnel.toBackend.valid() || !tunnel.toClient.valid()) {
+        return false;
+    }
+    if (!tunnel.backendConnected) {
+        // Hold the client's bytes until there is somewhere to send them.
+        return fill(tunnel.clientFd, tunnel.toBackend, tunnel.clientEOF);
+    }
+    bool ok {
+        fill(tunnel.clientFd, tunnel.toBackend, tunnel.clientEOF) 
+        && drain(tunnel.backendFd, tunnel.toBackend, tunnel.bytesRelayed) 
+        && fill(tunnel.backendFd, tunnel.toClient, tunnel.backendEOF) 
+        && drain(tunnel.clientFd, tunnel.toClient, tunnel.bytesRelayed)
+    };
+    if (!ok) {
+        return false;
+    }
+    // Propagate half-closes once everything before them was delivered.
+    if (tunnel.clientEOF && tunnel.toBackend.empty()) {
+        shutdown(tunnel.backendFd, SHUT_WR);
+    }
+    if (tunnel.backendEOF && tunnel.toClient.empty()) {
+        shutdown(tunnel.clientFd, SHUT_WR);
+    }
+    return !(tunnel.clientEOF && tunnel.backendEOF 
+        && tunnel.toBackend.empty() && tunnel.toClient.empty());
+}
+
+std::uint32_t code::clientInterest(const Tunnel &tunnel) {
+    // A half-close stays pending under level triggering, so it's only asked for once.
+    std::uint32_t events {tunnel.clientEOF ? 0u : EPOLLRDHUP};
+    if (!tunnel.clientEOF && !tunnel.toBackend.full()) {
+        events |= EPOLLIN;
+    }
+    if (!tunnel.toClient.empty()) {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+std::uint32_t code::backendInterest(const Tunnel &tunnel) {
+    if (!tunnel.backendConnected) {
+        return EPOLLOUT;
+    }
+    std::uint32_t events {tunnel.backendEOF ? 0u : EPOLLRDHUP};
+    if (!tunnel.backendEOF && !tunnel.toClient.full()) {
+        events |= EPOLLIN;
+    }
+    if (!tunnel.toBackend.empty()) {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+void code::watchTunnel(int epollFd, Tunnel &tunnel, bool add) {
+    epoll_event clientEvent {};
+    clientEvent.events = clientInterest(tunnel);
+    clientEvent.data.ptr = &tunnel.clientEndpoint;
+    epoll_ctl(epollFd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, tunnel.clientFd, &clientEvent);
+    if (tunnel.backendFd != -1) {
+        epoll_event backendEvent {};
+        backendEvent.events = backendInterest(tunnel);
+        backendEvent.data.ptr = &tunnel.backendEndpoint;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, tunnel.backendFd, &backendEvent) == -1 
+            && errno == ENOENT) {
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, tunnel.backendFd, &backendEvent);
+        }
+    }
+}
+
+void code::closeTunnel(Tunnel &tunnel) {
+    if (tunnel.clientFd != -1) {
+        close(tunnel.clientFd);
+        tunnel.clientFd = -1;
+    }
+    if (tunnel.backendFd != -1) {
+        close(tunnel.backendFd);
+        tunnel.backendFd = -1;
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef INSTRUCT_RELAY_HPP
+#define INSTRUCT_RELAY_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace instruct::code {
+    enum class EndpointKind {
+        Listener, Client, Backend, Request, Wake
+    };
+    
+    // Attached to every descriptor registered with an epoll loop so 
+    // events can be routed back to their owner.
+    struct Endpoint {
+        EndpointKind kind;
+        void *owner;
+    };
+    
+    // A kernel pipe holding one direction of a tunnel's bytes in flight, 
+    // so they're moved between sockets with `splice` and never copied to user space.
+    struct RelayPipe {
+        int readFd {-1};
+        int writeFd {-1};
+        std::size_t pending {};
+        std::size_t capacity {};
+        
+        RelayPipe();
+        ~RelayPipe();
+        RelayPipe(const RelayPipe &) = delete;
+        RelayPipe &operator=(const RelayPipe &) = delete;
+        bool valid() const;
+        bool empty() const;
+        bool full() const;
+    };
+    
+    // A client connection forwarded to a backend.
+    struct Tunnel {
+        int clientFd {-1};
+        int backendFd {-1};
+        bool backendConnected {false};
+        RelayPipe toBackend;
+        RelayPipe toClient;
+        bool clientEOF {false};
+        bool backendEOF {false};
+        std::uint64_t bytesRelayed {};
+        Endpoint clientEndpoint {EndpointKind::Client, this};
+        Endpoint backendEndpoint {EndpointKind::Backend, this};
+        
+        Tunnel() = default;
+        Tunnel(const Tunnel &) = delete;
+        Tunnel &operator=(const Tunnel &) = delete;
+    };
+    
+    // Binds a non-blocking listening socket. Returns -1 on failure.
+    int listenTCP(const std::string &, int);
+    // Starts a non-blocking connect to an IPv4 address, where anything else means 
+    // loopback. Returns -1 on failure.
+    int connectTCP(const std::string &, int);
+    // True if a non-blocking connect on the descriptor succeeded.
+    bool connectSucceeded(int);
+    
+    // Queues bytes already read from the client, e.g. a request head, ahead of the rest. 
+    // Returns false if they don't fit.
+    bool preloadTunnel(Tunnel &, const std::string &);
+    // Moves whatever bytes are ready in both directions. 
+    // Returns false once the tunnel is finished or failed.
+    bool pumpTunnel(Tunnel &);
+    // The epoll events each side of the tunnel is currently waiting for.
+    std::uint32_t clientInterest(const Tunnel &);
+    std::uint32_t backendInterest(const Tunnel &);
+    // Registers or updates both descriptors of the tunnel with the epoll instance.
+    void watchTunnel(int, Tunnel &, bool);
+    // Closing the descriptors also removes them from any epoll set.
+    void closeTunnel(Tunnel &);
+}
+
+#endif
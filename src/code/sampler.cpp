@@ -0,0 +1,164 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include <unistd.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "procstat.hpp"
+#include "sampler.hpp"
+
+namespace instruct {
+
+namespace {
+    // Counters of an instance as of the previous round, to turn them into rates.
+    struct Counters {
+        pid_t pid;
+        std::chrono::steady_clock::time_point time;
+        std::uint64_t cpuTicks;
+        std::uint64_t readBytes;
+        std::uint64_t writeBytes;
+    };
+    
+    std::thread samplerThread {};
+    std::atomic_bool sampling {false};
+    std::mutex samplerMutex {};
+    std::condition_variable samplerSignal {};
+    
+    // Only ever replaced as a whole through `std::atomic_load` and `std::atomic_store`.
+    std::shared_ptr<const code::ResourceSnapshot> snapshot {
+        std::make_shared<const code::ResourceSnapshot>()
+    };
+}
+
+const code::ResourceSample &code::ResourceHistory::latest() const {
+    return samples.at((head + count - 1) % samples.size());
+}
+
+double code::ResourceHistory::peakCpuPercent() const {
+    double peak {};
+    for (std::size_t idx {}; idx < count; ++idx) {
+        peak = std::max(peak, samples.at((head + idx) % samples.size()).cpuPercent);
+    }
+    return peak;
+}
+
+static void fillRates(
+    code::ResourceSample &sample, const code::GroupUsage &usage, const Counters &previous
+) {
+    static const double ticksPerSec {static_cast<double>(sysconf(_SC_CLK_TCK))};
+    double seconds {std::chrono::duration<double> {sample.time - previous.time}.count()};
+    if (seconds <= 0) {
+        return;
+    }
+    sample.cpuPercent = (usage.cpuTicks - std::min(usage.cpuTicks, previous.cpuTicks)) 
+        / ticksPerSec / seconds * 100;
+    sample.readBytesPerSec = (usage.readBytes - std::min(usage.readBytes, previous.readBytes)) 
+        / seconds;
+    sample.writeBytesPerSec = (usage.writeBytes - std::min(usage.writeBytes, previous.writeBytes)) 
+        / seconds;
+}
+
+static void pushSample(code::ResourceHistory &history, const code::ResourceSample &sample) {
+    if (history.count < history.samples.size()) {
+        history.samples.at((history.head + history.count++) % history.samples.size()) = sample;
+    } else {
+        history.samples.at(history.head) = sample;
+        history.head = (history.head + 1) % history.samples.size();
+    }
+}
+
+static void runSampler() {
+    std::unordered_map<uuids::uuid, Counters> counters {};
+    std::unordered_map<uuids::uuid, code::ResourceHistory> histories {};
+    
+    while (sampling) {
+        std::chrono::steady_clock::time_point now {std::chrono::steady_clock::now()};
+        std::vector<code::Instance> instances {};
+        std::vector<pid_t> leaders {};
+        for (code::Instance &instance : code::getInstances()) {
+            // The pid of an instance on an agent isn't one of this host's.
+            if (instance.pid == -1 || instance.agent != -1 
+                || instance.state != code::InstanceState::Running) {
+                continue;
+            }
+            leaders.push_back(instance.pid);
+            instances.push_back(std::move(instance));
+        }
+        code::InstanceUsage usage {std::move(leaders), true};
+        
+        std::unordered_map<uuids::uuid, Counters> nextCounters {};
+        std::unordered_map<uuids::uuid, code::ResourceHistory> sampled {};
+        for (const code::Instance &instance : instances) {
+            code::GroupUsage group {usage.of(instance.pid)};
+            // Nothing is resident only once the instance has exited.
+            if (group.memoryBytes == 0) {
+                continue;
+            }
+            code::ResourceSample sample {now, 0.0, group.memoryBytes, group.openFds, 0.0, 0.0};
+            if (auto it {counters.find(instance.uuid)}; it != counters.end() 
+                && it->second.pid == instance.pid) {
+                fillRates(sample, group, it->second);
+            }
+            nextCounters[instance.uuid] = {
+                instance.pid, now, group.cpuTicks, group.readBytes, group.writeBytes
+            };
+            
+            code::ResourceHistory &history {sampled[instance.uuid]};
+            if (auto it {histories.find(instance.uuid)}; it != histories.end() 
+                && it->second.pid == instance.pid) {
+                history = std::move(it->second);
+            } else {
+                history = {instance.label, instance.pid, {}, 0, 0};
+            }
+            pushSample(history, sample);
+        }
+        // Instances that stopped or failed to sample are dropped with the old maps.
+        counters.swap(nextCounters);
+        histories.swap(sampled);
+        
+        std::shared_ptr<code::ResourceSnapshot> next {std::make_shared<code::ResourceSnapshot>()};
+        next->time = now;
+        next->instances = histories;
+        std::atomic_store(&snapshot, std::shared_ptr<const code::ResourceSnapshot> {next});
+        
+        std::unique_lock<std::mutex> lock {samplerMutex};
+        samplerSignal.wait_for(lock, constants::SAMPLER_INTERVAL, [] {
+            return !sampling;
+        });
+    }
+}
+
+void code::startResourceSampler() {
+    if (sampling) {
+        return;
+    }
+    sampling = true;
+    samplerThread = std::thread {runSampler};
+    DLOG_F(INFO, "Resource sampler thread started.");
+}
+
+void code::stopResourceSampler() {
+    {
+        std::lock_guard<std::mutex> lock {samplerMutex};
+        sampling = false;
+    }
+    samplerSignal.notify_all();
+    if (samplerThread.joinable()) {
+        samplerThread.join();
+        DLOG_F(INFO, "Resource sampler thread joined.");
+    }
+}
+
+std::shared_ptr<const code::ResourceSnapshot> code::getResourceSnapshot() {
+    return std::atomic_load(&snapshot);
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef INSTRUCT_SAMPLER_HPP
+#define INSTRUCT_SAMPLER_HPP
+
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <array>
+
+#include <sys/types.h>
+
+#include "uuid.h"
+
+#include "../constants.hpp"
+
+namespace instruct::code {
+    struct ResourceSample {
+        std::chrono::steady_clock::time_point time;
+        // Of one core, so a busy instance may exceed 100.
+        double cpuPercent;
+        std::uint64_t rssBytes;
+        int openFds;
+        // Storage reads and writes per second, not counting the page cache.
+        double readBytesPerSec;
+        double writeBytesPerSec;
+    };
+    
+    // The last `SAMPLER_HISTORY` samples of an instance, oldest first from `head`.
+    struct ResourceHistory {
+        std::string label;
+        pid_t pid;
+        std::array<ResourceSample, constants::SAMPLER_HISTORY> samples;
+        std::size_t head;
+        std::size_t count;
+        
+        const ResourceSample &latest() const;
+        double peakCpuPercent() const;
+    };
+    
+    // Published whole by the sampler and never modified afterwards.
+    struct ResourceSnapshot {
+        std::chrono::steady_clock::time_point time;
+        std::unordered_map<uuids::uuid, ResourceHistory> instances;
+    };
+    
+    // Samples every local running instance from one thread, 
+    // totalling each over its cgroup or process group.
+    void startResourceSampler();
+    void stopResourceSampler();
+    
+    // The latest snapshot, without taking any lock the sampler holds. 
+    // Empty until the first round completes.
+    std::shared_ptr<const ResourceSnapshot> getResourceSnapshot();
+}
+
+#endif
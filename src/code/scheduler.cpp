@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "scheduler.hpp"
+#include "admission.hpp"
+#include "../data.hpp"
+
+namespace instruct {
+
+namespace {
+    std::thread schedulerThread {};
+    std::atomic_bool cancelled {false};
+    
+    std::mutex progressMutex {};
+    code::LaunchProgress progress {};
+}
+
+std::vector<uuids::uuid> code::prioritizeLaunch(
+    const std::unordered_set<uuids::uuid> &selectedStudentUUIDs, 
+    bool includeInstructor
+) {
+    std::vector<uuids::uuid> order {};
+    const auto &studentMap {SData::studentsData->get_students()};
+    order.reserve(studentMap.size() + 1);
+    if (includeInstructor) {
+        order.push_back(INSTRUCTOR_UUID);
+    }
+    for (const uuids::uuid &uuid : selectedStudentUUIDs) {
+        if (studentMap.count(uuid) > 0) {
+            order.push_back(uuid);
+        }
+    }
+    for (const auto &[uuid, student] : studentMap) {
+        if (selectedStudentUUIDs.count(uuid) == 0) {
+            order.push_back(uuid);
+        }
+    }
+    return order;
+}
+
+static void updateProgress(
+    const std::function<void()> &onProgress, 
+    const std::function<void(code::LaunchProgress &)> &update
+) {
+    {
+        std::lock_guard<std::mutex> lock {progressMutex};
+        update(progress);
+    }
+    if (onProgress) {
+        onProgress();
+    }
+}
+
+static void runLaunch(std::vector<uuids::uuid> order, std::function<void()> onProgress) {
+    using Clock = std::chrono::steady_clock;
+    struct InFlight {
+        uuids::uuid uuid;
+        Clock::time_point launchTime;
+    };
+    
+    const int maxWindow {std::max(1, SData::studentsData->get_launchConcurrency())};
+    int window {maxWindow};
+    // The fastest observed boot time serves as the baseline for "not overloaded".
+    Clock::duration baseline {Clock::duration::max()};
+    int fastStreak {};
+    
+    std::deque<uuids::uuid> queue {order.begin(), order.end()};
+    std::vector<InFlight> inFlight {};
+    inFlight.reserve(maxWindow);
+    
+    while (!cancelled && (!queue.empty() || !inFlight.empty())) {
+        // Fill the window.
+        while (!cancelled && !queue.empty() && static_cast<int>(inFlight.size()) < window) {
+            uuids::uuid uuid {queue.front()};
+            queue.pop_front();
+            if (code::instanceActive(uuid) && code::pollInstanceReady(uuid)) {
+                updateProgress(onProgress, [] (code::LaunchProgress &p) {++p.ready;});
+                continue;
+            }
+            code::AdmissionDecision admission {code::admitLaunch(uuid)};
+            if (admission.verdict == code::AdmissionVerdict::Defer) {
+                // Keep its place at the front so that priority order is preserved.
+                queue.push_front(uuid);
+                updateProgress(onProgress, [&] (code::LaunchProgress &p) {
+                    p.deferred = static_cast<int>(queue.size());
+                    p.eta = admission.eta;
+                });
+                break;
+            }
+            updateProgress(onProgress, [] (code::LaunchProgress &p) {p.deferred = 0;});
+            if (admission.verdict == code::AdmissionVerdict::Refuse 
+                || !code::startInstance(uuid)) {
+                updateProgress(onProgress, [] (code::LaunchProgress &p) {++p.failed;});
+                continue;
+            }
+            inFlight.push_back({uuid, Clock::now()});
+        }
+        updateProgress(onProgress, [&] (code::LaunchProgress &p) {
+            p.inFlight = static_cast<int>(inFlight.size());
+            p.window = window;
+        });
+        
+        std::this_thread::sleep_for(constants::LAUNCH_POLL_INTERVAL);
+        code::reapInstances();
+        
+        // Retire instances that answered or gave up.
+        for (auto it {inFlight.begin()}; it != inFlight.end() && !cancelled;) {
+            Clock::duration elapsed {Clock::now() - it->launchTime};
+            if (code::pollInstanceReady(it->uuid)) {
+                // Additive increase while boots stay close to the baseline, 
+                // multiplicative decrease once the machine is clearly saturated.
+                baseline = std::min(baseline, elapsed);
+                if (elapsed > baseline * 2) {
+                    window = std::max(1, window / 2);
+                    fastStreak = 0;
+                } else if (++fastStreak >= window) {
+                    window = std::min(maxWindow, window + 1);
+                    fastStreak = 0;
+                }
+                updateProgress(onProgress, [] (code::LaunchProgress &p) {++p.ready;});
+                it = inFlight.erase(it);
+            } else if (
+                elapsed > constants::LAUNCH_READY_TIMEOUT 
+                || !code::instanceActive(it->uuid)
+            ) {
+                LOG_F(WARNING, "Instance %s did not become ready.", 
+                    uuids::to_string(it->uuid).c_str());
+                updateProgress(onProgress, [] (code::LaunchProgress &p) {++p.failed;});
+                it = inFlight.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    updateProgress(onProgress, [] (code::LaunchProgress &p) {
+        p.inFlight = 0;
+        p.deferred = 0;
+        p.active = false;
+    });
+    code::LaunchProgress finalProgress {code::getLaunchProgress()};
+    LOG_F(
+        INFO, "Launch finished: %d ready, %d failed, %d total.", 
+        finalProgress.ready, finalProgress.failed, finalProgress.total
+    );
+    if (!cancelled && finalProgress.failed > 0) {
+        notif::notify(
+            std::to_string(finalProgress.failed) + " instance(s) failed to start. "
+            "See the log file for more details."
+        );
+    }
+}
+
+void code::scheduleLaunch(std::vector<uuids::uuid> order, std::function<void()> onProgress) {
+    cancelLaunch();
+    {
+        std::lock_guard<std::mutex> lock {progressMutex};
+        progress = {};
+        progress.total = static_cast<int>(order.size());
+        progress.window = SData::studentsData->get_launchConcurrency();
+        progress.active = true;
+    }
+    cancelled = false;
+    schedulerThread = std::thread {runLaunch, std::move(order), std::move(onProgress)};
+    DLOG_F(INFO, "Scheduler thread started.");
+}
+
+void code::cancelLaunch() {
+    cancelled = true;
+    if (schedulerThread.joinable()) {
+        schedulerThread.join();
+        DLOG_F(INFO, "Scheduler thread joined.");
+    }
+}
+
+code::LaunchProgress code::getLaunchProgress() {
+    std::lock_guard<std::mutex> lock {progressMutex};
+    return progress;
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef INSTRUCT_SCHEDULER_HPP
+#define INSTRUCT_SCHEDULER_HPP
+
+#include <unordered_set>
+#include <functional>
+#include <chrono>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct LaunchProgress {
+        int total;
+        int ready;
+        int failed;
+        int inFlight;
+        int window;
+        // Launches held back by admission control and when they might go ahead.
+        int deferred;
+        std::chrono::seconds eta;
+        bool active;
+    };
+    
+    // Orders the instructor first, then the selected students, then everyone else.
+    std::vector<uuids::uuid> prioritizeLaunch(const std::unordered_set<uuids::uuid> &, bool);
+    
+    // Starts the instances in order on a background thread, keeping at most 
+    // a window's worth of them booting at once and waiting while memory is short. The callback is invoked 
+    // from the scheduler thread whenever progress changes.
+    void scheduleLaunch(std::vector<uuids::uuid>, std::function<void()>);
+    // Stops scheduling further launches and joins the scheduler thread.
+    void cancelLaunch();
+    
+    LaunchProgress getLaunchProgress();
+}
+
+#endif
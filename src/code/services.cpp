@@ -0,0 +1,56 @@
+#include "loguru.hpp"
+
+#include "hibernation.hpp"
+#include "activator.hpp"
+#include "scheduler.hpp"
+#include "snapshots.hpp"
+#include "services.hpp"
+#include "userdata.hpp"
+#include "watcher.hpp"
+#include "sampler.hpp"
+#include "../data.hpp"
+#include "quotas.hpp"
+#include "agents.hpp"
+#include "proxy.hpp"
+#include "pool.hpp"
+
+namespace instruct {
+
+void code::startServices() {
+    DLOG_F(INFO, "Starting supervisor services.");
+    startAgentPolling();
+    startResourceSampler();
+    startWarmPool();
+    startHibernation();
+    startUserDataSync();
+    startWatcher();
+    startDiskQuotas();
+    startSnapshots();
+    // The proxy already owns the way in, so the two entry points are exclusive.
+    if (SData::studentsData->get_proxyPort() > 0) {
+        if (SData::studentsData->get_lazyStart()) {
+            LOG_F(INFO, "Lazy start is ignored while the student proxy is enabled.");
+        }
+        startProxy();
+    } else if (SData::studentsData->get_lazyStart()) {
+        startLazyActivation();
+    }
+}
+
+void code::stopServices() {
+    DLOG_F(INFO, "Stopping supervisor services.");
+    // Restarts scheduled by reattaching may still be underway.
+    cancelLaunch();
+    stopLazyActivation();
+    stopProxy();
+    stopHibernation();
+    stopSnapshots();
+    stopDiskQuotas();
+    stopWatcher();
+    stopUserDataSync();
+    stopWarmPool();
+    stopResourceSampler();
+    stopAgentPolling();
+}
+
+}
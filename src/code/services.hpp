@@ -0,0 +1,11 @@
+#ifndef INSTRUCT_SERVICES_HPP
+#define INSTRUCT_SERVICES_HPP
+
+namespace instruct::code {
+    // Starts the supervisor's background workers as configured in the students config.
+    void startServices();
+    // Stops them in reverse order. Running instances are left alone.
+    void stopServices();
+}
+
+#endif
@@ -0,0 +1,657 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <array>
+#include <mutex>
+#include <map>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "yaml-cpp/yaml.h"
+#include "picosha2.h"
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "snapshots.hpp"
+#include "fileops.hpp"
+#include "watcher.hpp"
+#include "../data.hpp"
+
+namespace instruct {
+
+namespace {
+    const std::filesystem::path CHUNKS_DIR {constants::SNAPSHOTS_DIR / "chunks"};
+    
+    // Random but fixed, so the same content is always cut at the same places.
+    const std::array<std::uint64_t, 256> GEAR {[] {
+        std::array<std::uint64_t, 256> gear {};
+        std::uint64_t state {0x9e3779b97f4a7c15ull};
+        for (std::uint64_t &value : gear) {
+            // splitmix64
+            std::uint64_t z {state += 0x9e3779b97f4a7c15ull};
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            value = z ^ (z >> 31);
+        }
+        return gear;
+    }()};
+    
+    struct FileRecord {
+        mode_t mode;
+        std::uint64_t size;
+        // Nanoseconds.
+        std::int64_t mtime;
+        std::uint64_t inode;
+        std::vector<std::string> chunks;
+    };
+    
+    // A workspace as captured, by path relative to it.
+    struct Tree {
+        std::map<std::string, mode_t> dirs;
+        std::map<std::string, FileRecord> files;
+        std::map<std::string, std::string> symlinks;
+    };
+    
+    // The latest snapshot of a student, which unchanged files are taken from.
+    struct Latest {
+        bool loaded;
+        Tree tree;
+        // As written, to tell whether anything changed since.
+        std::string text;
+        // The watcher's sequence when the workspace was last walked, if it was running.
+        std::uint64_t watchedAt;
+    };
+    
+    struct Capture {
+        bool succeeded;
+        bool changed;
+        int filesRead;
+        int filesUnchanged;
+    };
+    
+    std::thread snapshotThread {};
+    std::atomic_bool snapshotting {false};
+    std::atomic_bool roundUnderway {false};
+    std::mutex snapshotMutex {};
+    std::condition_variable snapshotSignal {};
+    // Requested rounds waiting for the thread.
+    std::vector<std::pair<std::vector<uuids::uuid>, std::function<void()>>> requests {};
+    // Of the requested round underway. Only invoked under the mutex, so it can be dropped.
+    std::function<void()> roundCallback {};
+    
+    // Only touched by rounds, which never overlap.
+    std::unordered_map<uuids::uuid, Latest> latest {};
+    
+    // Hashes of every chunk in the store.
+    std::mutex storeMutex {};
+    std::unordered_set<std::string> storedChunks {};
+    bool storeScanned {false};
+    std::uint64_t storeBytes {};
+    int chunksStored {};
+    std::uint64_t bytesStored {};
+    
+    std::mutex roundsMutex {};
+    std::vector<code::SnapshotRound> rounds {};
+}
+
+static std::filesystem::path chunkPath(const std::string &hash) {
+    return CHUNKS_DIR / hash.substr(0, 2) / hash.substr(2);
+}
+
+static std::filesystem::path snapshotPath(const std::string &label, const std::string &id) {
+    return constants::SNAPSHOTS_DIR / label / (id + ".yaml");
+}
+
+static void scanStore() {
+    std::error_code err;
+    std::filesystem::create_directories(CHUNKS_DIR, err);
+    std::filesystem::recursive_directory_iterator it {CHUNKS_DIR, err};
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        std::error_code sizeErr;
+        if (!it->is_regular_file(sizeErr) || it->path().filename().string().front() == '.') {
+            continue;
+        }
+        storedChunks.insert(
+            it->path().parent_path().filename().string() + it->path().filename().string()
+        );
+        storeBytes += it->file_size(sizeErr);
+    }
+    log::logErrorCodeWarning(err);
+    storeScanned = true;
+}
+
+// Cuts where the rolling hash of the last 64 bytes has its top bits clear, so an edit 
+// only moves the boundaries near it and the rest of the file still deduplicates.
+static std::size_t chunkLength(const unsigned char *data, std::size_t length) {
+    if (length <= constants::SNAPSHOT_MIN_CHUNK) {
+        return length;
+    }
+    std::size_t limit {std::min(length, constants::SNAPSHOT_MAX_CHUNK)};
+    std::uint64_t hash {};
+    for (std::size_t idx {constants::SNAPSHOT_MIN_CHUNK}; idx < limit; ++idx) {
+        hash = (hash << 1) + GEAR[data[idx]];
+        if (hash >> (64 - constants::SNAPSHOT_CHUNK_BITS) == 0) {
+            return idx + 1;
+        }
+    }
+    return limit;
+}
+
+// Returns the chunk's hash, or an empty string if it couldn't be stored.
+static std::string storeChunk(const unsigned char *data, std::size_t length) {
+    std::string hash {picosha2::hash256_hex_string(data, data + length)};
+    {
+        std::lock_guard<std::mutex> lock {storeMutex};
+        // Claimed before it's written, so no two workers write the same chunk.
+        if (!storedChunks.insert(hash).second) {
+            return hash;
+        }
+    }
+    std::filesystem::path path {chunkPath(hash)};
+    std::filesystem::path temp {path.parent_path() / ("." + path.filename().string())};
+    std::error_code err;
+    std::filesystem::create_directories(path.parent_path(), err);
+    int fd {open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0444)};
+    bool written {fd != -1};
+    for (std::size_t offset {}; written && offset < length;) {
+        ssize_t chunk {write(fd, data + offset, length - offset)};
+        written = chunk > 0;
+        offset += written ? chunk : 0;
+    }
+    if (fd != -1) {
+        written = close(fd) == 0 && written;
+    }
+    written = written && std::rename(temp.c_str(), path.c_str()) == 0;
+    std::lock_guard<std::mutex> lock {storeMutex};
+    if (!written) {
+        unlink(temp.c_str());
+        storedChunks.erase(hash);
+        return "";
+    }
+    storeBytes += length;
+    ++chunksStored;
+    bytesStored += length;
+    return hash;
+}
+
+static bool chunkFile(const std::filesystem::path &path, FileRecord &record) {
+    int fd {open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)};
+    if (fd == -1) {
+        return false;
+    }
+    static_assert(constants::SNAPSHOT_BUFFER_SIZE > constants::SNAPSHOT_MAX_CHUNK);
+    std::vector<unsigned char> buffer(constants::SNAPSHOT_BUFFER_SIZE);
+    std::size_t start {}, filled {};
+    bool ended {false};
+    record.size = 0;
+    while (!ended || start < filled) {
+        if (!ended) {
+            // Carry the remainder over, so chunks never straddle two reads.
+            std::memmove(buffer.data(), buffer.data() + start, filled - start);
+            filled -= start;
+            start = 0;
+            ssize_t length {code::readFull(fd, buffer.data() + filled, buffer.size() - filled)};
+            if (length == -1) {
+                close(fd);
+                return false;
+            }
+            filled += length;
+            ended = filled < buffer.size();
+        }
+        while (filled - start >= constants::SNAPSHOT_MAX_CHUNK || (ended && start < filled)) {
+            std::size_t length {chunkLength(buffer.data() + start, filled - start)};
+            std::string hash {storeChunk(buffer.data() + start, length)};
+            if (hash.empty()) {
+                close(fd);
+                return false;
+            }
+            record.chunks.push_back(std::move(hash));
+            record.size += length;
+            start += length;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+static std::string emitTree(const Tree &tree) {
+    YAML::Emitter emitter {};
+    emitter << YAML::BeginMap;
+    emitter << YAML::Key << "dirs" << YAML::Value << YAML::BeginMap;
+    for (const auto &[path, mode] : tree.dirs) {
+        emitter << YAML::Key << path << YAML::Value << mode;
+    }
+    emitter << YAML::EndMap;
+    emitter << YAML::Key << "files" << YAML::Value << YAML::BeginMap;
+    for (const auto &[path, record] : tree.files) {
+        emitter << YAML::Key << path << YAML::Value << YAML::BeginMap;
+        emitter << YAML::Key << "mode" << YAML::Value << record.mode;
+        emitter << YAML::Key << "size" << YAML::Value << record.size;
+        emitter << YAML::Key << "mtime" << YAML::Value << record.mtime;
+        emitter << YAML::Key << "inode" << YAML::Value << record.inode;
+        emitter << YAML::Key << "chunks" << YAML::Value << YAML::Flow << record.chunks;
+        emitter << YAML::EndMap;
+    }
+    emitter << YAML::EndMap;
+    emitter << YAML::Key << "symlinks" << YAML::Value << YAML::BeginMap;
+    for (const auto &[path, target] : tree.symlinks) {
+        emitter << YAML::Key << path << YAML::Value << target;
+    }
+    emitter << YAML::EndMap;
+    emitter << YAML::EndMap;
+    return emitter.c_str();
+}
+
+// Throws `YAML::Exception` on failure.
+static Tree parseTree(const YAML::Node &node) {
+    Tree tree {};
+    for (const auto &dir : node["dirs"]) {
+        tree.dirs.emplace(dir.first.as<std::string>(), dir.second.as<mode_t>());
+    }
+    for (const auto &file : node["files"]) {
+        const YAML::Node &fields {file.second};
+        tree.files.emplace(file.first.as<std::string>(), FileRecord {
+            fields["mode"].as<mode_t>(), 
+            fields["size"].as<std::uint64_t>(), 
+            fields["mtime"].as<std::int64_t>(), 
+            fields["inode"].as<std::uint64_t>(), 
+            fields["chunks"].as<std::vector<std::string>>()
+        });
+    }
+    for (const auto &symlink : node["symlinks"]) {
+        tree.symlinks.emplace(symlink.first.as<std::string>(), symlink.second.as<std::string>());
+    }
+    return tree;
+}
+
+static std::vector<std::string> listIds(const std::string &label) {
+    std::vector<std::string> ids {};
+    std::error_code err;
+    for (std::filesystem::directory_iterator it {constants::SNAPSHOTS_DIR / label, err};
+        !err && it != std::filesystem::directory_iterator {}; it.increment(err)) {
+        if (it->path().extension() == ".yaml") {
+            ids.push_back(it->path().stem().string());
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static void loadLatest(const std::string &label, Latest &previous) {
+    previous.loaded = true;
+    std::vector<std::string> ids {listIds(label)};
+    if (ids.empty()) {
+        return;
+    }
+    std::ifstream fin {snapshotPath(label, ids.back())};
+    previous.text.assign(std::istreambuf_iterator<char> {fin}, {});
+    try {
+        previous.tree = parseTree(YAML::Load(previous.text));
+    } catch (const YAML::Exception &e) {
+        log::logExceptionWarning(e);
+        previous = {true, {}, {}, 0};
+    }
+}
+
+static Capture captureWorkspace(const uuids::uuid &uuid, const std::string &id, Latest &previous) {
+    Capture capture {true, false, 0, 0};
+    std::filesystem::path workspace {code::getWorkspacePath(uuid)};
+    std::string label {workspace.filename().string()};
+    if (!previous.loaded) {
+        loadLatest(label, previous);
+    }
+    std::error_code err;
+    if (!std::filesystem::is_directory(workspace, err)) {
+        return capture;
+    }
+    // Read first, so that a change made during the walk shows up next round.
+    std::uint64_t watchedAt {code::changeSequence()};
+    if (previous.watchedAt != 0 && !code::workspaceChangedSince(uuid, previous.watchedAt)) {
+        return capture;
+    }
+    
+    Tree tree {};
+    std::filesystem::recursive_directory_iterator it {
+        workspace, std::filesystem::directory_options::skip_permission_denied, err
+    };
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        if (!snapshotting) {
+            return {false, false, capture.filesRead, capture.filesUnchanged};
+        }
+        const std::filesystem::path &path {it->path()};
+        std::string relative {path.lexically_relative(workspace).string()};
+        struct stat info {};
+        if (lstat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            tree.dirs.emplace(relative, info.st_mode & 07777);
+            continue;
+        }
+        if (S_ISLNK(info.st_mode)) {
+            std::error_code linkErr;
+            tree.symlinks.emplace(relative, std::filesystem::read_symlink(path, linkErr).string());
+            continue;
+        }
+        if (!S_ISREG(info.st_mode)) {
+            continue;
+        }
+        FileRecord record {
+            info.st_mode & 07777, 
+            static_cast<std::uint64_t>(info.st_size), 
+            static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec, 
+            static_cast<std::uint64_t>(info.st_ino), 
+            {}
+        };
+        // The same inode, size and modification time are taken to mean the same content.
+        auto prior {previous.tree.files.find(relative)};
+        if (prior != previous.tree.files.end() && prior->second.inode == record.inode 
+            && prior->second.size == record.size && prior->second.mtime == record.mtime) {
+            record.chunks = prior->second.chunks;
+            ++capture.filesUnchanged;
+        } else if (chunkFile(path, record)) {
+            ++capture.filesRead;
+        } else {
+            LOG_F(WARNING, "Failed to snapshot %s.", path.c_str());
+            capture.succeeded = false;
+            continue;
+        }
+        tree.files.emplace(relative, std::move(record));
+    }
+    if (err) {
+        log::logErrorCodeWarning(err);
+        capture.succeeded = false;
+    }
+    
+    previous.watchedAt = capture.succeeded ? watchedAt : 0;
+    std::string text {emitTree(tree)};
+    if (text == previous.text) {
+        return capture;
+    }
+    std::filesystem::path target {snapshotPath(label, id)};
+    std::filesystem::path temp {target.parent_path() / ("." + target.filename().string())};
+    std::filesystem::create_directories(target.parent_path(), err);
+    {
+        std::ofstream fout {temp};
+        fout << text;
+        if (!fout.flush()) {
+            previous.watchedAt = 0;
+            capture.succeeded = false;
+            return capture;
+        }
+    }
+    std::filesystem::rename(temp, target, err);
+    if (err) {
+        log::logErrorCodeWarning(err);
+        previous.watchedAt = 0;
+        capture.succeeded = false;
+        return capture;
+    }
+    previous.tree = std::move(tree);
+    previous.text = std::move(text);
+    capture.changed = true;
+    return capture;
+}
+
+static void runRound(const std::vector<uuids::uuid> &students) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point started {Clock::now()};
+    code::SnapshotRound round {
+        code::makeTimestampId(), static_cast<int>(students.size()), 0, 0, 0, 0, 0, 0, 0, {}
+    };
+    {
+        std::lock_guard<std::mutex> lock {storeMutex};
+        if (!storeScanned) {
+            scanStore();
+        }
+        chunksStored = 0;
+        bytesStored = 0;
+    }
+    // Made up front, so workers never insert into the map.
+    std::vector<Latest *> previous {};
+    for (const uuids::uuid &uuid : students) {
+        previous.push_back(&latest[uuid]);
+    }
+    
+    std::mutex roundMutex {};
+    auto capture {[&] (std::size_t idx) {
+        if (!snapshotting) {
+            return;
+        }
+        Capture result {captureWorkspace(students.at(idx), round.id, *previous.at(idx))};
+        std::lock_guard<std::mutex> lock {roundMutex};
+        round.changed += result.changed;
+        round.failed += !result.succeeded;
+        round.filesRead += result.filesRead;
+        round.filesUnchanged += result.filesUnchanged;
+    }};
+    code::forEachParallel(students.size(), constants::SNAPSHOT_MAX_WORKERS, capture);
+    
+    {
+        std::lock_guard<std::mutex> lock {storeMutex};
+        round.chunksStored = chunksStored;
+        round.bytesStored = bytesStored;
+        round.storeBytes = storeBytes;
+    }
+    round.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - started
+    );
+    LOG_F(
+        INFO, 
+        "Snapshot %s: %d/%d workspace(s) changed, %d file(s) read, %d unchanged, "
+        "%d chunk(s) and %llu KB stored (%llu MB in total) in %lld ms.", 
+        round.id.c_str(), round.changed, round.students, round.filesRead, round.filesUnchanged, 
+        round.chunksStored, static_cast<unsigned long long>(round.bytesStored >> 10), 
+        static_cast<unsigned long long>(round.storeBytes >> 20), 
+        static_cast<long long>(round.duration.count())
+    );
+    if (round.failed > 0) {
+        notif::notify(
+            std::to_string(round.failed) + " workspace(s) could not be fully snapshotted. "
+            "See the log file for more details."
+        );
+    }
+    std::lock_guard<std::mutex> lock {roundsMutex};
+    rounds.push_back(std::move(round));
+    if (rounds.size() > constants::SNAPSHOT_ROUND_HISTORY) {
+        rounds.erase(rounds.begin());
+    }
+}
+
+static void runSnapshots() {
+    code::unpinThread();
+    const std::chrono::minutes interval {SData::studentsData->get_snapshotIntervalMinutes()};
+    std::chrono::steady_clock::time_point due {std::chrono::steady_clock::now() + interval};
+    while (snapshotting) {
+        std::vector<uuids::uuid> students {};
+        {
+            std::unique_lock<std::mutex> lock {snapshotMutex};
+            auto ready {[&] {
+                return !snapshotting || !requests.empty();
+            }};
+            if (interval.count() > 0) {
+                snapshotSignal.wait_until(lock, due, ready);
+            } else {
+                snapshotSignal.wait(lock, ready);
+            }
+            if (!snapshotting) {
+                break;
+            }
+            if (!requests.empty()) {
+                roundUnderway = true;
+                students = std::move(requests.front().first);
+                roundCallback = std::move(requests.front().second);
+                requests.erase(requests.begin());
+            } else if (std::chrono::steady_clock::now() >= due) {
+                due = std::chrono::steady_clock::now() + interval;
+                for (const auto &[uuid, student] : SData::studentsData->get_students()) {
+                    students.push_back(uuid);
+                }
+            }
+        }
+        if (students.empty()) {
+            continue;
+        }
+        roundUnderway = true;
+        runRound(students);
+        roundUnderway = false;
+        std::lock_guard<std::mutex> lock {snapshotMutex};
+        if (roundCallback) {
+            roundCallback();
+            roundCallback = nullptr;
+        }
+    }
+}
+
+void code::startSnapshots() {
+    if (snapshotting) {
+        return;
+    }
+    snapshotting = true;
+    snapshotThread = std::thread {runSnapshots};
+    DLOG_F(INFO, "Snapshot thread started.");
+}
+
+void code::stopSnapshots() {
+    {
+        std::lock_guard<std::mutex> lock {snapshotMutex};
+        snapshotting = false;
+        requests.clear();
+    }
+    snapshotSignal.notify_all();
+    if (snapshotThread.joinable()) {
+        snapshotThread.join();
+        DLOG_F(INFO, "Snapshot thread joined.");
+    }
+}
+
+bool code::requestSnapshot(std::vector<uuids::uuid> students, std::function<void()> onDone) {
+    {
+        std::lock_guard<std::mutex> lock {snapshotMutex};
+        if (!snapshotting) {
+            return false;
+        }
+        requests.emplace_back(std::move(students), std::move(onDone));
+    }
+    snapshotSignal.notify_all();
+    return true;
+}
+
+void code::cancelSnapshotRequests() {
+    std::lock_guard<std::mutex> lock {snapshotMutex};
+    requests.clear();
+    roundCallback = nullptr;
+}
+
+bool code::snapshotRunning() {
+    if (roundUnderway) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock {snapshotMutex};
+    return !requests.empty();
+}
+
+std::vector<code::SnapshotRound> code::getSnapshotRounds() {
+    std::lock_guard<std::mutex> lock {roundsMutex};
+    return rounds;
+}
+
+std::vector<std::string> code::listSnapshots(const uuids::uuid &uuid) {
+    return listIds(workspaceLabel(uuid));
+}
+
+static bool restoreFile(const FileRecord &record, const std::filesystem::path &target) {
+    int out {open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, record.mode)};
+    if (out == -1) {
+        return false;
+    }
+    std::vector<unsigned char> buffer(constants::SNAPSHOT_MAX_CHUNK);
+    bool restored {true};
+    for (const std::string &hash : record.chunks) {
+        int in {open(chunkPath(hash).c_str(), O_RDONLY | O_CLOEXEC)};
+        ssize_t length {in == -1 ? -1 : code::readFull(in, buffer.data(), buffer.size())};
+        if (in != -1) {
+            close(in);
+        }
+        restored = length > 0 && write(out, buffer.data(), length) == length;
+        if (!restored) {
+            LOG_F(WARNING, "Chunk %s of %s is missing.", hash.c_str(), target.c_str());
+            break;
+        }
+    }
+    fchmod(out, record.mode);
+    timespec times[2] {
+        {0, UTIME_OMIT}, 
+        {
+            static_cast<time_t>(record.mtime / 1000000000), 
+            static_cast<long>(record.mtime % 1000000000)
+        }
+    };
+    futimens(out, times);
+    return close(out) == 0 && restored;
+}
+
+bool code::restoreSnapshot(
+    const uuids::uuid &uuid, const std::string &id, const std::filesystem::path &destination
+) {
+    std::string label {workspaceLabel(uuid)};
+    std::vector<std::string> ids {listIds(label)};
+    // The latest snapshot at or before the round, since unchanged students write none.
+    auto found {std::upper_bound(ids.begin(), ids.end(), id)};
+    if (found == ids.begin()) {
+        LOG_F(WARNING, "%s has no snapshot as of %s.", label.c_str(), id.c_str());
+        return false;
+    }
+    Tree tree {};
+    try {
+        tree = parseTree(YAML::LoadFile(snapshotPath(label, *std::prev(found))));
+    } catch (const YAML::Exception &e) {
+        log::logExceptionWarning(e);
+        return false;
+    }
+    
+    std::error_code err;
+    std::filesystem::create_directories(destination, err);
+    for (const auto &[path, mode] : tree.dirs) {
+        std::filesystem::create_directories(destination / path, err);
+    }
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return false;
+    }
+    bool restored {true};
+    for (const auto &[path, record] : tree.files) {
+        if (!restoreFile(record, destination / path)) {
+            LOG_F(WARNING, "Failed to restore %s.", (destination / path).c_str());
+            restored = false;
+        }
+    }
+    for (const auto &[path, target] : tree.symlinks) {
+        std::filesystem::remove(destination / path, err);
+        std::filesystem::create_symlink(target, destination / path, err);
+        if (err) {
+            log::logErrorCodeWarning(err);
+            restored = false;
+        }
+    }
+    // Last, since a directory may not be writable.
+    for (const auto &[path, mode] : tree.dirs) {
+        std::filesystem::permissions(
+            destination / path, static_cast<std::filesystem::perms>(mode), err
+        );
+    }
+    return restored;
+}
+
+}
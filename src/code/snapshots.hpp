@@ -0,0 +1,51 @@
+#ifndef INSTRUCT_SNAPSHOTS_HPP
+#define INSTRUCT_SNAPSHOTS_HPP
+
+#include <filesystem>
+#include <functional>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct SnapshotRound {
+        // Shared by every student captured in the round.
+        std::string id;
+        int students;
+        // Students with a new snapshot, i.e. whose workspace changed since their last.
+        int changed;
+        int failed;
+        // Files chunked and those taken from the previous snapshot on their metadata alone.
+        int filesRead;
+        int filesUnchanged;
+        int chunksStored;
+        // What the round added to the store, and the size of the store after it.
+        std::uint64_t bytesStored;
+        std::uint64_t storeBytes;
+        std::chrono::milliseconds duration;
+    };
+    
+    // Periodically snapshots every student's workspace into a deduplicated chunk 
+    // store every `snapshot_interval_minutes`, if set.
+    void startSnapshots();
+    void stopSnapshots();
+    // Snapshots the given students on the snapshot thread as soon as it's free. 
+    // The callback is invoked once the round is complete.
+    bool requestSnapshot(std::vector<uuids::uuid>, std::function<void()>);
+    // Drops requested rounds not yet started, and the callback of the one underway.
+    void cancelSnapshotRequests();
+    bool snapshotRunning();
+    
+    // The most recent rounds, oldest first.
+    std::vector<SnapshotRound> getSnapshotRounds();
+    // Ids of the student's snapshots, oldest first.
+    std::vector<std::string> listSnapshots(const uuids::uuid &);
+    // Writes the student's workspace as of the given round into the directory. 
+    // A student unchanged in that round is restored from their snapshot before it.
+    bool restoreSnapshot(const uuids::uuid &, const std::string &, const std::filesystem::path &);
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <system_error>
+#include <exception>
+#include <algorithm>
+#include <optional>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <mutex>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "yaml-cpp/yaml.h"
+#include "loguru.hpp"
+#include "uuid.h"
+
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "scheduler.hpp"
+#include "../data.hpp"
+#include "process.hpp"
+#include "agents.hpp"
+#include "ports.hpp"
+#include "proxy.hpp"
+#include "state.hpp"
+
+namespace instruct {
+
+namespace {
+    namespace keys {
+        static const std::string INSTANCES {"instances"};
+        static const std::string SESSIONS {"sessions"};
+        static const std::string UUID {"uuid"};
+        static const std::string PID {"pid"};
+        static const std::string START_TICKS {"start_ticks"};
+        static const std::string LABEL {"label"};
+        static const std::string HOST {"host"};
+        static const std::string PORT {"port"};
+        static const std::string READY {"ready"};
+        static const std::string FROZEN {"frozen"};
+        static const std::string POOLED {"pooled"};
+        static const std::string AGENT_HOST {"agent_host"};
+        static const std::string AGENT_PORT {"agent_port"};
+    }
+    
+    std::mutex stateMutex {};
+}
+
+bool code::saveState() {
+    // Held while taking the snapshot too, or a writer with an older snapshot 
+    // could rename it over a newer one.
+    std::lock_guard<std::mutex> lock {stateMutex};
+    YAML::Node root {};
+    root[keys::INSTANCES] = YAML::Node {YAML::NodeType::Sequence};
+    for (const Instance &instance : getInstances()) {
+        if (instance.pid == -1) {
+            continue;
+        }
+        YAML::Node node {};
+        node[keys::UUID] = uuids::to_string(instance.uuid);
+        node[keys::PID] = instance.pid;
+        node[keys::START_TICKS] = instance.startTicks;
+        node[keys::LABEL] = instance.label;
+        node[keys::HOST] = instance.host;
+        node[keys::PORT] = instance.port;
+        node[keys::READY] = instance.state == InstanceState::Running;
+        node[keys::FROZEN] = instance.frozen;
+        node[keys::POOLED] = instance.pooled;
+        // By address, since the agents may be listed in another order next time.
+        if (instance.agent != -1) {
+            const SData::Agent &agent {SData::studentsData->get_agents().at(instance.agent)};
+            node[keys::AGENT_HOST] = agent.host;
+            node[keys::AGENT_PORT] = agent.port;
+        }
+        root[keys::INSTANCES].push_back(node);
+    }
+    root[keys::SESSIONS] = YAML::Node {YAML::NodeType::Map};
+    for (const auto &[token, uuid] : getSessions()) {
+        root[keys::SESSIONS][token] = uuids::to_string(uuid);
+    }
+    
+    // Written aside and renamed over, so a crash never leaves a torn file.
+    std::filesystem::path tmpPath {constants::INSTANCES_STATE};
+    tmpPath += ".tmp";
+    std::error_code err;
+    std::filesystem::remove(tmpPath, err);
+    // Session tokens are as good as a login, so it's never readable by others.
+    int fd {open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)};
+    if (fd == -1) {
+        LOG_F(WARNING, "Failed to create %s: %s", tmpPath.c_str(), std::strerror(errno));
+        return false;
+    }
+    YAML::Emitter emitter {};
+    emitter << root;
+    std::string contents {emitter.c_str()};
+    contents.push_back('\n');
+    bool written {
+        write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size())
+    };
+    close(fd);
+    if (!written) {
+        LOG_F(WARNING, "Failed to write %s.", tmpPath.c_str());
+        std::filesystem::remove(tmpPath, err);
+        return false;
+    }
+    std::filesystem::rename(tmpPath, constants::INSTANCES_STATE, err);
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return false;
+    }
+    return true;
+}
+
+// Verifies the recorded process is still the one instruct started and opens a 
+// pidfd on it. Returns false if the instance has to be started again.
+static bool reattachInstance(code::Instance &instance) {
+    if (instance.agent != -1) {
+        return code::agentRunsInstance(instance.agent, instance.label);
+    }
+    if (instance.pid <= 0 || instance.startTicks == 0 
+        || code::readStartTicks(instance.pid) != instance.startTicks) {
+        return false;
+    }
+    instance.pidfd = code::openPidfd(instance.pid);
+    if (instance.pidfd == -1) {
+        // Without a pidfd a process that isn't our child can't be watched safely.
+        LOG_F(WARNING, "pidfd_open() is unavailable. Restarting pid %d.", instance.pid);
+        code::stopProcess(instance.pid);
+        return false;
+    }
+    // The pid may have been recycled between reading its start time and opening it.
+    if (code::readStartTicks(instance.pid) != instance.startTicks) {
+        close(instance.pidfd);
+        instance.pidfd = -1;
+        return false;
+    }
+    // Ports taken from the allocator must not be handed out again.
+    if (instance.pooled && !code::getPortAllocator().reserve(instance.port)) {
+        instance.pooled = false;
+    }
+    return true;
+}
+
+void code::reattachInstances() {
+    std::error_code err;
+    if (!std::filesystem::exists(constants::INSTANCES_STATE, err)) {
+        return;
+    }
+    YAML::Node root {};
+    try {
+        root = YAML::LoadFile(constants::INSTANCES_STATE);
+    } catch (const std::exception &e) {
+        log::logExceptionWarning(e);
+        return;
+    }
+    const auto &students {SData::studentsData->get_students()};
+    
+    for (const auto &session : root[keys::SESSIONS]) {
+        std::optional<uuids::uuid> uuid {
+            uuids::uuid::from_string(session.second.as<std::string>(""))
+        };
+        if (uuid && students.count(*uuid) > 0) {
+            restoreSession(session.first.as<std::string>(), *uuid);
+        }
+    }
+    
+    // What the agents run decides which of their instances are still there.
+    refreshAgents();
+    
+    int reattached {};
+    std::vector<uuids::uuid> restartUUIDs {};
+    for (const YAML::Node &node : root[keys::INSTANCES]) {
+        std::optional<uuids::uuid> uuid {
+            uuids::uuid::from_string(node[keys::UUID].as<std::string>(""))
+        };
+        if (!uuid) {
+            continue;
+        }
+        Instance instance {};
+        instance.uuid = *uuid;
+        instance.pid = node[keys::PID].as<pid_t>(-1);
+        instance.startTicks = node[keys::START_TICKS].as<std::uint64_t>(0);
+        instance.label = node[keys::LABEL].as<std::string>("");
+        instance.host = node[keys::HOST].as<std::string>("");
+        instance.port = node[keys::PORT].as<int>(-1);
+        instance.state = node[keys::READY].as<bool>(false) 
+            ? InstanceState::Running 
+            : InstanceState::Starting;
+        instance.frozen = node[keys::FROZEN].as<bool>(false);
+        instance.pooled = node[keys::POOLED].as<bool>(false);
+        bool remote {node[keys::AGENT_HOST].IsDefined()};
+        if (remote) {
+            instance.agent = findAgent(
+                node[keys::AGENT_HOST].as<std::string>(""), node[keys::AGENT_PORT].as<int>(-1)
+            );
+        }
+        
+        bool known {*uuid == INSTRUCTOR_UUID || students.count(*uuid) > 0};
+        // Those on an agent no longer in the config are started over.
+        if ((remote && instance.agent == -1) || !reattachInstance(instance)) {
+            if (known) {
+                restartUUIDs.push_back(*uuid);
+            }
+            continue;
+        }
+        if (!known) {
+            // The student was removed while instruct was down.
+            if (instance.agent != -1) {
+                stopOnAgent(instance.agent, instance.label);
+                continue;
+            }
+            stopProcess(instance.pid, instance.pidfd);
+            close(instance.pidfd);
+            if (instance.pooled) {
+                getPortAllocator().release(instance.port);
+            }
+            continue;
+        }
+        restoreInstance(instance);
+        ++reattached;
+    }
+    LOG_F(
+        INFO, "Reattached %d instance(s), %zu need restarting.", 
+        reattached, restartUUIDs.size()
+    );
+    saveState();
+    
+    // Lazy activation starts student instances again on their next connection.
+    if (SData::studentsData->get_lazyStart() && SData::studentsData->get_proxyPort() == 0) {
+        auto notInstructor {[] (const uuids::uuid &uuid) {return uuid != INSTRUCTOR_UUID;}};
+        restartUUIDs.erase(
+            std::remove_if(restartUUIDs.begin(), restartUUIDs.end(), notInstructor), 
+            restartUUIDs.end()
+        );
+    }
+    if (!restartUUIDs.empty()) {
+        scheduleLaunch(restartUUIDs, {});
+    }
+}
+
+}
@@ -0,0 +1,13 @@
+#ifndef INSTRUCT_STATE_HPP
+#define INSTRUCT_STATE_HPP
+
+namespace instruct::code {
+    // Records the running instances and proxy sessions so that a restarted 
+    // instruct takes them back instead of restarting every editor.
+    bool saveState();
+    // Adopts the instances that outlived the previous run and restarts the ones 
+    // that didn't. Call once ports are assigned and before services start.
+    void reattachInstances();
+}
+
+#endif
@@ -0,0 +1,614 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <csignal>
+#include <vector>
+#include <mutex>
+
+#include <unistd.h>
+
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "userdata.hpp"
+#include "../data.hpp"
+#include "process.hpp"
+#include "agents.hpp"
+#include "cgroup.hpp"
+#include "image.hpp"
+#include "ports.hpp"
+#include "state.hpp"
+
+namespace instruct {
+
+namespace {
+    std::mutex instancesMutex {};
+    std::unordered_map<uuids::uuid, code::Instance> instances {};
+    // Thaws asked for while held, carried out on release.
+    bool thawsHeld {false};
+    std::vector<uuids::uuid> heldThaws {};
+    // Students whose instances may not start, e.g. while their workspace is captured.
+    std::unordered_set<uuids::uuid> heldStarts {};
+    
+    enum class Claim {
+        Claimed, 
+        // Already starting or running.
+        Active, 
+        Held
+    };
+}
+
+static std::string instanceLabel(const uuids::uuid &uuid) {
+    return uuid == code::INSTRUCTOR_UUID ? "instructor" : uuids::to_string(uuid);
+}
+
+std::filesystem::path code::getWorkspacePath(const uuids::uuid &uuid) {
+    return constants::WORKSPACES_DIR / instanceLabel(uuid);
+}
+
+std::filesystem::path code::getInstanceDataPath(const uuids::uuid &uuid) {
+    return constants::INSTANCES_DIR / instanceLabel(uuid);
+}
+
+bool code::studentsBehindInstruct() {
+    return SData::studentsData->get_proxyPort() > 0 || SData::studentsData->get_lazyStart();
+}
+
+std::string code::studentInstanceHost() {
+    // Behind the proxy, student editors must only be reachable through it.
+    return studentsBehindInstruct() ? "127.0.0.1" : SData::studentsData->get_authHost();
+}
+
+// Marks the instance as starting under the same lock as the check, so that 
+// concurrent callers can't both spawn it. Once claimed, `previous` is what 
+// `abandonStart` rolls back to.
+static Claim claimStart(
+    const uuids::uuid &uuid, std::optional<code::InstanceState> &previous
+) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    if (it != instances.end() && (it->second.state == code::InstanceState::Starting 
+        || it->second.state == code::InstanceState::Running)) {
+        return Claim::Active;
+    }
+    if (heldStarts.count(uuid) > 0) {
+        LOG_F(INFO, "Held back the start of instance %s.", instanceLabel(uuid).c_str());
+        return Claim::Held;
+    }
+    if (it == instances.end()) {
+        previous = std::nullopt;
+        it = instances.emplace(uuid, code::Instance {}).first;
+        it->second.uuid = uuid;
+        it->second.label = instanceLabel(uuid);
+        it->second.pid = -1;
+        it->second.pidfd = -1;
+        it->second.agent = -1;
+    } else {
+        previous = it->second.state;
+    }
+    // Nothing is spawned yet, which `pollInstanceReady` goes by.
+    it->second.pid = -1;
+    it->second.state = code::InstanceState::Starting;
+    return Claim::Claimed;
+}
+
+// Undoes `claimStart` when nothing was spawned.
+static void abandonStart(
+    const uuids::uuid &uuid, const std::optional<code::InstanceState> &previous
+) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    if (it == instances.end() || it->second.state != code::InstanceState::Starting 
+        || it->second.pid != -1) {
+        return;
+    }
+    if (previous) {
+        it->second.state = *previous;
+    } else {
+        instances.erase(it);
+    }
+}
+
+// Starts a student's instance on whichever agent has the most room.
+static bool startRemoteInstance(const uuids::uuid &uuid) {
+    std::optional<code::InstanceState> previous {};
+    Claim claim {claimStart(uuid, previous)};
+    if (claim != Claim::Claimed) {
+        return claim == Claim::Active;
+    }
+    std::string label {instanceLabel(uuid)};
+    std::string token {code::loadConnectionToken(code::getInstanceDataPath(uuid))};
+    if (token.empty()) {
+        abandonStart(uuid, previous);
+        notif::notify("Failed to create an editor token. See the log file for more details.");
+        return false;
+    }
+    std::optional<code::RemoteInstance> remote {
+        code::spawnOnAgent(label, SData::studentsData->get_studentBudget(), token)
+    };
+    // Whether it was stopped while spawning, in which case it's stopped again once 
+    // there's something to stop.
+    bool cancelled {false};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        code::Instance &instance {instances[uuid]};
+        cancelled = instance.state != code::InstanceState::Starting;
+        instance.uuid = uuid;
+        instance.host = remote ? remote->host : "";
+        instance.port = remote ? remote->port : -1;
+        instance.pid = remote ? remote->pid : -1;
+        instance.startTicks = 0;
+        instance.label = label;
+        instance.token = token;
+        if (instance.pidfd != -1) {
+            close(instance.pidfd);
+        }
+        instance.pidfd = -1;
+        instance.agent = remote ? remote->agent : -1;
+        instance.state = remote ? code::InstanceState::Starting : code::InstanceState::Failed;
+        instance.startTime = std::chrono::steady_clock::now();
+        instance.lastActive = instance.startTime;
+        instance.frozen = false;
+        instance.paused = false;
+        instance.pooled = false;
+    }
+    if (!remote) {
+        return false;
+    }
+    LOG_F(
+        INFO, "Starting instance %s on %s:%d.", 
+        label.c_str(), remote->host.c_str(), remote->port
+    );
+    if (cancelled) {
+        code::stopInstance(uuid);
+        return false;
+    }
+    code::saveState();
+    return true;
+}
+
+bool code::startInstance(const uuids::uuid &uuid) {
+    bool isInstructor {uuid == INSTRUCTOR_UUID};
+    // Agents pick the ports of the students placed on them.
+    if (!isInstructor && agentsConfigured()) {
+        return startRemoteInstance(uuid);
+    }
+    // The assigned port belongs to the activator's listener under lazy start.
+    bool proxied {!isInstructor && studentsBehindInstruct()};
+    int port {
+        isInstructor ? IData::instructorData->get_codePort() 
+            : proxied ? getInternalPort() 
+            : getStudentPort(uuid)
+    };
+    std::string host {
+        isInstructor ? IData::instructorData->get_authHost() : studentInstanceHost()
+    };
+    if (port == -1) {
+        LOG_F(WARNING, "No port assigned to %s.", instanceLabel(uuid).c_str());
+        return false;
+    }
+    return startInstance(uuid, host, port);
+}
+
+bool code::startInstance(const uuids::uuid &uuid, const std::string &host, int port) {
+    std::optional<InstanceState> previous {};
+    Claim claim {claimStart(uuid, previous)};
+    if (claim != Claim::Claimed) {
+        return claim == Claim::Active;
+    }
+    
+    std::optional<std::filesystem::path> serverRoot {locateServerRoot()};
+    if (!serverRoot) {
+        abandonStart(uuid, previous);
+        notif::notify("OpenVsCode Server is not installed.");
+        return false;
+    }
+    
+    std::string token {loadConnectionToken(getInstanceDataPath(uuid))};
+    if (token.empty()) {
+        abandonStart(uuid, previous);
+        notif::notify("Failed to create an editor token. See the log file for more details.");
+        return false;
+    }
+    SpawnSpec spec {makeServerSpec(
+        *serverRoot, 
+        host, 
+        port, 
+        getWorkspacePath(uuid), 
+        getInstanceDataPath(uuid), 
+        instanceLabel(uuid), 
+        token
+    )};
+    spec.budget = uuid == INSTRUCTOR_UUID 
+        ? SData::studentsData->get_instructorBudget() 
+        : SData::studentsData->get_studentBudget();
+    spec.placement = placeInstance(instanceLabel(uuid), uuid == INSTRUCTOR_UUID);
+    pid_t pid {spawnProcess(spec)};
+    if (pid == -1) {
+        releasePlacement(instanceLabel(uuid));
+    }
+    
+    bool cancelled {false};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        Instance &instance {instances[uuid]};
+        cancelled = instance.state != InstanceState::Starting;
+        instance.uuid = uuid;
+        instance.host = host;
+        instance.port = port;
+        instance.pid = pid;
+        instance.startTicks = pid == -1 ? 0 : readStartTicks(pid);
+        instance.label = instanceLabel(uuid);
+        instance.token = token;
+        if (instance.pidfd != -1) {
+            close(instance.pidfd);
+        }
+        instance.pidfd = -1;
+        instance.agent = -1;
+        instance.state = pid == -1 ? InstanceState::Failed : InstanceState::Starting;
+        instance.startTime = std::chrono::steady_clock::now();
+        instance.lastActive = instance.startTime;
+        instance.frozen = false;
+        instance.paused = false;
+        instance.pooled = false;
+    }
+    LOG_F(INFO, "Starting instance %s on port %d.", instanceLabel(uuid).c_str(), port);
+    if (cancelled && pid != -1) {
+        stopInstance(uuid);
+        return false;
+    }
+    saveState();
+    return pid != -1;
+}
+
+bool code::stopInstance(const uuids::uuid &uuid) {
+    pid_t pid {-1};
+    int pidfd {-1};
+    int agent {-1};
+    int pooledPort {-1};
+    std::string label {};
+    std::optional<std::filesystem::path> cgroup {};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        auto it {instances.find(uuid)};
+        if (it == instances.end()) {
+            return false;
+        }
+        pid = it->second.pid;
+        pidfd = it->second.pidfd;
+        agent = it->second.agent;
+        label = it->second.label;
+        if (it->second.pooled) {
+            pooledPort = it->second.port;
+        }
+        if (pid != -1 && agent == -1) {
+            cgroup = getInstanceCgroup(pid);
+        }
+        // A stopped process won't act on `SIGTERM` until it's continued.
+        if (it->second.frozen && pid != -1) {
+            if (cgroup) {
+                setCgroupFrozen(*cgroup, false);
+            }
+            kill(-pid, SIGCONT);
+            it->second.frozen = false;
+        }
+        it->second.paused = false;
+        it->second.pid = -1;
+        it->second.pidfd = -1;
+        it->second.agent = -1;
+        it->second.state = InstanceState::Stopped;
+    }
+    LOG_F(INFO, "Stopping instance %s.", instanceLabel(uuid).c_str());
+    // Stop outside of the lock since it may wait out the grace period.
+    bool stopped {agent != -1 ? stopOnAgent(agent, label) : stopProcess(pid, pidfd)};
+    if (pidfd != -1) {
+        close(pidfd);
+    }
+    if (cgroup) {
+        removeInstanceCgroup(*cgroup);
+    }
+    releaseUserData(label);
+    releasePlacement(label);
+    releaseServerView(constants::INSTANCES_DIR / label);
+    if (pooledPort != -1) {
+        getPortAllocator().release(pooledPort);
+    }
+    saveState();
+    return stopped;
+}
+
+bool code::adoptInstance(
+    const uuids::uuid &uuid, pid_t pid, int port, const std::string &label, 
+    const std::string &token
+) {
+    {
+        // Checked under the same lock as the adoption, so that concurrent logins 
+        // can't both adopt and orphan one of the servers.
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        auto it {instances.find(uuid)};
+        if (heldStarts.count(uuid) > 0 || (it != instances.end() 
+            && (it->second.state == InstanceState::Starting 
+                || it->second.state == InstanceState::Running))) {
+            return false;
+        }
+        Instance &instance {instances[uuid]};
+        instance.uuid = uuid;
+        instance.host = studentInstanceHost();
+        instance.port = port;
+        instance.pid = pid;
+        instance.startTicks = readStartTicks(pid);
+        instance.label = label;
+        instance.token = token;
+        instance.pidfd = -1;
+        instance.agent = -1;
+        instance.state = InstanceState::Running;
+        instance.startTime = std::chrono::steady_clock::now();
+        instance.lastActive = instance.startTime;
+        instance.frozen = false;
+        instance.paused = false;
+        instance.pooled = true;
+    }
+    LOG_F(INFO, "Adopted pooled instance on port %d for %s.", port, instanceLabel(uuid).c_str());
+    saveState();
+    return true;
+}
+
+void code::restoreInstance(const Instance &restored) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    Instance &instance {instances[restored.uuid]};
+    instance = restored;
+    if (instance.label.empty()) {
+        instance.label = instanceLabel(restored.uuid);
+    }
+    // Kept next to the rest of the instance's data, under its label.
+    instance.token = loadConnectionToken(constants::INSTANCES_DIR / instance.label);
+    if (instance.agent == -1) {
+        recordPlacement(instance.label, instance.pid);
+    }
+    instance.startTime = std::chrono::steady_clock::now();
+    instance.lastActive = instance.startTime;
+    instance.connections = 0;
+    instance.bytesRelayed = 0;
+    LOG_F(
+        INFO, "Reattached instance %s (pid %d) on port %d.", 
+        instanceLabel(restored.uuid).c_str(), restored.pid, restored.port
+    );
+}
+
+void code::stopAllInstances(bool includeInstructor) {
+    std::vector<uuids::uuid> stopUUIDs {};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        for (auto &[uuid, instance] : instances) {
+            if (instance.pid != -1 && (includeInstructor || uuid != INSTRUCTOR_UUID)) {
+                stopUUIDs.push_back(uuid);
+            }
+        }
+    }
+    for (const uuids::uuid &uuid : stopUUIDs) {
+        stopInstance(uuid);
+    }
+}
+
+bool code::pollInstanceReady(const uuids::uuid &uuid) {
+    std::string host {};
+    int port {};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        auto it {instances.find(uuid)};
+        if (it == instances.end() || it->second.state == InstanceState::Failed 
+            || it->second.state == InstanceState::Stopped) {
+            return false;
+        }
+        if (it->second.state == InstanceState::Running) {
+            return true;
+        }
+        // Claimed by `claimStart` but not spawned yet.
+        if (it->second.pid == -1) {
+            return false;
+        }
+        host = it->second.host;
+        port = it->second.port;
+    }
+    if (!serverReady(host, port)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    if (it == instances.end() || it->second.state != InstanceState::Starting) {
+        return false;
+    }
+    it->second.state = InstanceState::Running;
+    return true;
+}
+
+int code::reapInstances() {
+    std::vector<std::string> reapedLabels {};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        for (auto &[uuid, instance] : instances) {
+            if (instance.pid == -1) {
+                continue;
+            }
+            bool exited {
+                instance.agent != -1 
+                    ? !agentRunsInstance(instance.agent, instance.label) 
+                    : processExited(instance.pid, instance.pidfd)
+            };
+            if (exited) {
+                LOG_F(WARNING, "Instance %s exited unexpectedly.", instanceLabel(uuid).c_str());
+                instance.pid = -1;
+                instance.agent = -1;
+                if (instance.pidfd != -1) {
+                    close(instance.pidfd);
+                    instance.pidfd = -1;
+                }
+                instance.state = InstanceState::Failed;
+                if (instance.pooled) {
+                    getPortAllocator().release(instance.port);
+                }
+                reapedLabels.push_back(instance.label);
+            }
+        }
+    }
+    if (reapedLabels.empty()) {
+        return 0;
+    }
+    // Persisted now, so a restart picks up where the instance left off.
+    for (const std::string &label : reapedLabels) {
+        releaseUserData(label);
+        releasePlacement(label);
+        releaseServerView(constants::INSTANCES_DIR / label);
+    }
+    saveState();
+    return static_cast<int>(reapedLabels.size());
+}
+
+void code::recordActivity(const uuids::uuid &uuid, int connections, std::uint64_t bytes) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    if (it == instances.end()) {
+        return;
+    }
+    it->second.connections += connections;
+    it->second.bytesRelayed += bytes;
+    if (connections > 0 || bytes > 0) {
+        it->second.lastActive = std::chrono::steady_clock::now();
+    }
+}
+
+void code::touchInstance(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    if (it != instances.end()) {
+        it->second.lastActive = std::chrono::steady_clock::now();
+    }
+}
+
+bool code::freezeInstance(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    // Instances on an agent can't be signalled from here.
+    if (it == instances.end() || it->second.pid == -1 || it->second.frozen 
+        || it->second.agent != -1) {
+        return false;
+    }
+    // Prefer the cgroup freezer since it also catches processes that left the group.
+    std::optional<std::filesystem::path> cgroup {getInstanceCgroup(it->second.pid)};
+    if (!(cgroup && setCgroupFrozen(*cgroup, true)) && kill(-it->second.pid, SIGSTOP) == -1) {
+        return false;
+    }
+    it->second.frozen = true;
+    LOG_F(INFO, "Froze instance %s.", instanceLabel(uuid).c_str());
+    return true;
+}
+
+bool code::thawInstance(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    // Paused instances stay frozen until resumed, whatever their activity.
+    if (it == instances.end() || it->second.pid == -1 || !it->second.frozen 
+        || it->second.paused) {
+        return false;
+    }
+    if (thawsHeld) {
+        if (std::find(heldThaws.begin(), heldThaws.end(), uuid) == heldThaws.end()) {
+            heldThaws.push_back(uuid);
+        }
+        return false;
+    }
+    std::optional<std::filesystem::path> cgroup {getInstanceCgroup(it->second.pid)};
+    if (cgroup) {
+        setCgroupFrozen(*cgroup, false);
+    }
+    // Harmless if the cgroup froze it instead.
+    kill(-it->second.pid, SIGCONT);
+    it->second.frozen = false;
+    it->second.lastActive = std::chrono::steady_clock::now();
+    LOG_F(INFO, "Thawed instance %s.", instanceLabel(uuid).c_str());
+    return true;
+}
+
+bool code::pauseInstance(const uuids::uuid &uuid) {
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        auto it {instances.find(uuid)};
+        if (it == instances.end() || it->second.pid == -1 || it->second.agent != -1) {
+            return false;
+        }
+        it->second.paused = true;
+    }
+    LOG_F(INFO, "Paused instance %s.", instanceLabel(uuid).c_str());
+    // One already frozen, i.e. hibernating, now just stays that way.
+    if (freezeInstance(uuid)) {
+        return true;
+    }
+    std::optional<Instance> instance {getInstance(uuid)};
+    return instance && instance->frozen;
+}
+
+bool code::resumeInstance(const uuids::uuid &uuid) {
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        auto it {instances.find(uuid)};
+        if (it == instances.end() || !it->second.paused) {
+            return false;
+        }
+        it->second.paused = false;
+    }
+    LOG_F(INFO, "Resumed instance %s.", instanceLabel(uuid).c_str());
+    thawInstance(uuid);
+    return true;
+}
+
+void code::holdThaws(bool held) {
+    std::vector<uuids::uuid> thawUUIDs {};
+    {
+        std::lock_guard<std::mutex> lock {instancesMutex};
+        thawsHeld = held;
+        if (!held) {
+            thawUUIDs.swap(heldThaws);
+        }
+    }
+    for (const uuids::uuid &uuid : thawUUIDs) {
+        thawInstance(uuid);
+    }
+}
+
+void code::holdStarts(const std::vector<uuids::uuid> &students) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    heldStarts = {students.begin(), students.end()};
+}
+
+bool code::instanceActive(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    return it != instances.end() 
+        && (it->second.state == InstanceState::Starting 
+            || it->second.state == InstanceState::Running);
+}
+
+std::optional<code::Instance> code::getInstance(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    auto it {instances.find(uuid)};
+    if (it == instances.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::vector<code::Instance> code::getInstances() {
+    std::lock_guard<std::mutex> lock {instancesMutex};
+    std::vector<Instance> instanceVec {};
+    instanceVec.reserve(instances.size());
+    for (auto &[uuid, instance] : instances) {
+        instanceVec.push_back(instance);
+    }
+    return instanceVec;
+}
+
+}
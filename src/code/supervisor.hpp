@@ -0,0 +1,104 @@
+#ifndef INSTRUCT_SUPERVISOR_HPP
+#define INSTRUCT_SUPERVISOR_HPP
+
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    enum class InstanceState {
+        Stopped, Starting, Running, Failed
+    };
+    
+    struct Instance {
+        uuids::uuid uuid;
+        std::string host;
+        int port {-1};
+        pid_t pid {-1};
+        // Tells the process apart from a later one reusing its pid.
+        std::uint64_t startTicks {};
+        // Names the instance's log, cgroup and user data, which keep the pool's 
+        // name for instances adopted from the warm pool.
+        std::string label;
+        // Clients must present it to the editor, i.e. as `tkn` in the first URL.
+        std::string token;
+        // Watches instances reattached after a restart, which can't be waited on.
+        int pidfd {-1};
+        // Index into `agents` of the worker host running it, or -1 if it runs here. 
+        // The pid is then the agent's, so it's only ever handled through the agent.
+        int agent {-1};
+        InstanceState state {InstanceState::Stopped};
+        std::chrono::steady_clock::time_point startTime;
+        // Handed over from the warm pool, so the port goes back to the allocator.
+        bool pooled {false};
+        
+        // Activity reported by the relays and the hibernation monitor.
+        int connections {};
+        std::uint64_t bytesRelayed {};
+        std::chrono::steady_clock::time_point lastActive;
+        bool frozen {false};
+        // Kept frozen whatever its activity, i.e. while over its disk quota.
+        bool paused {false};
+    };
+    
+    // The instructor's instance is keyed by the nil UUID.
+    inline const uuids::uuid INSTRUCTOR_UUID {};
+    
+    std::filesystem::path getWorkspacePath(const uuids::uuid &);
+    std::filesystem::path getInstanceDataPath(const uuids::uuid &);
+    
+    // Whether student editors are only reached through instruct's own listeners, 
+    // which thaw frozen instances when students connect.
+    bool studentsBehindInstruct();
+    // Where student instances listen, which is loopback only behind the proxy 
+    // or lazy activation.
+    std::string studentInstanceHost();
+    
+    bool startInstance(const uuids::uuid &);
+    // Starts on an explicit host and port, i.e. an internal port behind instruct.
+    bool startInstance(const uuids::uuid &, const std::string &, int);
+    bool stopInstance(const uuids::uuid &);
+    // Takes ownership of an already running server for the given UUID. Returns false, 
+    // leaving the server to the caller, if the student already has an instance 
+    // starting or running, or their starts are held.
+    bool adoptInstance(
+        const uuids::uuid &, pid_t, int, const std::string &, const std::string &
+    );
+    // Takes back an instance that outlived the previous run of instruct.
+    void restoreInstance(const Instance &);
+    void stopAllInstances(bool);
+    
+    // Probes a starting instance and promotes it to running once it answers.
+    bool pollInstanceReady(const uuids::uuid &);
+    // Marks instances whose process exited as failed. Returns how many were found.
+    int reapInstances();
+    
+    // Notes connections opened (or closed, if negative) and bytes forwarded.
+    void recordActivity(const uuids::uuid &, int, std::uint64_t);
+    void touchInstance(const uuids::uuid &);
+    // Suspends or resumes the instance's whole process group.
+    bool freezeInstance(const uuids::uuid &);
+    bool thawInstance(const uuids::uuid &);
+    // Freezes the instance and keeps it frozen until it's resumed or stopped.
+    bool pauseInstance(const uuids::uuid &);
+    bool resumeInstance(const uuids::uuid &);
+    // While held, frozen instances stay frozen, e.g. so that a connection can't wake 
+    // one mid-capture. Thaws asked for meanwhile are carried out on release.
+    void holdThaws(bool);
+    // Refuses to start the given students' instances, which stopped ones would 
+    // otherwise do on their next connection, until called again without them.
+    void holdStarts(const std::vector<uuids::uuid> &);
+    
+    bool instanceActive(const uuids::uuid &);
+    std::optional<Instance> getInstance(const uuids::uuid &);
+    std::vector<Instance> getInstances();
+}
+
+#endif
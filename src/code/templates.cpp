@@ -0,0 +1,365 @@
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <mutex>
+
+#include <linux/fs.h>
+#include <fcntl.h>
+
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "fileops.hpp"
+#include "templates.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    code::ReflinkProbe reflinks {
+        "The filesystem doesn't support reflinks, workspace resets will copy."
+    };
+    // Resets, undos and changes to templates run one at a time.
+    std::atomic_bool resetting {false};
+    
+    std::mutex reportMutex {};
+    std::optional<code::ResetReport> report {};
+    std::vector<code::ResetResult> results {};
+}
+
+static std::chrono::milliseconds elapsed(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from);
+}
+
+static std::filesystem::path stagingPath(const uuids::uuid &uuid) {
+    return constants::RESETS_DIR / ("." + code::workspaceLabel(uuid) + ".staging");
+}
+
+static std::filesystem::path undoPath(const uuids::uuid &uuid) {
+    return constants::RESETS_DIR / code::workspaceLabel(uuid);
+}
+
+// Hidden names are kept for staging.
+static bool validTemplateName(const std::string &name) {
+    return !name.empty() && name.front() != '.' && name.find('/') == std::string::npos;
+}
+
+// Recreates the tree at the destination, which mustn't exist yet, with reflinks so a class's 
+// worth of clones costs little more than the template itself. Files are never hard 
+// linked instead, since editors usually write in place and a write would then reach 
+// the template and every other workspace. Returns the first error, or an empty string.
+static std::string cloneTree(
+    const std::filesystem::path &src, const std::filesystem::path &dst, int &cloned, int &copied
+) {
+    std::error_code err;
+    std::filesystem::create_directory(dst, src, err);
+    if (err) {
+        return err.message();
+    }
+    std::filesystem::recursive_directory_iterator it {src, err};
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        const std::filesystem::path &entry {it->path()};
+        std::filesystem::path target {dst / entry.lexically_relative(src)};
+        std::error_code entryErr;
+        if (it->is_symlink(entryErr)) {
+            std::filesystem::copy_symlink(entry, target, entryErr);
+        } else if (it->is_directory(entryErr)) {
+            std::filesystem::create_directory(target, entry, entryErr);
+        } else if (it->is_regular_file(entryErr)) {
+            code::CopyResult result {reflinks.cloneFile(entry, target)};
+            cloned += result == code::CopyResult::Cloned;
+            copied += result == code::CopyResult::Copied;
+            if (result == code::CopyResult::Failed) {
+                entryErr = {errno, std::generic_category()};
+            }
+        }
+        if (entryErr) {
+            return entry.lexically_relative(src).string() + ": " + entryErr.message();
+        }
+    }
+    return err ? err.message() : "";
+}
+
+// Swaps the directory in for the target with a single rename, leaving what was 
+// the target where the directory was. Returns the error, or an empty string.
+static std::string swapIn(
+    const std::filesystem::path &incoming, const std::filesystem::path &target
+) {
+    std::error_code err;
+    if (!std::filesystem::exists(target, err)) {
+        std::filesystem::rename(incoming, target, err);
+        return err ? err.message() : "";
+    }
+    if (renameat2(AT_FDCWD, incoming.c_str(), AT_FDCWD, target.c_str(), RENAME_EXCHANGE) == 0) {
+        return "";
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return std::strerror(errno);
+    }
+    // Filesystems that can't exchange get two renames, briefly leaving no target.
+    std::filesystem::path aside {incoming.string() + ".aside"};
+    std::filesystem::rename(target, aside, err);
+    if (err) {
+        return err.message();
+    }
+    std::filesystem::rename(incoming, target, err);
+    if (err) {
+        std::error_code restoreErr;
+        std::filesystem::rename(aside, target, restoreErr);
+        return err.message();
+    }
+    std::filesystem::rename(aside, incoming, err);
+    return err ? err.message() : "";
+}
+
+// Stops the instances of the students still without an error, 
+// since they'd otherwise keep the replaced workspace open.
+static void stopInstances(
+    const std::vector<uuids::uuid> &students, std::vector<code::ResetResult> &resetResults
+) {
+    // Stopping is mostly waiting on the grace period, so far more run at once.
+    code::forEachParallel(students.size(), constants::TEMPLATE_MAX_STOPPERS, [&] (std::size_t idx) {
+        code::ResetResult &result {resetResults.at(idx)};
+        if (!result.error.empty() || !code::instanceActive(students.at(idx))) {
+            return;
+        }
+        result.stopped = code::stopInstance(students.at(idx));
+        if (!result.stopped) {
+            result.error = "Failed to stop the instance";
+        }
+    });
+}
+
+static bool onAgent(const uuids::uuid &uuid) {
+    std::optional<code::Instance> instance {code::getInstance(uuid)};
+    return instance && instance->agent != -1 && code::instanceActive(uuid);
+}
+
+static void finishReset(
+    const std::string &name, 
+    const std::vector<uuids::uuid> &students, 
+    std::vector<code::ResetResult> resetResults, 
+    Clock::time_point started
+) {
+    code::ResetReport resetReport {
+        name, static_cast<int>(students.size()), 0, elapsed(started, Clock::now())
+    };
+    int cloned {}, copied {};
+    for (const code::ResetResult &result : resetResults) {
+        resetReport.failed += !result.succeeded;
+        cloned += result.cloned;
+        copied += result.copied;
+        if (!result.succeeded) {
+            LOG_F(
+                WARNING, "Failed to reset workspace %s: %s", 
+                code::workspaceLabel(result.uuid).c_str(), result.error.c_str()
+            );
+        }
+    }
+    std::string target {name.empty() ? "from before their last reset" : "to template " + name};
+    LOG_F(
+        INFO, 
+        "%s %d/%d workspace(s) %s in %lld ms, with %d file(s) cloned and %d copied.", 
+        name.empty() ? "Restored" : "Reset", resetReport.students - resetReport.failed, 
+        resetReport.students, target.c_str(), 
+        static_cast<long long>(resetReport.duration.count()), cloned, copied
+    );
+    if (resetReport.failed > 0) {
+        notif::notify(
+            std::to_string(resetReport.failed) + " workspace(s) could not be " 
+            + (name.empty() ? "restored" : "reset") + ". See the log file for more details."
+        );
+    }
+    std::lock_guard<std::mutex> lock {reportMutex};
+    report = resetReport;
+    results = std::move(resetResults);
+}
+
+bool code::saveTemplate(const std::string &name, const std::filesystem::path &source) {
+    if (!validTemplateName(name)) {
+        notif::notify("Template names can't be empty, contain `/` or start with `.`.");
+        return false;
+    }
+    std::error_code err;
+    if (!std::filesystem::is_directory(source, err)) {
+        notif::notify("`" + source.string() + "` isn't a directory.");
+        return false;
+    }
+    if (resetting.exchange(true)) {
+        notif::notify("A workspace reset is underway.");
+        return false;
+    }
+    std::filesystem::path staging {constants::TEMPLATES_DIR / ("." + name + ".staging")};
+    std::filesystem::create_directories(constants::TEMPLATES_DIR, err);
+    // Left behind if saving was interrupted.
+    std::filesystem::remove_all(staging, err);
+    int cloned {}, copied {};
+    std::string error {cloneTree(source, staging, cloned, copied)};
+    if (error.empty()) {
+        error = swapIn(staging, constants::TEMPLATES_DIR / name);
+    }
+    std::filesystem::remove_all(staging, err);
+    resetting = false;
+    if (!error.empty()) {
+        LOG_F(WARNING, "Failed to save template %s: %s", name.c_str(), error.c_str());
+        notif::notify("Failed to save template " + name + ". See the log file for more details.");
+        return false;
+    }
+    LOG_F(
+        INFO, "Saved template %s from %s (%d file(s) cloned, %d copied).", 
+        name.c_str(), source.c_str(), cloned, copied
+    );
+    return true;
+}
+
+bool code::removeTemplate(const std::string &name) {
+    if (!validTemplateName(name)) {
+        return false;
+    }
+    if (resetting.exchange(true)) {
+        notif::notify("A workspace reset is underway.");
+        return false;
+    }
+    std::error_code err;
+    std::filesystem::remove_all(constants::TEMPLATES_DIR / name, err);
+    resetting = false;
+    if (err) {
+        log::logErrorCodeWarning(err);
+        notif::notify("Failed to remove template " + name + ". See the log file for more details.");
+        return false;
+    }
+    LOG_F(INFO, "Removed template %s.", name.c_str());
+    return true;
+}
+
+std::vector<std::string> code::listTemplates() {
+    std::vector<std::string> names {};
+    std::error_code err;
+    std::filesystem::directory_iterator it {constants::TEMPLATES_DIR, err};
+    for (; !err && it != std::filesystem::directory_iterator {}; it.increment(err)) {
+        std::string name {it->path().filename().string()};
+        if (validTemplateName(name) && it->is_directory(err)) {
+            names.push_back(name);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool code::resetWorkspaces(const std::string &name, std::vector<uuids::uuid> students) {
+    std::filesystem::path templateDir {constants::TEMPLATES_DIR / name};
+    std::error_code err;
+    if (!validTemplateName(name) || !std::filesystem::is_directory(templateDir, err)) {
+        notif::notify("There's no template named " + name + ".");
+        return false;
+    }
+    if (resetting.exchange(true)) {
+        notif::notify("A workspace reset is already underway.");
+        return false;
+    }
+    std::filesystem::create_directories(constants::RESETS_DIR, err);
+    if (err) {
+        log::logErrorCodeWarning(err);
+        notif::notify(
+            "Failed to create `" + constants::RESETS_DIR.string() 
+            + "`. See the log file for more details."
+        );
+        resetting = false;
+        return false;
+    }
+    Clock::time_point started {Clock::now()};
+    std::vector<ResetResult> resetResults(students.size());
+    
+    // Cloned while the instances keep running, so they're only down for the swap.
+    forEachParallel(students.size(), constants::TEMPLATE_MAX_WORKERS, [&] (std::size_t idx) {
+        const uuids::uuid &uuid {students.at(idx)};
+        ResetResult &result {resetResults.at(idx)};
+        result = {uuid, false, "", false, 0, 0};
+        if (onAgent(uuid)) {
+            result.error = "The workspace is on an agent";
+            return;
+        }
+        std::filesystem::path staging {stagingPath(uuid)};
+        std::error_code stagingErr;
+        // Left behind if a reset was interrupted.
+        std::filesystem::remove_all(staging, stagingErr);
+        result.error = cloneTree(templateDir, staging, result.cloned, result.copied);
+    });
+    stopInstances(students, resetResults);
+    forEachParallel(students.size(), constants::TEMPLATE_MAX_WORKERS, [&] (std::size_t idx) {
+        const uuids::uuid &uuid {students.at(idx)};
+        ResetResult &result {resetResults.at(idx)};
+        std::filesystem::path staging {stagingPath(uuid)};
+        std::error_code stagingErr;
+        if (result.error.empty()) {
+            result.error = swapIn(staging, getWorkspacePath(uuid));
+        }
+        // Now the replaced workspace, if there was one, which replaces the last kept.
+        if (result.error.empty() && std::filesystem::exists(staging, stagingErr)) {
+            std::filesystem::path undo {undoPath(uuid)};
+            std::filesystem::remove_all(undo, stagingErr);
+            std::filesystem::rename(staging, undo, stagingErr);
+        }
+        std::filesystem::remove_all(staging, stagingErr);
+        result.succeeded = result.error.empty();
+    });
+    
+    finishReset(name, students, std::move(resetResults), started);
+    resetting = false;
+    return true;
+}
+
+bool code::undoReset(std::vector<uuids::uuid> students) {
+    if (resetting.exchange(true)) {
+        notif::notify("A workspace reset is already underway.");
+        return false;
+    }
+    Clock::time_point started {Clock::now()};
+    std::vector<ResetResult> resetResults(students.size());
+    for (std::size_t idx {}; idx < students.size(); ++idx) {
+        const uuids::uuid &uuid {students.at(idx)};
+        resetResults.at(idx) = {uuid, false, "", false, 0, 0};
+        if (!resetUndoable(uuid)) {
+            resetResults.at(idx).error = "Nothing to undo";
+        } else if (onAgent(uuid)) {
+            resetResults.at(idx).error = "The workspace is on an agent";
+        }
+    }
+    stopInstances(students, resetResults);
+    forEachParallel(students.size(), constants::TEMPLATE_MAX_WORKERS, [&] (std::size_t idx) {
+        ResetResult &result {resetResults.at(idx)};
+        if (result.error.empty()) {
+            result.error = swapIn(undoPath(students.at(idx)), getWorkspacePath(students.at(idx)));
+        }
+        result.succeeded = result.error.empty();
+    });
+    
+    finishReset("", students, std::move(resetResults), started);
+    resetting = false;
+    return true;
+}
+
+bool code::resetUndoable(const uuids::uuid &uuid) {
+    std::error_code err;
+    return std::filesystem::is_directory(undoPath(uuid), err);
+}
+
+std::optional<code::ResetReport> code::getResetReport() {
+    std::lock_guard<std::mutex> lock {reportMutex};
+    return report;
+}
+
+std::vector<code::ResetResult> code::getResetResults() {
+    std::lock_guard<std::mutex> lock {reportMutex};
+    return results;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef INSTRUCT_TEMPLATES_HPP
+#define INSTRUCT_TEMPLATES_HPP
+
+#include <filesystem>
+#include <optional>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct ResetResult {
+        uuids::uuid uuid;
+        bool succeeded;
+        std::string error;
+        // Whether the instance was stopped for the swap, i.e. should be started again.
+        bool stopped;
+        // Files sharing the template's extents, and those copied.
+        int cloned;
+        int copied;
+    };
+    
+    struct ResetReport {
+        // Empty for an undo.
+        std::string templateName;
+        int students;
+        int failed;
+        std::chrono::milliseconds duration;
+    };
+    
+    // Stores a copy of the directory as the named template, replacing any 
+    // template of that name.
+    bool saveTemplate(const std::string &, const std::filesystem::path &);
+    bool removeTemplate(const std::string &);
+    std::vector<std::string> listTemplates();
+    
+    // Clones the template for each of the given students in parallel, stops 
+    // their instances, then swaps each clone in for the workspace with a single 
+    // rename. The replaced workspace is kept, replacing the one kept before it.
+    bool resetWorkspaces(const std::string &, std::vector<uuids::uuid>);
+    // Swaps the workspace kept by each student's last reset back in, so that 
+    // undoing again redoes the reset.
+    bool undoReset(std::vector<uuids::uuid>);
+    bool resetUndoable(const uuids::uuid &);
+    
+    std::optional<ResetReport> getResetReport();
+    // One per student of the last reset or undo.
+    std::vector<ResetResult> getResetResults();
+}
+
+#endif
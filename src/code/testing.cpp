@@ -0,0 +1,554 @@
+#include <unordered_map>
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <mutex>
+
+#include "yaml-cpp/yaml.h"
+#include "loguru.hpp"
+
+#include "../notification.hpp"
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "placement.hpp"
+#include "fileops.hpp"
+#include "harness.hpp"
+#include "testing.hpp"
+#include "../data.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    // A worker's share of the jobs, taken from the front by the worker 
+    // and from the back by the others once they run out.
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::size_t> jobs;
+    };
+    
+    // What a test's students are compared with.
+    struct Reference {
+        bool succeeded;
+        // The instructor's stdout, as written to a file.
+        std::filesystem::path expected;
+        std::string error;
+    };
+    
+    // A command's stdout checked against the instructor's as it's read, a 
+    // buffer's worth at a time.
+    struct Comparison {
+        std::ifstream expected;
+        std::vector<char> buffer;
+        std::uint64_t seen;
+        // What matched last, until there's a mismatch to keep it.
+        std::string context;
+        std::optional<code::OutputMismatch> mismatch;
+        bool truncated;
+    };
+    
+    std::thread engineThread {};
+    std::atomic_bool testing {false};
+    
+    std::mutex resultsMutex {};
+    code::TestProgress progress {};
+    std::vector<code::TestResult> results {};
+    std::unordered_map<uuids::uuid, code::TestTally> tallies {};
+}
+
+static std::chrono::milliseconds elapsed(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from);
+}
+
+static std::string statusName(code::TestStatus status) {
+    switch (status) {
+        case code::TestStatus::Passed:
+            return "passed";
+        case code::TestStatus::Failed:
+            return "failed";
+        case code::TestStatus::Errored:
+            return "errored";
+        case code::TestStatus::Cancelled:
+            return "cancelled";
+    }
+    return "";
+}
+
+// Each worker starts with an even, contiguous share of the jobs, so a student's 
+// tests tend to run back to back on one core. A worker that runs out steals 
+// from the back of the next queue that still has jobs, which spreads out 
+// slow jobs bunched together until every queue is empty.
+static void runPool(
+    std::size_t count, std::size_t workerCount, const std::function<void(std::size_t)> &fn
+) {
+    workerCount = std::max<std::size_t>(1, std::min(workerCount, count));
+    std::vector<WorkQueue> queues(workerCount);
+    for (std::size_t idx {}; idx < count; ++idx) {
+        queues.at(idx * workerCount / count).jobs.push_back(idx);
+    }
+    auto take {[&] (std::size_t self, std::size_t &job) {
+        for (std::size_t offset {}; offset < workerCount; ++offset) {
+            WorkQueue &queue {queues.at((self + offset) % workerCount)};
+            std::lock_guard<std::mutex> lock {queue.mutex};
+            if (queue.jobs.empty()) {
+                continue;
+            }
+            if (offset == 0) {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            } else {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }};
+    auto work {[&] (std::size_t self) {
+        std::size_t job {};
+        while (testing && take(self, job)) {
+            fn(job);
+        }
+    }};
+    std::vector<std::thread> workers {};
+    for (std::size_t idx {1}; idx < workerCount; ++idx) {
+        workers.emplace_back(work, idx);
+    }
+    work(0);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+// Returns false if not all of it fit.
+static bool appendBounded(std::string &excerpt, const char *data, std::size_t length) {
+    std::size_t room {constants::TEST_EXCERPT_SIZE - std::min(
+        constants::TEST_EXCERPT_SIZE, excerpt.size()
+    )};
+    excerpt.append(data, std::min(length, room));
+    return length <= room;
+}
+
+static void keepTail(std::string &excerpt, const char *data, std::size_t length) {
+    if (length >= constants::TEST_EXCERPT_SIZE) {
+        excerpt.assign(data + length - constants::TEST_EXCERPT_SIZE, constants::TEST_EXCERPT_SIZE);
+        return;
+    }
+    excerpt.append(data, length);
+    if (excerpt.size() > constants::TEST_EXCERPT_SIZE) {
+        excerpt.erase(0, excerpt.size() - constants::TEST_EXCERPT_SIZE);
+    }
+}
+
+// Given what the instructor wrote from the mismatch on, of what was compared.
+static void recordMismatch(
+    Comparison &comparison, std::uint64_t offset, const char *expected, std::size_t length
+) {
+    code::OutputMismatch mismatch {offset, std::move(comparison.context), "", ""};
+    appendBounded(mismatch.expected, expected, length);
+    // The rest of the excerpt is still in the file, past what was compared.
+    if (mismatch.expected.size() < constants::TEST_EXCERPT_SIZE) {
+        comparison.expected.read(
+            comparison.buffer.data(), constants::TEST_EXCERPT_SIZE - mismatch.expected.size()
+        );
+        mismatch.expected.append(comparison.buffer.data(), comparison.expected.gcount());
+    }
+    comparison.mismatch = std::move(mismatch);
+}
+
+// Returns false once the command should be killed, i.e. when it went over the 
+// cap, or as soon as it diverged if failing fast.
+static bool compareOutput(
+    Comparison &comparison, const char *data, std::size_t length, bool failFast
+) {
+    if (comparison.seen + length > constants::TEST_OUTPUT_CAP) {
+        length = constants::TEST_OUTPUT_CAP - comparison.seen;
+        comparison.truncated = true;
+    }
+    std::size_t done {};
+    while (done < length && !comparison.mismatch) {
+        std::size_t step {std::min(length - done, comparison.buffer.size())};
+        comparison.expected.read(comparison.buffer.data(), step);
+        std::size_t read {static_cast<std::size_t>(comparison.expected.gcount())};
+        // Running out of the instructor's output counts as a mismatch too.
+        std::size_t same {static_cast<std::size_t>(
+            std::mismatch(data + done, data + done + read, comparison.buffer.data()).first 
+                - (data + done)
+        )};
+        keepTail(comparison.context, data + done, same);
+        if (same < step) {
+            recordMismatch(
+                comparison, comparison.seen + done + same, 
+                comparison.buffer.data() + same, read - same
+            );
+        }
+        done += same;
+    }
+    // Everything from the mismatch on is only kept for the excerpt.
+    if (comparison.mismatch) {
+        appendBounded(comparison.mismatch->actual, data + done, length - done);
+    }
+    comparison.seen += length;
+    return !comparison.truncated && !(failFast && comparison.mismatch);
+}
+
+// Catches output that stopped short of the instructor's.
+static void finishComparison(Comparison &comparison) {
+    if (!comparison.mismatch && !comparison.truncated 
+        && comparison.expected.peek() != std::ifstream::traits_type::eof()) {
+        recordMismatch(comparison, comparison.seen, nullptr, 0);
+    }
+    if (comparison.truncated && comparison.mismatch) {
+        comparison.mismatch->actual += constants::TEST_TRUNCATION_MARKER;
+    }
+}
+
+// Every run starts from an empty scratch directory and the bare minimum 
+// of an environment, so jobs can't see each other's files or settings.
+static std::vector<std::string> prepareRun(
+    const std::filesystem::path &scratch, 
+    const std::filesystem::path &workspace, 
+    const std::string &student, 
+    const std::string &test
+) {
+    std::error_code err;
+    std::filesystem::remove_all(scratch, err);
+    std::filesystem::create_directories(scratch, err);
+    const char *path {getenv("PATH")};
+    std::string absScratch {std::filesystem::absolute(scratch, err).string()};
+    return {
+        std::string {"PATH="} + (path ? path : "/usr/local/bin:/usr/bin:/bin"), 
+        "LANG=C.UTF-8", 
+        "HOME=" + absScratch, 
+        "TMPDIR=" + absScratch, 
+        "INSTRUCT_WORKSPACE=" + std::filesystem::absolute(workspace, err).string(), 
+        "INSTRUCT_STUDENT=" + student, 
+        "INSTRUCT_TEST=" + test
+    };
+}
+
+static Reference runReference(const TData::TestCase &test, const std::string &runId) {
+    std::filesystem::path scratch {
+        constants::TEST_RUNS_DIR / runId / "instructor" / uuids::to_string(test.uuid)
+    };
+    code::CommandSpec spec {
+        test.instructorRunCmd, 
+        scratch, 
+        prepareRun(
+            scratch, code::getWorkspacePath(code::INSTRUCTOR_UUID), "instructor", test.displayName
+        ), 
+        std::chrono::duration<double> {test.secondsAllotted}
+    };
+    // Kept outside the scratch directory, which is cleared for each run.
+    std::filesystem::path expected {
+        constants::TEST_RUNS_DIR / runId / "expected" / uuids::to_string(test.uuid)
+    };
+    std::error_code err;
+    std::filesystem::create_directories(expected.parent_path(), err);
+    std::ofstream fout {expected, std::ios::binary};
+    std::uint64_t written {};
+    code::CommandOutput output {code::runCommand(
+        spec, 
+        [&] (const char *data, std::size_t length) {
+            written += length;
+            fout.write(data, length);
+            return written <= constants::TEST_OUTPUT_CAP;
+        }, 
+        [] (const char *, std::size_t) {
+            return true;
+        }
+    )};
+    fout.close();
+    if (!output.started) {
+        return {false, "", "The instructor's command couldn't be run"};
+    }
+    if (output.stopped) {
+        return {
+            false, "", 
+            "The instructor's output exceeded the " 
+                + std::to_string(constants::TEST_OUTPUT_CAP >> 20) + " MB allowed"
+        };
+    }
+    if (output.usage.exitCode != 0) {
+        return {
+            false, "", "The instructor's command failed: " + code::describeExit(output.usage, spec)
+        };
+    }
+    if (!fout) {
+        LOG_F(ERROR, "Failed to write %s.", expected.c_str());
+        return {false, "", "The instructor's output couldn't be saved"};
+    }
+    return {true, expected, ""};
+}
+
+static void recordResult(std::size_t idx, code::TestResult result) {
+    std::lock_guard<std::mutex> lock {resultsMutex};
+    code::TestTally &tally {tallies[result.test]};
+    switch (result.status) {
+        case code::TestStatus::Passed:
+            ++progress.passed;
+            ++tally.passed;
+            break;
+        case code::TestStatus::Failed:
+            ++progress.failed;
+            ++tally.failed;
+            break;
+        case code::TestStatus::Errored:
+            ++progress.errored;
+            ++tally.errored;
+            break;
+        case code::TestStatus::Cancelled:
+            break;
+    }
+    ++progress.done;
+    results.at(idx) = std::move(result);
+}
+
+static void saveResults(const std::string &runId) {
+    YAML::Emitter emitter {};
+    emitter << YAML::BeginSeq;
+    {
+        std::lock_guard<std::mutex> lock {resultsMutex};
+        for (const code::TestResult &result : results) {
+            emitter << YAML::BeginMap;
+            emitter << YAML::Key << "student" << YAML::Value << uuids::to_string(result.student);
+            emitter << YAML::Key << "test" << YAML::Value << uuids::to_string(result.test);
+            emitter << YAML::Key << "status" << YAML::Value << statusName(result.status);
+            const code::CommandUsage &usage {result.usage};
+            emitter << YAML::Key << "exit_code" << YAML::Value << usage.exitCode;
+            emitter << YAML::Key << "signal" << YAML::Value << usage.signal;
+            emitter << YAML::Key << "timed_out" << YAML::Value << usage.timedOut;
+            emitter << YAML::Key << "cpu_exceeded" << YAML::Value << usage.cpuExceeded;
+            emitter << YAML::Key << "wall_us" << YAML::Value << usage.wallTime.count();
+            emitter << YAML::Key << "user_us" << YAML::Value << usage.userTime.count();
+            emitter << YAML::Key << "system_us" << YAML::Value << usage.systemTime.count();
+            emitter << YAML::Key << "peak_rss_bytes" << YAML::Value << usage.peakRssBytes;
+            emitter << YAML::Key << "detail" << YAML::Value << result.detail;
+            if (result.mismatch) {
+                emitter << YAML::Key << "mismatch" << YAML::Value << YAML::BeginMap;
+                emitter << YAML::Key << "offset" << YAML::Value << result.mismatch->offset;
+                emitter << YAML::Key << "context" << YAML::Value << result.mismatch->context;
+                emitter << YAML::Key << "expected" << YAML::Value << result.mismatch->expected;
+                emitter << YAML::Key << "actual" << YAML::Value << result.mismatch->actual;
+                emitter << YAML::EndMap;
+            }
+            emitter << YAML::Key << "stderr" << YAML::Value << result.errorOutput;
+            emitter << YAML::EndMap;
+        }
+    }
+    emitter << YAML::EndSeq;
+    std::error_code err;
+    std::filesystem::create_directories(constants::TEST_RESULTS_DIR, err);
+    std::filesystem::path target {constants::TEST_RESULTS_DIR / (runId + ".yaml")};
+    std::ofstream fout {target};
+    fout << emitter.c_str();
+    if (!fout.flush()) {
+        LOG_F(ERROR, "Failed to write %s.", target.c_str());
+        notif::notify("Failed to save the test results. See the log file for more details.");
+    }
+}
+
+static void runTests(
+    std::string runId, 
+    std::vector<uuids::uuid> students, 
+    std::vector<TData::TestCase> tests, 
+    bool failFast, 
+    std::size_t workerCount, 
+    std::function<void()> onProgress
+) {
+    code::unpinThread();
+    Clock::time_point started {Clock::now()};
+    // Without it commands still run, only without their time limits.
+    code::startHarness();
+    std::vector<Reference> references(tests.size());
+    runPool(tests.size(), workerCount, [&] (std::size_t idx) {
+        references.at(idx) = runReference(tests.at(idx), runId);
+    });
+    
+    // Student-major, so each worker's share is a run of whole students.
+    runPool(students.size() * tests.size(), workerCount, [&] (std::size_t idx) {
+        const uuids::uuid &student {students.at(idx / tests.size())};
+        const TData::TestCase &test {tests.at(idx % tests.size())};
+        const Reference &reference {references.at(idx % tests.size())};
+        code::TestResult result {
+            student, test.uuid, code::TestStatus::Errored, {{}, {}, {}, 0, -1, 0, false, false}, 
+            reference.error, std::nullopt, ""
+        };
+        if (reference.succeeded) {
+            std::string label {code::getWorkspacePath(student).filename().string()};
+            std::filesystem::path scratch {
+                constants::TEST_RUNS_DIR / runId / label / uuids::to_string(test.uuid)
+            };
+            code::CommandSpec spec {
+                test.studentRunCmd, 
+                scratch, 
+                prepareRun(scratch, code::getWorkspacePath(student), label, test.displayName), 
+                std::chrono::duration<double> {test.secondsAllotted}
+            };
+            Comparison comparison {
+                std::ifstream {reference.expected, std::ios::binary}, 
+                std::vector<char>(constants::TEST_READ_BUFFER_SIZE), 
+                0, "", std::nullopt, false
+            };
+            bool errorTruncated {false};
+            code::CommandOutput output {code::runCommand(
+                spec, 
+                [&] (const char *data, std::size_t length) {
+                    return compareOutput(comparison, data, length, failFast);
+                }, 
+                [&] (const char *data, std::size_t length) {
+                    errorTruncated |= !appendBounded(result.errorOutput, data, length);
+                    return true;
+                }
+            )};
+            if (!testing) {
+                return;
+            }
+            if (errorTruncated) {
+                result.errorOutput += constants::TEST_TRUNCATION_MARKER;
+            }
+            if (!output.started) {
+                result.detail = "The command couldn't be run";
+            } else if (!comparison.expected.is_open()) {
+                result.detail = "The instructor's output couldn't be read";
+            } else {
+                finishComparison(comparison);
+                result.usage = output.usage;
+                result.mismatch = comparison.mismatch;
+                // Killed for its output, it wouldn't have exited cleanly.
+                if (!output.stopped && result.usage.exitCode != 0) {
+                    result.status = code::TestStatus::Failed;
+                    result.detail = code::describeExit(result.usage, spec);
+                } else if (comparison.mismatch) {
+                    result.status = code::TestStatus::Failed;
+                    result.detail = "The output differs from the instructor's at byte " 
+                        + std::to_string(comparison.mismatch->offset);
+                } else if (comparison.truncated) {
+                    result.status = code::TestStatus::Failed;
+                    result.detail = "The output exceeded the " 
+                        + std::to_string(constants::TEST_OUTPUT_CAP >> 20) + " MB allowed";
+                } else {
+                    result.status = code::TestStatus::Passed;
+                    result.detail = "";
+                }
+            }
+            std::error_code err;
+            std::filesystem::remove_all(scratch, err);
+        }
+        recordResult(idx, std::move(result));
+        onProgress();
+    });
+    testing = false;
+    code::stopHarness();
+    std::error_code err;
+    std::filesystem::remove_all(constants::TEST_RUNS_DIR / runId, err);
+    
+    saveResults(runId);
+    code::TestProgress finished {code::getTestProgress()};
+    LOG_F(
+        INFO, 
+        "Test run %s: %d passed, %d failed and %d errored of %d in %lld ms%s.", 
+        runId.c_str(), finished.passed, finished.failed, finished.errored, finished.total, 
+        static_cast<long long>(elapsed(started, Clock::now()).count()), 
+        finished.done < finished.total ? " (cancelled)" : ""
+    );
+    {
+        std::lock_guard<std::mutex> lock {resultsMutex};
+        progress.elapsed = elapsed(started, Clock::now());
+        progress.active = false;
+    }
+    onProgress();
+}
+
+bool code::startTests(
+    std::vector<uuids::uuid> students, 
+    std::vector<uuids::uuid> testUUIDs, 
+    std::function<void()> onProgress
+) {
+    if (testing) {
+        notif::notify("Tests are already running.");
+        return false;
+    }
+    if (engineThread.joinable()) {
+        engineThread.join();
+    }
+    const auto &testMap {TData::testsData->get_tests()};
+    std::vector<TData::TestCase> tests {};
+    for (const uuids::uuid &uuid : testUUIDs) {
+        auto it {testMap.find(uuid)};
+        if (it != testMap.end()) {
+            tests.push_back(it->second);
+        }
+    }
+    if (students.empty() || tests.empty()) {
+        notif::notify("There are no students or tests to run.");
+        return false;
+    }
+    
+    std::string runId {makeTimestampId()};
+    std::size_t workerCount {std::max(1u, std::thread::hardware_concurrency())};
+    {
+        std::lock_guard<std::mutex> lock {resultsMutex};
+        int total {static_cast<int>(students.size() * tests.size())};
+        progress = {runId, total, 0, 0, 0, 0, static_cast<int>(workerCount), {}, true};
+        // Every pair has a result, which jobs that never run leave as cancelled.
+        results.clear();
+        tallies.clear();
+        for (const uuids::uuid &student : students) {
+            for (const TData::TestCase &test : tests) {
+                results.push_back({
+                    student, test.uuid, TestStatus::Cancelled, 
+                    {{}, {}, {}, 0, -1, 0, false, false}, "Not run", std::nullopt, ""
+                });
+                ++tallies[test.uuid].total;
+            }
+        }
+    }
+    testing = true;
+    engineThread = std::thread {
+        runTests, runId, std::move(students), std::move(tests), TData::testsData->get_failFast(), 
+        workerCount, std::move(onProgress)
+    };
+    DLOG_F(INFO, "Test engine started with %zu worker(s).", workerCount);
+    return true;
+}
+
+void code::stopTests() {
+    testing = false;
+    code::cancelCommands();
+    if (engineThread.joinable()) {
+        engineThread.join();
+        DLOG_F(INFO, "Test engine joined.");
+    }
+}
+
+bool code::testsRunning() {
+    std::lock_guard<std::mutex> lock {resultsMutex};
+    return progress.active;
+}
+
+code::TestProgress code::getTestProgress() {
+    std::lock_guard<std::mutex> lock {resultsMutex};
+    return progress;
+}
+
+std::optional<code::TestTally> code::getTestTally(const uuids::uuid &uuid) {
+    std::lock_guard<std::mutex> lock {resultsMutex};
+    auto it {tallies.find(uuid)};
+    if (it == tallies.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::vector<code::TestResult> code::getTestResults() {
+    std::lock_guard<std::mutex> lock {resultsMutex};
+    return results;
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef INSTRUCT_TESTING_HPP
+#define INSTRUCT_TESTING_HPP
+
+#include <functional>
+#include <optional>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+#include "harness.hpp"
+
+namespace instruct::code {
+    enum class TestStatus {
+        Passed, Failed, Errored, Cancelled
+    };
+    
+    // Where a student's output first differs from the instructor's, or where 
+    // one of them ended early.
+    struct OutputMismatch {
+        std::uint64_t offset;
+        // What both wrote just before it.
+        std::string context;
+        // What each wrote from it on.
+        std::string expected;
+        std::string actual;
+    };
+    
+    struct TestResult {
+        uuids::uuid student;
+        uuids::uuid test;
+        TestStatus status;
+        // Of the student's command, if it ran.
+        CommandUsage usage;
+        // Why the test didn't pass.
+        std::string detail;
+        std::optional<OutputMismatch> mismatch;
+        // The start of what the command wrote to stderr.
+        std::string errorOutput;
+    };
+    
+    struct TestTally {
+        int total;
+        int passed;
+        int failed;
+        int errored;
+    };
+    
+    struct TestProgress {
+        // Names the run's results under `TEST_RESULTS_DIR`.
+        std::string id;
+        int total;
+        int done;
+        int passed;
+        int failed;
+        int errored;
+        int workers;
+        std::chrono::milliseconds elapsed;
+        bool active;
+    };
+    
+    // Runs every given test for every given student on a background pool of 
+    // one worker per core. Each test's instructor command is run first, and 
+    // its output is what the students' output is compared with as it's read, 
+    // so only excerpts of either are ever held in memory. Commands run 
+    // under `sh -c` from a scratch directory of their own, with a clean 
+    // environment pointing `INSTRUCT_WORKSPACE` at the workspace being tested, 
+    // and are killed once they run longer than the test allots. 
+    // The callback is invoked from the workers whenever progress changes.
+    bool startTests(std::vector<uuids::uuid>, std::vector<uuids::uuid>, std::function<void()>);
+    // Kills the commands still running and joins the pool. Jobs not yet run 
+    // are recorded as cancelled.
+    void stopTests();
+    bool testsRunning();
+    
+    TestProgress getTestProgress();
+    // Of the current or last run.
+    std::optional<TestTally> getTestTally(const uuids::uuid &);
+    std::vector<TestResult> getTestResults();
+}
+
+#endif
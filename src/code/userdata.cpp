@@ -0,0 +1,352 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <system_error>
+#include <optional>
+#include <utility>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "../logging.hpp"
+#include "supervisor.hpp"
+#include "userdata.hpp"
+#include "../data.hpp"
+#include "cgroup.hpp"
+
+namespace instruct {
+
+namespace {
+    // Settings and state kept across instance restarts, relative to the user data directory. 
+    // Everything else, e.g. logs and caches, is rebuilt by the editor and never hits the disk.
+    const std::filesystem::path PERSISTED_ENTRIES [] {
+        "User/settings.json", 
+        "User/keybindings.json", 
+        "User/tasks.json", 
+        "User/snippets", 
+        "User/globalStorage", 
+        "Machine"
+    };
+    // Dropped first when a directory grows past its cap.
+    const std::filesystem::path CACHE_ENTRIES [] {
+        "CachedData", 
+        "CachedExtensionVSIXs", 
+        "CachedProfilesData", 
+        "logs", 
+        "User/History", 
+        "User/workspaceStorage"
+    };
+    
+    std::thread syncThread {};
+    std::atomic_bool syncing {false};
+    std::mutex syncMutex {};
+    std::condition_variable syncSignal {};
+    
+    // Serializes syncs with instances releasing their directories.
+    std::mutex dirsMutex {};
+    // Where each in-memory directory is persisted to.
+    std::unordered_map<std::string, std::filesystem::path> diskDirs {};
+    
+    std::mutex statsMutex {};
+    code::UserDataStats stats {0, 0, 0, 0, -1.0};
+}
+
+static std::filesystem::path ramRoot() {
+    // Shared across users, so keep each user's directories apart.
+    return constants::RAM_USER_DATA_ROOT / ("instruct-" + std::to_string(getuid()));
+}
+
+// Expects `dirsMutex` to be held.
+static std::filesystem::path diskDirOf(const std::string &label) {
+    auto it {diskDirs.find(label)};
+    // Directories of instances reattached after a restart weren't prepared by this run.
+    return it != diskDirs.end() ? it->second : constants::INSTANCES_DIR / label / "user-data";
+}
+
+static bool ramRootUsable() {
+    struct statfs fsInfo {};
+    if (statfs(constants::RAM_USER_DATA_ROOT.c_str(), &fsInfo) == -1 
+        || fsInfo.f_type != TMPFS_MAGIC) {
+        return false;
+    }
+    std::error_code err;
+    std::filesystem::create_directories(ramRoot(), err);
+    std::filesystem::permissions(ramRoot(), std::filesystem::perms::owner_all, err);
+    return !err;
+}
+
+// Copies the file unless the destination already matches its size and modification time.
+static std::uint64_t copyIfChanged(
+    const std::filesystem::path &src, const std::filesystem::path &dst
+) {
+    std::error_code err;
+    std::uintmax_t size {std::filesystem::file_size(src, err)};
+    std::filesystem::file_time_type modified {std::filesystem::last_write_time(src, err)};
+    if (err) {
+        return 0;
+    }
+    std::error_code dstErr;
+    if (std::filesystem::file_size(dst, dstErr) == size 
+        && std::filesystem::last_write_time(dst, dstErr) == modified && !dstErr) {
+        return 0;
+    }
+    // Copied aside and renamed over so the disk copy is never torn.
+    std::filesystem::path tmpPath {dst};
+    tmpPath += ".tmp";
+    std::filesystem::create_directories(dst.parent_path(), err);
+    std::filesystem::copy_file(
+        src, tmpPath, std::filesystem::copy_options::overwrite_existing, err
+    );
+    std::filesystem::last_write_time(tmpPath, modified, err);
+    std::filesystem::rename(tmpPath, dst, err);
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return 0;
+    }
+    return size;
+}
+
+// Mirrors the persisted entries of one directory. Returns the files and bytes written.
+static std::pair<std::uint64_t, std::uint64_t> syncDir(
+    const std::filesystem::path &ramDir, const std::filesystem::path &diskDir
+) {
+    std::uint64_t files {}, bytes {};
+    auto syncFile {[&] (const std::filesystem::path &src, const std::filesystem::path &dst) {
+        if (std::uint64_t copied {copyIfChanged(src, dst)}; copied > 0) {
+            ++files;
+            bytes += copied;
+        }
+    }};
+    for (const std::filesystem::path &entry : PERSISTED_ENTRIES) {
+        std::filesystem::path src {ramDir / entry};
+        std::filesystem::path dst {diskDir / entry};
+        std::error_code err;
+        if (std::filesystem::is_regular_file(src, err)) {
+            syncFile(src, dst);
+            continue;
+        }
+        if (!std::filesystem::is_directory(src, err)) {
+            continue;
+        }
+        for (std::filesystem::recursive_directory_iterator it {src, err}, end {}; 
+            !err && it != end; it.increment(err)) {
+            if (it->is_regular_file(err)) {
+                syncFile(it->path(), dst / std::filesystem::relative(it->path(), src));
+            }
+        }
+        // Files deleted in memory are deleted on disk as well.
+        std::vector<std::filesystem::path> stale {};
+        for (std::filesystem::recursive_directory_iterator it {dst, err}, end {}; 
+            !err && it != end; it.increment(err)) {
+            if (it->is_regular_file(err) 
+                && !std::filesystem::exists(src / std::filesystem::relative(it->path(), dst))) {
+                stale.push_back(it->path());
+            }
+        }
+        for (const std::filesystem::path &path : stale) {
+            std::filesystem::remove(path, err);
+        }
+    }
+    return {files, bytes};
+}
+
+static std::uint64_t dirBytes(const std::filesystem::path &dir) {
+    std::uint64_t bytes {};
+    std::error_code err;
+    for (std::filesystem::recursive_directory_iterator it {dir, err}, end {}; 
+        !err && it != end; it.increment(err)) {
+        if (it->is_regular_file(err)) {
+            bytes += it->file_size(err);
+        }
+    }
+    return bytes;
+}
+
+// Syncs every in-memory directory, trimming those over the cap first.
+static void syncAll() {
+    std::uint64_t capBytes {
+        static_cast<std::uint64_t>(SData::studentsData->get_ramUserDataMB()) << 20
+    };
+    int ramDirs {};
+    std::uint64_t ramBytes {}, files {}, bytes {};
+    {
+        std::lock_guard<std::mutex> lock {dirsMutex};
+        std::error_code err;
+        for (const std::filesystem::directory_entry &dirEntry 
+            : std::filesystem::directory_iterator {ramRoot(), err}) {
+            std::string label {dirEntry.path().filename()};
+            std::uint64_t used {dirBytes(dirEntry.path())};
+            if (capBytes > 0 && used > capBytes) {
+                LOG_F(INFO, "User data of %s is over its cap. Dropping caches.", label.c_str());
+                for (const std::filesystem::path &entry : CACHE_ENTRIES) {
+                    std::filesystem::remove_all(dirEntry.path() / entry, err);
+                }
+                used = dirBytes(dirEntry.path());
+            }
+            auto [syncedFiles, syncedBytes] {syncDir(dirEntry.path(), diskDirOf(label))};
+            ++ramDirs;
+            ramBytes += used;
+            files += syncedFiles;
+            bytes += syncedBytes;
+        }
+    }
+    if (files > 0) {
+        DLOG_F(
+            INFO, "Synced %llu file(s) of user data to disk.", 
+            static_cast<unsigned long long>(files)
+        );
+    }
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.ramDirs = ramDirs;
+    stats.ramBytes = ramBytes;
+    stats.syncedFiles += files;
+    stats.syncedBytes += bytes;
+}
+
+// Samples the block device writes of every running instance, 
+// which is what the in-memory directories are meant to cut down.
+static void sampleWriteOps(std::unordered_map<uuids::uuid, std::uint64_t> &lastOps) {
+    std::unordered_map<uuids::uuid, std::uint64_t> ops {};
+    std::uint64_t delta {};
+    int sampled {};
+    for (const code::Instance &instance : code::getInstances()) {
+        if (instance.pid == -1 || instance.agent != -1 
+            || instance.state != code::InstanceState::Running) {
+            continue;
+        }
+        std::optional<std::filesystem::path> cgroup {code::getInstanceCgroup(instance.pid)};
+        if (!cgroup) {
+            continue;
+        }
+        std::uint64_t writeOps {code::readCgroupWriteOps(*cgroup)};
+        ops.emplace(instance.uuid, writeOps);
+        auto last {lastOps.find(instance.uuid)};
+        if (last != lastOps.end() && writeOps >= last->second) {
+            delta += writeOps - last->second;
+            ++sampled;
+        }
+    }
+    lastOps.swap(ops);
+    if (sampled == 0) {
+        return;
+    }
+    double minutes {std::chrono::duration<double, std::ratio<60>> {
+        constants::USER_DATA_SYNC_INTERVAL
+    }.count()};
+    double perMinute {static_cast<double>(delta) / sampled / minutes};
+    LOG_F(
+        1, "Disk writes per running instance: %.1f/min over %d instance(s).", 
+        perMinute, sampled
+    );
+    std::lock_guard<std::mutex> lock {statsMutex};
+    stats.writeOpsPerMinute = perMinute;
+}
+
+static void runSync() {
+    std::unordered_map<uuids::uuid, std::uint64_t> lastOps {};
+    while (syncing) {
+        {
+            std::unique_lock<std::mutex> lock {syncMutex};
+            syncSignal.wait_for(lock, constants::USER_DATA_SYNC_INTERVAL, [] {
+                return !syncing;
+            });
+        }
+        if (!syncing) {
+            break;
+        }
+        syncAll();
+        sampleWriteOps(lastOps);
+    }
+}
+
+std::filesystem::path code::prepareUserData(
+    const std::string &label, const std::filesystem::path &diskDir
+) {
+    if (SData::studentsData->get_ramUserDataMB() <= 0) {
+        return diskDir;
+    }
+    if (!ramRootUsable()) {
+        LOG_F(
+            WARNING, "%s isn't a tmpfs. Keeping user data on disk.", 
+            constants::RAM_USER_DATA_ROOT.c_str()
+        );
+        return diskDir;
+    }
+    std::lock_guard<std::mutex> lock {dirsMutex};
+    std::filesystem::path ramDir {ramRoot() / label};
+    std::error_code err;
+    // One left behind while instruct was down holds newer state than the disk.
+    if (!std::filesystem::exists(ramDir, err)) {
+        std::filesystem::create_directories(ramDir, err);
+        for (const std::filesystem::path &entry : PERSISTED_ENTRIES) {
+            if (!std::filesystem::exists(diskDir / entry, err)) {
+                continue;
+            }
+            std::filesystem::create_directories((ramDir / entry).parent_path(), err);
+            std::filesystem::copy(
+                diskDir / entry, 
+                ramDir / entry, 
+                std::filesystem::copy_options::recursive, 
+                err
+            );
+        }
+    }
+    if (err) {
+        log::logErrorCodeWarning(err);
+        return diskDir;
+    }
+    diskDirs[label] = diskDir;
+    return ramDir;
+}
+
+void code::releaseUserData(const std::string &label) {
+    std::lock_guard<std::mutex> lock {dirsMutex};
+    std::filesystem::path ramDir {ramRoot() / label};
+    std::error_code err;
+    if (!std::filesystem::exists(ramDir, err)) {
+        return;
+    }
+    syncDir(ramDir, diskDirOf(label));
+    std::filesystem::remove_all(ramDir, err);
+    diskDirs.erase(label);
+}
+
+void code::startUserDataSync() {
+    if (syncing) {
+        return;
+    }
+    syncing = true;
+    syncThread = std::thread {runSync};
+    DLOG_F(INFO, "User data sync thread started.");
+}
+
+void code::stopUserDataSync() {
+    {
+        std::lock_guard<std::mutex> lock {syncMutex};
+        syncing = false;
+    }
+    syncSignal.notify_all();
+    if (syncThread.joinable()) {
+        syncThread.join();
+        DLOG_F(INFO, "User data sync thread joined.");
+    }
+    std::error_code err;
+    if (std::filesystem::exists(ramRoot(), err)) {
+        syncAll();
+    }
+}
+
+code::UserDataStats code::getUserDataStats() {
+    std::lock_guard<std::mutex> lock {statsMutex};
+    return stats;
+}
+
+}
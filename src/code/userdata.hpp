@@ -0,0 +1,36 @@
+#ifndef INSTRUCT_USERDATA_HPP
+#define INSTRUCT_USERDATA_HPP
+
+#include <filesystem>
+#include <cstdint>
+#include <string>
+
+namespace instruct::code {
+    struct UserDataStats {
+        int ramDirs;
+        std::uint64_t ramBytes;
+        std::uint64_t syncedFiles;
+        std::uint64_t syncedBytes;
+        // Block device writes per running instance per minute over the last interval, 
+        // or negative without instance cgroups to read them from.
+        double writeOpsPerMinute;
+    };
+    
+    // Returns the user data directory an instance should be started with. 
+    // With `ram_user_data_mb` set, this is a directory in memory seeded from 
+    // the settings and state persisted in the given directory, otherwise it's 
+    // the given directory itself.
+    std::filesystem::path prepareUserData(const std::string &, const std::filesystem::path &);
+    // Persists the instance's in-memory user data, if any, and frees it.
+    void releaseUserData(const std::string &);
+    
+    // Periodically copies what's worth keeping from every in-memory directory 
+    // to disk in one batch and trims the caches of those over their cap.
+    void startUserDataSync();
+    // Syncs one last time. The in-memory directories stay for running instances.
+    void stopUserDataSync();
+    
+    UserDataStats getUserDataStats();
+}
+
+#endif
@@ -0,0 +1,490 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <system_error>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <mutex>
+
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loguru.hpp"
+
+#include "../constants.hpp"
+#include "supervisor.hpp"
+#include "../data.hpp"
+#include "watcher.hpp"
+
+namespace instruct {
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    
+    // Directories only, since events for a directory's entries come through it.
+    constexpr std::uint32_t WATCH_MASK {
+        IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO 
+            | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK
+    };
+    
+    struct Watch {
+        uuids::uuid uuid;
+        // Of the directory, empty for the workspace itself.
+        std::string relative;
+    };
+    
+    // Enough to tell a file changed between two scans.
+    struct ScannedFile {
+        std::int64_t mtime;
+        std::uint64_t size;
+    };
+    
+    struct Workspace {
+        std::filesystem::path root;
+        // Without watches, changes are found by comparing scans.
+        bool scanned;
+        // Removed or replaced, to be watched again once it's back.
+        bool dropped;
+        std::unordered_map<std::string, ScannedFile> files;
+        // Gathered until the next flush.
+        std::unordered_set<std::string> pending;
+        bool pendingEverything;
+    };
+    
+    // What queries are answered from.
+    struct ChangeIndex {
+        // Of the last change, and of the last time the paths were dropped.
+        std::uint64_t sequence;
+        std::uint64_t everythingAt;
+        std::unordered_map<std::string, std::uint64_t> paths;
+    };
+    
+    std::thread watcherThread {};
+    std::atomic_bool watching {false};
+    int epollFd {-1};
+    int inotifyFd {-1};
+    int wakeFd {-1};
+    
+    // Only touched by the watcher thread.
+    std::unordered_map<int, Watch> watches {};
+    std::unordered_map<uuids::uuid, Workspace> workspaces {};
+    bool flushDue {false};
+    Clock::time_point flushAt {};
+    Clock::time_point reconcileAt {};
+    bool limitLogged {false};
+    
+    std::mutex indexMutex {};
+    std::uint64_t sequence {0};
+    std::unordered_map<uuids::uuid, ChangeIndex> changeIndex {};
+    code::WatcherStats stats {};
+}
+
+static std::string joinRelative(const std::string &dir, const std::string &name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+// Events that arrive together are recorded together, once the delay is up.
+static void scheduleFlush() {
+    if (!flushDue) {
+        flushDue = true;
+        flushAt = Clock::now() + constants::WATCHER_COALESCE_DELAY;
+    }
+}
+
+static void markPending(Workspace &workspace, const std::string &relative) {
+    if (!workspace.pendingEverything) {
+        workspace.pending.insert(relative);
+    }
+    scheduleFlush();
+}
+
+static void markEverything(Workspace &workspace) {
+    workspace.pendingEverything = true;
+    workspace.pending.clear();
+    scheduleFlush();
+}
+
+// Removes the watches of the directory and those below it, or of the whole 
+// workspace without one.
+static void unwatchTree(const uuids::uuid &uuid, const std::string &relative) {
+    for (auto it {watches.begin()}; it != watches.end();) {
+        const std::string &watched {it->second.relative};
+        if (it->second.uuid == uuid && (relative.empty() || watched == relative 
+            || watched.rfind(relative + "/", 0) == 0)) {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Watches the directory and every one below it. Watching a directory again 
+// returns its existing watch, which is then renamed, i.e. after a move. 
+// Files found are marked as changed if asked, since they may have been written 
+// before their directory was watched. Returns false once the kernel's limit is hit.
+static bool watchTree(
+    const uuids::uuid &uuid, Workspace &workspace, const std::string &relative, bool markFiles
+) {
+    auto addWatch {[&] (const std::filesystem::path &dir, const std::string &dirRelative) {
+        int wd {inotify_add_watch(inotifyFd, dir.c_str(), WATCH_MASK)};
+        if (wd == -1) {
+            // Otherwise it's gone already, and its parent reports that.
+            return errno != ENOSPC && errno != ENOMEM;
+        }
+        watches[wd] = {uuid, dirRelative};
+        return true;
+    }};
+    std::filesystem::path top {relative.empty() ? workspace.root : workspace.root / relative};
+    if (!addWatch(top, relative)) {
+        return false;
+    }
+    std::error_code err;
+    std::filesystem::recursive_directory_iterator it {
+        top, std::filesystem::directory_options::skip_permission_denied, err
+    };
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        std::string entryRelative {it->path().lexically_relative(workspace.root).string()};
+        std::error_code typeErr;
+        if (it->is_directory(typeErr) && !it->is_symlink(typeErr)) {
+            if (!addWatch(it->path(), entryRelative)) {
+                return false;
+            }
+        } else if (markFiles) {
+            markPending(workspace, entryRelative);
+        }
+    }
+    return true;
+}
+
+static std::unordered_map<std::string, ScannedFile> scanFiles(const std::filesystem::path &root) {
+    std::unordered_map<std::string, ScannedFile> files {};
+    std::error_code err;
+    std::filesystem::recursive_directory_iterator it {
+        root, std::filesystem::directory_options::skip_permission_denied, err
+    };
+    for (; !err && it != std::filesystem::recursive_directory_iterator {}; it.increment(err)) {
+        struct stat info {};
+        if (lstat(it->path().c_str(), &info) != 0 || S_ISDIR(info.st_mode)) {
+            continue;
+        }
+        files.emplace(it->path().lexically_relative(root).string(), ScannedFile {
+            static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec, 
+            static_cast<std::uint64_t>(info.st_size)
+        });
+    }
+    return files;
+}
+
+// Stands in for the watches of a workspace, comparing it with its last scan.
+static void rescanWorkspace(Workspace &workspace) {
+    std::unordered_map<std::string, ScannedFile> files {scanFiles(workspace.root)};
+    for (const auto &[relative, file] : files) {
+        auto prior {workspace.files.find(relative)};
+        if (prior == workspace.files.end() || prior->second.mtime != file.mtime 
+            || prior->second.size != file.size) {
+            markPending(workspace, relative);
+        }
+    }
+    for (const auto &[relative, file] : workspace.files) {
+        if (files.count(relative) == 0) {
+            markPending(workspace, relative);
+        }
+    }
+    workspace.files = std::move(files);
+}
+
+static void fallBackToScanning(const uuids::uuid &uuid, Workspace &workspace) {
+    if (!limitLogged) {
+        LOG_F(
+            WARNING, 
+            "Ran out of inotify watches, so workspaces are scanned every %lld s instead. "
+            "Raise fs.inotify.max_user_watches to watch them all.", 
+            static_cast<long long>(constants::WATCHER_RESCAN_INTERVAL.count())
+        );
+        limitLogged = true;
+    }
+    // Partly watched workspaces would report changes twice.
+    unwatchTree(uuid, "");
+    workspace.scanned = true;
+    workspace.files = scanFiles(workspace.root);
+    markEverything(workspace);
+}
+
+// Picks up workspaces created since the last pass, drops those of students 
+// removed, and scans the ones without watches.
+static void reconcile() {
+    std::unordered_set<uuids::uuid> students {};
+    for (const auto &[uuid, student] : SData::studentsData->get_students()) {
+        students.insert(uuid);
+        auto known {workspaces.find(uuid)};
+        if (known != workspaces.end() && !known->second.dropped) {
+            continue;
+        }
+        std::filesystem::path root {code::getWorkspacePath(uuid)};
+        std::error_code err;
+        // Workspaces are created when instances first start.
+        if (!std::filesystem::is_directory(root, err)) {
+            continue;
+        }
+        Workspace &workspace {workspaces[uuid]};
+        workspace.root = root;
+        workspace.dropped = false;
+        if (!watchTree(uuid, workspace, "", false)) {
+            fallBackToScanning(uuid, workspace);
+        }
+        markEverything(workspace);
+    }
+    for (auto it {workspaces.begin()}; it != workspaces.end();) {
+        if (students.count(it->first) == 0) {
+            unwatchTree(it->first, "");
+            std::lock_guard<std::mutex> lock {indexMutex};
+            changeIndex.erase(it->first);
+            it = workspaces.erase(it);
+            continue;
+        }
+        if (it->second.scanned) {
+            rescanWorkspace(it->second);
+        }
+        ++it;
+    }
+}
+
+// The workspace itself was removed or replaced, so it's picked up again 
+// on the next pass, which is brought forward.
+static void dropWorkspace(const uuids::uuid &uuid) {
+    unwatchTree(uuid, "");
+    workspaces.at(uuid).dropped = true;
+    markEverything(workspaces.at(uuid));
+    reconcileAt = std::min(reconcileAt, Clock::now() + constants::WATCHER_COALESCE_DELAY);
+}
+
+static void handleEvent(const inotify_event &event) {
+    if (event.mask & IN_Q_OVERFLOW) {
+        // Events were lost, including possibly the creation of directories to watch.
+        LOG_F(WARNING, "The inotify queue overflowed, rewatching every workspace.");
+        for (auto &[uuid, workspace] : workspaces) {
+            if (!workspace.scanned && !watchTree(uuid, workspace, "", false)) {
+                fallBackToScanning(uuid, workspace);
+            }
+            markEverything(workspace);
+        }
+        return;
+    }
+    auto watch {watches.find(event.wd)};
+    if (watch == watches.end()) {
+        return;
+    }
+    if (event.mask & IN_IGNORED) {
+        watches.erase(watch);
+        return;
+    }
+    uuids::uuid uuid {watch->second.uuid};
+    std::string dirRelative {watch->second.relative};
+    auto workspace {workspaces.find(uuid)};
+    if (workspace == workspaces.end()) {
+        return;
+    }
+    if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        // Anywhere below the root, the parent's event covers it.
+        if (dirRelative.empty()) {
+            dropWorkspace(uuid);
+        }
+        return;
+    }
+    std::string relative {event.len > 0 ? joinRelative(dirRelative, event.name) : dirRelative};
+    markPending(workspace->second, relative);
+    // Its watches would go on reporting under the old path, even from outside the workspace. 
+    // A move within it is followed by `IN_MOVED_TO`, which watches it anew.
+    if ((event.mask & IN_ISDIR) && (event.mask & IN_MOVED_FROM)) {
+        unwatchTree(uuid, relative);
+    }
+    if ((event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO)) 
+        && !watchTree(uuid, workspace->second, relative, true)) {
+        fallBackToScanning(uuid, workspace->second);
+    }
+}
+
+static void drainEvents() {
+    alignas(inotify_event) char buffer[constants::WATCHER_EVENT_BUFFER_SIZE];
+    while (true) {
+        ssize_t length {read(inotifyFd, buffer, sizeof buffer)};
+        if (length <= 0) {
+            if (length == -1 && errno != EAGAIN && errno != EINTR) {
+                LOG_F(WARNING, "Failed to read inotify events: %s", std::strerror(errno));
+            }
+            return;
+        }
+        for (ssize_t offset {}; offset < length;) {
+            const inotify_event *event {reinterpret_cast<const inotify_event *>(buffer + offset)};
+            handleEvent(*event);
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+// Records everything gathered since the last flush under one new sequence.
+static void flush() {
+    flushDue = false;
+    std::lock_guard<std::mutex> lock {indexMutex};
+    ++sequence;
+    for (auto &[uuid, workspace] : workspaces) {
+        if (!workspace.pendingEverything && workspace.pending.empty()) {
+            continue;
+        }
+        ChangeIndex &index {changeIndex[uuid]};
+        index.sequence = sequence;
+        if (!workspace.pendingEverything) {
+            for (const std::string &relative : workspace.pending) {
+                index.paths[relative] = sequence;
+            }
+        }
+        // Past this many, the paths stop being cheap to keep and to go through.
+        if (workspace.pendingEverything || index.paths.size() > constants::WATCHER_MAX_PATHS) {
+            index.everythingAt = sequence;
+            index.paths.clear();
+        }
+        workspace.pending.clear();
+        workspace.pendingEverything = false;
+    }
+    stats.sequence = sequence;
+}
+
+static void updateStats() {
+    int scanned {static_cast<int>(std::count_if(
+        workspaces.begin(), workspaces.end(), [] (const auto &entry) {
+            return entry.second.scanned;
+        }
+    ))};
+    std::lock_guard<std::mutex> lock {indexMutex};
+    stats.workspaces = static_cast<int>(workspaces.size());
+    stats.watches = static_cast<int>(watches.size());
+    stats.scanned = scanned;
+}
+
+static void runWatcher() {
+    std::vector<epoll_event> events(2);
+    reconcileAt = Clock::now();
+    while (watching) {
+        if (Clock::now() >= reconcileAt) {
+            reconcile();
+            updateStats();
+            reconcileAt = Clock::now() + constants::WATCHER_RESCAN_INTERVAL;
+        }
+        if (flushDue && Clock::now() >= flushAt) {
+            flush();
+            updateStats();
+        }
+        Clock::time_point wakeAt {flushDue ? std::min(flushAt, reconcileAt) : reconcileAt};
+        auto timeout {std::chrono::duration_cast<std::chrono::milliseconds>(
+            wakeAt - Clock::now()
+        )};
+        int count {epoll_wait(
+            epollFd, events.data(), events.size(), std::max<int>(0, timeout.count() + 1)
+        )};
+        if (count == -1 && errno != EINTR) {
+            LOG_F(ERROR, "epoll_wait() failed: %s", std::strerror(errno));
+            break;
+        }
+        for (int idx {}; idx < count; ++idx) {
+            if (events.at(idx).data.fd == inotifyFd) {
+                drainEvents();
+            }
+        }
+    }
+}
+
+void code::startWatcher() {
+    if (watching) {
+        return;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd == -1 || inotifyFd == -1 || wakeFd == -1) {
+        LOG_F(ERROR, "Failed to create the workspace watcher: %s", std::strerror(errno));
+        return;
+    }
+    for (int fd : {inotifyFd, wakeFd}) {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+    watching = true;
+    watcherThread = std::thread {runWatcher};
+    DLOG_F(INFO, "Watcher thread started.");
+}
+
+void code::stopWatcher() {
+    if (!watching) {
+        return;
+    }
+    watching = false;
+    std::uint64_t one {1};
+    if (write(wakeFd, &one, sizeof(one)) == -1) {
+        LOG_F(WARNING, "Failed to wake the watcher thread.");
+    }
+    watcherThread.join();
+    DLOG_F(INFO, "Watcher thread joined.");
+    
+    // Closing the inotify instance removes its watches.
+    close(inotifyFd);
+    close(wakeFd);
+    close(epollFd);
+    inotifyFd = wakeFd = epollFd = -1;
+    watches.clear();
+    workspaces.clear();
+    flushDue = false;
+    
+    // The sequence carries on, so that no earlier one is mistaken for a later one.
+    std::lock_guard<std::mutex> lock {indexMutex};
+    changeIndex.clear();
+    stats = {0, 0, 0, sequence};
+}
+
+bool code::watcherRunning() {
+    return watching;
+}
+
+std::uint64_t code::changeSequence() {
+    std::lock_guard<std::mutex> lock {indexMutex};
+    return sequence;
+}
+
+bool code::workspaceChangedSince(const uuids::uuid &uuid, std::uint64_t since) {
+    std::lock_guard<std::mutex> lock {indexMutex};
+    auto index {changeIndex.find(uuid)};
+    return index == changeIndex.end() || index->second.sequence > since;
+}
+
+code::WorkspaceChanges code::changesSince(const uuids::uuid &uuid, std::uint64_t since) {
+    std::lock_guard<std::mutex> lock {indexMutex};
+    WorkspaceChanges changes {sequence, true, {}};
+    auto index {changeIndex.find(uuid)};
+    if (index == changeIndex.end() || index->second.everythingAt > since) {
+        return changes;
+    }
+    changes.everything = false;
+    for (const auto &[relative, changedAt] : index->second.paths) {
+        if (changedAt > since) {
+            changes.paths.push_back(relative);
+        }
+    }
+    std::sort(changes.paths.begin(), changes.paths.end());
+    return changes;
+}
+
+code::WatcherStats code::getWatcherStats() {
+    std::lock_guard<std::mutex> lock {indexMutex};
+    return stats;
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef INSTRUCT_WATCHER_HPP
+#define INSTRUCT_WATCHER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "uuid.h"
+
+namespace instruct::code {
+    struct WorkspaceChanges {
+        // What the changes run up to, i.e. the sequence to pass to the next query.
+        std::uint64_t sequence;
+        // Set when the paths weren't kept, i.e. the workspace was only just seen, 
+        // events were lost or too many paths changed, so anything may have changed.
+        bool everything;
+        // Relative to the workspace, sorted.
+        std::vector<std::string> paths;
+    };
+    
+    struct WatcherStats {
+        int workspaces;
+        int watches;
+        // Workspaces left to periodic scans by the kernel's limit on watches.
+        int scanned;
+        std::uint64_t sequence;
+    };
+    
+    // Watches every student's workspace with inotify from a single thread, 
+    // keeping which paths changed in each.
+    void startWatcher();
+    void stopWatcher();
+    bool watcherRunning();
+    
+    // Increases with every batch of changes recorded, across all workspaces 
+    // and restarts of the watcher.
+    std::uint64_t changeSequence();
+    // Whether the student's workspace may have changed after the given sequence. 
+    // Always true for a workspace that isn't being watched.
+    bool workspaceChangedSince(const uuids::uuid &, std::uint64_t);
+    WorkspaceChanges changesSince(const uuids::uuid &, std::uint64_t);
+    
+    WatcherStats getWatcherStats();
+}
+
+#endif
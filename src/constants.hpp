@@ -3,6 +3,8 @@
 
 #include <unordered_map>
 #include <filesystem>
+#include <cstdint>
+#include <utility>
 #include <string>
 #include <chrono>
 #include <vector>
@@ -19,16 +21,138 @@ namespace instruct::constants {
     inline const std::filesystem::path DATA_DIR {"instruct_data"};
     inline const std::filesystem::path LOG_DIR {"instruct_logs"};
     inline const std::filesystem::path OPENVSCODE_SERVER_DIR {DATA_DIR / "openvscode-server"};
+    inline const std::filesystem::path WORKSPACES_DIR {DATA_DIR / "workspaces"};
+    inline const std::filesystem::path INSTANCES_DIR {DATA_DIR / "instances"};
+    inline const std::filesystem::path SNAPSHOTS_DIR {DATA_DIR / "snapshots"};
+    inline const std::filesystem::path DEADLINES_DIR {DATA_DIR / "deadlines"};
+    inline const std::filesystem::path TEMPLATES_DIR {DATA_DIR / "templates"};
+    // Workspaces set aside by resets, and reset clones being staged.
+    inline const std::filesystem::path RESETS_DIR {DATA_DIR / "resets"};
+    // Scratch directories test commands run from, and the results of each run.
+    inline const std::filesystem::path TEST_RUNS_DIR {DATA_DIR / "test-runs"};
+    inline const std::filesystem::path TEST_RESULTS_DIR {DATA_DIR / "test-results"};
     
     inline const std::filesystem::path INSTRUCT_LOG_DIR {LOG_DIR / "instruct.log"};
-
+    inline const std::filesystem::path INSTANCE_LOG_DIR {LOG_DIR / "instances"};
+    // Within an instance's data directory, readable by instruct's user only.
+    inline const std::filesystem::path CONNECTION_TOKEN_FILE {"connection-token"};
+    
+    inline const std::filesystem::path CGROUP_ROOT {"/sys/fs/cgroup"};
+    inline const std::filesystem::path NUMA_NODES_DIR {"/sys/devices/system/node"};
+    // In-memory user data directories are kept in a per-user directory here.
+    inline const std::filesystem::path RAM_USER_DATA_ROOT {"/dev/shm"};
+    
     inline const std::filesystem::path INSTRUCTOR_CONFIG {DATA_DIR / "instructor_config.yaml"};
     inline const std::filesystem::path STUDENTS_CONFIG {DATA_DIR / "students_config.yaml"};
     inline const std::filesystem::path TESTS_CONFIG {DATA_DIR / "tests_config.yaml"};
     inline const std::filesystem::path UI_CONFIG {DATA_DIR / "ui_config.yaml"};
+    inline const std::filesystem::path INSTANCES_STATE {DATA_DIR / "instances_state.yaml"};
 
     inline constexpr int MAX_INSTRUCTOR_PASSWORD_LENGTH = 16;
     
+    inline constexpr std::size_t PORT_PROBE_BATCH_SIZE {256};
+    inline const std::chrono::milliseconds PORT_PROBE_TIMEOUT {250};
+    
+    inline const std::chrono::milliseconds PROCESS_STOP_GRACE_PERIOD {3000};
+    inline const std::chrono::milliseconds LAUNCH_POLL_INTERVAL {250};
+    inline const std::chrono::seconds LAUNCH_READY_TIMEOUT {90};
+    // How often the page shown while an editor starts checks on it.
+    inline const std::chrono::seconds LOGIN_REFRESH_INTERVAL {1};
+    inline constexpr int LAUNCH_CONCURRENCY_DEFAULT {8};
+    
+    inline const std::chrono::seconds HIBERNATION_INTERVAL {15};
+    inline constexpr double HIBERNATION_BUSY_CPU_FRACTION {0.01};
+    
+    inline const std::chrono::seconds USER_DATA_SYNC_INTERVAL {60};
+    
+    inline const std::chrono::seconds SAMPLER_INTERVAL {2};
+    // Samples kept per instance, i.e. the last minute.
+    inline constexpr std::size_t SAMPLER_HISTORY {30};
+    inline constexpr std::size_t SAMPLER_READ_BUFFER_SIZE {1024};
+    
+    // Only used where neither reflinks nor `copy_file_range` work.
+    inline constexpr std::size_t COPY_BUFFER_SIZE {1 << 20};
+    
+    inline constexpr std::size_t DISTRIBUTION_MAX_WORKERS {16};
+    inline constexpr std::size_t DISTRIBUTION_BUFFER_SIZE {1 << 20};
+    inline constexpr std::size_t DISTRIBUTION_BLOCK_SIZE {16 * 1024};
+    
+    inline constexpr std::size_t COLLECTION_MAX_READERS {16};
+    // Files read ahead of the archive are held in memory up to this much. 
+    // Larger files are read by the archive as it writes them.
+    inline constexpr std::uint64_t COLLECTION_READ_AHEAD_BYTES {256ull << 20};
+    inline constexpr std::uint64_t COLLECTION_MAX_BUFFERED_FILE {16ull << 20};
+    // The archive is compressed in independent gzip members of this size.
+    inline constexpr std::size_t COLLECTION_BLOCK_SIZE {1 << 20};
+    inline constexpr std::size_t COLLECTION_BLOCKS_PER_COMPRESSOR {4};
+    inline const std::string COLLECTION_MANIFEST {"manifest.yaml"};
+    
+    inline constexpr std::size_t SNAPSHOT_MAX_WORKERS {8};
+    inline constexpr std::size_t SNAPSHOT_BUFFER_SIZE {1 << 20};
+    // Content-defined chunks average 2^bits bytes past the minimum.
+    inline constexpr std::size_t SNAPSHOT_MIN_CHUNK {2 * 1024};
+    inline constexpr std::size_t SNAPSHOT_MAX_CHUNK {64 * 1024};
+    inline constexpr int SNAPSHOT_CHUNK_BITS {13};
+    inline constexpr std::size_t SNAPSHOT_ROUND_HISTORY {20};
+    
+    // Changes are gathered for this long and then recorded as one batch.
+    inline const std::chrono::milliseconds WATCHER_COALESCE_DELAY {200};
+    // New workspaces are picked up, and those without watches scanned, this often.
+    inline const std::chrono::seconds WATCHER_RESCAN_INTERVAL {30};
+    // Changed paths kept per workspace before it's just marked as changed throughout.
+    inline constexpr std::size_t WATCHER_MAX_PATHS {4096};
+    inline constexpr std::size_t WATCHER_EVENT_BUFFER_SIZE {64 * 1024};
+    
+    inline constexpr std::size_t DEADLINE_MAX_WORKERS {16};
+    // Stopping is mostly waiting on the grace period, so far more run at once.
+    inline constexpr std::size_t DEADLINE_MAX_STOPPERS {64};
+    // Instances that haven't finished freezing by then are captured anyway.
+    inline const std::chrono::milliseconds DEADLINE_FREEZE_TIMEOUT {2000};
+    
+    inline const std::chrono::seconds QUOTA_CHECK_INTERVAL {5};
+    // Without the watcher's changes to go on, workspaces are only rescanned this often.
+    inline const std::chrono::seconds QUOTA_RESCAN_INTERVAL {300};
+    inline constexpr std::size_t QUOTA_MAX_SCANNERS {8};
+    
+    inline constexpr std::size_t TEMPLATE_MAX_WORKERS {16};
+    inline constexpr std::size_t TEMPLATE_MAX_STOPPERS {64};
+    
+    inline constexpr std::size_t TEST_READ_BUFFER_SIZE {64 * 1024};
+    inline constexpr int TEST_MAX_EVENTS {64};
+    // Commands writing more to stdout are killed, like those stuck printing in a loop.
+    inline constexpr std::uint64_t TEST_OUTPUT_CAP {64 << 20};
+    // Kept of the output on either side of its first difference, and of stderr.
+    inline constexpr std::size_t TEST_EXCERPT_SIZE {512};
+    inline const std::string TEST_TRUNCATION_MARKER {"[truncated]"};
+    
+    inline constexpr std::size_t PLACEMENT_MIN_CPUS_TO_RESERVE {4};
+    inline constexpr std::size_t PLACEMENT_INSTRUCTOR_CPUS {2};
+    inline constexpr std::size_t PLACEMENT_CPUS_PER_INSTANCE {2};
+    
+    inline constexpr std::size_t RELAY_BUFFER_SIZE {64 * 1024};
+    inline constexpr int RELAY_MAX_EVENTS {256};
+    inline const std::chrono::seconds ACTIVATION_REAP_INTERVAL {1};
+    
+    inline const std::string PROXY_SESSION_COOKIE {"instruct_session"};
+    inline const std::string PROXY_SESSION_PATH {"/session/"};
+    inline constexpr std::size_t PROXY_MAX_REQUEST_HEAD {16 * 1024};
+    inline const std::chrono::seconds PROXY_REQUEST_TIMEOUT {10};
+    
+    inline constexpr std::uint64_t ADMISSION_DEFAULT_INSTANCE_COST {512ull << 20};
+    inline constexpr double ADMISSION_HEADROOM_FRACTION {0.10};
+    inline constexpr double ADMISSION_PSI_FULL_LIMIT {10.0};
+    inline const std::chrono::seconds ADMISSION_PSI_WINDOW {10};
+    inline const std::chrono::seconds ADMISSION_VERDICT_TTL {60};
+    
+    inline constexpr int AGENT_DEFAULT_PORT {8100};
+    // Ports the editors an agent spawns listen on.
+    inline const std::pair<int, int> AGENT_DEFAULT_PORT_RANGE {5001, 6000};
+    inline const std::string AGENT_TOKEN_ENV {"INSTRUCT_AGENT_TOKEN"};
+    inline const std::chrono::seconds AGENT_POLL_INTERVAL {5};
+    inline const std::chrono::seconds AGENT_REQUEST_TIMEOUT {5};
+    // Instances on an agent that hasn't answered for this long are started elsewhere.
+    inline const std::chrono::seconds AGENT_STALE_AFTER {20};
+    
     inline const std::string OPENVSCODE_SERVER_HOST {"github.com"}; // Note: Do not specify scheme.
     inline const std::string OPENVSCODE_SERVER_ROUTE_FORMAT {"/gitpod-io/openvscode-server/releases/download/openvscode-server-${VERSION}/openvscode-server-${VERSION}-linux-${PLATFORM}.tar.gz"};
     inline const std::string OPENVSCODE_SERVER_VERSION_DEFAULT {"v1.79.2"};
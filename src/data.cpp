@@ -34,10 +34,43 @@ namespace keys {
     static const std::string CODE_PORTS {"code_ports"};
     static const std::string CODE_PORT_RANGE {"code_port_range"};
     static const std::string USE_RANDOM_PORTS {"use_random_ports"};
+    static const std::string LAUNCH_CONCURRENCY {"launch_concurrency"};
+    static const std::string WARM_POOL_SIZE {"warm_pool_size"};
+    static const std::string LAZY_START {"lazy_start"};
+    static const std::string PROXY_PORT {"proxy_port"};
+    static const std::string RAM_USER_DATA_MB {"ram_user_data_mb"};
+    static const std::string CPU_PLACEMENT {"cpu_placement"};
+    static const std::string IDLE_FREEZE_MINUTES {"idle_freeze_minutes"};
+    static const std::string IDLE_STOP_MINUTES {"idle_stop_minutes"};
+    static const std::string IDLE_OVERRIDES {"idle_overrides"};
+    static const std::string SNAPSHOT_INTERVAL_MINUTES {"snapshot_interval_minutes"};
+    static const std::string DISK_QUOTA_MB {"disk_quota_mb"};
+    static const std::string DISK_QUOTA_OVERRIDES {"disk_quota_overrides"};
+    static const std::string ENFORCE_DISK_QUOTA {"enforce_disk_quota"};
+    static const std::string STUDENT_BUDGET {"student_budget"};
+    static const std::string INSTRUCTOR_BUDGET {"instructor_budget"};
+    static const std::string ADDRESS_SPACE_MB {"address_space_mb"};
+    static const std::string CPU_SECONDS {"cpu_seconds"};
+    static const std::string OPEN_FILES {"open_files"};
+    static const std::string PROCESSES {"processes"};
+    static const std::string NICENESS {"niceness"};
+    static const std::string IO_CLASS {"io_class"};
+    static const std::string IO_LEVEL {"io_level"};
+    static const std::string CPU_WEIGHT {"cpu_weight"};
+    static const std::string MEMORY_MAX_MB {"memory_max_mb"};
+    static const std::string AGENTS {"agents"};
+    static const std::string HOST {"host"};
+    static const std::string PORT {"port"};
+    static const std::string TOKEN {"token"};
+    static const std::string COLLECTION_FILTER {"collection_filter"};
+    static const std::string COLLECTION_OVERRIDES {"collection_overrides"};
+    static const std::string INCLUDE {"include"};
+    static const std::string EXCLUDE {"exclude"};
     static const std::string UUID {"uuid"};
     static const std::string DISPLAY_NAME {"display_name"};
     static const std::string ELEVATED_PRIVILEGES {"elevated_privileges"};
     static const std::string STUDENTS {"students"};
+    static const std::string ASSIGNED_PORTS {"assigned_ports"};
     
     // Test keys.
     static const std::string SELECTED_TESTS {"selected_test_uuids"};
@@ -45,6 +78,7 @@ namespace keys {
     static const std::string I_RUN_CMD {"instructor_run_command"};
     static const std::string S_RUN_CMD {"student_run_command"};
     static const std::string SECONDS_ALLOTTED {"seconds_allotted"};
+    static const std::string FAIL_FAST {"fail_fast"};
     
     // UI keys.
     static const std::string ALWAYS_SHOW_STUDENT_UUIDS {"always_show_student_uuids"};
@@ -135,6 +169,19 @@ SData::SData(const std::filesystem::path &filePath) : Data {filePath} {
     codePorts = yaml[keys::CODE_PORTS].as<std::set<int>>();
     codePortRange = yaml[keys::CODE_PORT_RANGE].as<std::pair<int, int>>();
     useRandomPorts = yaml[keys::USE_RANDOM_PORTS].as<bool>();
+    launchConcurrency = yaml[keys::LAUNCH_CONCURRENCY].as<int>(
+        constants::LAUNCH_CONCURRENCY_DEFAULT
+    );
+    warmPoolSize = yaml[keys::WARM_POOL_SIZE].as<int>(0);
+    lazyStart = yaml[keys::LAZY_START].as<bool>(false);
+    proxyPort = yaml[keys::PROXY_PORT].as<int>(0);
+    ramUserDataMB = yaml[keys::RAM_USER_DATA_MB].as<int>(0);
+    cpuPlacement = yaml[keys::CPU_PLACEMENT].as<bool>(false);
+    idleFreezeMinutes = yaml[keys::IDLE_FREEZE_MINUTES].as<int>(0);
+    idleStopMinutes = yaml[keys::IDLE_STOP_MINUTES].as<int>(0);
+    snapshotIntervalMinutes = yaml[keys::SNAPSHOT_INTERVAL_MINUTES].as<int>(0);
+    diskQuotaMB = yaml[keys::DISK_QUOTA_MB].as<std::pair<int, int>>(std::pair<int, int> {0, 0});
+    enforceDiskQuota = yaml[keys::ENFORCE_DISK_QUOTA].as<bool>(false);
     
     std::vector<Student> studentVec {yaml[keys::STUDENTS].as<std::vector<Student>>()};
     students.reserve(studentVec.size());
@@ -144,6 +191,30 @@ SData::SData(const std::filesystem::path &filePath) : Data {filePath} {
         }
         students.emplace(student.uuid, student);
     }
+    
+    // Absent in configs written before ports were assigned.
+    assignedPorts = yaml[keys::ASSIGNED_PORTS].as<std::unordered_map<uuids::uuid, int>>(
+        std::unordered_map<uuids::uuid, int> {}
+    );
+    idleOverrides = yaml[keys::IDLE_OVERRIDES]
+        .as<std::unordered_map<uuids::uuid, std::pair<int, int>>>(
+            std::unordered_map<uuids::uuid, std::pair<int, int>> {}
+        );
+    diskQuotaOverrides = yaml[keys::DISK_QUOTA_OVERRIDES]
+        .as<std::unordered_map<uuids::uuid, std::pair<int, int>>>(
+            std::unordered_map<uuids::uuid, std::pair<int, int>> {}
+        );
+    // Configs without budgets leave every limit unset.
+    studentBudget = yaml[keys::STUDENT_BUDGET].as<Budget>(Budget {});
+    instructorBudget = yaml[keys::INSTRUCTOR_BUDGET].as<Budget>(Budget {});
+    // Without agents every instance runs on this host.
+    agents = yaml[keys::AGENTS].as<std::vector<Agent>>(std::vector<Agent> {});
+    // Without filters whole workspaces are collected.
+    collectionFilter = yaml[keys::COLLECTION_FILTER].as<CollectionFilter>(CollectionFilter {});
+    collectionOverrides = yaml[keys::COLLECTION_OVERRIDES]
+        .as<std::unordered_map<uuids::uuid, CollectionFilter>>(
+            std::unordered_map<uuids::uuid, CollectionFilter> {}
+        );
 }
 
 void SData::saveData() {
@@ -152,6 +223,17 @@ void SData::saveData() {
     yaml[keys::CODE_PORTS] = codePorts;
     yaml[keys::CODE_PORT_RANGE] = codePortRange;
     yaml[keys::USE_RANDOM_PORTS] = useRandomPorts;
+    yaml[keys::LAUNCH_CONCURRENCY] = launchConcurrency;
+    yaml[keys::WARM_POOL_SIZE] = warmPoolSize;
+    yaml[keys::LAZY_START] = lazyStart;
+    yaml[keys::PROXY_PORT] = proxyPort;
+    yaml[keys::RAM_USER_DATA_MB] = ramUserDataMB;
+    yaml[keys::CPU_PLACEMENT] = cpuPlacement;
+    yaml[keys::IDLE_FREEZE_MINUTES] = idleFreezeMinutes;
+    yaml[keys::IDLE_STOP_MINUTES] = idleStopMinutes;
+    yaml[keys::SNAPSHOT_INTERVAL_MINUTES] = snapshotIntervalMinutes;
+    yaml[keys::DISK_QUOTA_MB] = diskQuotaMB;
+    yaml[keys::ENFORCE_DISK_QUOTA] = enforceDiskQuota;
     
     std::vector<Student> studentVec {};
     studentVec.reserve(students.size());
@@ -159,6 +241,14 @@ void SData::saveData() {
         studentVec.push_back(student);
     }
     yaml[keys::STUDENTS] = studentVec;
+    yaml[keys::ASSIGNED_PORTS] = assignedPorts;
+    yaml[keys::IDLE_OVERRIDES] = idleOverrides;
+    yaml[keys::DISK_QUOTA_OVERRIDES] = diskQuotaOverrides;
+    yaml[keys::STUDENT_BUDGET] = studentBudget;
+    yaml[keys::INSTRUCTOR_BUDGET] = instructorBudget;
+    yaml[keys::AGENTS] = agents;
+    yaml[keys::COLLECTION_FILTER] = collectionFilter;
+    yaml[keys::COLLECTION_OVERRIDES] = collectionOverrides;
     
     Data::saveData();
 }
@@ -255,6 +345,7 @@ bool SData::exportStudentsList(const std::filesystem::path &filePath) {
 
 TData::TData(const std::filesystem::path &filePath) : Data {filePath} {
     selectedTestUUIDs = yaml[keys::SELECTED_TESTS].as<std::unordered_set<uuids::uuid>>();
+    failFast = yaml[keys::FAIL_FAST].as<bool>(false);
     
     std::vector<TestCase> testVec {yaml[keys::TESTS].as<std::vector<TestCase>>()};
     tests.reserve(testVec.size());
@@ -268,6 +359,7 @@ TData::TData(const std::filesystem::path &filePath) : Data {filePath} {
 
 void TData::saveData() {
     yaml[keys::SELECTED_TESTS] = selectedTestUUIDs;
+    yaml[keys::FAIL_FAST] = failFast;
 
     std::vector<TestCase> testVec {};
     testVec.reserve(tests.size());
@@ -347,6 +439,70 @@ struct convert<SData::Student> {
     }
 };
 
+template<>
+struct convert<SData::Budget> {
+    static Node encode(const SData::Budget &rhs) {
+        Node node;
+        node[keys::ADDRESS_SPACE_MB] = rhs.addressSpaceMB;
+        node[keys::CPU_SECONDS] = rhs.cpuSeconds;
+        node[keys::OPEN_FILES] = rhs.openFiles;
+        node[keys::PROCESSES] = rhs.processes;
+        node[keys::NICENESS] = rhs.niceness;
+        node[keys::IO_CLASS] = rhs.ioClass;
+        node[keys::IO_LEVEL] = rhs.ioLevel;
+        node[keys::CPU_WEIGHT] = rhs.cpuWeight;
+        node[keys::MEMORY_MAX_MB] = rhs.memoryMaxMB;
+        return node;
+    }
+    static bool decode(const Node &node, SData::Budget &rhs) {
+        rhs.addressSpaceMB = node[keys::ADDRESS_SPACE_MB].as<int>(0);
+        rhs.cpuSeconds = node[keys::CPU_SECONDS].as<int>(0);
+        rhs.openFiles = node[keys::OPEN_FILES].as<int>(0);
+        rhs.processes = node[keys::PROCESSES].as<int>(0);
+        rhs.niceness = node[keys::NICENESS].as<int>(0);
+        rhs.ioClass = node[keys::IO_CLASS].as<int>(0);
+        rhs.ioLevel = node[keys::IO_LEVEL].as<int>(0);
+        rhs.cpuWeight = node[keys::CPU_WEIGHT].as<int>(0);
+        rhs.memoryMaxMB = node[keys::MEMORY_MAX_MB].as<int>(0);
+
+        return true;
+    }
+};
+
+template<>
+struct convert<SData::Agent> {
+    static Node encode(const SData::Agent &rhs) {
+        Node node;
+        node[keys::HOST] = rhs.host;
+        node[keys::PORT] = rhs.port;
+        node[keys::TOKEN] = rhs.token;
+        return node;
+    }
+    static bool decode(const Node &node, SData::Agent &rhs) {
+        rhs.host = node[keys::HOST].as<std::string>();
+        rhs.port = node[keys::PORT].as<int>(instruct::constants::AGENT_DEFAULT_PORT);
+        rhs.token = node[keys::TOKEN].as<std::string>("");
+
+        return true;
+    }
+};
+
+template<>
+struct convert<SData::CollectionFilter> {
+    static Node encode(const SData::CollectionFilter &rhs) {
+        Node node;
+        node[keys::INCLUDE] = rhs.include;
+        node[keys::EXCLUDE] = rhs.exclude;
+        return node;
+    }
+    static bool decode(const Node &node, SData::CollectionFilter &rhs) {
+        rhs.include = node[keys::INCLUDE].as<std::vector<std::string>>(std::vector<std::string> {});
+        rhs.exclude = node[keys::EXCLUDE].as<std::vector<std::string>>(std::vector<std::string> {});
+
+        return true;
+    }
+};
+
 template<>
 struct convert<std::set<int>> {
     static Node encode(const std::set<int> &rhs) {
@@ -360,6 +516,27 @@ struct convert<std::set<int>> {
     }
 };
 
+template<typename V>
+struct convert<std::unordered_map<uuids::uuid, V>> {
+    static Node encode(const std::unordered_map<uuids::uuid, V> &rhs) {
+        Node node {NodeType::Map};
+        for (const auto &[uuid, val] : rhs) {
+            node[uuids::to_string(uuid)] = val;
+        }
+        return node;
+    }
+    static bool decode(const Node &node, std::unordered_map<uuids::uuid, V> &rhs) {
+        if (!node.IsMap()) {
+            return false;
+        }
+        for (const auto &pair : node) {
+            rhs.emplace(pair.first.as<uuids::uuid>(), pair.second.as<V>());
+        }
+
+        return true;
+    }
+};
+
 template<>
 struct convert<TData::TestCase> {
     static Node encode(const TData::TestCase &rhs) {
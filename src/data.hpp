@@ -6,6 +6,7 @@
 #include <filesystem>
 #include <memory>
 #include <string>
+#include <vector>
 #include <set>
 
 #include "yaml-cpp/yaml.h"
@@ -82,6 +83,68 @@ namespace instruct {
         DATA_ATTR(std::set<int>, codePorts)
         DATA_ATTR(SINGLE(std::pair<int, int>), codePortRange)
         DATA_ATTR(bool, useRandomPorts)
+        DATA_ATTR(int, launchConcurrency)
+        DATA_ATTR(int, warmPoolSize)
+        DATA_ATTR(bool, lazyStart)
+        // The single port all student editors are reached through, or 0 to disable it.
+        DATA_ATTR(int, proxyPort)
+        // Per-instance cap of the in-memory user data directory, or 0 to keep it on disk.
+        DATA_ATTR(int, ramUserDataMB)
+        // Pins instances to CPUs and NUMA nodes, reserving cores for instruct and the instructor.
+        DATA_ATTR(bool, cpuPlacement)
+        DATA_ATTR(int, idleFreezeMinutes)
+        DATA_ATTR(int, idleStopMinutes)
+        // Minutes between snapshots of every workspace, or 0 to only take them on request.
+        DATA_ATTR(int, snapshotIntervalMinutes)
+        // Per-student (freeze, stop) minutes taking precedence over the above.
+        DATA_ATTR(SINGLE(std::unordered_map<uuids::uuid, std::pair<int, int>>), idleOverrides)
+        // Workspace (soft, hard) disk quota in MB, where 0 leaves either unset.
+        DATA_ATTR(SINGLE(std::pair<int, int>), diskQuotaMB)
+        // Per-student (soft, hard) MB taking precedence over the above.
+        DATA_ATTR(
+            SINGLE(std::unordered_map<uuids::uuid, std::pair<int, int>>), diskQuotaOverrides
+        )
+        // Pauses instances whose workspace is over its hard quota until it's back under.
+        DATA_ATTR(bool, enforceDiskQuota)
+        
+        // Limits applied to an instance's processes as they're spawned. Zero leaves one unset.
+        struct Budget {
+            int addressSpaceMB;
+            int cpuSeconds;
+            int openFiles;
+            // Counted per user, so this includes every other instance as well.
+            int processes;
+            int niceness;
+            // `ioprio` class (1 realtime, 2 best effort, 3 idle) and level (0 highest to 7).
+            int ioClass;
+            int ioLevel;
+            // Only applied when instruct was delegated a cgroup v2 subtree.
+            int cpuWeight;
+            int memoryMaxMB;
+        };
+        DATA_ATTR(Budget, studentBudget)
+        DATA_ATTR(Budget, instructorBudget)
+        
+        // A worker host running `instruct-agent`, which student instances are spread across.
+        struct Agent {
+            std::string host;
+            int port;
+            std::string token;
+        };
+        DATA_ATTR(std::vector<Agent>, agents)
+        
+        // Selects what's collected from a workspace. Globs without a slash match a file 
+        // or directory name and those with one the path relative to the workspace. 
+        // Without include globs every file not excluded is collected.
+        struct CollectionFilter {
+            std::vector<std::string> include;
+            std::vector<std::string> exclude;
+        };
+        DATA_ATTR(CollectionFilter, collectionFilter)
+        // Per-student filters taking precedence over the above.
+        DATA_ATTR(
+            SINGLE(std::unordered_map<uuids::uuid, CollectionFilter>), collectionOverrides
+        )
         
         struct Student {
             uuids::uuid uuid;
@@ -91,6 +154,7 @@ namespace instruct {
             bool elevatedPriveleges;
         };
         DATA_ATTR(SINGLE(std::unordered_map<uuids::uuid, Student>), students)
+        DATA_ATTR(SINGLE(std::unordered_map<uuids::uuid, int>), assignedPorts)
         
         inline static std::unique_ptr<SData> studentsData;
         
@@ -119,6 +183,8 @@ namespace instruct {
             double secondsAllotted;
         };
         DATA_ATTR(SINGLE(std::unordered_map<uuids::uuid, TestCase>), tests)
+        // Kills a student's command at the first byte of output differing from the instructor's.
+        DATA_ATTR(bool, failFast)
         
         inline static std::unique_ptr<TData> testsData;
     };
@@ -1,5 +1,11 @@
 #include "loguru.hpp"
 
+#include "code/placement.hpp"
+#include "code/services.hpp"
+#include "code/cgroup.hpp"
+#include "code/ports.hpp"
+#include "code/state.hpp"
+#include "code/auth.hpp"
 #include "security.hpp"
 #include "logging.hpp"
 #include "setup.hpp"
@@ -40,16 +46,35 @@ int main(int argc, char **argv) {
     }
     LOG_F(1, "Instance locked.");
     
+    instruct::code::initCgroupDelegation();
+    instruct::code::initPlacement();
+    
+    LOG_F(1, "Assigning code ports.");
+    instruct::code::initPorts();
+    instruct::code::assignStudentPorts();
+    
+    LOG_F(1, "Reattaching code instances.");
+    instruct::code::reattachInstances();
+    
+    instruct::sec::ThreadedServer studentAuth {};
+    if (!(studentAuth = instruct::code::createStudentAuthServer()).initialized) {
+        LOG_F(WARNING, "Student logins are unavailable.");
+    }
+    instruct::code::startServices();
+    
     LOG_F(INFO, "Starting main application");
     bool reloadMainUI;
     do {
         auto [exitNow, exitSuccess] {instruct::ui::mainMenu()};
         if (!exitSuccess) {
             LOG_F(INFO, "Exiting.");
+            instruct::code::stopServices();
             return EXIT_FAILURE;
         }
         reloadMainUI = !exitNow;
     } while (reloadMainUI);
+    
+    instruct::code::stopServices();
         
     LOG_F(INFO, "Exiting main application.");
     
@@ -1,3 +1,5 @@
+#include <mutex>
+
 #include "loguru.hpp"
 
 #include "notification.hpp"
@@ -9,14 +11,41 @@ namespace {
     std::vector<std::string> recentNotifications {};
     std::string notification {};
     bool notice {false};
+    // Background workers (i.e. the launch scheduler) also post notifications, 
+    // so they're queued rather than touching what the UI is rendering.
+    std::mutex notifyMutex {};
+    std::vector<std::string> pendingNotifications {};
+    std::function<void()> notifyPoster {};
 }
 
 void notify(const std::string &newNotification) {
-    notice = true;
-    notification = newNotification;
-    recentNotifications.insert(recentNotifications.begin(), notification);
+    std::function<void()> poster {};
+    {
+        std::lock_guard<std::mutex> lock {notifyMutex};
+        pendingNotifications.push_back(newNotification);
+        poster = notifyPoster;
+    }
     
     LOG_F(INFO, "New Notification: %s", newNotification.c_str());
+    if (poster) {
+        poster();
+    }
+}
+void setPoster(const std::function<void()> &poster) {
+    std::lock_guard<std::mutex> lock {notifyMutex};
+    notifyPoster = poster;
+}
+void applyNotifications() {
+    std::vector<std::string> pending {};
+    {
+        std::lock_guard<std::mutex> lock {notifyMutex};
+        pending.swap(pendingNotifications);
+    }
+    for (std::string &newNotification : pending) {
+        notice = true;
+        notification = newNotification;
+        recentNotifications.insert(recentNotifications.begin(), std::move(newNotification));
+    }
 }
 void setNotification(const std::string &notif) {
     notification = notif;
@@ -1,12 +1,19 @@
 #ifndef INSTRUCT_NOTIFICATION_HPP
 #define INSTRUCT_NOTIFICATION_HPP
 
+#include <functional>
 #include <string>
 #include <vector>
 
 namespace instruct::notif {
+    // Safe from any thread. The notification is queued until the UI thread applies it.
     void notify(const std::string &newNotification);
+    // Called after each notification is queued, e.g. to wake up the UI thread.
+    void setPoster(const std::function<void()> &poster);
+    // Moves queued notifications into the ones below.
+    void applyNotifications();
     
+    // Everything below belongs to the UI thread.
     void setNotification(const std::string &notification);
     const std::string &getNotification();
     const std::vector<std::string> &getRecentNotifications();
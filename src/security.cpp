@@ -25,13 +25,22 @@ sec::ThreadedServer::ThreadedServer(
     int port, 
     const std::string &route, 
     httplib::Server::Handler handler
+) : ThreadedServer {host, port, [=] (httplib::Server &new_server) {
+    new_server.Get(route, handler);
+}} {
+}
+
+sec::ThreadedServer::ThreadedServer(
+    const std::string &host, 
+    int port, 
+    std::function<void(httplib::Server &)> configure
 ) {
     try {
         // The `this` pointer goes out-of-scope, so we'll have to hack around it.
         server = std::make_unique<httplib::Server>();
         httplib::Server *new_server {server.get()};
         worker = std::make_unique<std::thread>([=] {
-            new_server->Get(route, handler);
+            configure(*new_server);
             new_server->listen(host, port);
         });
         initialized = true;
@@ -138,6 +147,10 @@ void sec::updateStudentPswd(
     student.pswdSalt = studentPswdSalt;
 }
 
+bool sec::verifyStudentPswd(const SData::Student &student, const std::string &studentPswd) {
+    return picosha2::hash256_hex_string(studentPswd + student.pswdSalt) == student.pswdSHA256;
+}
+
 bool sec::verifyOVSCSTarball(const std::string &ovscsVersion) {
     try {
         std::ifstream fin {constants::OPENVSCODE_SERVER_ARCHIVE, std::ios::binary};
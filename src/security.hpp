@@ -2,6 +2,7 @@
 #define INSTRUCT_SECURITY_HPP
 
 #include <unordered_map>
+#include <functional>
 #include <string>
 #include <thread>
 #include <memory>
@@ -21,6 +22,8 @@ namespace instruct::sec {
         
         ThreadedServer();
         ThreadedServer(const std::string &, int, const std::string &, httplib::Server::Handler);
+        // Registers routes through the callback before listening.
+        ThreadedServer(const std::string &, int, std::function<void(httplib::Server &)>);
         ThreadedServer(const ThreadedServer &) = delete;
         ThreadedServer &operator=(const ThreadedServer &) = delete;
         ThreadedServer &operator=(ThreadedServer &&) noexcept;
@@ -37,6 +40,8 @@ namespace instruct::sec {
         const std::string &
     );
     
+    bool verifyStudentPswd(const SData::Student &, const std::string &);
+    
     bool verifyOVSCSTarball(const std::string &);
 }
 
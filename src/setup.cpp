@@ -86,6 +86,25 @@ bool setup::setDefaults() {
         SData::studentsData->set_codePorts({});
         SData::studentsData->set_codePortRange({3001, 4000});
         SData::studentsData->set_useRandomPorts(true);
+        SData::studentsData->set_launchConcurrency(constants::LAUNCH_CONCURRENCY_DEFAULT);
+        SData::studentsData->set_warmPoolSize(0);
+        SData::studentsData->set_lazyStart(false);
+        SData::studentsData->set_proxyPort(0);
+        SData::studentsData->set_ramUserDataMB(0);
+        SData::studentsData->set_cpuPlacement(false);
+        SData::studentsData->set_agents({});
+        SData::studentsData->set_idleFreezeMinutes(0);
+        SData::studentsData->set_idleStopMinutes(0);
+        SData::studentsData->set_idleOverrides({});
+        SData::studentsData->set_snapshotIntervalMinutes(0);
+        SData::studentsData->set_diskQuotaMB({0, 0});
+        SData::studentsData->set_diskQuotaOverrides({});
+        SData::studentsData->set_enforceDiskQuota(false);
+        SData::studentsData->set_collectionFilter({{}, {}});
+        SData::studentsData->set_collectionOverrides({});
+        // Students yield CPU and disk to the instructor's live session.
+        SData::studentsData->set_studentBudget({0, 0, 0, 0, 10, 2, 7, 100, 0});
+        SData::studentsData->set_instructorBudget({0, 0, 0, 0, 0, 2, 0, 1000, 0});
         #if DEBUG
         uuids::uuid debugStudentUUID {
             uuids::uuid::from_string("9d5b69cc-1aca-46bd-940a-de1f110357a9").value()
@@ -105,6 +124,7 @@ bool setup::setDefaults() {
         
         DLOG_F(INFO, "Assigning default tests data.");
         TData::testsData->set_selectedTestUUIDs({});
+        TData::testsData->set_failFast(false);
         #if DEBUG
         uuids::uuid debugTestUUID {
             uuids::uuid::from_string("78127002-2f3d-4655-83fd-d0f6b7e25b95").value()
@@ -1,15 +1,18 @@
 #include <unordered_map>
 #include <unordered_set>
+#include <functional>
 #include <filesystem>
 #include <exception>
 #include <algorithm>
 #include <iostream>
 #include <typeinfo>
+#include <sstream>
 #include <vector>
 #include <memory>
 #include <atomic>
 #include <thread>
 #include <cctype>
+#include <array>
 
 #include "ftxui/component/screen_interactive.hpp"
 #include "ftxui/component/component.hpp"
@@ -17,8 +20,28 @@
 #include "loguru.hpp"
 #include "uuid.h"
 
+#include "../code/distribution.hpp"
+#include "../code/hibernation.hpp"
+#include "../code/collection.hpp"
+#include "../code/supervisor.hpp"
+#include "../code/snapshots.hpp"
+#include "../code/templates.hpp"
+#include "../code/placement.hpp"
+#include "../code/activator.hpp"
+#include "../code/admission.hpp"
+#include "../code/scheduler.hpp"
+#include "../code/deadline.hpp"
+#include "../code/services.hpp"
+#include "../code/userdata.hpp"
+#include "../code/testing.hpp"
+#include "../code/sampler.hpp"
 #include "../notification.hpp"
+#include "../code/agents.hpp"
+#include "../code/quotas.hpp"
 #include "util/terminal.hpp"
+#include "../code/ports.hpp"
+#include "../code/proxy.hpp"
+#include "../code/pool.hpp"
 #include "../constants.hpp"
 #include "util/spinner.hpp"
 #include "../security.hpp"
@@ -106,6 +129,20 @@ namespace {
         std::string label;
         std::vector<TitleBarButtonContents> options;
     };
+    
+    // Resource budget fields in the order they're listed in the settings.
+    const std::array<std::pair<std::string, int SData::Budget::*>, 9> BUDGET_FIELDS {{
+        {"Address Space (MB): ", &SData::Budget::addressSpaceMB}, 
+        {"CPU Seconds: ", &SData::Budget::cpuSeconds}, 
+        {"Open Files: ", &SData::Budget::openFiles}, 
+        {"Processes: ", &SData::Budget::processes}, 
+        {"Niceness: ", &SData::Budget::niceness}, 
+        {"IO Class: ", &SData::Budget::ioClass}, 
+        {"IO Level: ", &SData::Budget::ioLevel}, 
+        {"CPU Weight: ", &SData::Budget::cpuWeight}, 
+        {"Memory Max (MB): ", &SData::Budget::memoryMaxMB}
+    }};
+    using BudgetContents = std::array<std::string, BUDGET_FIELDS.size()>;
 }
 
 static void createTitleBarMenus(
@@ -128,7 +165,8 @@ static void createPaneBoxes(
     ftxui::Components &, 
     bool *, 
     int &, 
-    const bool &
+    const bool &, 
+    std::function<ftxui::Element(const uuids::uuid &)>
 );
 
 static ftxui::Dimensions getDimensions();
@@ -173,12 +211,37 @@ std::tuple<bool, bool> ui::mainMenu() {
     } dynamicLabels;
     std::string instructorCodeButtonLabel {dynamicLabels.icblStart};
     std::string studentCodeButtonLabel {dynamicLabels.scblStart};
+    for (const code::Instance &instance : code::getInstances()) {
+        // Student instances survive reloading the main UI.
+        if (instance.uuid != code::INSTRUCTOR_UUID 
+            && (instance.state == code::InstanceState::Starting 
+                || instance.state == code::InstanceState::Running)
+        ) {
+            studentCodeButtonLabel = dynamicLabels.scblStop;
+            break;
+        }
+    }
     std::string runAllTestsButtonLabel {dynamicLabels.ratbl};
     // ---------------------------------------------------------
     
+    // Declared early since the title bar menus act on the selected students.
+    std::unordered_set<uuids::uuid> selectedStudentUUIDS {};
+    
+    // Redraws the screen when background workers report progress.
+    auto postRefresh {[&] {appScreen.PostEvent(ftxui::Event::Custom);}};
+    
     bool importModalShown {false};
     bool exportModalShown {false};
     bool installOVSCSModalShown {false};
+    bool diagnosticsModalShown {false};
+    bool filesModalShown {false};
+    bool filesModalRemoving {false};
+    bool collectModalShown {false};
+    bool snapshotsModalShown {false};
+    bool deadlineModalShown {false};
+    bool resetModalShown {false};
+    // Refreshed whenever the reset modal opens.
+    std::vector<std::string> resetTemplateVec {};
     // Data structure containing the titles of each title bar menu, 
     // along with the label of each button and their functions.
     std::vector<TitleBarMenuContents> titleBarMenuContents {
@@ -186,11 +249,50 @@ std::tuple<bool, bool> ui::mainMenu() {
             "Code", {
                 {
                     instructorCodeButtonLabel, 
-                    [&] {}
+                    [&] {
+                        if (code::instanceActive(code::INSTRUCTOR_UUID)) {
+                            startAsyncSpinner("Stopping instructor instance...");
+                            code::stopInstance(code::INSTRUCTOR_UUID);
+                            stopAsyncSpinner();
+                        } else if (code::startInstance(code::INSTRUCTOR_UUID)) {
+                            // The editor only lets in browsers that bring its token.
+                            code::Instance instance {*code::getInstance(code::INSTRUCTOR_UUID)};
+                            std::string host {
+                                instance.host == "0.0.0.0" ? "localhost" : instance.host
+                            };
+                            notif::notify(
+                                "Instructor editor: http://" + host + ":" 
+                                    + std::to_string(instance.port) + "/?tkn=" + instance.token
+                            );
+                        }
+                    }
                 }, 
                 {
                     studentCodeButtonLabel, 
-                    [&] {}
+                    [&] {
+                        if (studentCodeButtonLabel == dynamicLabels.scblStop) {
+                            startAsyncSpinner("Stopping student instances...");
+                            code::cancelLaunch();
+                            code::stopAllInstances(false);
+                            stopAsyncSpinner();
+                            studentCodeButtonLabel = dynamicLabels.scblStart;
+                        } else if (code::lazyActivationRunning()) {
+                            notif::notify(
+                                "Lazy start is enabled. "
+                                "Student instances start when students first connect."
+                            );
+                        } else {
+                            code::scheduleLaunch(code::prioritizeLaunch(
+                                selectedStudentUUIDS, 
+                                !code::instanceActive(code::INSTRUCTOR_UUID)
+                            ), postRefresh);
+                            studentCodeButtonLabel = dynamicLabels.scblStop;
+                        }
+                    }
+                }, 
+                {
+                    "Diagnostics", 
+                    [&] {diagnosticsModalShown = true;}
                 }
             }
         }, 
@@ -198,11 +300,36 @@ std::tuple<bool, bool> ui::mainMenu() {
             "Tools", {
                 {
                     "Add File", 
-                    [] {}
+                    [&] {
+                        filesModalRemoving = false;
+                        filesModalShown = true;
+                    }
                 }, 
                 {
                     "Remove File", 
-                    [] {}
+                    [&] {
+                        filesModalRemoving = true;
+                        filesModalShown = true;
+                    }
+                }, 
+                {
+                    "Collect Submissions", 
+                    [&] {collectModalShown = true;}
+                }, 
+                {
+                    "Snapshots", 
+                    [&] {snapshotsModalShown = true;}
+                }, 
+                {
+                    "Deadline", 
+                    [&] {deadlineModalShown = true;}
+                }, 
+                {
+                    "Reset Workspaces", 
+                    [&] {
+                        resetTemplateVec = code::listTemplates();
+                        resetModalShown = true;
+                    }
                 }, 
                 {
                     "Add Student", 
@@ -218,7 +345,32 @@ std::tuple<bool, bool> ui::mainMenu() {
             "Tests", {
                 {
                     runAllTestsButtonLabel, 
-                    [&] {}
+                    [&] {
+                        if (code::testsRunning()) {
+                            startAsyncSpinner("Stopping tests...");
+                            code::stopTests();
+                            stopAsyncSpinner();
+                            return;
+                        }
+                        // The selected students and tests, or all of either if none are.
+                        std::vector<uuids::uuid> students {
+                            selectedStudentUUIDS.begin(), selectedStudentUUIDS.end()
+                        };
+                        if (students.empty()) {
+                            const auto &studentMap {SData::studentsData->get_students()};
+                            for (const auto &[uuid, student] : studentMap) {
+                                students.push_back(uuid);
+                            }
+                        }
+                        const auto &selectedTests {TData::testsData->get_selectedTestUUIDs()};
+                        std::vector<uuids::uuid> tests {selectedTests.begin(), selectedTests.end()};
+                        if (tests.empty()) {
+                            for (const auto &[uuid, test] : TData::testsData->get_tests()) {
+                                tests.push_back(uuid);
+                            }
+                        }
+                        code::startTests(std::move(students), std::move(tests), postRefresh);
+                    }
                 }, 
                 {
                     "Add Test", 
@@ -257,16 +409,156 @@ std::tuple<bool, bool> ui::mainMenu() {
     bool *p_titleBarMenusShown {u_titleBarMenusShown.get()};
     createTitleBarMenus(titleBarMenuContents, titleBarMenus, p_titleBarMenusShown);
 
+    // Warm pool occupancy and hit rate, shown only while the pool is enabled.
+    auto poolStatus {[] {
+        code::PoolStats poolStats {code::getPoolStats()};
+        if (poolStats.target <= 0) {
+            return ftxui::emptyElement();
+        }
+        int claims {poolStats.hits + poolStats.misses};
+        std::string hitRate {
+            claims == 0 ? "-" : std::to_string(poolStats.hits * 100 / claims) + "%"
+        };
+        return ftxui::text(
+            "Pool: " + std::to_string(poolStats.ready) + "/" + std::to_string(poolStats.target) 
+            + " Hits: " + hitRate
+        ) | ftxui::borderLight;
+    }};
+    
+    // Lazy activation listeners and how many of them started an instance.
+    auto activationStatus {[] {
+        if (!code::lazyActivationRunning()) {
+            return ftxui::emptyElement();
+        }
+        code::ActivationStats activationStats {code::getActivationStats()};
+        return ftxui::text(
+            "Lazy: " + std::to_string(activationStats.activated) 
+            + "/" + std::to_string(activationStats.listening) + " active"
+        ) | ftxui::borderLight;
+    }};
+    
+    // Frozen instances and the memory released by stopping idle ones.
+    auto hibernationStatus {[] {
+        code::HibernationStats hibernationStats {code::getHibernationStats()};
+        if (hibernationStats.frozen == 0 && hibernationStats.stopped == 0) {
+            return ftxui::emptyElement();
+        }
+        return ftxui::text(
+            "Frozen: " + std::to_string(hibernationStats.frozen) 
+            + " (" + std::to_string(hibernationStats.frozenBytes >> 20) + " MB)" 
+            + " Freed: " + std::to_string(hibernationStats.freedBytes >> 20) + " MB"
+        ) | ftxui::borderLight;
+    }};
+    
+    // CPU and memory of the instances running here as of the last sample.
+    auto resourceStatus {[] {
+        std::shared_ptr<const code::ResourceSnapshot> resourceSnapshot {
+            code::getResourceSnapshot()
+        };
+        if (resourceSnapshot->instances.empty()) {
+            return ftxui::emptyElement();
+        }
+        double cpuPercent {};
+        std::uint64_t rssBytes {};
+        for (const auto &[uuid, history] : resourceSnapshot->instances) {
+            cpuPercent += history.latest().cpuPercent;
+            rssBytes += history.latest().rssBytes;
+        }
+        return ftxui::text(
+            "Instances: " + std::to_string(static_cast<int>(cpuPercent)) + "% CPU " 
+            + std::to_string(rssBytes >> 20) + " MB"
+        ) | ftxui::borderLight;
+    }};
+    
+    // In-memory user data and the disk writes per instance it leaves.
+    auto userDataStatus {[] {
+        if (SData::studentsData->get_ramUserDataMB() <= 0) {
+            return ftxui::emptyElement();
+        }
+        code::UserDataStats userDataStats {code::getUserDataStats()};
+        std::string writeOps {
+            userDataStats.writeOpsPerMinute < 0 
+                ? "-" 
+                : std::to_string(static_cast<int>(userDataStats.writeOpsPerMinute))
+        };
+        return ftxui::text(
+            "RAM Data: " + std::to_string(userDataStats.ramDirs) 
+            + " (" + std::to_string(userDataStats.ramBytes >> 20) + " MB)" 
+            + " Disk: " + writeOps + " writes/min"
+        ) | ftxui::borderLight;
+    }};
+    
+    // Worker hosts answering out of those configured.
+    auto agentsStatus {[] {
+        std::vector<code::AgentStatus> agentStatuses {code::getAgentStatuses()};
+        if (agentStatuses.empty()) {
+            return ftxui::emptyElement();
+        }
+        int reachable {};
+        for (const code::AgentStatus &agentStatus : agentStatuses) {
+            reachable += agentStatus.reachable;
+        }
+        ftxui::Element status {ftxui::text(
+            "Agents: " + std::to_string(reachable) + "/" + std::to_string(agentStatuses.size())
+        ) | ftxui::borderLight};
+        return reachable < static_cast<int>(agentStatuses.size()) 
+            ? status | ftxui::color(ftxui::Color::Red) 
+            : status;
+    }};
+    
+    // Student proxy sessions and open connections.
+    auto proxyStatus {[] {
+        if (!code::proxyRunning()) {
+            return ftxui::emptyElement();
+        }
+        code::ProxyStats proxyStats {code::getProxyStats()};
+        return ftxui::text(
+            "Proxy: " + std::to_string(proxyStats.sessions) + " sessions " 
+            + std::to_string(proxyStats.tunnels) + " conns " 
+            + std::to_string(proxyStats.bytesRelayed >> 20) + " MB"
+        ) | ftxui::borderLight;
+    }};
+    
     // The status bar next to the title bar menus that contains 
     // the application status and version.
     struct {
         int problemCount {};
         ftxui::Component renderer {ftxui::Renderer([&] {
+            code::LaunchProgress launchProgress {code::getLaunchProgress()};
+            // Launches held back or turned away for lack of memory count as problems.
+            code::AdmissionStats admissionStats {code::getAdmissionStats()};
+            int problems {problemCount + admissionStats.deferred + admissionStats.refused};
             return ftxui::hbox(
-                (problemCount == 0
+                (problems == 0
                     ? ftxui::text("Systems Operational") | ftxui::borderLight 
-                    : ftxui::text("Problems Encountered: " + std::to_string(problemCount)) 
+                    : ftxui::text("Problems Encountered: " + std::to_string(problems)) 
                         | ftxui::borderLight | ftxui::color(ftxui::Color::Red)), 
+                launchProgress.active 
+                    ? ftxui::hbox(
+                        ftxui::text("Launching: "), 
+                        ftxui::gauge(
+                            static_cast<float>(launchProgress.ready + launchProgress.failed) 
+                            / std::max(1, launchProgress.total)
+                        ) | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, 10), 
+                        ftxui::text(
+                            " " + std::to_string(launchProgress.ready) 
+                            + "/" + std::to_string(launchProgress.total)
+                        ), 
+                        launchProgress.deferred > 0 
+                            ? ftxui::text(
+                                " Waiting for memory: " + std::to_string(launchProgress.deferred) 
+                                + " (~" + std::to_string(launchProgress.eta.count()) + "s)"
+                            )
+                            : ftxui::emptyElement()
+                    ) | ftxui::borderLight | ftxui::color(ftxui::Color::Gold1)
+                    : ftxui::emptyElement(), 
+                poolStatus(), 
+                activationStatus(), 
+                proxyStatus(), 
+                agentsStatus(), 
+                resourceStatus(), 
+                hibernationStatus(), 
+                userDataStatus(), 
                 ftxui::text(constants::INSTRUCT_VERSION) | ftxui::borderLight
             );
         })};
@@ -305,6 +597,10 @@ std::tuple<bool, bool> ui::mainMenu() {
                 titleBarMenuCount, p_titleBarMenusShown, lastTitleBarMenuIdx
             );
             
+            instructorCodeButtonLabel = code::instanceActive(code::INSTRUCTOR_UUID) 
+                ? dynamicLabels.icblStop 
+                : dynamicLabels.icblStart;
+            
             /*
             Collapsible Menu Rendering Nuances:
             1. FTXUI is not intended to render elements like this.
@@ -362,7 +658,6 @@ std::tuple<bool, bool> ui::mainMenu() {
     studentBoxes.reserve(studentCount);
     std::unique_ptr<bool []> u_studentBoxStates {std::make_unique<bool []>(studentCount)};
     bool *p_studentBoxStates {u_studentBoxStates.get()};
-    std::unordered_set<uuids::uuid> selectedStudentUUIDS {};
     
     createPaneBoxes(
         studentMap, 
@@ -371,7 +666,24 @@ std::tuple<bool, bool> ui::mainMenu() {
         studentBoxes, 
         p_titleBarMenusShown, 
         lastTitleBarMenuIdx, 
-        UData::uiData->get_alwaysShowStudentUUIDs()
+        UData::uiData->get_alwaysShowStudentUUIDs(), 
+        // Disk usage, coloured by how it stands against the quota.
+        [] (const uuids::uuid &uuid) {
+            std::optional<code::DiskUsage> usage {code::getDiskUsage(uuid)};
+            if (!usage) {
+                return ftxui::emptyElement();
+            }
+            ftxui::Element usageElem {
+                ftxui::text(" " + std::to_string(usage->bytes >> 20) + " MB")
+            };
+            if (usage->paused || usage->state == code::QuotaState::Hard) {
+                return usageElem | ftxui::color(ftxui::Color::Red);
+            }
+            if (usage->state == code::QuotaState::Soft) {
+                return usageElem | ftxui::color(ftxui::Color::Yellow);
+            }
+            return usageElem | ftxui::dim;
+        }
     );
     
     ftxui::Component studentPane {studentBoxes.empty() 
@@ -397,7 +709,24 @@ std::tuple<bool, bool> ui::mainMenu() {
         testBoxes, 
         p_titleBarMenusShown, 
         lastTitleBarMenuIdx, 
-        UData::uiData->get_alwaysShowTestUUIDs()
+        UData::uiData->get_alwaysShowTestUUIDs(), 
+        // Students passing out of those tested, coloured by whether any didn't.
+        [] (const uuids::uuid &uuid) {
+            std::optional<code::TestTally> tally {code::getTestTally(uuid)};
+            if (!tally) {
+                return ftxui::emptyElement();
+            }
+            ftxui::Element tallyElem {ftxui::text(
+                " " + std::to_string(tally->passed) + "/" + std::to_string(tally->total)
+            )};
+            if (tally->errored > 0) {
+                return tallyElem | ftxui::color(ftxui::Color::Red);
+            }
+            if (tally->failed > 0) {
+                return tallyElem | ftxui::color(ftxui::Color::Yellow);
+            }
+            return tallyElem | ftxui::color(ftxui::Color::GreenYellow);
+        }
     );
     
     ftxui::Component testPane {testBoxes.empty() 
@@ -421,7 +750,7 @@ std::tuple<bool, bool> ui::mainMenu() {
     ftxui::Component exitNegative {ftxui::Button(
         "No", [&] {exitModalShown = false;}, ftxui::ButtonOption::Ascii()
     )};
-    ftxui::Component exitAffirmative {ftxui::Button("Yes", [&] {
+    auto exitApp {[&] (bool stopEditors) {
         // Save remaining data if it wasn't already.
         // This includes information such as the selected tests and some UI settings.
         startAsyncSpinner("Saving all data...");
@@ -429,14 +758,32 @@ std::tuple<bool, bool> ui::mainMenu() {
         LOG_F(INFO, "Finalizing save data.");
         exitState = instruct::ui::saveAllHandled();
         
+        code::cancelLaunch();
+        // Editors left running are reattached by the next launch of instruct.
+        if (stopEditors) {
+            LOG_F(INFO, "Stopping instances.");
+            code::stopAllInstances(true);
+        } else {
+            LOG_F(INFO, "Leaving instances running.");
+        }
+        
         stopAsyncSpinner();
         appScreen.Exit();
-    }, ftxui::ButtonOption::Ascii())};
+    }};
+    ftxui::Component exitAffirmative {ftxui::Button(
+        "Yes", [&] {exitApp(false);}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component exitStopEditors {ftxui::Button(
+        "Stop Editors & Exit", [&] {exitApp(true);}, ftxui::ButtonOption::Ascii()
+    )};
     ftxui::Component exitModal {ftxui::Renderer(
-        ftxui::Container::Horizontal({exitNegative, exitAffirmative}), 
+        ftxui::Container::Horizontal({exitNegative, exitAffirmative, exitStopEditors}), 
         [&] {
             return ftxui::vbox(
                 ftxui::text("Exit?") | ftxui::bold | ftxui::hcenter, 
+                ftxui::paragraphAlignCenter(
+                    "Running editors stay up and are reattached on the next launch."
+                ), 
                 ftxui::hbox(
                     exitNegative->Render() 
                         | ftxui::hcenter 
@@ -447,10 +794,15 @@ std::tuple<bool, bool> ui::mainMenu() {
                         | ftxui::hcenter 
                         | ftxui::border 
                         | ftxui::flex 
-                        | ftxui::color(ftxui::Color::GreenYellow)
+                        | ftxui::color(ftxui::Color::GreenYellow),
+                    exitStopEditors->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::flex 
+                        | ftxui::color(ftxui::Color::Orange1)
                 )
             ) 
-                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, getDimensions().dimx * 0.25) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, getDimensions().dimx * 0.4) 
                 | ftxui::border;
         }
     )};
@@ -529,6 +881,101 @@ std::tuple<bool, bool> ui::mainMenu() {
         makeOnOffToggle(onOffToggle, sUseRandomPortsSelection)
     };
     
+    std::string sLaunchConcurrencyContent;
+    ftxui::Component sLaunchConcurrencyInput {
+        makeInput(sLaunchConcurrencyContent, "i.e. 8")
+    };
+    sLaunchConcurrencyInput |= ftxui::CatchEvent(onlyDigits);
+    int sLazyStartSelection;
+    ftxui::Component sLazyStartToggle {makeOnOffToggle(onOffToggle, sLazyStartSelection)};
+    int sCpuPlacementSelection;
+    ftxui::Component sCpuPlacementToggle {makeOnOffToggle(onOffToggle, sCpuPlacementSelection)};
+    std::pair<std::string, std::string> sIdleMinutesContent;
+    ftxui::Component sIdleFreezeInput {
+        makeInput(sIdleMinutesContent.first, "freeze after minutes (0 --> never)")
+    };
+    sIdleFreezeInput |= ftxui::CatchEvent(onlyDigits);
+    ftxui::Component sIdleStopInput {
+        makeInput(sIdleMinutesContent.second, "stop after minutes (0 --> never)")
+    };
+    sIdleStopInput |= ftxui::CatchEvent(onlyDigits);
+    std::string sSnapshotIntervalContent;
+    ftxui::Component sSnapshotIntervalInput {
+        makeInput(sSnapshotIntervalContent, "minutes, 0 --> on request only")
+    };
+    sSnapshotIntervalInput |= ftxui::CatchEvent(onlyDigits);
+    std::pair<std::string, std::string> sDiskQuotaContent;
+    ftxui::Component sDiskQuotaSoftInput {
+        makeInput(sDiskQuotaContent.first, "soft MB (0 --> none)")
+    };
+    sDiskQuotaSoftInput |= ftxui::CatchEvent(onlyDigits);
+    ftxui::Component sDiskQuotaHardInput {
+        makeInput(sDiskQuotaContent.second, "hard MB (0 --> none)")
+    };
+    sDiskQuotaHardInput |= ftxui::CatchEvent(onlyDigits);
+    int sEnforceDiskQuotaSelection;
+    ftxui::Component sEnforceDiskQuotaToggle {
+        makeOnOffToggle(onOffToggle, sEnforceDiskQuotaSelection)
+    };
+    std::string sWarmPoolSizeContent;
+    ftxui::Component sWarmPoolSizeInput {makeInput(sWarmPoolSizeContent, "0 --> disabled")};
+    sWarmPoolSizeInput |= ftxui::CatchEvent(onlyDigits);
+    std::string sProxyPortContent;
+    ftxui::Component sProxyPortInput {makeInput(sProxyPortContent, "0 --> disabled")};
+    sProxyPortInput |= ftxui::CatchEvent(onlyDigits);
+    std::string sRamUserDataContent;
+    ftxui::Component sRamUserDataInput {makeInput(sRamUserDataContent, "MB, 0 --> on disk")};
+    sRamUserDataInput |= ftxui::CatchEvent(onlyDigits);
+    
+    // Resource budgets for each role. Niceness is the only field that may be negative.
+    auto signedDigits {[] (ftxui::Event event) {
+        return event.is_character() 
+            && !std::isdigit(event.character()[0]) && event.character() != "-";
+    }};
+    auto makeBudgetInputs {[&] (BudgetContents &contents) {
+        ftxui::Components inputs {};
+        for (std::size_t idx {}; idx < BUDGET_FIELDS.size(); ++idx) {
+            ftxui::Component input {makeInput(contents.at(idx), "0 --> unset")};
+            bool isNiceness {BUDGET_FIELDS.at(idx).second == &SData::Budget::niceness};
+            input |= isNiceness 
+                ? ftxui::CatchEvent(signedDigits) 
+                : ftxui::CatchEvent(onlyDigits);
+            inputs.push_back(input);
+        }
+        return inputs;
+    }};
+    auto toBudgetContents {[] (const SData::Budget &budget) {
+        BudgetContents contents {};
+        for (std::size_t idx {}; idx < BUDGET_FIELDS.size(); ++idx) {
+            contents.at(idx) = std::to_string(budget.*BUDGET_FIELDS.at(idx).second);
+        }
+        return contents;
+    }};
+    auto toBudget {[] (const BudgetContents &contents) {
+        SData::Budget budget {};
+        for (std::size_t idx {}; idx < BUDGET_FIELDS.size(); ++idx) {
+            budget.*BUDGET_FIELDS.at(idx).second = std::stoi(contents.at(idx));
+        }
+        return budget;
+    }};
+    auto renderBudgetInputs {[] (ftxui::Components &inputs) {
+        ftxui::Elements lines {};
+        for (std::size_t idx {}; idx < BUDGET_FIELDS.size(); ++idx) {
+            lines.push_back(ftxui::hbox(
+                ftxui::text(BUDGET_FIELDS.at(idx).first), inputs.at(idx)->Render()
+            ));
+        }
+        return ftxui::vbox(lines);
+    }};
+    BudgetContents sStudentBudgetContents {};
+    ftxui::Components sStudentBudgetInputs {makeBudgetInputs(sStudentBudgetContents)};
+    BudgetContents sInstructorBudgetContents {};
+    ftxui::Components sInstructorBudgetInputs {makeBudgetInputs(sInstructorBudgetContents)};
+    
+    // Test settings.
+    int tFailFastSelection;
+    ftxui::Component tFailFastToggle {makeOnOffToggle(onOffToggle, tFailFastSelection)};
+    
     // Instruct UI settings.
     int alwaysShowStudentUUIDsSelection;
     ftxui::Component alwaysShowStudentUUIDsToggle {
@@ -560,6 +1007,25 @@ std::tuple<bool, bool> ui::mainMenu() {
             std::to_string(SData::studentsData->get_codePortRange().second);
         
         sUseRandomPortsSelection = SData::studentsData->get_useRandomPorts();
+        sLaunchConcurrencyContent = 
+            std::to_string(SData::studentsData->get_launchConcurrency());
+        sWarmPoolSizeContent = std::to_string(SData::studentsData->get_warmPoolSize());
+        sLazyStartSelection = SData::studentsData->get_lazyStart();
+        sCpuPlacementSelection = SData::studentsData->get_cpuPlacement();
+        sProxyPortContent = std::to_string(SData::studentsData->get_proxyPort());
+        sRamUserDataContent = std::to_string(SData::studentsData->get_ramUserDataMB());
+        sStudentBudgetContents = toBudgetContents(SData::studentsData->get_studentBudget());
+        sInstructorBudgetContents = 
+            toBudgetContents(SData::studentsData->get_instructorBudget());
+        sIdleMinutesContent.first = std::to_string(SData::studentsData->get_idleFreezeMinutes());
+        sIdleMinutesContent.second = std::to_string(SData::studentsData->get_idleStopMinutes());
+        sSnapshotIntervalContent = 
+            std::to_string(SData::studentsData->get_snapshotIntervalMinutes());
+        sDiskQuotaContent.first = std::to_string(SData::studentsData->get_diskQuotaMB().first);
+        sDiskQuotaContent.second = std::to_string(SData::studentsData->get_diskQuotaMB().second);
+        sEnforceDiskQuotaSelection = SData::studentsData->get_enforceDiskQuota();
+        
+        tFailFastSelection = TData::testsData->get_failFast();
 
         alwaysShowStudentUUIDsSelection = UData::uiData->get_alwaysShowStudentUUIDs();
         alwaysShowTestUUIDsSelection = UData::uiData->get_alwaysShowTestUUIDs();
@@ -583,6 +1049,24 @@ std::tuple<bool, bool> ui::mainMenu() {
                 || iCodePortContent.empty() 
                 || sAuthHostContent.empty() 
                 || sAuthPortContent.empty() 
+                || sLaunchConcurrencyContent.empty() 
+                || std::stoi(sLaunchConcurrencyContent) < 1 
+                || sWarmPoolSizeContent.empty() 
+                || sProxyPortContent.empty() 
+                || sRamUserDataContent.empty() 
+                || std::any_of(
+                    sStudentBudgetContents.begin(), sStudentBudgetContents.end(), 
+                    [] (const std::string &content) {return content.empty();}
+                ) 
+                || std::any_of(
+                    sInstructorBudgetContents.begin(), sInstructorBudgetContents.end(), 
+                    [] (const std::string &content) {return content.empty();}
+                ) 
+                || sIdleMinutesContent.first.empty() 
+                || sIdleMinutesContent.second.empty() 
+                || sSnapshotIntervalContent.empty() 
+                || sDiskQuotaContent.first.empty() 
+                || sDiskQuotaContent.second.empty() 
                 || i_sCodePortRangeContent.first > i_sCodePortRangeContent.second
             ) {
                 notif::notify("A field was left empty or was out of range.");
@@ -606,9 +1090,39 @@ std::tuple<bool, bool> ui::mainMenu() {
             SData::studentsData->set_codePortRange(i_sCodePortRangeContent);
             
             SData::studentsData->set_useRandomPorts(sUseRandomPortsSelection);
+            SData::studentsData->set_launchConcurrency(std::stoi(sLaunchConcurrencyContent));
+            SData::studentsData->set_warmPoolSize(std::stoi(sWarmPoolSizeContent));
+            SData::studentsData->set_lazyStart(sLazyStartSelection);
+            // Reserving instruct's own core takes a restart.
+            SData::studentsData->set_cpuPlacement(sCpuPlacementSelection);
+            SData::studentsData->set_proxyPort(std::stoi(sProxyPortContent));
+            // Takes effect from each instance's next start.
+            SData::studentsData->set_ramUserDataMB(std::stoi(sRamUserDataContent));
+            // Budgets apply from each instance's next start.
+            SData::studentsData->set_studentBudget(toBudget(sStudentBudgetContents));
+            SData::studentsData->set_instructorBudget(toBudget(sInstructorBudgetContents));
+            SData::studentsData->set_idleFreezeMinutes(std::stoi(sIdleMinutesContent.first));
+            SData::studentsData->set_idleStopMinutes(std::stoi(sIdleMinutesContent.second));
+            SData::studentsData->set_snapshotIntervalMinutes(
+                std::stoi(sSnapshotIntervalContent)
+            );
+            SData::studentsData->set_diskQuotaMB({
+                std::stoi(sDiskQuotaContent.first), std::stoi(sDiskQuotaContent.second)
+            });
+            SData::studentsData->set_enforceDiskQuota(sEnforceDiskQuotaSelection);
+            
+            // Takes effect from the next test run.
+            TData::testsData->set_failFast(tFailFastSelection);
             
             UData::uiData->set_alwaysShowStudentUUIDs(alwaysShowStudentUUIDsSelection);
             UData::uiData->set_alwaysShowTestUUIDs(alwaysShowTestUUIDsSelection);
+            
+            // Port settings may have changed, so rebuild the allocator. 
+            // The pool and listeners hold ports from the old allocator, so drain them first.
+            code::stopServices();
+            code::initPorts();
+            code::assignStudentPorts();
+            code::startServices();
         } catch (const std::exception &e) {
             notif::notify("Failed to save all settings. Some old settings may persist.");
             resetValues();
@@ -650,6 +1164,25 @@ std::tuple<bool, bool> ui::mainMenu() {
                 sCodePortRangeInput_ub
             }), 
             sUseRandomPortsToggle, 
+            sLaunchConcurrencyInput, 
+            sWarmPoolSizeInput, 
+            sLazyStartToggle, 
+            sProxyPortInput, 
+            sRamUserDataInput, 
+            sCpuPlacementToggle, 
+            ftxui::Container::Vertical(sStudentBudgetInputs), 
+            ftxui::Container::Vertical(sInstructorBudgetInputs), 
+            ftxui::Container::Horizontal({
+                sIdleFreezeInput, 
+                sIdleStopInput
+            }), 
+            sSnapshotIntervalInput, 
+            ftxui::Container::Horizontal({
+                sDiskQuotaSoftInput, 
+                sDiskQuotaHardInput
+            }), 
+            sEnforceDiskQuotaToggle, 
+            tFailFastToggle, 
             alwaysShowStudentUUIDsToggle, 
             alwaysShowTestUUIDsToggle, 
             ftxui::Container::Horizontal({
@@ -670,9 +1203,10 @@ std::tuple<bool, bool> ui::mainMenu() {
             ) {
                 // Dynamically approximate the total height encompassed 
                 // by settings items.
+                // Each budget is a single child spanning a line per field.
                 std::size_t items {settingsContainer->ChildAt(0)->ChildCount()};
                 settingsScrollPosition = std::min(
-                    static_cast<int>(items * 2 + sCodePortVec.size()), 
+                    static_cast<int>(items * 2 + sCodePortVec.size() + BUDGET_FIELDS.size() * 2), 
                     settingsScrollPosition + 1
                 );
                 settingsSaveChangesButton->TakeFocus();
@@ -710,6 +1244,27 @@ std::tuple<bool, bool> ui::mainMenu() {
                     ftxui::text(" to "), 
                     sCodePortRangeInput_ub->Render(), 
                     inputLine("Use Random Ports: ", sUseRandomPortsToggle), 
+                    inputLine("Launch Concurrency: ", sLaunchConcurrencyInput), 
+                    inputLine("Warm Pool Size: ", sWarmPoolSizeInput), 
+                    inputLine("Lazy Start: ", sLazyStartToggle), 
+                    inputLine("Proxy Port: ", sProxyPortInput), 
+                    inputLine("RAM User Data: ", sRamUserDataInput), 
+                    inputLine("CPU Placement: ", sCpuPlacementToggle), 
+                    ftxui::text("Student Budget: "), 
+                    renderBudgetInputs(sStudentBudgetInputs), 
+                    ftxui::text("Instructor Budget: "), 
+                    renderBudgetInputs(sInstructorBudgetInputs), 
+                    ftxui::text("Idle Instances: "), 
+                    sIdleFreezeInput->Render(), 
+                    sIdleStopInput->Render(), 
+                    inputLine("Snapshot Interval: ", sSnapshotIntervalInput), 
+                    ftxui::text("Disk Quota: "), 
+                    sDiskQuotaSoftInput->Render(), 
+                    sDiskQuotaHardInput->Render(), 
+                    inputLine("Pause Over Hard Quota: ", sEnforceDiskQuotaToggle), 
+                    ftxui::separatorEmpty(), 
+                    ftxui::text("Test Settings") | ftxui::bold | ftxui::underlined, 
+                    inputLine("Stop At First Difference: ", tFailFastToggle), 
                     ftxui::separatorEmpty(), 
                     ftxui::text("UI Settings") | ftxui::bold | ftxui::underlined, 
                     inputLine(
@@ -798,6 +1353,117 @@ std::tuple<bool, bool> ui::mainMenu() {
         }
     )};
     
+    // Diagnostics modal.
+    ftxui::Component closeDiagnosticsButton {ftxui::Button(
+        "Close", [&] {diagnosticsModalShown = false;}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component diagnosticsModal {ftxui::Renderer(
+        closeDiagnosticsButton, 
+        [&] {
+            code::PlacementReport placementReport {code::getPlacementReport()};
+            ftxui::Elements placementLines {};
+            if (!placementReport.enabled) {
+                placementLines.push_back(ftxui::text("CPU placement is off."));
+            } else {
+                placementLines.push_back(ftxui::text(
+                    "instruct: CPU " + code::formatCpuList(placementReport.supervisorCpus)
+                ));
+                placementLines.push_back(ftxui::text(
+                    "Instructor: CPU " + code::formatCpuList(placementReport.instructorCpus)
+                ));
+                for (const code::NodeLoad &nodeLoad : placementReport.nodes) {
+                    std::string nodeName {
+                        nodeLoad.node == -1 ? "All CPUs" : "Node " + std::to_string(nodeLoad.node)
+                    };
+                    placementLines.push_back(ftxui::text(
+                        nodeName + ": CPU " + code::formatCpuList(nodeLoad.cpus) + ", " 
+                        + std::to_string(nodeLoad.instances) + " instance(s)"
+                    ));
+                }
+                placementLines.push_back(ftxui::separatorLight());
+                for (const auto &[label, placement] : placementReport.instances) {
+                    placementLines.push_back(ftxui::text(
+                        label + ": CPU " + code::formatCpuList(placement.cpus) 
+                        + (placement.node == -1 ? "" : " node " + std::to_string(placement.node))
+                    ));
+                }
+            }
+            std::shared_ptr<const code::ResourceSnapshot> resourceSnapshot {
+                code::getResourceSnapshot()
+            };
+            std::vector<const code::ResourceHistory *> histories {};
+            for (const auto &[uuid, history] : resourceSnapshot->instances) {
+                histories.push_back(&history);
+            }
+            std::sort(
+                histories.begin(), 
+                histories.end(), 
+                [] (const code::ResourceHistory *lhs, const code::ResourceHistory *rhs) {
+                    return lhs->label < rhs->label;
+                }
+            );
+            if (!histories.empty()) {
+                placementLines.push_back(ftxui::separator());
+                placementLines.push_back(ftxui::text("Resources") | ftxui::bold | ftxui::hcenter);
+                placementLines.push_back(ftxui::separator());
+            }
+            for (const code::ResourceHistory *history : histories) {
+                const code::ResourceSample &sample {history->latest()};
+                placementLines.push_back(ftxui::text(
+                    history->label + ": " + std::to_string(static_cast<int>(sample.cpuPercent)) 
+                    + "% CPU (peak " 
+                    + std::to_string(static_cast<int>(history->peakCpuPercent())) + "%), " 
+                    + std::to_string(sample.rssBytes >> 20) + " MB, " 
+                    + std::to_string(sample.openFds) + " fds, " 
+                    + std::to_string(static_cast<int>(sample.readBytesPerSec / 1024)) + "/" 
+                    + std::to_string(static_cast<int>(sample.writeBytesPerSec / 1024)) 
+                    + " KB/s read/written"
+                ));
+            }
+            std::vector<code::AgentStatus> agentStatuses {code::getAgentStatuses()};
+            if (!agentStatuses.empty()) {
+                placementLines.push_back(ftxui::separator());
+                placementLines.push_back(ftxui::text("Agents") | ftxui::bold | ftxui::hcenter);
+                placementLines.push_back(ftxui::separator());
+            }
+            for (const code::AgentStatus &agentStatus : agentStatuses) {
+                std::string address {agentStatus.host + ":" + std::to_string(agentStatus.port)};
+                if (!agentStatus.reachable) {
+                    placementLines.push_back(
+                        ftxui::text(address + ": unreachable") | ftxui::color(ftxui::Color::Red)
+                    );
+                    continue;
+                }
+                placementLines.push_back(ftxui::text(
+                    address + ": " + std::to_string(agentStatus.instances.size()) 
+                    + " instance(s), " 
+                    + std::to_string(agentStatus.memAvailable >> 20) + "/" 
+                    + std::to_string(agentStatus.memTotal >> 20) + " MB free, " 
+                    + std::to_string(static_cast<int>(
+                        agentStatus.load * 100 / std::max(1, agentStatus.cpus)
+                    )) + "% load on " + std::to_string(agentStatus.cpus) + " CPU(s)"
+                ));
+            }
+            ftxui::Dimensions dims {getDimensions()};
+            return ftxui::vbox(
+                ftxui::text("Instance Placement") | ftxui::bold | ftxui::hcenter, 
+                ftxui::separator(), 
+                ftxui::vbox(placementLines) 
+                    | ftxui::vscroll_indicator 
+                    | ftxui::yframe 
+                    | ftxui::flex, 
+                ftxui::separator(), 
+                closeDiagnosticsButton->Render() 
+                    | ftxui::hcenter 
+                    | ftxui::border 
+                    | ftxui::color(ftxui::Color::Blue)
+            ) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, dims.dimx * 0.5) 
+                | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, dims.dimy * 0.75) 
+                | ftxui::border;
+        }
+    )};
+    
     // Import students list modal.
     std::string importInputContent {std::filesystem::current_path()};
     std::string importNameCol {"Name"};
@@ -833,6 +1499,8 @@ std::tuple<bool, bool> ui::mainMenu() {
         exitState = std::make_tuple(false, true);
 
         notif::notify("Successfully imported students list.");
+        
+        code::assignStudentPorts();
 
         stopAsyncSpinner();
         importModalShown = false;
@@ -1007,6 +1675,671 @@ std::tuple<bool, bool> ui::mainMenu() {
         }
     )};
     
+    // Add and remove file modal, acting on the selected students or on everyone.
+    std::string filesSourceContent {std::filesystem::current_path()};
+    std::string filesDestinationContent {};
+    bool filesUpdateOnly {false};
+    auto filesTargets {[&] {
+        std::vector<uuids::uuid> targets {
+            selectedStudentUUIDS.begin(), selectedStudentUUIDS.end()
+        };
+        if (targets.empty()) {
+            for (const auto &[uuid, student] : SData::studentsData->get_students()) {
+                targets.push_back(uuid);
+            }
+        }
+        return targets;
+    }};
+    ftxui::Component closeFilesButton {ftxui::Button(
+        "Close", [&] {filesModalShown = false;}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component confirmFilesButton {ftxui::Button("Start", [&] {
+        if (code::getDistributionProgress().active) {
+            return;
+        }
+        if (filesModalRemoving) {
+            code::removeDistributedFiles(filesDestinationContent, filesTargets(), postRefresh);
+        } else {
+            code::distributeFiles(
+                filesSourceContent, 
+                filesDestinationContent, 
+                filesTargets(), 
+                postRefresh, 
+                filesUpdateOnly
+            );
+        }
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::InputOption filesSourceInputOptions {ftxui::InputOption::Default()};
+    ftxui::Elements autoFilesCompletePaths {};
+    filesSourceInputOptions.on_change = [&] {
+        // Suggest valid paths.
+        try {
+            autoFilesCompletePaths.clear();
+            std::filesystem::path dirPath {filesSourceContent};
+            std::string fileName {dirPath.filename()};
+            for (const std::filesystem::directory_entry &dirEntry 
+                : std::filesystem::directory_iterator {dirPath.parent_path()}) {
+                const std::filesystem::path &pathEntry {dirEntry.path()};
+                if (std::string {pathEntry.filename()}.rfind(fileName, 0) == 0) {
+                    autoFilesCompletePaths.push_back(ftxui::text(pathEntry));
+                }
+            }
+        } catch (const std::exception &e) {
+            // Do nothing.
+        }
+    };
+    ftxui::Component filesSourceInput {makeInput(
+        filesSourceContent, "i.e. path/to/starter", {}, filesSourceInputOptions
+    )};
+    ftxui::Component filesDestinationInput {makeInput(
+        filesDestinationContent, "i.e. lab1 (empty for the workspace itself)"
+    )};
+    ftxui::Component filesUpdateBox {ftxui::Checkbox(
+        "Only update files students haven't changed", &filesUpdateOnly
+    )};
+    ftxui::Component filesModal {ftxui::Renderer(
+        ftxui::Container::Vertical({
+            ftxui::Maybe(filesSourceInput, [&] {return !filesModalRemoving;}), 
+            filesDestinationInput, 
+            ftxui::Maybe(filesUpdateBox, [&] {return !filesModalRemoving;}), 
+            ftxui::Container::Horizontal({
+                closeFilesButton, confirmFilesButton
+            })
+        }), 
+        [&] {
+            code::DistributionProgress distributionProgress {code::getDistributionProgress()};
+            const auto &students {SData::studentsData->get_students()};
+            ftxui::Elements failureLines {};
+            for (const code::DistributionResult &result : code::getDistributionResults()) {
+                auto it {students.find(result.uuid)};
+                std::string name {
+                    it != students.end() ? it->second.displayName : uuids::to_string(result.uuid)
+                };
+                if (!result.succeeded) {
+                    failureLines.push_back(
+                        ftxui::text(name + ": " + result.error) | ftxui::color(ftxui::Color::Red)
+                    );
+                }
+                if (result.modified.empty()) {
+                    continue;
+                }
+                // Left for the instructor to reconcile with the student.
+                std::string modified {};
+                for (const std::filesystem::path &path : result.modified) {
+                    modified += (modified.empty() ? "" : ", ") + path.string();
+                }
+                failureLines.push_back(
+                    ftxui::text(name + ": kept changes to " + modified) 
+                        | ftxui::color(ftxui::Color::Orange1)
+                );
+            }
+            std::size_t targetCount {
+                selectedStudentUUIDS.empty() ? students.size() : selectedStudentUUIDS.size()
+            };
+            ftxui::Dimensions dims {getDimensions()};
+            return ftxui::vbox(
+                ftxui::text(filesModalRemoving ? "Remove File" : "Add File") 
+                    | ftxui::bold 
+                    | ftxui::hcenter, 
+                ftxui::separator(), 
+                filesModalRemoving 
+                    ? ftxui::emptyElement() 
+                    : ftxui::vbox(
+                        ftxui::hbox(ftxui::text("Source Path: "), filesSourceInput->Render()), 
+                        ftxui::vbox(autoFilesCompletePaths) | ftxui::flex_shrink
+                    ), 
+                ftxui::hbox(
+                    ftxui::text(filesModalRemoving ? "Path in Workspace: " : "Copy Into: "), 
+                    filesDestinationInput->Render()
+                ), 
+                filesModalRemoving ? ftxui::emptyElement() : filesUpdateBox->Render(), 
+                ftxui::text(
+                    (selectedStudentUUIDS.empty() ? "All " : "Selected ") 
+                    + std::to_string(targetCount) + " student(s)"
+                ), 
+                distributionProgress.total > 0 
+                    ? ftxui::hbox(
+                        ftxui::gauge(
+                            static_cast<float>(distributionProgress.done) 
+                            / distributionProgress.total
+                        ) | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, 20), 
+                        ftxui::text(
+                            " " + std::to_string(distributionProgress.done) 
+                            + "/" + std::to_string(distributionProgress.total) + ", " 
+                            + std::to_string(distributionProgress.filesCopied) + " copied, " 
+                            + std::to_string(distributionProgress.filesPatched) + " patched (" 
+                            + std::to_string(distributionProgress.bytesCopied >> 20) + " MB), " 
+                            + std::to_string(distributionProgress.filesSkipped) + " unchanged, " 
+                            + std::to_string(distributionProgress.filesModified) + " kept"
+                        )
+                    ) 
+                    : ftxui::emptyElement(), 
+                ftxui::vbox(failureLines) 
+                    | ftxui::vscroll_indicator 
+                    | ftxui::yframe 
+                    | ftxui::flex, 
+                ftxui::separator(), 
+                ftxui::hbox(
+                    closeFilesButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::Red), 
+                    confirmFilesButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | (distributionProgress.active 
+                            ? ftxui::dim 
+                            : ftxui::color(ftxui::Color::GreenYellow))
+                )
+            ) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, dims.dimx * 0.75) 
+                | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, dims.dimy * 0.75) 
+                | ftxui::border;
+        }
+    )};
+    
+    // Collect submissions modal, archiving the selected students or everyone.
+    std::string collectOutputContent {
+        std::filesystem::current_path() / "submissions.tar.gz"
+    };
+    auto joinGlobs {[] (const std::vector<std::string> &globs) {
+        std::string joined {};
+        for (const std::string &glob : globs) {
+            joined += (joined.empty() ? "" : " ") + glob;
+        }
+        return joined;
+    }};
+    auto splitGlobs {[] (const std::string &joined) {
+        std::vector<std::string> globs {};
+        std::istringstream stream {joined};
+        for (std::string glob {}; stream >> glob;) {
+            globs.push_back(glob);
+        }
+        return globs;
+    }};
+    std::string collectIncludeContent {
+        joinGlobs(SData::studentsData->get_collectionFilter().include)
+    };
+    std::string collectExcludeContent {
+        joinGlobs(SData::studentsData->get_collectionFilter().exclude)
+    };
+    ftxui::Component closeCollectButton {ftxui::Button(
+        "Close", [&] {collectModalShown = false;}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component confirmCollectButton {ftxui::Button("Start", [&] {
+        if (code::getCollectionProgress().active) {
+            return;
+        }
+        // Students with their own filter keep it.
+        SData::studentsData->set_collectionFilter({
+            splitGlobs(collectIncludeContent), splitGlobs(collectExcludeContent)
+        });
+        code::collectSubmissions(collectOutputContent, filesTargets(), postRefresh, {});
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component collectOutputInput {makeInput(
+        collectOutputContent, "i.e. path/to/submissions.tar.gz"
+    )};
+    ftxui::Component collectIncludeInput {makeInput(
+        collectIncludeContent, "i.e. *.py src/* (empty for every file)"
+    )};
+    ftxui::Component collectExcludeInput {makeInput(
+        collectExcludeContent, "i.e. node_modules *.o"
+    )};
+    ftxui::Component collectModal {ftxui::Renderer(
+        ftxui::Container::Vertical({
+            collectOutputInput, 
+            collectIncludeInput, 
+            collectExcludeInput, 
+            ftxui::Container::Horizontal({
+                closeCollectButton, confirmCollectButton
+            })
+        }), 
+        [&] {
+            code::CollectionProgress collectionProgress {code::getCollectionProgress()};
+            const auto &students {SData::studentsData->get_students()};
+            ftxui::Elements failureLines {};
+            for (const code::CollectionResult &result : code::getCollectionResults()) {
+                if (result.succeeded) {
+                    continue;
+                }
+                auto it {students.find(result.uuid)};
+                failureLines.push_back(
+                    ftxui::text(
+                        (it != students.end() 
+                            ? it->second.displayName 
+                            : uuids::to_string(result.uuid)) 
+                        + ": " + result.error
+                    ) | ftxui::color(ftxui::Color::Red)
+                );
+            }
+            std::size_t targetCount {
+                selectedStudentUUIDS.empty() ? students.size() : selectedStudentUUIDS.size()
+            };
+            ftxui::Dimensions dims {getDimensions()};
+            return ftxui::vbox(
+                ftxui::text("Collect Submissions") | ftxui::bold | ftxui::hcenter, 
+                ftxui::separator(), 
+                ftxui::hbox(ftxui::text("Archive Path: "), collectOutputInput->Render()), 
+                ftxui::hbox(ftxui::text("Include: "), collectIncludeInput->Render()), 
+                ftxui::hbox(ftxui::text("Exclude: "), collectExcludeInput->Render()), 
+                ftxui::text(
+                    (selectedStudentUUIDS.empty() ? "All " : "Selected ") 
+                    + std::to_string(targetCount) + " student(s)"
+                ), 
+                collectionProgress.total > 0 
+                    ? ftxui::hbox(
+                        ftxui::gauge(
+                            static_cast<float>(collectionProgress.done) 
+                            / collectionProgress.total
+                        ) | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, 20), 
+                        ftxui::text(
+                            " " + std::to_string(collectionProgress.done) 
+                            + "/" + std::to_string(collectionProgress.total) + ", " 
+                            + std::to_string(collectionProgress.files) + " file(s), " 
+                            + std::to_string(collectionProgress.bytesRead >> 20) + " MB read, " 
+                            + std::to_string(collectionProgress.bytesWritten >> 20) 
+                            + " MB written" 
+                            + (collectionProgress.active ? "" : " (finished)")
+                        )
+                    ) 
+                    : ftxui::emptyElement(), 
+                ftxui::vbox(failureLines) 
+                    | ftxui::vscroll_indicator 
+                    | ftxui::yframe 
+                    | ftxui::flex, 
+                ftxui::separator(), 
+                ftxui::hbox(
+                    closeCollectButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::Red), 
+                    confirmCollectButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | (collectionProgress.active 
+                            ? ftxui::dim 
+                            : ftxui::color(ftxui::Color::GreenYellow))
+                )
+            ) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, dims.dimx * 0.75) 
+                | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, dims.dimy * 0.75) 
+                | ftxui::border;
+        }
+    )};
+    
+    // Snapshots modal, taking and restoring snapshots of the selected students or everyone.
+    std::string snapshotRestoreIdContent {};
+    std::string snapshotRestoreContent {std::filesystem::current_path() / "restored"};
+    ftxui::Component closeSnapshotsButton {ftxui::Button(
+        "Close", [&] {snapshotsModalShown = false;}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component takeSnapshotButton {ftxui::Button("Snapshot Now", [&] {
+        if (!code::requestSnapshot(filesTargets(), postRefresh)) {
+            notif::notify("Snapshots aren't running.");
+        }
+        postRefresh();
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component restoreSnapshotButton {ftxui::Button("Restore", [&] {
+        startAsyncSpinner("Restoring snapshots...");
+        std::vector<uuids::uuid> targets {filesTargets()};
+        int restored {};
+        for (const uuids::uuid &uuid : targets) {
+            std::vector<std::string> ids {code::listSnapshots(uuid)};
+            if (ids.empty()) {
+                continue;
+            }
+            // Each student goes in their own directory, named as their workspace is.
+            restored += code::restoreSnapshot(
+                uuid, 
+                snapshotRestoreIdContent.empty() ? ids.back() : snapshotRestoreIdContent, 
+                std::filesystem::path {snapshotRestoreContent} 
+                    / code::getWorkspacePath(uuid).filename()
+            );
+        }
+        stopAsyncSpinner();
+        notif::notify(
+            "Restored " + std::to_string(restored) + "/" + std::to_string(targets.size()) 
+            + " workspace(s) into `" + snapshotRestoreContent + "`."
+        );
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component snapshotRestoreIdInput {makeInput(
+        snapshotRestoreIdContent, "i.e. 20250102-150405 (empty for the latest)"
+    )};
+    ftxui::Component snapshotRestoreInput {makeInput(
+        snapshotRestoreContent, "i.e. path/to/restored"
+    )};
+    ftxui::Component snapshotsModal {ftxui::Renderer(
+        ftxui::Container::Vertical({
+            snapshotRestoreIdInput, 
+            snapshotRestoreInput, 
+            ftxui::Container::Horizontal({
+                closeSnapshotsButton, takeSnapshotButton, restoreSnapshotButton
+            })
+        }), 
+        [&] {
+            ftxui::Elements roundLines {};
+            for (const code::SnapshotRound &round : code::getSnapshotRounds()) {
+                roundLines.push_back(
+                    ftxui::text(
+                        round.id + ": " + std::to_string(round.changed) + "/" 
+                        + std::to_string(round.students) + " changed, " 
+                        + std::to_string(round.filesRead) + " file(s) read, " 
+                        + std::to_string(round.filesUnchanged) + " unchanged, +" 
+                        + std::to_string(round.bytesStored >> 10) + " KB (" 
+                        + std::to_string(round.storeBytes >> 20) + " MB stored) in " 
+                        + std::to_string(round.duration.count()) + " ms"
+                    ) | (round.failed > 0 
+                        ? ftxui::color(ftxui::Color::Red) 
+                        : ftxui::color(ftxui::Color::Default))
+                );
+            }
+            std::size_t targetCount {
+                selectedStudentUUIDS.empty() 
+                    ? SData::studentsData->get_students().size() 
+                    : selectedStudentUUIDS.size()
+            };
+            bool running {code::snapshotRunning()};
+            ftxui::Dimensions dims {getDimensions()};
+            return ftxui::vbox(
+                ftxui::text("Snapshots") | ftxui::bold | ftxui::hcenter, 
+                ftxui::separator(), 
+                ftxui::vbox(roundLines) 
+                    | ftxui::vscroll_indicator 
+                    | ftxui::yframe 
+                    | ftxui::flex, 
+                running ? ftxui::text("Taking a snapshot...") : ftxui::emptyElement(), 
+                ftxui::separator(), 
+                ftxui::hbox(ftxui::text("Restore Snapshot: "), snapshotRestoreIdInput->Render()), 
+                ftxui::hbox(ftxui::text("Restore Into: "), snapshotRestoreInput->Render()), 
+                ftxui::text(
+                    (selectedStudentUUIDS.empty() ? "All " : "Selected ") 
+                    + std::to_string(targetCount) + " student(s)"
+                ), 
+                ftxui::separator(), 
+                ftxui::hbox(
+                    closeSnapshotsButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::Red), 
+                    takeSnapshotButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | (running 
+                            ? ftxui::dim 
+                            : ftxui::color(ftxui::Color::GreenYellow)), 
+                    restoreSnapshotButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::GreenYellow)
+                )
+            ) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, dims.dimx * 0.75) 
+                | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, dims.dimy * 0.75) 
+                | ftxui::border;
+        }
+    )};
+    
+    // Deadline modal, freezing and capturing the selected students or everyone at once.
+    int deadlineStopSelection {0};
+    ftxui::Component deadlineStopToggle {makeOnOffToggle(onOffToggle, deadlineStopSelection)};
+    ftxui::Component closeDeadlineButton {ftxui::Button(
+        "Close", [&] {deadlineModalShown = false;}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component captureDeadlineButton {ftxui::Button("Capture Now", [&] {
+        bool stop {deadlineStopSelection == 1};
+        startAsyncSpinner("Capturing workspaces...");
+        if (stop) {
+            // Otherwise queued launches would start instances right back up.
+            code::cancelLaunch();
+        }
+        bool captured {code::captureDeadline(filesTargets(), stop, postRefresh)};
+        stopAsyncSpinner();
+        if (captured && stop && selectedStudentUUIDS.empty()) {
+            studentCodeButtonLabel = dynamicLabels.scblStart;
+        }
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component deadlineModal {ftxui::Renderer(
+        ftxui::Container::Vertical({
+            deadlineStopToggle, 
+            ftxui::Container::Horizontal({
+                closeDeadlineButton, captureDeadlineButton
+            })
+        }), 
+        [&] {
+            std::optional<code::DeadlineReport> report {code::getDeadlineReport()};
+            const auto &students {SData::studentsData->get_students()};
+            ftxui::Elements reportLines {};
+            if (report) {
+                reportLines.push_back(ftxui::text(
+                    report->id + ": froze " + std::to_string(report->frozen) + " instance(s) in " 
+                    + std::to_string(report->freezeTime.count()) + " ms, captured " 
+                    + std::to_string(report->students - report->failed) + "/" 
+                    + std::to_string(report->students) + " workspace(s) in " 
+                    + std::to_string(report->captureTime.count()) + " ms"
+                ));
+                reportLines.push_back(ftxui::text(
+                    "Instances were frozen for " + std::to_string(report->freezeWindow.count()) 
+                    + " ms, then " + (report->stopped ? "stopped" : "thawed")
+                ) | ftxui::bold);
+                for (const code::DeadlineCapture &capture : code::getDeadlineCaptures()) {
+                    if (capture.succeeded) {
+                        continue;
+                    }
+                    auto it {students.find(capture.uuid)};
+                    reportLines.push_back(
+                        ftxui::text(
+                            (it != students.end() 
+                                ? it->second.displayName 
+                                : uuids::to_string(capture.uuid)) 
+                            + ": " + capture.error
+                        ) | ftxui::color(ftxui::Color::Red)
+                    );
+                }
+            }
+            code::CollectionProgress collectionProgress {code::getCollectionProgress()};
+            std::size_t targetCount {
+                selectedStudentUUIDS.empty() ? students.size() : selectedStudentUUIDS.size()
+            };
+            ftxui::Dimensions dims {getDimensions()};
+            return ftxui::vbox(
+                ftxui::text("Deadline") | ftxui::bold | ftxui::hcenter, 
+                ftxui::separator(), 
+                ftxui::text(
+                    (selectedStudentUUIDS.empty() ? "All " : "Selected ") 
+                    + std::to_string(targetCount) + " student(s)"
+                ), 
+                ftxui::hbox(
+                    ftxui::text("Stop Instances After Capture: "), deadlineStopToggle->Render()
+                ), 
+                ftxui::vbox(reportLines) 
+                    | ftxui::vscroll_indicator 
+                    | ftxui::yframe 
+                    | ftxui::flex, 
+                report && report->archiving && collectionProgress.total > 0 
+                    ? ftxui::text(
+                        "Archiving into " + (constants::DEADLINES_DIR / report->id).string() 
+                        + ".tar.gz: " + std::to_string(collectionProgress.done) + "/" 
+                        + std::to_string(collectionProgress.total) 
+                        + (collectionProgress.active ? "" : " (finished)")
+                    ) 
+                    : ftxui::emptyElement(), 
+                ftxui::separator(), 
+                ftxui::hbox(
+                    closeDeadlineButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::Red), 
+                    captureDeadlineButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::GreenYellow)
+                )
+            ) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, dims.dimx * 0.75) 
+                | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, dims.dimy * 0.75) 
+                | ftxui::border;
+        }
+    )};
+    
+    // Reset modal, swapping a template in for the selected students' workspaces or everyone's.
+    ftxui::MenuOption resetTemplateMenuOptions {ftxui::MenuOption::Vertical()};
+    int resetTemplateSelected {};
+    resetTemplateMenuOptions.entries = &resetTemplateVec;
+    resetTemplateMenuOptions.selected = &resetTemplateSelected;
+    ftxui::Component resetTemplateMenu {ftxui::Menu(resetTemplateMenuOptions)};
+    std::string templateNameContent {};
+    std::string templateSourceContent {code::getWorkspacePath(code::INSTRUCTOR_UUID)};
+    auto selectedTemplate {[&] {
+        return resetTemplateVec.empty() 
+            ? std::string {} 
+            : resetTemplateVec.at(std::min<std::size_t>(
+                resetTemplateSelected, resetTemplateVec.size() - 1
+            ));
+    }};
+    // Instances stopped for the swap are started again, unless they start on connection.
+    auto relaunchReset {[&] {
+        std::vector<uuids::uuid> stopped {};
+        for (const code::ResetResult &result : code::getResetResults()) {
+            if (result.stopped) {
+                stopped.push_back(result.uuid);
+            }
+        }
+        if (!stopped.empty() && !code::lazyActivationRunning()) {
+            code::scheduleLaunch(stopped, postRefresh);
+        }
+    }};
+    ftxui::Component closeResetButton {ftxui::Button(
+        "Close", [&] {resetModalShown = false;}, ftxui::ButtonOption::Ascii()
+    )};
+    ftxui::Component saveTemplateButton {ftxui::Button("Save Template", [&] {
+        startAsyncSpinner("Saving template...");
+        if (code::saveTemplate(templateNameContent, templateSourceContent)) {
+            resetTemplateVec = code::listTemplates();
+            templateNameContent.clear();
+        }
+        stopAsyncSpinner();
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component removeTemplateButton {ftxui::Button("Remove Template", [&] {
+        if (code::removeTemplate(selectedTemplate())) {
+            resetTemplateVec = code::listTemplates();
+        }
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component resetWorkspacesButton {ftxui::Button("Reset", [&] {
+        if (resetTemplateVec.empty()) {
+            notif::notify("Save a template first.");
+            return;
+        }
+        startAsyncSpinner("Resetting workspaces...");
+        // Otherwise queued launches could start instances in the middle of the swap.
+        code::cancelLaunch();
+        if (code::resetWorkspaces(selectedTemplate(), filesTargets())) {
+            relaunchReset();
+        }
+        stopAsyncSpinner();
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component undoResetButton {ftxui::Button("Undo", [&] {
+        startAsyncSpinner("Restoring workspaces...");
+        code::cancelLaunch();
+        if (code::undoReset(filesTargets())) {
+            relaunchReset();
+        }
+        stopAsyncSpinner();
+    }, ftxui::ButtonOption::Ascii())};
+    ftxui::Component templateNameInput {makeInput(templateNameContent, "i.e. assignment-1")};
+    ftxui::Component templateSourceInput {makeInput(
+        templateSourceContent, "i.e. path/to/baseline"
+    )};
+    ftxui::Component resetModal {ftxui::Renderer(
+        ftxui::Container::Vertical({
+            resetTemplateMenu, 
+            templateNameInput, 
+            templateSourceInput, 
+            ftxui::Container::Horizontal({
+                closeResetButton, 
+                saveTemplateButton, 
+                removeTemplateButton, 
+                resetWorkspacesButton, 
+                undoResetButton
+            })
+        }), 
+        [&] {
+            std::optional<code::ResetReport> report {code::getResetReport()};
+            const auto &students {SData::studentsData->get_students()};
+            ftxui::Elements reportLines {};
+            if (report) {
+                reportLines.push_back(ftxui::text(
+                    (report->templateName.empty() 
+                        ? "Undid the last reset of " 
+                        : "Reset to " + report->templateName + ": ") 
+                    + std::to_string(report->students - report->failed) + "/" 
+                    + std::to_string(report->students) + " workspace(s) in " 
+                    + std::to_string(report->duration.count()) + " ms"
+                ));
+                for (const code::ResetResult &result : code::getResetResults()) {
+                    if (result.succeeded) {
+                        continue;
+                    }
+                    auto it {students.find(result.uuid)};
+                    reportLines.push_back(
+                        ftxui::text(
+                            (it != students.end() 
+                                ? it->second.displayName 
+                                : uuids::to_string(result.uuid)) 
+                            + ": " + result.error
+                        ) | ftxui::color(ftxui::Color::Red)
+                    );
+                }
+            }
+            std::size_t targetCount {
+                selectedStudentUUIDS.empty() ? students.size() : selectedStudentUUIDS.size()
+            };
+            ftxui::Dimensions dims {getDimensions()};
+            return ftxui::vbox(
+                ftxui::text("Reset Workspaces") | ftxui::bold | ftxui::hcenter, 
+                ftxui::separator(), 
+                resetTemplateVec.empty() 
+                    ? ftxui::text("No templates saved yet.") 
+                    : resetTemplateMenu->Render() | ftxui::vscroll_indicator | ftxui::yframe, 
+                ftxui::hbox(ftxui::text("New Template: "), templateNameInput->Render()), 
+                ftxui::hbox(ftxui::text("From: "), templateSourceInput->Render()), 
+                ftxui::text(
+                    (selectedStudentUUIDS.empty() ? "All " : "Selected ") 
+                    + std::to_string(targetCount) + " student(s)"
+                ), 
+                ftxui::vbox(reportLines) 
+                    | ftxui::vscroll_indicator 
+                    | ftxui::yframe 
+                    | ftxui::flex, 
+                ftxui::separator(), 
+                ftxui::hbox(
+                    closeResetButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::Red), 
+                    saveTemplateButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::GreenYellow), 
+                    removeTemplateButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::Red), 
+                    resetWorkspacesButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::GreenYellow), 
+                    undoResetButton->Render() 
+                        | ftxui::hcenter 
+                        | ftxui::border 
+                        | ftxui::color(ftxui::Color::GreenYellow)
+                )
+            ) 
+                | ftxui::size(ftxui::WIDTH, ftxui::EQUAL, dims.dimx * 0.75) 
+                | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, dims.dimy * 0.75) 
+                | ftxui::border;
+        }
+    )};
+    
     // Install OpenVsCode Server modal.
     std::string installOVSCSContent {constants::OPENVSCODE_SERVER_VERSION_DEFAULT};
     ftxui::Component installOVSCSInput {makeInput(
@@ -1153,6 +2486,10 @@ std::tuple<bool, bool> ui::mainMenu() {
     ftxui::Component app {ftxui::Renderer(
         mainScreen, 
         [&] {
+            // Runs finish on their own, so the label follows the engine.
+            runAllTestsButtonLabel = code::testsRunning() 
+                ? dynamicLabels.satbl 
+                : dynamicLabels.ratbl;
             return ftxui::dbox(
                 ftxui::vbox( // 3 --> height of title bar.
                     ftxui::emptyElement() | ftxui::size(ftxui::HEIGHT, ftxui::EQUAL, 3), 
@@ -1167,8 +2504,14 @@ std::tuple<bool, bool> ui::mainMenu() {
     exitModal |= catchEscEvent(exitModalShown, false);
     settingsModal |= catchEscEvent(settingsModalShown, false);
     recentNotifsModal |= catchEscEvent(recentNotifsModalShown, false);
+    diagnosticsModal |= catchEscEvent(diagnosticsModalShown, false);
     importModal |= catchEscEvent(importModalShown, false);
     exportModal |= catchEscEvent(exportModalShown, false);
+    filesModal |= catchEscEvent(filesModalShown, false);
+    collectModal |= catchEscEvent(collectModalShown, false);
+    snapshotsModal |= catchEscEvent(snapshotsModalShown, false);
+    deadlineModal |= catchEscEvent(deadlineModalShown, false);
+    resetModal |= catchEscEvent(resetModalShown, false);
     installOVSCSModal |= catchEscEvent(installOVSCSModalShown, false);
     notifModal |= ftxui::CatchEvent([&] (ftxui::Event event) {
         if (event == ftxui::Event::Escape) {
@@ -1181,12 +2524,35 @@ std::tuple<bool, bool> ui::mainMenu() {
     app |= ftxui::Modal(exitModal, &exitModalShown);
     app |= ftxui::Modal(settingsModal, &settingsModalShown);
     app |= ftxui::Modal(recentNotifsModal, &recentNotifsModalShown);
+    app |= ftxui::Modal(diagnosticsModal, &diagnosticsModalShown);
     app |= ftxui::Modal(importModal, &importModalShown);
     app |= ftxui::Modal(exportModal, &exportModalShown);
+    app |= ftxui::Modal(filesModal, &filesModalShown);
+    app |= ftxui::Modal(collectModal, &collectModalShown);
+    app |= ftxui::Modal(snapshotsModal, &snapshotsModalShown);
+    app |= ftxui::Modal(deadlineModal, &deadlineModalShown);
+    app |= ftxui::Modal(resetModal, &resetModalShown);
     app |= ftxui::Modal(installOVSCSModal, &installOVSCSModalShown);
     app |= ftxui::Modal(notifModal, &notif::getNotice());
 
+    // Queued notifications are applied on every event, including the one 
+    // `postRefresh` sends for each of them.
+    app |= ftxui::CatchEvent([&] (ftxui::Event) {
+        notif::applyNotifications();
+        return false;
+    });
+    
+    notif::applyNotifications();
+    notif::setPoster(postRefresh);
     appScreen.Loop(app);
+    notif::setPoster({});
+    
+    // The scheduler and background jobs refresh this screen, so they can't outlive it.
+    code::cancelLaunch();
+    code::cancelDistribution();
+    code::cancelCollection();
+    code::cancelSnapshotRequests();
+    code::stopTests();
 
     return exitState;
     // Also reset appScreen cursor manually.
@@ -1290,7 +2656,8 @@ static void createPaneBoxes(
     ftxui::Components &dataBoxes, 
     bool *titleBarMenusShown, 
     int &lastTitleBarMenuIdx, 
-    const bool &alwaysShowUUIDs
+    const bool &alwaysShowUUIDs, 
+    std::function<ftxui::Element(const uuids::uuid &)> badge
 ) {
     int dataBoxIdx {};
     std::vector<const DataType *> p_dataVec {};
@@ -1328,11 +2695,14 @@ static void createPaneBoxes(
             }
         };
         
-        checkboxOption.transform = [&, p_data] (const ftxui::EntryState &e) {
+        checkboxOption.transform = [&, p_data, badge] (const ftxui::EntryState &e) {
             bool titleBarMenusHidden {lastTitleBarMenuIdx == -1};
             ftxui::EntryState e2 {e};
             e2.focused = e2.focused && titleBarMenusHidden;
             ftxui::Element elem {ftxui::CheckboxOption::Simple().transform(e2)};
+            if (badge) {
+                elem = ftxui::hbox(elem, badge(p_data->uuid));
+            }
             ftxui::Element sepElem {ftxui::text("|")};
             ftxui::Element uuidElem {
                 ftxui::text(uuids::to_string(p_data->uuid)) | ftxui::flex_shrink